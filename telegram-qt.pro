@@ -8,6 +8,7 @@ CONFIG += ordered
 
 contains(options, developer-build) {
     SUBDIRS += telegram-qt/tests
+    SUBDIRS += telegram-qt/benchmarks
     SUBDIRS += telegram-qt/generator
     greaterThan(QT_MAJOR_VERSION, 4) {
         SUBDIRS += telegram-qt/generator-ng
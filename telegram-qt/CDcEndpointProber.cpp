@@ -0,0 +1,92 @@
+/*
+    Copyright (C) 2015 Alexandr Akulich <akulichalexander@gmail.com>
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+    LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+    OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+    WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+#include "CDcEndpointProber.hpp"
+
+#include <QTcpSocket>
+#include <QTimer>
+
+#include <QDebug>
+
+CDcEndpointProber::CDcEndpointProber(QObject *parent) :
+    QObject(parent),
+    m_timeoutTimer(new QTimer(this))
+{
+    m_timeoutTimer->setSingleShot(true);
+    connect(m_timeoutTimer, SIGNAL(timeout()), SLOT(whenTimeout()));
+}
+
+CDcEndpointProber::~CDcEndpointProber()
+{
+    qDeleteAll(m_sockets.keys());
+}
+
+void CDcEndpointProber::probe(const QVector<TLDcOption> &endpoints, int timeout)
+{
+    if (isProbing()) {
+        return;
+    }
+
+    m_clock.start();
+
+    foreach (const TLDcOption &endpoint, endpoints) {
+        QTcpSocket *socket = new QTcpSocket(this);
+        connect(socket, SIGNAL(connected()), SLOT(whenSocketConnected()));
+        connect(socket, SIGNAL(error(QAbstractSocket::SocketError)), SLOT(whenSocketError()));
+
+        m_sockets.insert(socket, endpoint);
+        socket->connectToHost(endpoint.ipAddress, endpoint.port);
+    }
+
+    if (isProbing()) {
+        m_timeoutTimer->start(timeout);
+    }
+}
+
+void CDcEndpointProber::whenSocketConnected()
+{
+    finishProbe(qobject_cast<QTcpSocket *>(sender()), m_clock.elapsed());
+}
+
+void CDcEndpointProber::whenSocketError()
+{
+    finishProbe(qobject_cast<QTcpSocket *>(sender()), -1);
+}
+
+void CDcEndpointProber::whenTimeout()
+{
+    foreach (QTcpSocket *socket, m_sockets.keys()) {
+        finishProbe(socket, -1);
+    }
+}
+
+void CDcEndpointProber::finishProbe(QTcpSocket *socket, qint64 connectTime)
+{
+    if (!socket || !m_sockets.contains(socket)) {
+        return;
+    }
+
+    const TLDcOption endpoint = m_sockets.take(socket);
+
+    socket->disconnect(this);
+    socket->abort();
+    socket->deleteLater();
+
+    emit endpointProbed(endpoint, connectTime);
+
+    if (m_sockets.isEmpty()) {
+        m_timeoutTimer->stop();
+        emit finished();
+    }
+}
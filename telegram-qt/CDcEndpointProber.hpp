@@ -0,0 +1,57 @@
+/*
+    Copyright (C) 2015 Alexandr Akulich <akulichalexander@gmail.com>
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+    LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+    OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+    WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+#ifndef CDCENDPOINTPROBER_HPP
+#define CDCENDPOINTPROBER_HPP
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QMap>
+
+#include "TLTypes.hpp"
+
+class QTcpSocket;
+class QTimer;
+
+// Opens TCP connections to the endpoints concurrently and reports the connect time of each one (or -1 on failure).
+// The sockets are closed right after the connect.
+class CDcEndpointProber : public QObject
+{
+    Q_OBJECT
+public:
+    explicit CDcEndpointProber(QObject *parent = 0);
+    ~CDcEndpointProber();
+
+    void probe(const QVector<TLDcOption> &endpoints, int timeout);
+    inline bool isProbing() const { return !m_sockets.isEmpty(); }
+
+signals:
+    void endpointProbed(const TLDcOption &endpoint, qint64 connectTime);
+    void finished();
+
+protected slots:
+    void whenSocketConnected();
+    void whenSocketError();
+    void whenTimeout();
+
+protected:
+    void finishProbe(QTcpSocket *socket, qint64 connectTime);
+
+    QMap<QTcpSocket *, TLDcOption> m_sockets; // Probing socket, endpoint
+    QElapsedTimer m_clock;
+    QTimer *m_timeoutTimer;
+
+};
+
+#endif // CDCENDPOINTPROBER_HPP
@@ -0,0 +1,87 @@
+/*
+    Copyright (C) 2015 Alexandr Akulich <akulichalexander@gmail.com>
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+    LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+    OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+    WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+#ifndef CENDPOINTLATENCY_HPP
+#define CENDPOINTLATENCY_HPP
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+#include "TLTypes.hpp"
+
+// TCP connect times of the DC endpoints (address and port), smoothed by the exponentially weighted moving average.
+// A failed attempt counts as a very slow sample. Used to pick the fastest of the alternative endpoints of a DC.
+// Only the connect times are added: they are measured for all endpoints alike, unlike the ping round trip times.
+class CEndpointLatency
+{
+public:
+    enum {
+        FailurePenalty = 10000 // ms
+    };
+
+    static inline QString key(const TLDcOption &endpoint)
+    {
+        return endpoint.ipAddress + QLatin1Char(':') + QString::number(endpoint.port);
+    }
+
+    inline qint64 rtt(const TLDcOption &endpoint) const { return m_rtt.value(key(endpoint), -1); } // -1 if unknown
+
+    void addSample(const TLDcOption &endpoint, qint64 rtt)
+    {
+        QHash<QString, qint64>::iterator it = m_rtt.find(key(endpoint));
+
+        if (it == m_rtt.end()) {
+            m_rtt.insert(key(endpoint), rtt);
+        } else {
+            it.value() = (it.value() * 3 + rtt) / 4;
+        }
+    }
+
+    inline void addFailure(const TLDcOption &endpoint) { addSample(endpoint, FailurePenalty); }
+
+    // The fastest known endpoint of the DC. Endpoints without samples are preferred to the known failing ones only.
+    TLDcOption fastest(const QVector<TLDcOption> &endpoints, quint32 dc) const
+    {
+        TLDcOption result;
+        qint64 resultRtt = -1;
+
+        foreach (const TLDcOption &endpoint, endpoints) {
+            if (endpoint.id != dc) {
+                continue;
+            }
+
+            qint64 endpointRtt = rtt(endpoint);
+
+            if (endpointRtt < 0) {
+                endpointRtt = FailurePenalty - 1;
+            }
+
+            if ((resultRtt < 0) || (endpointRtt < resultRtt)) {
+                result = endpoint;
+                resultRtt = endpointRtt;
+            }
+        }
+
+        return result;
+    }
+
+    inline void clear() { m_rtt.clear(); }
+
+protected:
+    QHash<QString, qint64> m_rtt; // Endpoint key, smoothed rtt in ms
+
+};
+
+#endif // CENDPOINTLATENCY_HPP
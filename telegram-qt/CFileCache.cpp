@@ -0,0 +1,464 @@
+/*
+    Copyright (C) 2015 Alexandr Akulich <akulichalexander@gmail.com>
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+    LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+    OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+    WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "CFileCache.hpp"
+
+#include "CTelegramStream.hpp"
+
+#include <QDir>
+#include <QFile>
+
+#include <QDebug>
+
+const quint32 s_indexFormatVersion = 1;
+const quint64 s_defaultMaxSize = 256 * 1024 * 1024; // 256 MB
+const int s_journalMaxRecords = 128; // The journal is merged into the index after so many records
+
+static const QLatin1String s_indexFileName("index");
+static const QLatin1String s_journalFileName("journal");
+static const QLatin1String s_temporarySuffix(".tmp");
+
+static bool writeFile(const QString &fileName, const QByteArray &data)
+{
+    // Write to a temporary file first, so an interrupted write never leaves a truncated file under the real name.
+    const QString temporaryFileName = fileName + s_temporarySuffix;
+
+    QFile file(temporaryFileName);
+
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+
+    if (file.write(data) != data.size()) {
+        file.close();
+        file.remove();
+        return false;
+    }
+
+    file.close();
+
+    QFile::remove(fileName);
+    return QFile::rename(temporaryFileName, fileName);
+}
+
+// Cached files are named by their keys (hex numbers, separated by dashes). Other files of the directory are not touched.
+static bool isCacheFileName(const QString &fileName)
+{
+    if ((fileName == s_indexFileName) || (fileName == s_journalFileName) || fileName.endsWith(s_temporarySuffix)) {
+        return true;
+    }
+
+    if (!fileName.contains(QLatin1Char('-'))) {
+        return false;
+    }
+
+    foreach (const QChar &c, fileName) {
+        if (!c.isDigit() && (c != QLatin1Char('-')) && ((c < QLatin1Char('a')) || (c > QLatin1Char('f')))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+CFileCache::CFileCache() :
+    m_maxSize(s_defaultMaxSize),
+    m_size(0),
+    m_accessCounter(0),
+    m_indexLoaded(false),
+    m_indexChanged(false),
+    m_journalRecords(0)
+{
+}
+
+CFileCache::~CFileCache()
+{
+    if (m_indexChanged) {
+        saveIndex();
+    }
+}
+
+void CFileCache::setDirectory(const QString &directory)
+{
+    if (m_directory == directory) {
+        return;
+    }
+
+    if (m_indexChanged) {
+        saveIndex();
+    }
+
+    m_directory = directory;
+
+    m_entries.clear();
+    m_accessOrder.clear();
+    m_size = 0;
+    m_accessCounter = 0;
+    m_indexLoaded = false;
+    m_indexChanged = false;
+    m_journalRecords = 0;
+}
+
+void CFileCache::setMaxSize(quint64 bytes)
+{
+    m_maxSize = bytes;
+
+    if (!m_indexLoaded) {
+        return;
+    }
+
+    bool removed = false;
+
+    while ((m_size > m_maxSize) && !m_accessOrder.isEmpty()) {
+        removeEntry(m_accessOrder.begin().value());
+        removed = true;
+    }
+
+    if (removed) {
+        saveIndex();
+    }
+}
+
+quint64 CFileCache::size()
+{
+    ensureIndexLoaded();
+    return m_size;
+}
+
+QString CFileCache::key(quint32 dcId, const TLInputFileLocation &location)
+{
+    // Audio, video and document locations have only id and access hash, photo locations have only volume, local id and secret.
+    return QString(QLatin1String("%1-%2-%3-%4-%5-%6-%7"))
+            .arg(dcId)
+            .arg(quint32(location.tlType), sizeof(quint32) * 2, 16, QLatin1Char('0'))
+            .arg(location.volumeId, sizeof(location.volumeId) * 2, 16, QLatin1Char('0'))
+            .arg(location.localId, sizeof(location.localId) * 2, 16, QLatin1Char('0'))
+            .arg(location.secret, sizeof(location.secret) * 2, 16, QLatin1Char('0'))
+            .arg(location.id, sizeof(location.id) * 2, 16, QLatin1Char('0'))
+            .arg(location.accessHash, sizeof(location.accessHash) * 2, 16, QLatin1Char('0'));
+}
+
+bool CFileCache::lookup(const QString &key, quint32 *size, TLValue *fileType)
+{
+    if (!isEnabled()) {
+        return false;
+    }
+
+    ensureIndexLoaded();
+
+    QMap<QString, Entry>::iterator it = m_entries.find(key);
+
+    if (it == m_entries.end()) {
+        return false;
+    }
+
+    touch(&it.value(), key);
+
+    *size = it.value().size;
+    *fileType = it.value().fileType;
+
+    return true;
+}
+
+QString CFileCache::filePath(const QString &key) const
+{
+    return m_directory + QLatin1Char('/') + key;
+}
+
+QByteArray CFileCache::data(const QString &key)
+{
+    if (!isEnabled()) {
+        return QByteArray();
+    }
+
+    ensureIndexLoaded();
+
+    if (!m_entries.contains(key)) {
+        return QByteArray();
+    }
+
+    QFile file(filePath(key));
+
+    if (!file.open(QIODevice::ReadOnly) || (file.size() != m_entries.value(key).size)) {
+        // The file was removed or damaged outside of the cache.
+        remove(key);
+        return QByteArray();
+    }
+
+    // The data is copied out instead of being a view over a mapping of the file: it is passed to the signal receivers,
+    // which can keep it for any time, while the mapping lives only as long as the opened file.
+    // Large files are expected to be read by parts (streaming requests) anyway.
+    return file.readAll();
+}
+
+bool CFileCache::insert(const QString &key, const QByteArray &data, TLValue fileType)
+{
+    if (!isEnabled() || data.isEmpty() || (quint64(data.size()) > m_maxSize)) {
+        return false;
+    }
+
+    ensureIndexLoaded();
+
+    if (m_entries.contains(key)) {
+        removeEntry(key);
+    }
+
+    while ((m_size + data.size() > m_maxSize) && !m_accessOrder.isEmpty()) {
+        removeEntry(m_accessOrder.begin().value());
+    }
+
+    if (!QDir().mkpath(m_directory) || !writeFile(filePath(key), data)) {
+        qDebug() << Q_FUNC_INFO << "Unable to write cache file" << filePath(key);
+        return false;
+    }
+
+    Entry entry;
+    entry.size = data.size();
+    entry.fileType = fileType;
+
+    QMap<QString, Entry>::iterator it = m_entries.insert(key, entry);
+    touch(&it.value(), key);
+    m_size += entry.size;
+
+    appendToJournal(JournalInsert, key, entry);
+
+    return true;
+}
+
+void CFileCache::remove(const QString &key)
+{
+    ensureIndexLoaded();
+
+    if (!m_entries.contains(key)) {
+        return;
+    }
+
+    removeEntry(key);
+}
+
+void CFileCache::clear()
+{
+    if (!isEnabled()) {
+        return;
+    }
+
+    ensureIndexLoaded();
+
+    // The empty index is written once, without journal records.
+    while (!m_entries.isEmpty()) {
+        const QString key = m_entries.begin().key();
+        forgetEntry(key);
+        QFile::remove(filePath(key));
+    }
+
+    saveIndex();
+}
+
+void CFileCache::ensureIndexLoaded()
+{
+    if (m_indexLoaded || !isEnabled()) {
+        return;
+    }
+
+    m_indexLoaded = true;
+
+    QFile file(m_directory + QLatin1Char('/') + s_indexFileName);
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        loadJournal();
+        return;
+    }
+
+    CTelegramStream inputStream(file.readAll());
+
+    quint32 format = 0;
+    inputStream >> format;
+
+    if (format != s_indexFormatVersion) {
+        qDebug() << Q_FUNC_INFO << "Unknown index format" << format << "The cache is reset.";
+        file.close();
+
+        // The files of the unknown index would never be removed otherwise.
+        QDir directory(m_directory);
+        foreach (const QString &fileName, directory.entryList(QDir::Files)) {
+            if (isCacheFileName(fileName)) {
+                directory.remove(fileName);
+            }
+        }
+
+        m_indexChanged = true;
+        return;
+    }
+
+    quint32 count = 0;
+    inputStream >> count;
+
+    // Entries are saved from the least to the most recently used, so the access stamps are restored in order.
+    for (quint32 i = 0; (i < count) && !inputStream.atEnd(); ++i) {
+        QString key;
+        Entry entry;
+
+        inputStream >> key;
+        inputStream >> entry.size;
+        inputStream >> entry.fileType;
+
+        if (key.isEmpty() || m_entries.contains(key)) {
+            continue;
+        }
+
+        QMap<QString, Entry>::iterator it = m_entries.insert(key, entry);
+        touch(&it.value(), key);
+        m_size += entry.size;
+    }
+
+    m_indexChanged = false;
+
+    loadJournal();
+}
+
+void CFileCache::loadJournal()
+{
+    QFile file(m_directory + QLatin1Char('/') + s_journalFileName);
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    CTelegramStream inputStream(file.readAll());
+
+    // The records are replayed in order, so the inserted files become the most recently used ones.
+    while (!inputStream.atEnd()) {
+        quint32 operation = 0;
+        QString key;
+        Entry entry;
+
+        inputStream >> operation;
+        inputStream >> key;
+
+        if (key.isEmpty()) {
+            break;
+        }
+
+        if (operation == JournalInsert) {
+            inputStream >> entry.size;
+            inputStream >> entry.fileType;
+
+            forgetEntry(key);
+
+            QMap<QString, Entry>::iterator it = m_entries.insert(key, entry);
+            touch(&it.value(), key);
+            m_size += entry.size;
+        } else if (operation == JournalRemove) {
+            forgetEntry(key);
+        } else {
+            qDebug() << Q_FUNC_INFO << "Unknown journal operation" << operation;
+            break;
+        }
+
+        ++m_journalRecords;
+    }
+
+    if (m_journalRecords) {
+        m_indexChanged = true;
+    }
+}
+
+void CFileCache::saveIndex()
+{
+    if (!m_indexLoaded) {
+        return;
+    }
+
+    QByteArray output;
+    CTelegramStream outputStream(&output, /* write */ true);
+
+    outputStream << s_indexFormatVersion;
+    outputStream << quint32(m_accessOrder.count());
+
+    foreach (const QString &key, m_accessOrder) {
+        const Entry entry = m_entries.value(key);
+
+        outputStream << key;
+        outputStream << entry.size;
+        outputStream << entry.fileType;
+    }
+
+    if (QDir().mkpath(m_directory) && writeFile(m_directory + QLatin1Char('/') + s_indexFileName, output)) {
+        // The journal records are in the index now.
+        QFile::remove(m_directory + QLatin1Char('/') + s_journalFileName);
+        m_indexChanged = false;
+        m_journalRecords = 0;
+    }
+}
+
+void CFileCache::appendToJournal(JournalOperation operation, const QString &key, const Entry &entry)
+{
+    if (m_journalRecords >= s_journalMaxRecords) {
+        saveIndex();
+        return;
+    }
+
+    QByteArray output;
+    CTelegramStream outputStream(&output, /* write */ true);
+
+    outputStream << quint32(operation);
+    outputStream << key;
+
+    if (operation == JournalInsert) {
+        outputStream << entry.size;
+        outputStream << entry.fileType;
+    }
+
+    QFile file(m_directory + QLatin1Char('/') + s_journalFileName);
+
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append) || (file.write(output) != output.size())) {
+        qDebug() << Q_FUNC_INFO << "Unable to write the cache journal";
+        saveIndex();
+        return;
+    }
+
+    ++m_journalRecords;
+    m_indexChanged = true;
+}
+
+void CFileCache::touch(Entry *entry, const QString &key)
+{
+    if (entry->accessStamp) {
+        m_accessOrder.remove(entry->accessStamp);
+    }
+
+    entry->accessStamp = ++m_accessCounter;
+    m_accessOrder.insert(entry->accessStamp, key);
+
+    // The index is not rewritten just for the access order: it is saved with the next insertion or removal.
+}
+
+void CFileCache::forgetEntry(const QString &key)
+{
+    if (!m_entries.contains(key)) {
+        return;
+    }
+
+    const Entry entry = m_entries.take(key);
+
+    m_accessOrder.remove(entry.accessStamp);
+    m_size -= entry.size;
+}
+
+void CFileCache::removeEntry(const QString &key)
+{
+    forgetEntry(key);
+    QFile::remove(filePath(key));
+
+    appendToJournal(JournalRemove, key);
+}
@@ -0,0 +1,92 @@
+/*
+    Copyright (C) 2015 Alexandr Akulich <akulichalexander@gmail.com>
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+    LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+    OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+    WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef CFILECACHE_HPP
+#define CFILECACHE_HPP
+
+#include <QByteArray>
+#include <QMap>
+#include <QString>
+
+#include "TLTypes.hpp"
+
+// Persistent cache of downloaded files, keyed by the file location (dc id, location type, volume id, local id, secret,
+// file id and access hash). The least recently used files are removed when the total size exceeds the limit.
+// The index is loaded on the first access. Insertions and removals are appended to a journal,
+// which is merged into the index when it grows too long and on destruction. Reads alone do not cause an index write,
+// the access order is saved along with the other changes.
+class CFileCache
+{
+public:
+    CFileCache();
+    ~CFileCache();
+
+    inline QString directory() const { return m_directory; }
+    void setDirectory(const QString &directory); // Empty directory disables the cache
+
+    inline bool isEnabled() const { return !m_directory.isEmpty(); }
+
+    inline quint64 maxSize() const { return m_maxSize; }
+    void setMaxSize(quint64 bytes);
+
+    quint64 size();
+
+    static QString key(quint32 dcId, const TLInputFileLocation &location);
+
+    bool lookup(const QString &key, quint32 *size, TLValue *fileType);
+    QString filePath(const QString &key) const;
+    QByteArray data(const QString &key);
+
+    bool insert(const QString &key, const QByteArray &data, TLValue fileType);
+    void remove(const QString &key);
+    void clear();
+
+protected:
+    struct Entry {
+        Entry() :
+            size(0),
+            fileType(TLValue::StorageFileUnknown),
+            accessStamp(0) { }
+
+        quint32 size;
+        TLValue fileType;
+        quint64 accessStamp;
+    };
+
+    enum JournalOperation {
+        JournalInsert = 1,
+        JournalRemove = 2
+    };
+
+    void ensureIndexLoaded();
+    void loadJournal();
+    void saveIndex();
+    void appendToJournal(JournalOperation operation, const QString &key, const Entry &entry = Entry());
+    void touch(Entry *entry, const QString &key);
+    void forgetEntry(const QString &key);
+    void removeEntry(const QString &key);
+
+    QString m_directory;
+    quint64 m_maxSize;
+    quint64 m_size;
+    quint64 m_accessCounter;
+    bool m_indexLoaded;
+    bool m_indexChanged;
+    int m_journalRecords;
+
+    QMap<QString, Entry> m_entries; // Key, entry
+    QMap<quint64, QString> m_accessOrder; // Access stamp, key. The first one is the least recently used.
+
+};
+
+#endif // CFILECACHE_HPP
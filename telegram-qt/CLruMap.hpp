@@ -0,0 +1,170 @@
+/*
+    Copyright (C) 2015 Alexandr Akulich <akulichalexander@gmail.com>
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+    LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+    OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+    WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef CLRUMAP_HPP
+#define CLRUMAP_HPP
+
+#include <QHash>
+#include <QLinkedList>
+#include <QList>
+#include <QPair>
+
+// Key-value container with limited number of entries.
+// The least recently used entries are removed (and optionally returned to the caller) on overflow.
+template <typename Key, typename T>
+class CLruMap
+{
+public:
+    explicit CLruMap(int capacity = 0) :
+        m_capacity(capacity)
+    {
+    }
+
+    inline int capacity() const { return m_capacity; }
+    void setCapacity(int capacity, QList<QPair<Key, T> > *evicted = 0); // Zero capacity means no limit
+
+    inline int count() const { return m_entries.count(); }
+    inline bool isEmpty() const { return m_entries.isEmpty(); }
+    inline bool contains(const Key &key) const { return m_entries.contains(key); }
+
+    T value(const Key &key, const T &defaultValue = T()); // Marks the entry as the most recently used one
+    inline T peek(const Key &key, const T &defaultValue = T()) const { return m_entries.value(key, Entry(defaultValue)).value; }
+
+    void insert(const Key &key, const T &value, QList<QPair<Key, T> > *evicted = 0);
+    void remove(const Key &key);
+    void clear();
+
+    // Approximate size of the stored entries with the containers overhead.
+    quint64 memoryUsage() const;
+
+protected:
+    typedef typename QLinkedList<Key>::iterator AccessOrderIterator;
+
+    struct Entry {
+        Entry(const T &value = T()) :
+            value(value) { }
+
+        T value;
+        AccessOrderIterator accessPosition; // The list iterators stay valid on insertion and removal of other items.
+    };
+
+    void touch(Entry *entry);
+    void evict(int count, QList<QPair<Key, T> > *evicted);
+
+    int m_capacity;
+
+    QHash<Key, Entry> m_entries;
+    QLinkedList<Key> m_accessOrder; // The first one is the least recently used.
+
+private:
+    // The entries keep iterators of the list, which would point to the nodes of another list after a detach.
+    Q_DISABLE_COPY(CLruMap)
+
+};
+
+template <typename Key, typename T>
+void CLruMap<Key, T>::setCapacity(int capacity, QList<QPair<Key, T> > *evicted)
+{
+    m_capacity = capacity;
+
+    if (m_capacity > 0) {
+        evict(m_entries.count() - m_capacity, evicted);
+    }
+}
+
+template <typename Key, typename T>
+T CLruMap<Key, T>::value(const Key &key, const T &defaultValue)
+{
+    typename QHash<Key, Entry>::iterator it = m_entries.find(key);
+
+    if (it == m_entries.end()) {
+        return defaultValue;
+    }
+
+    touch(&it.value());
+
+    return it.value().value;
+}
+
+template <typename Key, typename T>
+void CLruMap<Key, T>::insert(const Key &key, const T &value, QList<QPair<Key, T> > *evicted)
+{
+    typename QHash<Key, Entry>::iterator it = m_entries.find(key);
+
+    if (it == m_entries.end()) {
+        it = m_entries.insert(key, Entry(value));
+        it.value().accessPosition = m_accessOrder.insert(m_accessOrder.end(), key);
+    } else {
+        it.value().value = value;
+        touch(&it.value());
+    }
+
+    if (m_capacity > 0) {
+        evict(m_entries.count() - m_capacity, evicted);
+    }
+}
+
+template <typename Key, typename T>
+void CLruMap<Key, T>::remove(const Key &key)
+{
+    typename QHash<Key, Entry>::iterator it = m_entries.find(key);
+
+    if (it == m_entries.end()) {
+        return;
+    }
+
+    m_accessOrder.erase(it.value().accessPosition);
+    m_entries.erase(it);
+}
+
+template <typename Key, typename T>
+void CLruMap<Key, T>::clear()
+{
+    m_entries.clear();
+    m_accessOrder.clear();
+}
+
+template <typename Key, typename T>
+quint64 CLruMap<Key, T>::memoryUsage() const
+{
+    // Hash node: next pointer, hash, key and entry. List node: two pointers and key.
+    static const quint64 entrySize = sizeof(void *) * 2 + sizeof(Key) + sizeof(Entry)
+            + sizeof(void *) * 2 + sizeof(Key);
+
+    return entrySize * m_entries.count();
+}
+
+template <typename Key, typename T>
+void CLruMap<Key, T>::touch(Entry *entry)
+{
+    // Move the entry to the end of the list, without any lookups.
+    const Key key = *entry->accessPosition;
+    m_accessOrder.erase(entry->accessPosition);
+    entry->accessPosition = m_accessOrder.insert(m_accessOrder.end(), key);
+}
+
+template <typename Key, typename T>
+void CLruMap<Key, T>::evict(int count, QList<QPair<Key, T> > *evicted)
+{
+    for (int i = 0; (i < count) && !m_accessOrder.isEmpty(); ++i) {
+        const Key key = m_accessOrder.takeFirst();
+
+        if (evicted) {
+            evicted->append(QPair<Key, T>(key, m_entries.value(key).value));
+        }
+
+        m_entries.remove(key);
+    }
+}
+
+#endif // CLRUMAP_HPP
@@ -0,0 +1,507 @@
+/*
+    Copyright (C) 2015 Alexandr Akulich <akulichalexander@gmail.com>
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+    LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+    OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+    WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "CMessageStore.hpp"
+
+#include "CTelegramStream.hpp"
+
+#include <QDir>
+#include <QtEndian>
+
+#include <QDebug>
+
+const quint32 s_logFormatVersion = 1;
+const quint32 s_indexFormatVersion = 1;
+const quint64 s_logHeaderSize = sizeof(s_logFormatVersion);
+const quint32 s_recordHeaderSize = sizeof(quint32); // Payload size
+const quint32 s_recordMinPayloadSize = 7 * sizeof(quint32) + 4; // Numbers and an empty string
+const quint64 s_mapGrowthStep = 1024 * 1024; // The log is remapped when the not mapped tail reaches this size
+
+static const QLatin1String s_logFileName("messages.log");
+static const QLatin1String s_indexFileName("messages.index");
+static const QLatin1String s_temporarySuffix(".tmp");
+
+CMessageStore::CMessageStore() :
+    m_mappedData(0),
+    m_mappedSize(0),
+    m_logSize(0),
+    m_opened(false),
+    m_indexChanged(false)
+{
+}
+
+CMessageStore::~CMessageStore()
+{
+    close();
+}
+
+void CMessageStore::setDirectory(const QString &directory)
+{
+    if (m_directory == directory) {
+        return;
+    }
+
+    close();
+    m_directory = directory;
+}
+
+int CMessageStore::count()
+{
+    ensureOpened();
+    return m_messages.count();
+}
+
+bool CMessageStore::contains(quint32 messageId)
+{
+    ensureOpened();
+    return m_messages.contains(messageId);
+}
+
+bool CMessageStore::insert(const TelegramNamespace::Message &message)
+{
+    if (!message.id || !ensureOpened() || m_messages.contains(message.id)) {
+        return false;
+    }
+
+    QByteArray payload;
+    CTelegramStream outputStream(&payload, /* write */ true);
+
+    outputStream << message.id;
+    outputStream << quint32(message.peer.type);
+    outputStream << message.peer.id;
+    outputStream << message.fromId;
+    outputStream << message.timestamp;
+    outputStream << message.flags;
+    outputStream << quint32(message.type);
+    outputStream << message.text;
+
+    QByteArray record(s_recordHeaderSize, char(0));
+    qToLittleEndian<quint32>(payload.size(), reinterpret_cast<uchar *>(record.data()));
+    record.append(payload);
+
+    if (!m_log.seek(m_logSize) || (m_log.write(record) != record.size())) {
+        qDebug() << Q_FUNC_INFO << "Unable to write the message log";
+        return false;
+    }
+
+    IndexEntry entry;
+    entry.offset = m_logSize;
+    entry.timestamp = message.timestamp;
+    entry.peer = message.peer;
+
+    m_logSize += record.size();
+
+    indexRecord(message.id, entry);
+    m_indexChanged = true;
+
+    return true;
+}
+
+bool CMessageStore::message(quint32 messageId, TelegramNamespace::Message *output)
+{
+    if (!ensureOpened()) {
+        return false;
+    }
+
+    QHash<quint32, IndexEntry>::const_iterator it = m_messages.constFind(messageId);
+
+    if (it == m_messages.constEnd()) {
+        return false;
+    }
+
+    return readRecord(it.value().offset, output);
+}
+
+QList<TelegramNamespace::Message> CMessageStore::history(const TelegramNamespace::Peer &peer, quint32 beforeMessageId, int limit)
+{
+    QList<TelegramNamespace::Message> result;
+
+    if ((limit <= 0) || !ensureOpened() || !m_peerMessages.contains(peer)) {
+        return result;
+    }
+
+    const QMap<quint32, quint64> &messages = m_peerMessages[peer];
+    QMap<quint32, quint64>::const_iterator it = beforeMessageId ? messages.lowerBound(beforeMessageId) : messages.constEnd();
+
+    while ((it != messages.constBegin()) && (result.count() < limit)) {
+        --it;
+
+        TelegramNamespace::Message message;
+
+        if (readRecord(it.value(), &message)) {
+            result.append(message);
+        }
+    }
+
+    return result;
+}
+
+QList<TelegramNamespace::Message> CMessageStore::historyByDate(const TelegramNamespace::Peer &peer, quint32 fromTimestamp, quint32 toTimestamp, int limit)
+{
+    QList<TelegramNamespace::Message> result;
+
+    if ((limit <= 0) || !ensureOpened() || !m_peerDates.contains(peer)) {
+        return result;
+    }
+
+    const QMultiMap<quint32, quint32> &dates = m_peerDates[peer];
+
+    for (QMultiMap<quint32, quint32>::const_iterator it = dates.lowerBound(fromTimestamp);
+         (it != dates.constEnd()) && (it.key() <= toTimestamp) && (result.count() < limit); ++it) {
+        TelegramNamespace::Message message;
+
+        if (readRecord(m_messages.value(it.value()).offset, &message)) {
+            result.append(message);
+        }
+    }
+
+    return result;
+}
+
+void CMessageStore::clear()
+{
+    if (!ensureOpened()) {
+        return;
+    }
+
+    if (m_mappedData) {
+        m_log.unmap(m_mappedData);
+        m_mappedData = 0;
+        m_mappedSize = 0;
+    }
+
+    QByteArray header;
+    CTelegramStream outputStream(&header, /* write */ true);
+    outputStream << s_logFormatVersion;
+
+    m_log.resize(0);
+    m_log.seek(0);
+    m_log.write(header);
+    m_logSize = s_logHeaderSize;
+
+    QFile::remove(m_directory + QLatin1Char('/') + s_indexFileName);
+
+    m_messages.clear();
+    m_peerMessages.clear();
+    m_peerDates.clear();
+    m_indexChanged = false;
+}
+
+bool CMessageStore::ensureOpened()
+{
+    if (m_opened) {
+        return true;
+    }
+
+    if (!isEnabled() || !QDir().mkpath(m_directory)) {
+        return false;
+    }
+
+    m_log.setFileName(m_directory + QLatin1Char('/') + s_logFileName);
+
+    if (!m_log.open(QIODevice::ReadWrite)) {
+        qDebug() << Q_FUNC_INFO << "Unable to open the message log" << m_log.fileName();
+        return false;
+    }
+
+    m_opened = true;
+
+    quint32 format = 0;
+
+    if (quint64(m_log.size()) >= s_logHeaderSize) {
+        CTelegramStream inputStream(m_log.read(s_logHeaderSize));
+        inputStream >> format;
+    }
+
+    if (format != s_logFormatVersion) {
+        if (m_log.size()) {
+            qDebug() << Q_FUNC_INFO << "Unknown log format" << format << "The message log is reset.";
+        }
+
+        clear();
+        return true;
+    }
+
+    m_logSize = m_log.size();
+
+    quint64 indexedSize = s_logHeaderSize;
+
+    if (!loadIndex(&indexedSize)) {
+        m_messages.clear();
+        m_peerMessages.clear();
+        m_peerDates.clear();
+        indexedSize = s_logHeaderSize;
+    }
+
+    if (indexedSize < m_logSize) {
+        scanLog(indexedSize);
+        m_indexChanged = true;
+    }
+
+    return true;
+}
+
+void CMessageStore::close()
+{
+    if (!m_opened) {
+        return;
+    }
+
+    if (m_indexChanged) {
+        saveIndex();
+    }
+
+    if (m_mappedData) {
+        m_log.unmap(m_mappedData);
+        m_mappedData = 0;
+        m_mappedSize = 0;
+    }
+
+    m_log.close();
+    m_logSize = 0;
+    m_opened = false;
+
+    m_messages.clear();
+    m_peerMessages.clear();
+    m_peerDates.clear();
+}
+
+bool CMessageStore::loadIndex(quint64 *indexedSize)
+{
+    QFile file(m_directory + QLatin1Char('/') + s_indexFileName);
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    CTelegramStream inputStream(file.readAll());
+
+    quint32 format = 0;
+    quint64 logSize = 0;
+    quint32 count = 0;
+
+    inputStream >> format;
+
+    if (format != s_indexFormatVersion) {
+        return false;
+    }
+
+    inputStream >> logSize;
+    inputStream >> count;
+
+    if ((logSize < s_logHeaderSize) || (logSize > m_logSize)) {
+        return false; // The log was replaced or truncated
+    }
+
+    m_messages.reserve(count);
+
+    for (quint32 i = 0; (i < count) && !inputStream.atEnd(); ++i) {
+        quint32 messageId = 0;
+        quint32 peerType = 0;
+        IndexEntry entry;
+
+        inputStream >> messageId;
+        inputStream >> peerType;
+        inputStream >> entry.peer.id;
+        inputStream >> entry.timestamp;
+        inputStream >> entry.offset;
+
+        if (entry.offset >= logSize) {
+            return false;
+        }
+
+        entry.peer.type = static_cast<TelegramNamespace::Peer::Type>(peerType);
+        indexRecord(messageId, entry);
+    }
+
+    *indexedSize = logSize;
+
+    return true;
+}
+
+void CMessageStore::saveIndex()
+{
+    QByteArray output;
+    CTelegramStream outputStream(&output, /* write */ true);
+
+    outputStream << s_indexFormatVersion;
+    outputStream << m_logSize;
+    outputStream << quint32(m_messages.count());
+
+    for (QHash<quint32, IndexEntry>::const_iterator it = m_messages.constBegin(); it != m_messages.constEnd(); ++it) {
+        outputStream << it.key();
+        outputStream << quint32(it.value().peer.type);
+        outputStream << it.value().peer.id;
+        outputStream << it.value().timestamp;
+        outputStream << it.value().offset;
+    }
+
+    // The index is written to a temporary file first, so an interrupted write leaves the previous (still consistent) one.
+    const QString fileName = m_directory + QLatin1Char('/') + s_indexFileName;
+    QFile file(fileName + s_temporarySuffix);
+
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || (file.write(output) != output.size())) {
+        qDebug() << Q_FUNC_INFO << "Unable to write the message index";
+        return;
+    }
+
+    file.close();
+
+    QFile::remove(fileName);
+
+    if (QFile::rename(file.fileName(), fileName)) {
+        m_indexChanged = false;
+    }
+}
+
+void CMessageStore::scanLog(quint64 offset)
+{
+    const quint64 fileSize = m_log.size();
+
+    while (offset + s_recordHeaderSize <= fileSize) {
+        TelegramNamespace::Message message;
+        quint32 recordSize = 0;
+
+        if (!readRecord(offset, &message, &recordSize) || !message.id) {
+            break;
+        }
+
+        IndexEntry entry;
+        entry.offset = offset;
+        entry.timestamp = message.timestamp;
+        entry.peer = message.peer;
+
+        indexRecord(message.id, entry);
+
+        offset += recordSize;
+    }
+
+    if (offset < fileSize) {
+        qDebug() << Q_FUNC_INFO << "Incomplete record at" << offset << "The log tail is dropped.";
+
+        if (m_mappedData) {
+            m_log.unmap(m_mappedData);
+            m_mappedData = 0;
+            m_mappedSize = 0;
+        }
+
+        m_log.resize(offset);
+    }
+
+    m_logSize = offset;
+}
+
+void CMessageStore::updateMapping()
+{
+    m_log.flush(); // Appended records have to reach the file before it is mapped or read.
+
+    const quint64 fileSize = m_log.size();
+
+    // Remapping the whole log after each append is expensive, so it is remapped in steps.
+    if (m_mappedData && (fileSize < m_mappedSize + s_mapGrowthStep)) {
+        return;
+    }
+
+    if (fileSize <= m_mappedSize) {
+        return;
+    }
+
+    if (m_mappedData) {
+        m_log.unmap(m_mappedData);
+        m_mappedData = 0;
+        m_mappedSize = 0;
+    }
+
+    m_mappedData = m_log.map(0, fileSize);
+
+    if (!m_mappedData) {
+        qDebug() << Q_FUNC_INFO << "Unable to map the message log";
+        return;
+    }
+
+    m_mappedSize = fileSize;
+}
+
+QByteArray CMessageStore::recordPayload(quint64 offset)
+{
+    updateMapping();
+
+    if (offset + s_recordHeaderSize <= m_mappedSize) {
+        const quint32 size = qFromLittleEndian<quint32>(m_mappedData + offset);
+
+        if (offset + s_recordHeaderSize + size <= m_mappedSize) {
+            // The record data is not copied: the stream reads the mapped memory.
+            return QByteArray::fromRawData(reinterpret_cast<const char *>(m_mappedData + offset + s_recordHeaderSize), size);
+        }
+    }
+
+    // The record is in the tail, appended after the log was mapped.
+    const quint64 fileSize = m_log.size();
+
+    if ((offset + s_recordHeaderSize > fileSize) || !m_log.seek(offset)) {
+        return QByteArray();
+    }
+
+    const QByteArray header = m_log.read(s_recordHeaderSize);
+
+    if (quint32(header.size()) != s_recordHeaderSize) {
+        return QByteArray();
+    }
+
+    const quint32 size = qFromLittleEndian<quint32>(reinterpret_cast<const uchar *>(header.constData()));
+
+    if (offset + s_recordHeaderSize + size > fileSize) {
+        return QByteArray();
+    }
+
+    return m_log.read(size);
+}
+
+bool CMessageStore::readRecord(quint64 offset, TelegramNamespace::Message *output, quint32 *recordSize)
+{
+    const QByteArray payload = recordPayload(offset);
+
+    if (quint32(payload.size()) < s_recordMinPayloadSize) {
+        return false;
+    }
+
+    CTelegramStream inputStream(payload);
+
+    quint32 peerType = 0;
+    quint32 type = 0;
+
+    inputStream >> output->id;
+    inputStream >> peerType;
+    inputStream >> output->peer.id;
+    inputStream >> output->fromId;
+    inputStream >> output->timestamp;
+    inputStream >> output->flags;
+    inputStream >> type;
+    inputStream >> output->text;
+
+    output->peer.type = static_cast<TelegramNamespace::Peer::Type>(peerType);
+    output->type = static_cast<TelegramNamespace::MessageType>(type);
+
+    if (recordSize) {
+        *recordSize = s_recordHeaderSize + payload.size();
+    }
+
+    return true;
+}
+
+void CMessageStore::indexRecord(quint32 messageId, const IndexEntry &entry)
+{
+    m_messages.insert(messageId, entry);
+    m_peerMessages[entry.peer].insert(messageId, entry.offset);
+    m_peerDates[entry.peer].insert(entry.timestamp, messageId);
+}
@@ -0,0 +1,93 @@
+/*
+    Copyright (C) 2015 Alexandr Akulich <akulichalexander@gmail.com>
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+    LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+    OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+    WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef CMESSAGESTORE_HPP
+#define CMESSAGESTORE_HPP
+
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QString>
+
+#include "TelegramNamespace.hpp"
+
+// Persistent message history: an append-only log file, which is memory-mapped for reading. The log is remapped
+// when the appended tail grows big enough, the smaller tail is read from the file.
+// Messages are indexed by id, by peer and id and by peer and date. The index is saved on close
+// together with the covered log size, so only the log tail (written after the last save) is scanned on open.
+// Peer id of a chat is the Telegram chat id here (not the public one).
+class CMessageStore
+{
+public:
+    CMessageStore();
+    ~CMessageStore();
+
+    inline QString directory() const { return m_directory; }
+    void setDirectory(const QString &directory); // Empty directory disables the store
+
+    inline bool isEnabled() const { return !m_directory.isEmpty(); }
+
+    int count();
+    bool contains(quint32 messageId);
+
+    bool insert(const TelegramNamespace::Message &message); // Known messages are not inserted again
+
+    bool message(quint32 messageId, TelegramNamespace::Message *output);
+
+    // Messages with id less than beforeMessageId (or the latest ones for zero), from the newest to the oldest.
+    QList<TelegramNamespace::Message> history(const TelegramNamespace::Peer &peer, quint32 beforeMessageId, int limit);
+
+    // Messages from the time interval (both bounds are included), from the oldest to the newest.
+    QList<TelegramNamespace::Message> historyByDate(const TelegramNamespace::Peer &peer, quint32 fromTimestamp, quint32 toTimestamp, int limit);
+
+    void clear();
+
+protected:
+    struct IndexEntry {
+        IndexEntry() :
+            offset(0),
+            timestamp(0) { }
+
+        quint64 offset;
+        quint32 timestamp;
+        TelegramNamespace::Peer peer;
+    };
+
+    bool ensureOpened();
+    void close();
+
+    bool loadIndex(quint64 *indexedSize);
+    void saveIndex();
+    void scanLog(quint64 offset);
+    void updateMapping();
+    QByteArray recordPayload(quint64 offset);
+
+    bool readRecord(quint64 offset, TelegramNamespace::Message *output, quint32 *recordSize = 0);
+    void indexRecord(quint32 messageId, const IndexEntry &entry);
+
+    QString m_directory;
+    QFile m_log;
+    uchar *m_mappedData;
+    quint64 m_mappedSize;
+    quint64 m_logSize;
+    bool m_opened;
+    bool m_indexChanged;
+
+    QHash<quint32, IndexEntry> m_messages; // Message id, index entry
+    QMap<TelegramNamespace::Peer, QMap<quint32, quint64> > m_peerMessages; // Peer, message id to log offset
+    QMap<TelegramNamespace::Peer, QMultiMap<quint32, quint32> > m_peerDates; // Peer, timestamp to message id
+
+};
+
+#endif // CMESSAGESTORE_HPP
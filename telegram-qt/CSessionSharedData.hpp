@@ -0,0 +1,45 @@
+/*
+    Copyright (C) 2015 Alexandr Akulich <akulichalexander@gmail.com>
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+    LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+    OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+    WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef CSESSIONSHAREDDATA_HPP
+#define CSESSIONSHAREDDATA_HPP
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QVector>
+
+#include "TLTypes.hpp"
+
+// Data shared by the accounts of a session host. The accounts can live in different threads.
+class CSessionSharedData
+{
+public:
+    inline QVector<TLDcOption> dcConfiguration() const
+    {
+        QMutexLocker locker(&m_mutex);
+        return m_dcConfiguration;
+    }
+
+    inline void setDcConfiguration(const QVector<TLDcOption> &configuration)
+    {
+        QMutexLocker locker(&m_mutex);
+        m_dcConfiguration = configuration;
+    }
+
+protected:
+    mutable QMutex m_mutex;
+    QVector<TLDcOption> m_dcConfiguration;
+
+};
+
+#endif // CSESSIONSHAREDDATA_HPP
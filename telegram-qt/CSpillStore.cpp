@@ -0,0 +1,344 @@
+/*
+    Copyright (C) 2015 Alexandr Akulich <akulichalexander@gmail.com>
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+    LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+    OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+    WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+#include "CSpillStore.hpp"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QtEndian>
+
+#include <QDebug>
+
+const quint32 s_logFormatVersion = 1;
+const quint64 s_logHeaderSize = sizeof(s_logFormatVersion);
+const quint32 s_recordHeaderSize = 2 * sizeof(quint32); // Data size and id
+const quint32 s_tombstoneSize = 0xffffffff; // The data size of a taken record mark
+const int s_defaultMaxCount = 100000;
+const quint64 s_compactionMinSize = 64 * 1024; // Smaller logs are not compacted
+
+static const QLatin1String s_temporarySuffix(".tmp");
+
+static QByteArray logHeader()
+{
+    QByteArray header(s_logHeaderSize, char(0));
+    qToLittleEndian<quint32>(s_logFormatVersion, reinterpret_cast<uchar *>(header.data()));
+
+    return header;
+}
+
+static void appendRecordHeader(QByteArray *output, quint32 id, quint32 size)
+{
+    QByteArray header(s_recordHeaderSize, char(0));
+    qToLittleEndian<quint32>(size, reinterpret_cast<uchar *>(header.data()));
+    qToLittleEndian<quint32>(id, reinterpret_cast<uchar *>(header.data()) + sizeof(quint32));
+
+    output->append(header);
+}
+
+static void appendRecord(QByteArray *output, quint32 id, const QByteArray &data)
+{
+    appendRecordHeader(output, id, data.size());
+    output->append(data);
+}
+
+CSpillStore::CSpillStore() :
+    m_logSize(0),
+    m_liveSize(0),
+    m_maxCount(s_defaultMaxCount),
+    m_opened(false)
+{
+}
+
+CSpillStore::~CSpillStore()
+{
+    close();
+}
+
+void CSpillStore::setFileName(const QString &fileName)
+{
+    if (m_fileName == fileName) {
+        return;
+    }
+
+    close();
+    m_fileName = fileName;
+}
+
+void CSpillStore::setMaxCount(int count)
+{
+    m_maxCount = count;
+
+    if (m_opened) {
+        dropOldRecords();
+    }
+}
+
+int CSpillStore::count()
+{
+    ensureOpened();
+    return m_records.count();
+}
+
+bool CSpillStore::contains(quint32 id)
+{
+    ensureOpened();
+    return m_records.contains(id);
+}
+
+bool CSpillStore::insert(const QList<QPair<quint32, QByteArray> > &records)
+{
+    if (records.isEmpty() || !ensureOpened()) {
+        return false;
+    }
+
+    QByteArray output;
+
+    for (int i = 0; i < records.count(); ++i) {
+        appendRecord(&output, records.at(i).first, records.at(i).second);
+    }
+
+    if (!m_log.seek(m_logSize) || (m_log.write(output) != output.size())) {
+        qDebug() << Q_FUNC_INFO << "Unable to write the spill log" << m_fileName;
+        return false;
+    }
+
+    Record record;
+    record.offset = m_logSize;
+
+    for (int i = 0; i < records.count(); ++i) {
+        record.size = records.at(i).second.size();
+        indexRecord(records.at(i).first, record);
+        record.offset += s_recordHeaderSize + record.size;
+    }
+
+    m_logSize += output.size();
+
+    dropOldRecords();
+    compactIfNeeded();
+
+    return true;
+}
+
+QByteArray CSpillStore::take(quint32 id)
+{
+    if (!ensureOpened()) {
+        return QByteArray();
+    }
+
+    QHash<quint32, Record>::const_iterator it = m_records.constFind(id);
+
+    if (it == m_records.constEnd()) {
+        return QByteArray();
+    }
+
+    const Record record = it.value();
+    forgetRecord(id);
+
+    m_log.flush();
+
+    if (!m_log.seek(record.offset + s_recordHeaderSize)) {
+        return QByteArray();
+    }
+
+    const QByteArray data = m_log.read(record.size);
+
+    QByteArray tombstone;
+    appendRecordHeader(&tombstone, id, s_tombstoneSize);
+
+    if (m_log.seek(m_logSize) && (m_log.write(tombstone) == tombstone.size())) {
+        m_logSize += tombstone.size();
+        compactIfNeeded();
+    } else {
+        qDebug() << Q_FUNC_INFO << "Unable to write the spill log" << m_fileName;
+    }
+
+    if (quint32(data.size()) != record.size) {
+        return QByteArray();
+    }
+
+    return data;
+}
+
+void CSpillStore::clear()
+{
+    if (!ensureOpened()) {
+        return;
+    }
+
+    m_log.resize(0);
+    m_log.seek(0);
+    m_log.write(logHeader());
+    m_logSize = s_logHeaderSize;
+
+    m_records.clear();
+    m_order.clear();
+    m_liveSize = 0;
+}
+
+bool CSpillStore::ensureOpened()
+{
+    if (m_opened) {
+        return true;
+    }
+
+    if (!isEnabled() || !QDir().mkpath(QFileInfo(m_fileName).absolutePath())) {
+        return false;
+    }
+
+    m_log.setFileName(m_fileName);
+
+    if (!m_log.open(QIODevice::ReadWrite)) {
+        qDebug() << Q_FUNC_INFO << "Unable to open the spill log" << m_fileName;
+        return false;
+    }
+
+    m_opened = true;
+
+    if (m_log.read(s_logHeaderSize) != logHeader()) {
+        clear();
+        return true;
+    }
+
+    scanLog();
+    dropOldRecords();
+
+    return true;
+}
+
+void CSpillStore::close()
+{
+    if (!m_opened) {
+        return;
+    }
+
+    m_log.close();
+    m_logSize = 0;
+    m_opened = false;
+
+    m_records.clear();
+    m_order.clear();
+    m_liveSize = 0;
+}
+
+void CSpillStore::scanLog()
+{
+    // The log is small (the records are evicted from memory caches), so it is read at once.
+    m_log.seek(0);
+    const QByteArray data = m_log.readAll();
+    const uchar *rawData = reinterpret_cast<const uchar *>(data.constData());
+
+    quint64 offset = s_logHeaderSize;
+
+    while (offset + s_recordHeaderSize <= quint64(data.size())) {
+        Record record;
+        record.offset = offset;
+        record.size = qFromLittleEndian<quint32>(rawData + offset);
+
+        if (record.size == s_tombstoneSize) {
+            forgetRecord(qFromLittleEndian<quint32>(rawData + offset + sizeof(quint32)));
+            offset += s_recordHeaderSize;
+            continue;
+        }
+
+        if (offset + s_recordHeaderSize + record.size > quint64(data.size())) {
+            break;
+        }
+
+        // A later record with the same id replaces the earlier one.
+        indexRecord(qFromLittleEndian<quint32>(rawData + offset + sizeof(quint32)), record);
+        offset += s_recordHeaderSize + record.size;
+    }
+
+    if (offset < quint64(data.size())) {
+        qDebug() << Q_FUNC_INFO << "Incomplete record at" << offset << "The log tail is dropped.";
+        m_log.resize(offset);
+    }
+
+    m_logSize = offset;
+}
+
+void CSpillStore::compact()
+{
+    QByteArray output = logHeader();
+    output.reserve(s_logHeaderSize + m_liveSize);
+
+    m_log.flush();
+
+    // The records are written in the log order, so the oldest ones stay the first.
+    for (QMap<quint64, quint32>::const_iterator it = m_order.constBegin(); it != m_order.constEnd(); ++it) {
+        const Record record = m_records.value(it.value());
+
+        if (!m_log.seek(record.offset + s_recordHeaderSize)) {
+            return;
+        }
+
+        appendRecord(&output, it.value(), m_log.read(record.size));
+    }
+
+    // The log is written to a temporary file first, so an interrupted write leaves the previous (still consistent) one.
+    QFile file(m_fileName + s_temporarySuffix);
+
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || (file.write(output) != output.size())) {
+        qDebug() << Q_FUNC_INFO << "Unable to write the spill log" << file.fileName();
+        return;
+    }
+
+    file.close();
+
+    close();
+
+    QFile::remove(m_fileName);
+
+    if (!QFile::rename(file.fileName(), m_fileName)) {
+        qDebug() << Q_FUNC_INFO << "Unable to replace the spill log" << m_fileName;
+    }
+
+    ensureOpened();
+}
+
+void CSpillStore::compactIfNeeded()
+{
+    if ((m_logSize > s_compactionMinSize) && (m_logSize > m_liveSize * 2)) {
+        compact();
+    }
+}
+
+void CSpillStore::dropOldRecords()
+{
+    while ((m_records.count() > m_maxCount) && !m_order.isEmpty()) {
+        forgetRecord(m_order.begin().value());
+    }
+}
+
+void CSpillStore::indexRecord(quint32 id, const Record &record)
+{
+    forgetRecord(id);
+
+    m_records.insert(id, record);
+    m_order.insert(record.offset, id);
+    m_liveSize += s_recordHeaderSize + record.size;
+}
+
+void CSpillStore::forgetRecord(quint32 id)
+{
+    QHash<quint32, Record>::iterator it = m_records.find(id);
+
+    if (it == m_records.end()) {
+        return;
+    }
+
+    m_order.remove(it.value().offset);
+    m_liveSize -= s_recordHeaderSize + it.value().size;
+    m_records.erase(it);
+}
@@ -0,0 +1,85 @@
+/*
+    Copyright (C) 2015 Alexandr Akulich <akulichalexander@gmail.com>
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+    LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+    OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+    WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+#ifndef CSPILLSTORE_HPP
+#define CSPILLSTORE_HPP
+
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QPair>
+#include <QString>
+
+// Append-only store for the records, evicted from the memory caches (id and serialized data).
+// Records of one eviction are appended by a single write. A take appends a tombstone (a record header without data),
+// so the taken record does not come back after reopening. The log is rewritten without the dropped records
+// when most of it is dead.
+// The oldest records are dropped when the count exceeds the limit.
+class CSpillStore
+{
+public:
+    CSpillStore();
+    ~CSpillStore();
+
+    inline QString fileName() const { return m_fileName; }
+    void setFileName(const QString &fileName); // Empty file name disables the store
+
+    inline bool isEnabled() const { return !m_fileName.isEmpty(); }
+
+    inline int maxCount() const { return m_maxCount; }
+    void setMaxCount(int count);
+
+    int count();
+    bool contains(quint32 id);
+
+    bool insert(const QList<QPair<quint32, QByteArray> > &records);
+    QByteArray take(quint32 id);
+
+    void clear();
+
+protected:
+    struct Record {
+        Record() :
+            offset(0),
+            size(0) { }
+
+        quint64 offset;
+        quint32 size;
+    };
+
+    bool ensureOpened();
+    void close();
+
+    void scanLog();
+    void compact();
+    void compactIfNeeded();
+    void dropOldRecords();
+
+    void indexRecord(quint32 id, const Record &record);
+    void forgetRecord(quint32 id);
+
+    QString m_fileName;
+    QFile m_log;
+    quint64 m_logSize;
+    quint64 m_liveSize; // Size of the indexed records with headers
+    int m_maxCount;
+    bool m_opened;
+
+    QHash<quint32, Record> m_records; // Id, record
+    QMap<quint64, quint32> m_order; // Log offset, id. The first one is the oldest.
+
+};
+
+#endif // CSPILLSTORE_HPP
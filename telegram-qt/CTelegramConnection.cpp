@@ -17,7 +17,6 @@
 
 #include <QDateTime>
 #include <QStringList>
-#include <QTimer>
 
 #include <QtEndian>
 
@@ -37,8 +36,12 @@ QString formatTLValue(const TLValue &val)
 #include "CAppInformation.hpp"
 #include "CTelegramStream.hpp"
 #include "CTcpTransport.hpp"
+#include "CTimerScheduler.hpp"
 #include "Utils.hpp"
 
+const int s_ackTimeout = 90 * 1000; // ms, max delay of the received messages acknowledgment
+const int s_deltaTimeDriftLimit = 1000; // ms, max drift of the smoothed server time from the delta time in use
+
 // Have a copy in CTelegramDispatcher
 static QString maskPhoneNumber(const QString &phoneNumber)
 {
@@ -54,30 +57,31 @@ CTelegramConnection::CTelegramConnection(const CAppInformation *appInfo, QObject
     m_status(ConnectionStatusDisconnected),
     m_appInfo(appInfo),
     m_transport(0),
-    m_pingTimer(0),
-    m_ackTimer(new QTimer(this)),
+    m_timerScheduler(CTimerScheduler::threadInstance()),
     m_authState(AuthStateNone),
     m_authId(0),
     m_authKeyAuxHash(0),
     m_serverSalt(0),
+    m_receivedServerSalt(0),
+    m_receivedMessageId(0),
     m_sessionId(0),
     m_lastMessageId(0),
     m_lastSentPingId(0),
     m_sequenceNumber(0),
     m_contentRelatedMessages(0),
+    m_requestsBatchLevel(0),
+    m_initConnectionMessageId(0),
+    m_resendInitConnection(false),
+    m_bulkRequestsLimit(0),
     m_pingInterval(0),
     m_deltaTime(0),
-    m_deltaTimeHeuristicState(DeltaTimeIsOk),
+    m_serverTimeOffset(0),
     m_serverPublicFingersprint(0)
   #ifdef NETWORK_LOGGING
   , m_logFile(0)
   #endif
 {
     setTransport(new CTcpTransport(this));
-
-    m_ackTimer->setInterval(90 * 1000);
-    m_ackTimer->setSingleShot(true);
-    connect(m_ackTimer, SIGNAL(timeout()), SLOT(whenItsTimeToAckMessages()));
 }
 
 void CTelegramConnection::setDcInfo(const TLDcOption &newDcInfo)
@@ -119,6 +123,7 @@ void CTelegramConnection::setAuthKey(const QByteArray &newAuthKey)
 void CTelegramConnection::setDeltaTime(const qint32 newDt)
 {
     m_deltaTime = newDt;
+    m_serverTimeOffset = qint64(newDt) * 1000;
 
     // Message id depends on time, so if we fix time, we need to reset message id.
     m_lastMessageId = 0;
@@ -151,6 +156,14 @@ quint64 CTelegramConnection::timeStampToMSecsSinceEpoch(quint64 ts)
     return secs * 1000 + msecs;
 }
 
+qint32 CTelegramConnection::deltaTimeFromServerMessageId(quint64 serverMessageId, qint64 localTimeInMs)
+{
+    // Server message id contains the server time of the message
+    const qint64 offset = qint64(timeStampToMSecsSinceEpoch(serverMessageId)) - localTimeInMs;
+
+    return qRound(offset / 1000.0);
+}
+
 void CTelegramConnection::initAuth()
 {
     if (m_authState == AuthStateNone) {
@@ -198,9 +211,7 @@ void CTelegramConnection::setKeepAliveInterval(quint32 ms)
     if (ms) {
         startPingTimer();
     } else {
-        if (m_pingTimer) {
-            m_pingTimer->stop();
-        }
+        m_timerScheduler->cancel(this, "whenItsTimeToPing");
     }
 }
 
@@ -224,16 +235,43 @@ quint64 CTelegramConnection::signUp(const QString &phoneNumber, const QString &a
     return authSignUp(phoneNumber, m_authCodeHash, authCode, firstName, lastName);
 }
 
-void CTelegramConnection::getFile(const TLInputFileLocation &inputLocation, quint32 fileId)
+void CTelegramConnection::setBulkRequestsLimit(int requests)
 {
-    if (m_requestedFilesIds.contains(fileId)) {
-        // Prevent from (really possible) repeated request.
+    if (requests < 0) {
+        qDebug() << Q_FUNC_INFO << "Invalid limit" << requests << "is ignored.";
         return;
     }
 
-    const quint64 messageId = uploadGetFile(inputLocation, 0, 512 * 1024);
+    m_bulkRequestsLimit = requests;
+    sendDeferredRequests();
+}
 
-    m_requestedFilesIds.insert(messageId, fileId);
+CTelegramConnection::RequestPriority CTelegramConnection::requestPriority(TLValue method)
+{
+    switch (method) {
+    case TLValue::MessagesSendMessage:
+    case TLValue::MessagesSendMedia:
+    case TLValue::MessagesSendBroadcast:
+    case TLValue::MessagesSetTyping:
+    case TLValue::MessagesReadHistory:
+        return RequestPriorityInteractive;
+    case TLValue::UploadGetFile:
+    case TLValue::UploadSaveFilePart:
+    case TLValue::UploadSaveBigFilePart:
+    case TLValue::ContactsImportContacts:
+        return RequestPriorityBulk;
+    default:
+        return RequestPriorityNormal;
+    }
+}
+
+quint64 CTelegramConnection::getFilePart(const TLInputFileLocation &inputLocation, quint32 fileId, quint32 offset, quint32 limit)
+{
+    const quint64 messageId = uploadGetFile(inputLocation, offset, limit);
+
+    m_requestedFilesIds.insert(messageId, QPair<quint32, quint32>(fileId, offset));
+
+    return messageId;
 }
 
 // Generated Telegram API methods implementation
@@ -1505,7 +1543,6 @@ bool CTelegramConnection::answerDh(const QByteArray &payload)
     encryptedInputStream >> serverTime;
 
     setDeltaTime(qint64(serverTime) - (QDateTime::currentMSecsSinceEpoch() / 1000));
-    m_deltaTimeHeuristicState = DeltaTimeIsOk;
 
     m_b.resize(256);
     Utils::randomBytes(&m_b);
@@ -1680,11 +1717,6 @@ TLValue CTelegramConnection::processRpcQuery(const QByteArray &data)
         break;
     }
 
-    if ((value != TLValue::BadMsgNotification) && (m_deltaTimeHeuristicState != DeltaTimeIsOk)) {
-        // If we have no bad message notification, then time is synced.
-        m_deltaTimeHeuristicState = DeltaTimeIsOk;
-    }
-
     return value;
 }
 
@@ -1758,6 +1790,10 @@ void CTelegramConnection::processRpcResult(CTelegramStream &stream, quint64 idHi
         case TLValue::UploadGetFile:
             processingResult = processUploadGetFile(stream, id);
             break;
+        case TLValue::UploadSaveFilePart:
+        case TLValue::UploadSaveBigFilePart:
+            processingResult = processUploadSaveFilePart(stream, id);
+            break;
         case TLValue::UsersGetUsers:
             processingResult = processUsersGetUsers(stream, id);
             break;
@@ -1789,11 +1825,15 @@ void CTelegramConnection::processRpcResult(CTelegramStream &stream, quint64 idHi
             break;
         case TLValue::MessagesCreateChat:
         case TLValue::MessagesAddChatUser:
+        case TLValue::MessagesSendMedia:
             processingResult = processMessagesChatStateMessage(stream, id);
             break;
         case TLValue::MessagesSendMessage:
             processingResult = processMessagesSendMessage(stream, id);
             break;
+        case TLValue::MessagesSendBroadcast:
+            processingResult = processMessagesSendBroadcast(stream, id);
+            break;
         case TLValue::MessagesSetTyping:
             processingResult = processMessagesSetTyping(stream, id);
             break;
@@ -1838,6 +1878,8 @@ void CTelegramConnection::processRpcResult(CTelegramStream &stream, quint64 idHi
             addMessageToAck(id);
             break;
         }
+
+        releaseRequest(id);
     } else {
         stream >> request;
         qDebug() << "Unexpected RPC message:" << request.toString() << "id" << id;
@@ -1880,6 +1922,8 @@ bool CTelegramConnection::processRpcError(CTelegramStream &stream, quint64 id, T
     qDebug() << Q_FUNC_INFO << QString(QLatin1String("RPC Error %1: %2 for message %3 %4 (dc %5|%6:%7)"))
                 .arg(errorCode).arg(errorMessage).arg(id).arg(request.toString()).arg(m_dcInfo.id).arg(m_dcInfo.ipAddress).arg(m_dcInfo.port);
 
+    emit rpcErrorReceived(id, request, errorCode, errorMessage);
+
     switch (errorCode) {
     case 303: // ERROR_SEE_OTHER
         if (processErrorSeeOther(errorMessage, id)) {
@@ -1931,6 +1975,7 @@ bool CTelegramConnection::processRpcError(CTelegramStream &stream, quint64 id, T
         default:
             break;
         }
+        break;
     case 401: // UNAUTHORIZED
         emit authorizationErrorReceived();
         break;
@@ -1939,6 +1984,20 @@ bool CTelegramConnection::processRpcError(CTelegramStream &stream, quint64 id, T
         break;
     }
 
+    if ((request == TLValue::UploadGetFile) && m_requestedFilesIds.contains(id)) {
+        const QPair<quint32, quint32> filePart = m_requestedFilesIds.take(id);
+        emit filePartRequestFailed(filePart.first, filePart.second);
+    }
+
+    if ((request == TLValue::UploadSaveFilePart) || (request == TLValue::UploadSaveBigFilePart)) {
+        quint64 fileId;
+        quint32 filePart;
+
+        if (filePartFromPackage(id, &fileId, &filePart)) {
+            emit filePartSaved(fileId, filePart, /* result */ false);
+        }
+    }
+
     return false;
 }
 
@@ -2007,35 +2066,14 @@ void CTelegramConnection::processIgnoredMessageNotification(CTelegramStream &str
     }
     qDebug() << QString(QLatin1String("Bad message %1/%2: Code %3 (%4).")).arg(id).arg(seqNo).arg(errorCode).arg(errorText);
 
-    if (errorCode == 16) {
-        if (m_deltaTimeHeuristicState == DeltaTimeIsOk) {
-            m_deltaTimeHeuristicState = DeltaTimeCorrectionForward;
-        }
-
-        if (m_deltaTimeHeuristicState == DeltaTimeCorrectionForward) {
-            setDeltaTime(deltaTime() + 1000);
-        } else {
-            setDeltaTime(deltaTime() + 100);
-        }
-
-        sendEncryptedPackageAgain(id);
-        qDebug() << "DeltaTime factor increased to" << deltaTime();
-    } else if (errorCode == 17) {
-        if (m_deltaTimeHeuristicState == DeltaTimeIsOk) {
-            m_deltaTimeHeuristicState = DeltaTimeCorrectionBackward;
-        }
-
-        if (m_deltaTimeHeuristicState == DeltaTimeCorrectionBackward) {
-            setDeltaTime(deltaTime() - 1000);
-        } else {
-            setDeltaTime(deltaTime() - 100);
-        }
-
-        sendEncryptedPackageAgain(id);
-        qDebug() << "DeltaTime factor reduced to" << deltaTime();
+    if ((errorCode == 16) || (errorCode == 17)) {
+        // Take the server time from the notification message id, so the resent message is accepted right away.
+        setDeltaTime(deltaTimeFromServerMessageId(m_receivedMessageId, QDateTime::currentMSecsSinceEpoch()));
+        resendRejectedMessage(id);
+        qDebug() << "DeltaTime factor fixed to" << deltaTime();
     } else if (errorCode == 48) {
         m_serverSalt = m_receivedServerSalt;
-        sendEncryptedPackageAgain(id);
+        resendRejectedMessage(id);
         qDebug() << "Local serverSalt fixed to" << m_serverSalt;
     }
 }
@@ -2053,6 +2091,22 @@ void CTelegramConnection::processPingPong(CTelegramStream &stream)
 //    qDebug() << Q_FUNC_INFO << m_lastReceivedPingId << m_lastReceivedPingTime;
 }
 
+void CTelegramConnection::updateDeltaTime(quint64 serverMessageId, qint64 localTimeInMs)
+{
+    // Follow the server clock with every received message, so the local clock drift
+    // (e.g. after suspend/resume) is corrected before the server rejects our messages.
+    const qint64 offset = qint64(timeStampToMSecsSinceEpoch(serverMessageId)) - localTimeInMs;
+    m_serverTimeOffset = (m_serverTimeOffset * 7 + offset) / 8;
+
+    if (qAbs(m_serverTimeOffset - qint64(m_deltaTime) * 1000) < s_deltaTimeDriftLimit) {
+        return;
+    }
+
+    // Do not reset the last message id there: the message ids should grow within the session.
+    m_deltaTime = qRound(m_serverTimeOffset / 1000.0);
+    qDebug() << Q_FUNC_INFO << "DeltaTime factor adjusted to" << m_deltaTime;
+}
+
 TLValue CTelegramConnection::processHelpGetConfig(CTelegramStream &stream, quint64 id)
 {
     Q_UNUSED(id);
@@ -2089,6 +2143,8 @@ TLValue CTelegramConnection::processContactsGetContacts(CTelegramStream &stream,
         }
 
         emit contactListReceived(contactList);
+    } else if (result.tlType == TLValue::ContactsContactsNotModified) {
+        emit contactListNotModified();
     }
 
     return result.tlType;
@@ -2286,18 +2342,40 @@ TLValue CTelegramConnection::processAuthLogOut(CTelegramStream &stream, quint64
 
 TLValue CTelegramConnection::processUploadGetFile(CTelegramStream &stream, quint64 id)
 {
-    Q_UNUSED(id);
-
     TLUploadFile file;
     stream >> file;
 
     if (file.tlType == TLValue::UploadFile) {
-        emit fileReceived(file, m_requestedFilesIds.value(id));
+        const QPair<quint32, quint32> filePart = m_requestedFilesIds.take(id);
+        emit filePartReceived(file, filePart.first, filePart.second);
     }
 
     return file.tlType;
 }
 
+TLValue CTelegramConnection::processUploadSaveFilePart(CTelegramStream &stream, quint64 id)
+{
+    TLValue result;
+    stream >> result;
+
+    switch (result) {
+    case TLValue::BoolTrue:
+    case TLValue::BoolFalse: {
+        quint64 fileId;
+        quint32 filePart;
+
+        if (filePartFromPackage(id, &fileId, &filePart)) {
+            emit filePartSaved(fileId, filePart, result == TLValue::BoolTrue);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+
+    return result;
+}
+
 TLValue CTelegramConnection::processUsersGetUsers(CTelegramStream &stream, quint64 id)
 {
     Q_UNUSED(id);
@@ -2370,7 +2448,19 @@ TLValue CTelegramConnection::processMessagesSendMessage(CTelegramStream &stream,
         outputStream >> message;
         outputStream >> randomId;
 
-        emit messageSentInfoReceived(peer, randomId, result.id, result.pts, result.date, result.seq);
+        emit messageSentInfoReceived(peer, randomId, result.id, result.pts, result.date, result.seq, id);
+    }
+
+    return result.tlType;
+}
+
+TLValue CTelegramConnection::processMessagesSendBroadcast(CTelegramStream &stream, quint64 id)
+{
+    TLMessagesStatedMessages result;
+    stream >> result;
+
+    if (result.tlType == TLValue::MessagesStatedMessages) {
+        emit broadcastSentInfoReceived(result, id);
     }
 
     return result.tlType;
@@ -2568,7 +2658,29 @@ void CTelegramConnection::whenTransportStateChanged()
         setStatus(ConnectionStatusConnected);
         break;
     case QAbstractSocket::UnconnectedState:
+        // The file parts in flight are reported first, so the dispatcher resumes exactly the parts of this connection.
         setStatus(ConnectionStatusDisconnected);
+
+        // The requests in flight would not be answered. The deferred ones are dropped too, the dispatcher resumes them.
+        foreach (quint64 id, m_deferredRequests) {
+            m_submittedPackages.remove(id);
+        }
+
+        // The upload parts are sent again by the dispatcher as well, so they are not counted as in flight.
+        foreach (quint64 id, m_submittedPackages.keys()) {
+            quint64 fileId;
+            quint32 filePart;
+
+            if (filePartFromPackage(id, &fileId, &filePart)) {
+                m_submittedPackages.remove(id);
+            }
+        }
+
+        m_requestedFilesIds.clear();
+        m_deferredRequests.clear();
+        m_bulkRequests.clear();
+        m_interactiveRequests.clear();
+        m_containerMessages.clear();
         break;
     default:
         break;
@@ -2668,6 +2780,9 @@ void CTelegramConnection::whenReadyRead()
 
         payload = decryptedStream.readRemainingBytes();
 
+        m_receivedMessageId = messageId;
+        updateDeltaTime(messageId, QDateTime::currentMSecsSinceEpoch());
+
         processRpcQuery(payload);
     }
 
@@ -2693,6 +2808,8 @@ void CTelegramConnection::whenItsTimeToPing()
         return;
     }
 
+    m_timerScheduler->schedule(this, "whenItsTimeToPing", m_pingInterval); // The next ping
+
     if (m_lastSentPingTime && (m_lastSentPingTime > m_lastReceivedPingTime + m_pingInterval)) {
         qDebug() << Q_FUNC_INFO << "pong time is out";
         setStatus(ConnectionStatusDisconnected);
@@ -2793,64 +2910,127 @@ quint64 CTelegramConnection::sendPlainPackage(const QByteArray &buffer)
     return messageId;
 }
 
-quint64 CTelegramConnection::sendEncryptedPackage(const QByteArray &buffer, bool savePackage)
+void CTelegramConnection::beginRequestsBatch()
 {
-    QByteArray encryptedPackage;
-    QByteArray messageKey;
-    quint64 messageId;
-    {
-        messageId = newMessageId();
+    ++m_requestsBatchLevel;
+}
 
-        m_sequenceNumber = m_contentRelatedMessages * 2 + 1;
-        ++m_contentRelatedMessages;
+void CTelegramConnection::endRequestsBatch()
+{
+    if (!m_requestsBatchLevel) {
+        return;
+    }
 
-        if (savePackage) {
-            // Story only content-related messages
-            m_submittedPackages.insert(messageId, buffer);
-        }
+    --m_requestsBatchLevel;
 
-        QByteArray innerData;
-        CRawStream stream(&innerData, /* write */ true);
+    if (m_requestsBatchLevel || m_batchedMessages.isEmpty()) {
+        return;
+    }
 
-        stream << m_serverSalt;
-        stream << m_sessionId;
-        stream << messageId;
-        stream << m_sequenceNumber;
+    if (m_batchedMessages.count() == 1) {
+        const OutgoingMessage &message = m_batchedMessages.first();
+        sendEncryptedMessage(message.id, message.sequenceNumber, message.body);
+        m_batchedMessages.clear();
+        return;
+    }
 
-        QByteArray header;
-        if (m_sequenceNumber == 1) {
-            insertInitConnection(&header);
-        }
+    // https://core.telegram.org/mtproto/service_messages#simple-container
+    QByteArray container;
+    CRawStream stream(&container, /* write */ true);
 
-        stream << quint32(header.length() + buffer.length());
-        stream << header + buffer;
+    stream << TLValue::MsgContainer;
+    stream << quint32(m_batchedMessages.count());
 
-        messageKey = Utils::sha1(innerData).mid(4);
-        const SAesKey key = generateClientToServerAesKey(messageKey);
+    QVector<quint64> messageIds;
+    messageIds.reserve(m_batchedMessages.count());
 
-        quint32 packageLength = innerData.length();
+    foreach (const OutgoingMessage &message, m_batchedMessages) {
+        stream << message.id;
+        stream << message.sequenceNumber;
+        stream << quint32(message.body.length());
+        stream << message.body;
 
-        if ((packageLength) % 16) {
-            QByteArray randomPadding;
-            randomPadding.resize(16 - (packageLength % 16));
-            Utils::randomBytes(&randomPadding);
+        messageIds.append(message.id);
+    }
 
-            packageLength += randomPadding.size();
+    qDebug() << Q_FUNC_INFO << "send" << m_batchedMessages.count() << "messages in a container";
 
-            stream << randomPadding;
+    m_batchedMessages.clear();
+
+    // Forget the containers, which messages are all answered or sent again.
+    QMap<quint64, QVector<quint64> >::iterator it = m_containerMessages.begin();
+    while (it != m_containerMessages.end()) {
+        bool pending = false;
+
+        foreach (quint64 id, it.value()) {
+            if (m_submittedPackages.contains(id)) {
+                pending = true;
+                break;
+            }
         }
 
-        encryptedPackage = Utils::aesEncrypt(innerData, key).left(packageLength);
+        if (pending) {
+            ++it;
+        } else {
+            it = m_containerMessages.erase(it);
+        }
     }
 
-    QByteArray output;
-    CRawStream outputStream(&output, /* write */ true);
+    // The server names the container id, if it rejects the whole container.
+    const quint64 containerId = newMessageId();
+    m_containerMessages.insert(containerId, messageIds);
 
-    outputStream << m_authId;
-    outputStream << messageKey;
-    outputStream << encryptedPackage;
+    // The container itself is not a content-related message.
+    sendEncryptedMessage(containerId, m_contentRelatedMessages * 2, container);
+}
 
-    m_transport->sendPackage(output);
+quint64 CTelegramConnection::sendEncryptedPackage(const QByteArray &buffer, bool savePackage)
+{
+    const quint64 messageId = newMessageId();
+
+    if (savePackage) {
+        switch (requestPriority(TLValue::firstFromArray(buffer))) {
+        case RequestPriorityBulk:
+            if (!canSendBulkRequest()) {
+                m_submittedPackages.insert(messageId, buffer);
+                m_deferredRequests.append(messageId);
+                return messageId;
+            }
+
+            m_bulkRequests.insert(messageId);
+            break;
+        case RequestPriorityInteractive:
+            m_interactiveRequests.insert(messageId);
+            break;
+        default:
+            break;
+        }
+    }
+
+    m_sequenceNumber = m_contentRelatedMessages * 2 + 1;
+    ++m_contentRelatedMessages;
+
+    if (savePackage) {
+        // Story only content-related messages
+        m_submittedPackages.insert(messageId, buffer);
+    }
+
+    QByteArray header;
+    if ((m_sequenceNumber == 1) || m_resendInitConnection) {
+        insertInitConnection(&header);
+        m_initConnectionMessageId = messageId;
+        m_resendInitConnection = false;
+    }
+
+    if (m_requestsBatchLevel) {
+        OutgoingMessage message;
+        message.id = messageId;
+        message.sequenceNumber = m_sequenceNumber;
+        message.body = header + buffer;
+        m_batchedMessages.append(message);
+    } else {
+        sendEncryptedMessage(messageId, m_sequenceNumber, header + buffer);
+    }
 
 #ifdef NETWORK_LOGGING
     CTelegramStream readBack(buffer);
@@ -2875,15 +3055,131 @@ quint64 CTelegramConnection::sendEncryptedPackage(const QByteArray &buffer, bool
     return messageId;
 }
 
+void CTelegramConnection::sendEncryptedMessage(quint64 messageId, quint32 sequenceNumber, const QByteArray &body)
+{
+    QByteArray encryptedPackage;
+    QByteArray messageKey;
+    {
+        QByteArray innerData;
+        CRawStream stream(&innerData, /* write */ true);
+
+        stream << m_serverSalt;
+        stream << m_sessionId;
+        stream << messageId;
+        stream << sequenceNumber;
+
+        stream << quint32(body.length());
+        stream << body;
+
+        messageKey = Utils::sha1(innerData).mid(4);
+        const SAesKey key = generateClientToServerAesKey(messageKey);
+
+        quint32 packageLength = innerData.length();
+
+        if ((packageLength) % 16) {
+            QByteArray randomPadding;
+            randomPadding.resize(16 - (packageLength % 16));
+            Utils::randomBytes(&randomPadding);
+
+            packageLength += randomPadding.size();
+
+            stream << randomPadding;
+        }
+
+        encryptedPackage = Utils::aesEncrypt(innerData, key).left(packageLength);
+    }
+
+    QByteArray output;
+    CRawStream outputStream(&output, /* write */ true);
+
+    outputStream << m_authId;
+    outputStream << messageKey;
+    outputStream << encryptedPackage;
+
+    m_transport->sendPackage(output);
+}
+
 quint64 CTelegramConnection::sendEncryptedPackageAgain(quint64 id)
 {
+    // The saved package has no initConnection header, so it is added again.
+    m_resendInitConnection = (id == m_initConnectionMessageId);
+
     --m_contentRelatedMessages;
+    m_bulkRequests.remove(id);
+    m_interactiveRequests.remove(id);
+
     const QByteArray data = m_submittedPackages.take(id);
 #ifdef DEVELOPER_BUILD
     TLValue firstValue = TLValue::firstFromArray(data);
     qDebug() << Q_FUNC_INFO << id << firstValue.toString();
 #endif
-    return sendEncryptedPackage(data);
+    const quint64 newId = sendEncryptedPackage(data);
+    changeRequestId(id, newId);
+
+    return newId;
+}
+
+void CTelegramConnection::resendRejectedMessage(quint64 id)
+{
+    if (m_containerMessages.contains(id)) {
+        // The whole container is rejected, so each of its messages is sent again (in a new container).
+        const QVector<quint64> messageIds = m_containerMessages.take(id);
+
+        beginRequestsBatch();
+        foreach (quint64 messageId, messageIds) {
+            if (m_submittedPackages.contains(messageId)) {
+                sendEncryptedPackageAgain(messageId);
+            }
+        }
+        endRequestsBatch();
+
+        return;
+    }
+
+    if (!m_submittedPackages.contains(id)) {
+        // Service messages (acks and pings) are not saved.
+        qDebug() << Q_FUNC_INFO << "Unknown rejected message" << id;
+        return;
+    }
+
+    sendEncryptedPackageAgain(id);
+}
+
+void CTelegramConnection::releaseRequest(quint64 id)
+{
+    if (m_bulkRequests.remove(id) || m_interactiveRequests.remove(id)) {
+        sendDeferredRequests();
+    }
+}
+
+void CTelegramConnection::sendDeferredRequests()
+{
+    while (!m_deferredRequests.isEmpty() && canSendBulkRequest()) {
+        const quint64 id = m_deferredRequests.takeFirst();
+        const QByteArray data = m_submittedPackages.take(id);
+
+        // The message id is taken on the actual send, as the ids have to grow.
+        changeRequestId(id, sendEncryptedPackage(data));
+    }
+}
+
+void CTelegramConnection::changeRequestId(quint64 previousId, quint64 newId)
+{
+    if (m_requestedFilesIds.contains(previousId)) {
+        m_requestedFilesIds.insert(newId, m_requestedFilesIds.take(previousId));
+    }
+
+    emit requestIdChanged(previousId, newId);
+}
+
+bool CTelegramConnection::canSendBulkRequest() const
+{
+    if (!m_interactiveRequests.isEmpty()) {
+        return m_bulkRequests.isEmpty();
+    }
+
+    // No limit by default: the callers (e.g. the dispatcher file windows) limit their bulk requests.
+    return !m_bulkRequestsLimit || (m_bulkRequests.count() < m_bulkRequestsLimit);
 }
 
 void CTelegramConnection::setStatus(CTelegramConnection::ConnectionStatus status)
@@ -2895,8 +3191,8 @@ void CTelegramConnection::setStatus(CTelegramConnection::ConnectionStatus status
     m_status = status;
     emit statusChanged(status, m_dcInfo.id);
 
-    if ((status < ConnectionStatusConnected) && m_pingTimer && m_pingTimer->isActive()) {
-        m_pingTimer->stop();
+    if (status < ConnectionStatusConnected) {
+        m_timerScheduler->cancel(this, "whenItsTimeToPing");
     }
 }
 
@@ -2966,16 +3262,59 @@ QString CTelegramConnection::userNameFromPackage(quint64 id) const
     return name;
 }
 
-void CTelegramConnection::startPingTimer()
+QList<QPair<quint32, quint32> > CTelegramConnection::fileRequestsInFlight() const
+{
+    return m_requestedFilesIds.values();
+}
+
+QList<QPair<quint64, quint32> > CTelegramConnection::fileUploadsInFlight() const
+{
+    QList<QPair<quint64, quint32> > result;
+
+    foreach (quint64 id, m_submittedPackages.keys()) {
+        quint64 fileId;
+        quint32 filePart;
+
+        if (filePartFromPackage(id, &fileId, &filePart)) {
+            result.append(QPair<quint64, quint32>(fileId, filePart));
+        }
+    }
+
+    return result;
+}
+
+bool CTelegramConnection::filePartFromPackage(quint64 id, quint64 *fileId, quint32 *filePart) const
 {
-    if (!m_pingTimer) {
-        m_pingTimer = new QTimer(this);
-        m_pingTimer->setInterval(m_pingInterval);
-        m_pingTimer->setSingleShot(false);
-        connect(m_pingTimer, SIGNAL(timeout()), SLOT(whenItsTimeToPing()));
+    const QByteArray data = m_submittedPackages.value(id);
+
+    if (data.isEmpty()) {
+        return false;
+    }
+
+    CTelegramStream outputStream(data);
+
+    TLValue method;
+
+    outputStream >> method;
+
+    switch (method) {
+    case TLValue::UploadSaveFilePart:
+    case TLValue::UploadSaveBigFilePart:
+        break;
+    default:
+        return false;
     }
 
-    if (m_pingTimer->isActive()) {
+    // Both methods start with file_id:long file_part:int, so the part data is not read.
+    outputStream >> *fileId;
+    outputStream >> *filePart;
+
+    return true;
+}
+
+void CTelegramConnection::startPingTimer()
+{
+    if (m_timerScheduler->isScheduled(this, "whenItsTimeToPing")) {
         return;
     }
 
@@ -2984,20 +3323,20 @@ void CTelegramConnection::startPingTimer()
     m_lastReceivedPingTime = 0;
     m_lastSentPingTime = 0;
 
-    m_pingTimer->start();
+    m_timerScheduler->schedule(this, "whenItsTimeToPing", m_pingInterval);
 }
 
 void CTelegramConnection::addMessageToAck(quint64 id)
 {
 //    qDebug() << Q_FUNC_INFO << id;
-    if (!m_ackTimer->isActive()) {
-        m_ackTimer->start();
+    if (!m_timerScheduler->isScheduled(this, "whenItsTimeToAckMessages")) {
+        m_timerScheduler->schedule(this, "whenItsTimeToAckMessages", s_ackTimeout);
     }
 
     m_messagesToAck.append(id);
 
     if (m_messagesToAck.count() > 6) {
         whenItsTimeToAckMessages();
-        m_ackTimer->stop();
+        m_timerScheduler->cancel(this, "whenItsTimeToAckMessages");
     }
 }
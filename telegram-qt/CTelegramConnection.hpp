@@ -18,6 +18,8 @@
 #include <QByteArray>
 #include <QVector>
 #include <QMap>
+#include <QPair>
+#include <QSet>
 #include <QStringList>
 
 #include "TelegramNamespace.hpp"
@@ -29,13 +31,12 @@
 class CAppInformation;
 class CTelegramStream;
 class CTelegramTransport;
+class CTimerScheduler;
 
 #ifdef NETWORK_LOGGING
 class QFile;
 #endif
 
-class QTimer;
-
 class CTelegramConnection : public QObject
 {
     Q_OBJECT
@@ -57,12 +58,14 @@ public:
         AuthStateSignedIn
     };
 
-    enum DeltaTimeHeuristicState {
-        DeltaTimeIsOk,
-        DeltaTimeCorrectionForward,
-        DeltaTimeCorrectionBackward,
+    enum RequestPriority {
+        RequestPriorityInteractive, // Messages, typing and read status
+        RequestPriorityNormal,
+        RequestPriorityBulk // File parts and contacts import
     };
 
+    static RequestPriority requestPriority(TLValue method);
+
     explicit CTelegramConnection(const CAppInformation *appInfo, QObject *parent = 0);
 
     void setDcInfo(const TLDcOption &newDcInfo);
@@ -79,12 +82,30 @@ public:
     static inline quint64 formatClientTimeStamp(qint64 timeInMs) { return formatTimeStamp(timeInMs) & ~quint64(3); }
 
     static quint64 timeStampToMSecsSinceEpoch(quint64 ts);
+    static qint32 deltaTimeFromServerMessageId(quint64 serverMessageId, qint64 localTimeInMs);
 
     void initAuth();
     void getConfiguration();
 
     void setKeepAliveInterval(quint32 ms);
 
+    // Max number of bulk requests in flight (not limited by default, one while an interactive request is in flight).
+    // Zero means no limit, negative values are ignored.
+    // The rest are deferred and sent as the answers arrive, with new message ids. The id returned for a deferred
+    // request never goes on the wire; the actual id is reported by requestIdChanged().
+    void setBulkRequestsLimit(int requests);
+    inline int bulkRequestsInFlight() const { return m_bulkRequests.count(); }
+    inline int deferredRequestsCount() const { return m_deferredRequests.count(); }
+
+    // Not answered file parts requests (<file id, offset>) and uploads (<file id, part>), including the deferred ones.
+    // Still available while the disconnected status is reported.
+    QList<QPair<quint32, quint32> > fileRequestsInFlight() const;
+    QList<QPair<quint64, quint32> > fileUploadsInFlight() const;
+
+    // Requests made between the calls are sent together in one container. The calls can be nested.
+    void beginRequestsBatch();
+    void endRequestsBatch();
+
     // Generated Telegram API methods declaration
     quint64 accountChangePhone(const QString &phoneNumber, const QString &phoneCodeHash, const QString &phoneCode);
     quint64 accountCheckUsername(const QString &username);
@@ -181,7 +202,7 @@ public:
     quint64 signIn(const QString &phoneNumber, const QString &authCode);
     quint64 signUp(const QString &phoneNumber, const QString &authCode, const QString &firstName, const QString &lastName);
 
-    void getFile(const TLInputFileLocation &inputLocation, quint32 fileId);
+    quint64 getFilePart(const TLInputFileLocation &inputLocation, quint32 fileId, quint32 offset, quint32 limit);
 
     AuthState authState() { return m_authState; }
 
@@ -232,8 +253,11 @@ signals:
     void userNameStatusUpdated(const QString &userName, TelegramNamespace::AccountUserNameStatus status);
     void usersReceived(const QVector<TLUser> &users);
     void contactListReceived(const QList<quint32> &contactList);
+    void contactListNotModified();
     void contactListChanged(const QList<quint32> &added, const QList<quint32> &removed);
-    void fileReceived(const TLUploadFile &file, quint32 fileId);
+    void filePartReceived(const TLUploadFile &file, quint32 fileId, quint32 offset);
+    void filePartRequestFailed(quint32 fileId, quint32 offset);
+    void filePartSaved(quint64 fileId, quint32 filePart, bool result);
 
     void messagesChatsReceived(const QVector<TLChat> &chats, const QVector<TLUser> &users);
     void messagesFullChatReceived(const TLChatFull &chat, const QVector<TLChat> &chats, const QVector<TLUser> &users);
@@ -245,7 +269,10 @@ signals:
     void updatesStateReceived(const TLUpdatesState &updatesState);
     void updatesDifferenceReceived(const TLUpdatesDifference &updatesDifference);
 
-    void messageSentInfoReceived(const TLInputPeer &peer, quint64 randomId, quint32 messageId, quint32 pts, quint32 date, quint32 seq);
+    void messageSentInfoReceived(const TLInputPeer &peer, quint64 randomId, quint32 messageId, quint32 pts, quint32 date, quint32 seq, quint64 requestId);
+    void broadcastSentInfoReceived(const TLMessagesStatedMessages &result, quint64 requestId);
+    void rpcErrorReceived(quint64 requestId, TLValue request, quint32 errorCode, const QString &errorMessage);
+    void requestIdChanged(quint64 previousId, quint64 newId); // The request is sent again (or sent after a deferral)
     void authExportedAuthorizationReceived(quint32 dc, quint32 id, const QByteArray &data);
 
 protected:
@@ -261,6 +288,7 @@ protected:
     void processMessageAck(CTelegramStream &stream);
     void processIgnoredMessageNotification(CTelegramStream &stream);
     void processPingPong(CTelegramStream &stream);
+    void updateDeltaTime(quint64 serverMessageId, qint64 localTimeInMs);
 
     TLValue processHelpGetConfig(CTelegramStream &stream, quint64 id);
     TLValue processContactsGetContacts(CTelegramStream &stream, quint64 id);
@@ -275,10 +303,12 @@ protected:
     TLValue processAuthSign(CTelegramStream &stream, quint64 id);
     TLValue processAuthLogOut(CTelegramStream &stream, quint64 id);
     TLValue processUploadGetFile(CTelegramStream &stream, quint64 id);
+    TLValue processUploadSaveFilePart(CTelegramStream &stream, quint64 id);
     TLValue processUsersGetUsers(CTelegramStream &stream, quint64 id);
     TLValue processUsersGetFullUser(CTelegramStream &stream, quint64 id);
     TLValue processMessagesChatStateMessage(CTelegramStream &stream, quint64 id);
     TLValue processMessagesSendMessage(CTelegramStream &stream, quint64 id);
+    TLValue processMessagesSendBroadcast(CTelegramStream &stream, quint64 id);
     TLValue processMessagesSetTyping(CTelegramStream &stream, quint64 id);
     TLValue processMessagesReadHistory(CTelegramStream &stream, quint64 id);
     TLValue processMessagesReceivedMessages(CTelegramStream &stream, quint64 id);
@@ -301,8 +331,15 @@ protected:
     void insertInitConnection(QByteArray *data) const;
 
     quint64 sendPlainPackage(const QByteArray &buffer);
+    // Returns a placeholder id for a deferred bulk request, the request is sent later with a new id.
     quint64 sendEncryptedPackage(const QByteArray &buffer, bool savePackage = true);
+    void sendEncryptedMessage(quint64 messageId, quint32 sequenceNumber, const QByteArray &body);
     quint64 sendEncryptedPackageAgain(quint64 id);
+    void resendRejectedMessage(quint64 id);
+    void changeRequestId(quint64 previousId, quint64 newId);
+    void releaseRequest(quint64 id);
+    void sendDeferredRequests();
+    bool canSendBulkRequest() const;
 
     void setTransport(CTelegramTransport *newTransport);
 
@@ -312,6 +349,7 @@ protected:
     quint64 newMessageId();
 
     QString userNameFromPackage(quint64 id) const;
+    bool filePartFromPackage(quint64 id, quint64 *fileId, quint32 *filePart) const;
 
     void startPingTimer();
 
@@ -328,11 +366,10 @@ protected:
     const CAppInformation *m_appInfo;
 
     QMap<quint64, QByteArray> m_submittedPackages; // <message id, package data>
-    QMap<quint64, quint32> m_requestedFilesIds; // <message id, file id>
+    QMap<quint64, QPair<quint32, quint32> > m_requestedFilesIds; // <message id, <file id, offset> >
 
     CTelegramTransport *m_transport;
-    QTimer *m_pingTimer;
-    QTimer *m_ackTimer;
+    CTimerScheduler *m_timerScheduler; // Ping and ack timeouts of all connections of the thread
 
     AuthState m_authState;
 
@@ -341,6 +378,7 @@ protected:
     quint64 m_authKeyAuxHash;
     quint64 m_serverSalt;
     quint64 m_receivedServerSalt;
+    quint64 m_receivedMessageId;
     quint64 m_sessionId;
     quint64 m_lastMessageId;
     quint64 m_lastSentPingId;
@@ -350,11 +388,28 @@ protected:
     quint32 m_sequenceNumber;
     quint32 m_contentRelatedMessages;
 
+    struct OutgoingMessage {
+        quint64 id;
+        quint32 sequenceNumber;
+        QByteArray body;
+    };
+
+    int m_requestsBatchLevel;
+    QVector<OutgoingMessage> m_batchedMessages;
+    QMap<quint64, QVector<quint64> > m_containerMessages; // Container message id, ids of the contained messages
+    quint64 m_initConnectionMessageId; // The message with initConnection header, it is sent again with the header
+    bool m_resendInitConnection;
+
+    int m_bulkRequestsLimit; // Zero for no limit
+    QSet<quint64> m_bulkRequests; // Message ids of the bulk requests in flight
+    QSet<quint64> m_interactiveRequests; // Message ids of the interactive requests in flight
+    QList<quint64> m_deferredRequests; // Message ids of the bulk requests to be sent (the data is in m_submittedPackages)
+
     TLVector<quint64> m_messagesToAck;
 
     quint32 m_pingInterval;
     qint32 m_deltaTime;
-    DeltaTimeHeuristicState m_deltaTimeHeuristicState;
+    qint64 m_serverTimeOffset; // ms, smoothed difference between server and local clocks
 
     TLNumber128 m_clientNonce;
     TLNumber128 m_serverNonce;
@@ -14,14 +14,18 @@
 #include "CTelegramCore.hpp"
 
 #include <QDebug>
+#include <QThread>
 
 #include "CAppInformation.hpp"
 #include "CTelegramDispatcher.hpp"
+#include "Utils.hpp"
 
 CTelegramCore::CTelegramCore(QObject *parent) :
     QObject(parent),
     m_dispatcher(new CTelegramDispatcher(this)),
-    m_appInfo(0)
+    m_appInfo(0),
+    m_networkThread(0),
+    m_snapshot(0)
 {
     TelegramNamespace::registerTypes();
 
@@ -43,18 +47,28 @@ CTelegramCore::CTelegramCore(QObject *parent) :
             SIGNAL(avatarReceived(QString,QByteArray,QString,QString)));
     connect(m_dispatcher, SIGNAL(messageMediaDataReceived(QString,quint32,QByteArray,QString,TelegramNamespace::MessageType)),
             SIGNAL(messageMediaDataReceived(QString,quint32,QByteArray,QString,TelegramNamespace::MessageType)));
-    connect(m_dispatcher, SIGNAL(messageReceived(QString,QString,TelegramNamespace::MessageType,quint32,quint32,quint32)),
-            SIGNAL(messageReceived(QString,QString,TelegramNamespace::MessageType,quint32,quint32,quint32)));
-    connect(m_dispatcher, SIGNAL(chatMessageReceived(quint32,QString,QString,TelegramNamespace::MessageType,quint32,quint32,quint32)),
-            SIGNAL(chatMessageReceived(quint32,QString,QString,TelegramNamespace::MessageType,quint32,quint32,quint32)));
+    connect(m_dispatcher, SIGNAL(messageMediaDataProgress(quint32,quint32,quint32)),
+            SIGNAL(messageMediaDataProgress(quint32,quint32,quint32)));
+    connect(m_dispatcher, SIGNAL(messageMediaDataPartReceived(quint32,quint32,QByteArray)),
+            SIGNAL(messageMediaDataPartReceived(quint32,quint32,QByteArray)));
+    connect(m_dispatcher, SIGNAL(messageReceived(TelegramNamespace::Peer,quint32,QString,TelegramNamespace::MessageType,quint32,quint32,quint32)),
+            SIGNAL(peerMessageReceived(TelegramNamespace::Peer,quint32,QString,TelegramNamespace::MessageType,quint32,quint32,quint32)));
+    connect(m_dispatcher, SIGNAL(messageReceived(TelegramNamespace::Peer,quint32,QString,TelegramNamespace::MessageType,quint32,quint32,quint32)),
+            SLOT(whenMessageReceived(TelegramNamespace::Peer,quint32,QString,TelegramNamespace::MessageType,quint32,quint32,quint32)));
+    connect(m_dispatcher, SIGNAL(messagesReceived(QVector<TelegramNamespace::Message>)),
+            SIGNAL(messagesReceived(QVector<TelegramNamespace::Message>)));
     connect(m_dispatcher, SIGNAL(contactStatusChanged(QString,TelegramNamespace::ContactStatus)),
             SIGNAL(contactStatusChanged(QString,TelegramNamespace::ContactStatus)));
-    connect(m_dispatcher, SIGNAL(contactTypingStatusChanged(QString,bool)),
-            SIGNAL(contactTypingStatusChanged(QString,bool)));
-    connect(m_dispatcher, SIGNAL(contactChatTypingStatusChanged(quint32,QString,bool)),
-            SIGNAL(contactChatTypingStatusChanged(quint32,QString,bool)));
-    connect(m_dispatcher, SIGNAL(sentMessageStatusChanged(QString,quint64,TelegramNamespace::MessageDeliveryStatus)),
-            SIGNAL(sentMessageStatusChanged(QString,quint64,TelegramNamespace::MessageDeliveryStatus)));
+    connect(m_dispatcher, SIGNAL(typingStatusChanged(TelegramNamespace::Peer,quint32,bool)),
+            SIGNAL(peerTypingStatusChanged(TelegramNamespace::Peer,quint32,bool)));
+    connect(m_dispatcher, SIGNAL(typingStatusChanged(TelegramNamespace::Peer,quint32,bool)),
+            SLOT(whenTypingStatusChanged(TelegramNamespace::Peer,quint32,bool)));
+    connect(m_dispatcher, SIGNAL(sentMessageStatusChanged(TelegramNamespace::Peer,quint64,TelegramNamespace::MessageDeliveryStatus)),
+            SIGNAL(peerSentMessageStatusChanged(TelegramNamespace::Peer,quint64,TelegramNamespace::MessageDeliveryStatus)));
+    connect(m_dispatcher, SIGNAL(sentMessageStatusChanged(TelegramNamespace::Peer,quint64,TelegramNamespace::MessageDeliveryStatus)),
+            SLOT(whenSentMessageStatusChanged(TelegramNamespace::Peer,quint64,TelegramNamespace::MessageDeliveryStatus)));
+    connect(m_dispatcher, SIGNAL(mediaUploadProgress(quint64,quint32,quint32)),
+            SIGNAL(mediaUploadProgress(quint64,quint32,quint32)));
     connect(m_dispatcher, SIGNAL(chatAdded(quint32)),
             SIGNAL(chatAdded(quint32)));
     connect(m_dispatcher, SIGNAL(chatChanged(quint32)),
@@ -67,9 +81,49 @@ CTelegramCore::CTelegramCore(QObject *parent) :
 
 CTelegramCore::~CTelegramCore()
 {
+    if (m_networkThread) {
+        // The dispatcher is deleted on the thread finish.
+        m_networkThread->quit();
+        m_networkThread->wait();
+    }
+
+    delete m_snapshot;
     delete m_appInfo;
 }
 
+bool CTelegramCore::enableNetworkThread()
+{
+    if (m_networkThread) {
+        return true;
+    }
+
+    if (m_dispatcher->connectionState() != TelegramNamespace::ConnectionStateDisconnected) {
+        qDebug() << Q_FUNC_INFO << "The network thread can not be enabled for an initialized connection.";
+        return false;
+    }
+
+    m_snapshot = new DispatcherSnapshot();
+    m_dispatcher->setSnapshotReceiver(this);
+
+    m_networkThread = new QThread(this);
+    m_dispatcher->setParent(0);
+    m_dispatcher->moveToThread(m_networkThread);
+    connect(m_networkThread, SIGNAL(finished()), m_dispatcher, SLOT(deleteLater()));
+    m_networkThread->start();
+
+    return true;
+}
+
+bool CTelegramCore::event(QEvent *event)
+{
+    if (event->type() == DispatcherSnapshotEvent::eventType()) {
+        *m_snapshot = static_cast<DispatcherSnapshotEvent *>(event)->snapshot;
+        return true;
+    }
+
+    return QObject::event(event);
+}
+
 void CTelegramCore::setAppInformation(const CAppInformation *newAppInfo)
 {
     if (!newAppInfo) {
@@ -85,11 +139,32 @@ void CTelegramCore::setAppInformation(const CAppInformation *newAppInfo)
 
 QByteArray CTelegramCore::connectionSecretInfo() const
 {
-    return m_dispatcher->connectionSecretInfo();
+    if (!m_networkThread) {
+        return m_dispatcher->connectionSecretInfo();
+    }
+
+    QByteArray result;
+    QMetaObject::invokeMethod(m_dispatcher, "connectionSecretInfo", Qt::BlockingQueuedConnection, Q_RETURN_ARG(QByteArray, result));
+    return result;
+}
+
+QByteArray CTelegramCore::sessionSnapshot() const
+{
+    if (!m_networkThread) {
+        return m_dispatcher->sessionSnapshot();
+    }
+
+    QByteArray result;
+    QMetaObject::invokeMethod(m_dispatcher, "sessionSnapshot", Qt::BlockingQueuedConnection, Q_RETURN_ARG(QByteArray, result));
+    return result;
 }
 
 TelegramNamespace::ConnectionState CTelegramCore::connectionState() const
 {
+    if (m_snapshot) {
+        return m_snapshot->connectionState;
+    }
+
     return m_dispatcher->connectionState();
 }
 
@@ -100,80 +175,177 @@ bool CTelegramCore::initConnection(const QString &address, quint32 port)
         return false;
     }
 
-    m_dispatcher->setAppInformation(m_appInfo);
-    m_dispatcher->initConnection(address, port);
+    if (!m_networkThread) {
+        m_dispatcher->setAppInformation(m_appInfo);
+        m_dispatcher->initConnection(address, port);
+        return true;
+    }
+
+    QMetaObject::invokeMethod(m_dispatcher, "setAppInformation", Qt::BlockingQueuedConnection, Q_ARG(const CAppInformation*, m_appInfo));
+    QMetaObject::invokeMethod(m_dispatcher, "initConnection", Qt::QueuedConnection, Q_ARG(QString, address), Q_ARG(quint32, port));
 
     return true;
 }
 
 void CTelegramCore::closeConnection()
 {
-    return m_dispatcher->closeConnection();
+    if (m_networkThread) {
+        QMetaObject::invokeMethod(m_dispatcher, "closeConnection", Qt::QueuedConnection);
+        return;
+    }
+
+    m_dispatcher->closeConnection();
 }
 
 bool CTelegramCore::logOut()
 {
-    return m_dispatcher->logOut();
+    if (!m_networkThread) {
+        return m_dispatcher->logOut();
+    }
+
+    bool result = false;
+    QMetaObject::invokeMethod(m_dispatcher, "logOut", Qt::BlockingQueuedConnection, Q_RETURN_ARG(bool, result));
+    return result;
 }
 
 bool CTelegramCore::restoreConnection(const QByteArray &secret)
 {
-    m_dispatcher->setAppInformation(m_appInfo);
-    return m_dispatcher->restoreConnection(secret);
+    if (!m_networkThread) {
+        m_dispatcher->setAppInformation(m_appInfo);
+        return m_dispatcher->restoreConnection(secret);
+    }
+
+    bool result = false;
+    QMetaObject::invokeMethod(m_dispatcher, "setAppInformation", Qt::BlockingQueuedConnection, Q_ARG(const CAppInformation*, m_appInfo));
+    QMetaObject::invokeMethod(m_dispatcher, "restoreConnection", Qt::BlockingQueuedConnection, Q_RETURN_ARG(bool, result), Q_ARG(QByteArray, secret));
+    return result;
+}
+
+bool CTelegramCore::restoreSessionSnapshot(const QByteArray &snapshot)
+{
+    if (!m_networkThread) {
+        return m_dispatcher->restoreSessionSnapshot(snapshot);
+    }
+
+    bool result = false;
+    QMetaObject::invokeMethod(m_dispatcher, "restoreSessionSnapshot", Qt::BlockingQueuedConnection, Q_RETURN_ARG(bool, result), Q_ARG(QByteArray, snapshot));
+    return result;
 }
 
 void CTelegramCore::requestPhoneStatus(const QString &phoneNumber)
 {
+    if (m_networkThread) {
+        QMetaObject::invokeMethod(m_dispatcher, "requestPhoneStatus", Qt::QueuedConnection, Q_ARG(QString, phoneNumber));
+        return;
+    }
+
     m_dispatcher->requestPhoneStatus(phoneNumber);
 }
 
 void CTelegramCore::requestPhoneCode(const QString &phoneNumber)
 {
+    if (m_networkThread) {
+        QMetaObject::invokeMethod(m_dispatcher, "requestPhoneCode", Qt::QueuedConnection, Q_ARG(QString, phoneNumber));
+        return;
+    }
+
     m_dispatcher->requestPhoneCode(phoneNumber);
 }
 
 void CTelegramCore::signIn(const QString &phoneNumber, const QString &authCode)
 {
+    if (m_networkThread) {
+        QMetaObject::invokeMethod(m_dispatcher, "signIn", Qt::QueuedConnection, Q_ARG(QString, phoneNumber), Q_ARG(QString, authCode));
+        return;
+    }
+
     m_dispatcher->signIn(phoneNumber, authCode);
 }
 
 void CTelegramCore::signUp(const QString &phoneNumber, const QString &authCode, const QString &firstName, const QString &lastName)
 {
+    if (m_networkThread) {
+        QMetaObject::invokeMethod(m_dispatcher, "signUp", Qt::QueuedConnection, Q_ARG(QString, phoneNumber), Q_ARG(QString, authCode), Q_ARG(QString, firstName), Q_ARG(QString, lastName));
+        return;
+    }
+
     m_dispatcher->signUp(phoneNumber, authCode, firstName, lastName);
 }
 
 void CTelegramCore::addContacts(const QStringList &phoneNumbers)
 {
+    if (m_networkThread) {
+        QMetaObject::invokeMethod(m_dispatcher, "addContacts", Qt::QueuedConnection, Q_ARG(QStringList, phoneNumbers));
+        return;
+    }
+
     m_dispatcher->addContacts(phoneNumbers);
 }
 
 void CTelegramCore::deleteContacts(const QStringList &phoneNumbers)
 {
+    if (m_networkThread) {
+        QMetaObject::invokeMethod(m_dispatcher, "deleteContacts", Qt::QueuedConnection, Q_ARG(QStringList, phoneNumbers));
+        return;
+    }
+
     m_dispatcher->deleteContacts(phoneNumbers);
 }
 
 void CTelegramCore::requestContactAvatar(const QString &contact)
 {
+    if (m_networkThread) {
+        QMetaObject::invokeMethod(m_dispatcher, "requestContactAvatar", Qt::QueuedConnection, Q_ARG(QString, contact));
+        return;
+    }
+
     m_dispatcher->requestContactAvatar(contact);
 }
 
 void CTelegramCore::requestMessageMediaData(quint32 messageId)
 {
+    if (m_networkThread) {
+        QMetaObject::invokeMethod(m_dispatcher, "requestMessageMediaData", Qt::QueuedConnection, Q_ARG(quint32, messageId));
+        return;
+    }
+
     m_dispatcher->requestMessageMediaData(messageId);
 }
 
+void CTelegramCore::requestMessageMediaData(quint32 messageId, QIODevice *outputDevice)
+{
+    if (m_networkThread) {
+        QMetaObject::invokeMethod(m_dispatcher, "requestMessageMediaDataStream", Qt::BlockingQueuedConnection, Q_ARG(quint32, messageId), Q_ARG(QIODevice*, outputDevice));
+        return;
+    }
+
+    m_dispatcher->requestMessageMediaDataStream(messageId, outputDevice);
+}
+
 QStringList CTelegramCore::contactList() const
 {
+    if (m_snapshot) {
+        return m_snapshot->contactList;
+    }
+
     return m_dispatcher->contactList();
 }
 
 QList<quint32> CTelegramCore::chatList() const
 {
+    if (m_snapshot) {
+        return m_snapshot->chatList;
+    }
+
     return m_dispatcher->chatList();
 }
 
 TelegramNamespace::ContactStatus CTelegramCore::contactStatus(const QString &contact) const
 {
+    if (m_snapshot) {
+        return m_snapshot->contactStatuses.value(contact, TelegramNamespace::ContactStatusUnknown);
+    }
+
     return m_dispatcher->contactStatus(contact);
 }
 
@@ -192,31 +364,65 @@ TelegramNamespace::ContactStatus CTelegramCore::contactStatus(const QString &con
 */
 quint32 CTelegramCore::contactLastOnline(const QString &contact) const
 {
-    return m_dispatcher->contactLastOnline(contact);
+    if (!m_networkThread) {
+        return m_dispatcher->contactLastOnline(contact);
+    }
+
+    quint32 result = 0;
+    QMetaObject::invokeMethod(m_dispatcher, "contactLastOnline", Qt::BlockingQueuedConnection, Q_RETURN_ARG(quint32, result), Q_ARG(QString, contact));
+    return result;
 }
 
 QString CTelegramCore::contactFirstName(const QString &phone) const
 {
-    return m_dispatcher->contactFirstName(phone);
+    if (!m_networkThread) {
+        return m_dispatcher->contactFirstName(phone);
+    }
+
+    QString result;
+    QMetaObject::invokeMethod(m_dispatcher, "contactFirstName", Qt::BlockingQueuedConnection, Q_RETURN_ARG(QString, result), Q_ARG(QString, phone));
+    return result;
 }
 
 QString CTelegramCore::contactLastName(const QString &phone) const
 {
-    return m_dispatcher->contactLastName(phone);
+    if (!m_networkThread) {
+        return m_dispatcher->contactLastName(phone);
+    }
+
+    QString result;
+    QMetaObject::invokeMethod(m_dispatcher, "contactLastName", Qt::BlockingQueuedConnection, Q_RETURN_ARG(QString, result), Q_ARG(QString, phone));
+    return result;
 }
 
 QString CTelegramCore::contactUserName(const QString &contact) const
 {
-    return m_dispatcher->contactUserName(contact);
+    if (!m_networkThread) {
+        return m_dispatcher->contactUserName(contact);
+    }
+
+    QString result;
+    QMetaObject::invokeMethod(m_dispatcher, "contactUserName", Qt::BlockingQueuedConnection, Q_RETURN_ARG(QString, result), Q_ARG(QString, contact));
+    return result;
 }
 
 QString CTelegramCore::contactAvatarToken(const QString &phone) const
 {
-    return m_dispatcher->contactAvatarToken(phone);
+    if (!m_networkThread) {
+        return m_dispatcher->contactAvatarToken(phone);
+    }
+
+    QString result;
+    QMetaObject::invokeMethod(m_dispatcher, "contactAvatarToken", Qt::BlockingQueuedConnection, Q_RETURN_ARG(QString, result), Q_ARG(QString, phone));
+    return result;
 }
 
 QString CTelegramCore::chatTitle(quint32 chatId) const
 {
+    if (m_snapshot) {
+        return m_snapshot->chatTitles.value(chatId);
+    }
+
     return m_dispatcher->chatTitle(chatId);
 }
 
@@ -227,75 +433,450 @@ qint32 CTelegramCore::localTypingRecommendedRepeatInterval()
 
 bool CTelegramCore::getChatInfo(TelegramNamespace::GroupChat *chatInfo, quint32 chatId) const
 {
-    return m_dispatcher->getChatInfo(chatInfo, chatId);
+    if (!m_networkThread) {
+        return m_dispatcher->getChatInfo(chatInfo, chatId);
+    }
+
+    bool result = false;
+    QMetaObject::invokeMethod(m_dispatcher, "getChatInfo", Qt::BlockingQueuedConnection, Q_RETURN_ARG(bool, result), Q_ARG(TelegramNamespace::GroupChat*, chatInfo), Q_ARG(quint32, chatId));
+    return result;
 }
 
 bool CTelegramCore::getChatParticipants(QStringList *participants, quint32 chatId)
 {
-    return m_dispatcher->getChatParticipants(participants, chatId);
+    if (!m_networkThread) {
+        return m_dispatcher->getChatParticipants(participants, chatId);
+    }
+
+    bool result = false;
+    QMetaObject::invokeMethod(m_dispatcher, "getChatParticipants", Qt::BlockingQueuedConnection, Q_RETURN_ARG(bool, result), Q_ARG(QStringList*, participants), Q_ARG(quint32, chatId));
+    return result;
 }
 
 void CTelegramCore::setMessageReceivingFilterFlags(quint32 flags)
 {
-    return m_dispatcher->setMessageReceivingFilterFlags(flags);
+    if (m_networkThread) {
+        QMetaObject::invokeMethod(m_dispatcher, "setMessageReceivingFilterFlags", Qt::QueuedConnection, Q_ARG(quint32, flags));
+        return;
+    }
+
+    m_dispatcher->setMessageReceivingFilterFlags(flags);
 }
 
 void CTelegramCore::setAcceptableMessageTypes(quint32 types)
 {
-    return m_dispatcher->setAcceptableMessageTypes(types);
+    if (m_networkThread) {
+        QMetaObject::invokeMethod(m_dispatcher, "setAcceptableMessageTypes", Qt::QueuedConnection, Q_ARG(quint32, types));
+        return;
+    }
+
+    m_dispatcher->setAcceptableMessageTypes(types);
 }
 
 void CTelegramCore::setAutoReconnection(bool enable)
 {
-    return m_dispatcher->setAutoReconnection(enable);
+    if (m_networkThread) {
+        QMetaObject::invokeMethod(m_dispatcher, "setAutoReconnection", Qt::QueuedConnection, Q_ARG(bool, enable));
+        return;
+    }
+
+    m_dispatcher->setAutoReconnection(enable);
 }
 
 void CTelegramCore::setPingInterval(quint32 ms)
 {
-    return m_dispatcher->setPingInterval(ms);
+    if (m_networkThread) {
+        QMetaObject::invokeMethod(m_dispatcher, "setPingInterval", Qt::QueuedConnection, Q_ARG(quint32, ms));
+        return;
+    }
+
+    m_dispatcher->setPingInterval(ms);
+}
+
+void CTelegramCore::setFileRequestWindow(int partsPerConnection)
+{
+    if (m_networkThread) {
+        QMetaObject::invokeMethod(m_dispatcher, "setFileRequestWindow", Qt::QueuedConnection, Q_ARG(int, partsPerConnection));
+        return;
+    }
+
+    m_dispatcher->setFileRequestWindow(partsPerConnection);
+}
+
+void CTelegramCore::setFileUploadWindow(int parts)
+{
+    if (m_networkThread) {
+        QMetaObject::invokeMethod(m_dispatcher, "setFileUploadWindow", Qt::QueuedConnection, Q_ARG(int, parts));
+        return;
+    }
+
+    m_dispatcher->setFileUploadWindow(parts);
+}
+
+void CTelegramCore::setMediaConnectionsPerDc(int connections)
+{
+    if (m_networkThread) {
+        QMetaObject::invokeMethod(m_dispatcher, "setMediaConnectionsPerDc", Qt::QueuedConnection, Q_ARG(int, connections));
+        return;
+    }
+
+    m_dispatcher->setMediaConnectionsPerDc(connections);
+}
+
+void CTelegramCore::setConnectionPrewarmingEnabled(bool enabled)
+{
+    if (m_networkThread) {
+        QMetaObject::invokeMethod(m_dispatcher, "setConnectionPrewarmingEnabled", Qt::QueuedConnection, Q_ARG(bool, enabled));
+        return;
+    }
+
+    m_dispatcher->setConnectionPrewarmingEnabled(enabled);
+}
+
+void CTelegramCore::setBulkRequestsLimit(int requests)
+{
+    if (m_networkThread) {
+        QMetaObject::invokeMethod(m_dispatcher, "setBulkRequestsLimit", Qt::QueuedConnection, Q_ARG(int, requests));
+        return;
+    }
+
+    m_dispatcher->setBulkRequestsLimit(requests);
+}
+
+void CTelegramCore::setFileCacheDirectory(const QString &directory)
+{
+    if (m_networkThread) {
+        QMetaObject::invokeMethod(m_dispatcher, "setFileCacheDirectory", Qt::QueuedConnection, Q_ARG(QString, directory));
+        return;
+    }
+
+    m_dispatcher->setFileCacheDirectory(directory);
+}
+
+void CTelegramCore::setFileCacheMaxSize(quint64 bytes)
+{
+    if (m_networkThread) {
+        QMetaObject::invokeMethod(m_dispatcher, "setFileCacheMaxSize", Qt::QueuedConnection, Q_ARG(quint64, bytes));
+        return;
+    }
+
+    m_dispatcher->setFileCacheMaxSize(bytes);
+}
+
+void CTelegramCore::setMessageCacheCapacity(int messages)
+{
+    if (m_networkThread) {
+        QMetaObject::invokeMethod(m_dispatcher, "setMessageCacheCapacity", Qt::QueuedConnection, Q_ARG(int, messages));
+        return;
+    }
+
+    m_dispatcher->setMessageCacheCapacity(messages);
+}
+
+quint64 CTelegramCore::messageCacheMemoryUsage() const
+{
+    if (!m_networkThread) {
+        return m_dispatcher->messageCacheMemoryUsage();
+    }
+
+    quint64 result = 0;
+    QMetaObject::invokeMethod(m_dispatcher, "messageCacheMemoryUsage", Qt::BlockingQueuedConnection, Q_RETURN_ARG(quint64, result));
+    return result;
+}
+
+quint64 CTelegramCore::memoryUsage() const
+{
+    if (!m_networkThread) {
+        return sizeof(CTelegramCore) + m_dispatcher->memoryUsage();
+    }
+
+    quint64 result = 0;
+    QMetaObject::invokeMethod(m_dispatcher, "memoryUsage", Qt::BlockingQueuedConnection, Q_RETURN_ARG(quint64, result));
+    return sizeof(CTelegramCore) + result;
+}
+
+void CTelegramCore::setMessageStoreDirectory(const QString &directory)
+{
+    if (m_networkThread) {
+        QMetaObject::invokeMethod(m_dispatcher, "setMessageStoreDirectory", Qt::QueuedConnection, Q_ARG(QString, directory));
+        return;
+    }
+
+    m_dispatcher->setMessageStoreDirectory(directory);
+}
+
+void CTelegramCore::setMessageBatchingEnabled(bool enabled)
+{
+    if (m_networkThread) {
+        QMetaObject::invokeMethod(m_dispatcher, "setMessageBatchingEnabled", Qt::QueuedConnection, Q_ARG(bool, enabled));
+        return;
+    }
+
+    m_dispatcher->setMessageBatchingEnabled(enabled);
+}
+
+void CTelegramCore::setDifferenceChunkSize(int messages)
+{
+    if (m_networkThread) {
+        QMetaObject::invokeMethod(m_dispatcher, "setDifferenceChunkSize", Qt::QueuedConnection, Q_ARG(int, messages));
+        return;
+    }
+
+    m_dispatcher->setDifferenceChunkSize(messages);
+}
+
+void CTelegramCore::setSendWindow(int requests)
+{
+    if (m_networkThread) {
+        QMetaObject::invokeMethod(m_dispatcher, "setSendWindow", Qt::QueuedConnection, Q_ARG(int, requests));
+        return;
+    }
+
+    m_dispatcher->setSendWindow(requests);
+}
+
+QList<TelegramNamespace::Message> CTelegramCore::storedMessages(const TelegramNamespace::Peer &peer, quint32 beforeMessageId, int limit)
+{
+    if (!m_networkThread) {
+        return m_dispatcher->storedMessages(peer, beforeMessageId, limit);
+    }
+
+    QList<TelegramNamespace::Message> result;
+    QMetaObject::invokeMethod(m_dispatcher, "storedMessages", Qt::BlockingQueuedConnection, QReturnArgument<QList<TelegramNamespace::Message> >("QList<TelegramNamespace::Message>", result), Q_ARG(TelegramNamespace::Peer, peer), Q_ARG(quint32, beforeMessageId), Q_ARG(int, limit));
+    return result;
+}
+
+QList<TelegramNamespace::Message> CTelegramCore::storedMessagesByDate(const TelegramNamespace::Peer &peer, quint32 fromTimestamp, quint32 toTimestamp, int limit)
+{
+    if (!m_networkThread) {
+        return m_dispatcher->storedMessagesByDate(peer, fromTimestamp, toTimestamp, limit);
+    }
+
+    QList<TelegramNamespace::Message> result;
+    QMetaObject::invokeMethod(m_dispatcher, "storedMessagesByDate", Qt::BlockingQueuedConnection, QReturnArgument<QList<TelegramNamespace::Message> >("QList<TelegramNamespace::Message>", result), Q_ARG(TelegramNamespace::Peer, peer), Q_ARG(quint32, fromTimestamp), Q_ARG(quint32, toTimestamp), Q_ARG(int, limit));
+    return result;
+}
+
+bool CTelegramCore::getStoredMessage(TelegramNamespace::Message *message, quint32 messageId)
+{
+    if (!m_networkThread) {
+        return m_dispatcher->getStoredMessage(message, messageId);
+    }
+
+    bool result = false;
+    QMetaObject::invokeMethod(m_dispatcher, "getStoredMessage", Qt::BlockingQueuedConnection, Q_RETURN_ARG(bool, result), Q_ARG(TelegramNamespace::Message*, message), Q_ARG(quint32, messageId));
+    return result;
 }
 
 QString CTelegramCore::selfPhone() const
 {
+    if (m_snapshot) {
+        return m_snapshot->selfPhone;
+    }
+
     return m_dispatcher->selfPhone();
 }
 
 quint64 CTelegramCore::sendMessage(const QString &identifier, const QString &message)
 {
+    if (m_networkThread) {
+        // The random id is generated here, so the caller is not blocked by the network thread.
+        quint64 randomMessageId;
+        Utils::randomBytes(&randomMessageId);
+        QMetaObject::invokeMethod(m_dispatcher, "sendMessage", Qt::QueuedConnection, Q_ARG(QString, identifier), Q_ARG(QString, message), Q_ARG(quint64, randomMessageId));
+        return randomMessageId;
+    }
+
     return m_dispatcher->sendMessage(identifier, message);
 }
 
+quint64 CTelegramCore::sendMedia(const QString &identifier, const QString &fileName, TelegramNamespace::MessageType type, const QString &mimeType)
+{
+    if (!m_networkThread) {
+        return m_dispatcher->sendMedia(identifier, fileName, type, mimeType);
+    }
+
+    quint64 result = 0;
+    QMetaObject::invokeMethod(m_dispatcher, "sendMedia", Qt::BlockingQueuedConnection, Q_RETURN_ARG(quint64, result), Q_ARG(QString, identifier), Q_ARG(QString, fileName), Q_ARG(TelegramNamespace::MessageType, type), Q_ARG(QString, mimeType));
+    return result;
+}
+
 void CTelegramCore::setTyping(const QString &contact, bool typingStatus)
 {
+    if (m_networkThread) {
+        QMetaObject::invokeMethod(m_dispatcher, "setTyping", Qt::QueuedConnection, Q_ARG(QString, contact), Q_ARG(bool, typingStatus));
+        return;
+    }
+
     m_dispatcher->setTyping(contact, typingStatus);
 }
 
 void CTelegramCore::setMessageRead(const QString &contact, quint32 messageId)
 {
+    if (m_networkThread) {
+        QMetaObject::invokeMethod(m_dispatcher, "setMessageRead", Qt::QueuedConnection, Q_ARG(QString, contact), Q_ARG(quint32, messageId));
+        return;
+    }
+
     m_dispatcher->setMessageRead(contact, messageId);
 }
 
+quint64 CTelegramCore::sendMessage(const TelegramNamespace::Peer &peer, const QString &message)
+{
+    if (m_networkThread) {
+        quint64 randomMessageId;
+        Utils::randomBytes(&randomMessageId);
+        QMetaObject::invokeMethod(m_dispatcher, "sendMessage", Qt::QueuedConnection, Q_ARG(TelegramNamespace::Peer, peer), Q_ARG(QString, message), Q_ARG(quint64, randomMessageId));
+        return randomMessageId;
+    }
+
+    return m_dispatcher->sendMessage(peer, message);
+}
+
+QList<quint64> CTelegramCore::queueMessages(const QList<TelegramNamespace::Message> &messages)
+{
+    if (!m_networkThread) {
+        return m_dispatcher->queueMessages(messages);
+    }
+
+    QList<quint64> result;
+    QMetaObject::invokeMethod(m_dispatcher, "queueMessages", Qt::BlockingQueuedConnection, QReturnArgument<QList<quint64> >("QList<quint64>", result), QArgument<QList<TelegramNamespace::Message> >("QList<TelegramNamespace::Message>", messages));
+    return result;
+}
+
+void CTelegramCore::setTyping(const TelegramNamespace::Peer &peer, bool typingStatus)
+{
+    if (m_networkThread) {
+        QMetaObject::invokeMethod(m_dispatcher, "setTyping", Qt::QueuedConnection, Q_ARG(TelegramNamespace::Peer, peer), Q_ARG(bool, typingStatus));
+        return;
+    }
+
+    m_dispatcher->setTyping(peer, typingStatus);
+}
+
+void CTelegramCore::setMessageRead(const TelegramNamespace::Peer &peer, quint32 messageId)
+{
+    if (m_networkThread) {
+        QMetaObject::invokeMethod(m_dispatcher, "setMessageRead", Qt::QueuedConnection, Q_ARG(TelegramNamespace::Peer, peer), Q_ARG(quint32, messageId));
+        return;
+    }
+
+    m_dispatcher->setMessageRead(peer, messageId);
+}
+
+TelegramNamespace::Peer CTelegramCore::identifierToPeer(const QString &identifier) const
+{
+    if (!m_networkThread) {
+        return m_dispatcher->identifierToPeer(identifier);
+    }
+
+    TelegramNamespace::Peer result;
+    QMetaObject::invokeMethod(m_dispatcher, "identifierToPeer", Qt::BlockingQueuedConnection, Q_RETURN_ARG(TelegramNamespace::Peer, result), Q_ARG(QString, identifier));
+    return result;
+}
+
+QString CTelegramCore::peerToIdentifier(const TelegramNamespace::Peer &peer) const
+{
+    if (m_snapshot) {
+        if (peer.type == TelegramNamespace::Peer::Chat) {
+            return QString(QLatin1String("chat%1")).arg(peer.id);
+        }
+
+        const QString phone = m_snapshot->userPhones.value(peer.id);
+
+        if (!phone.isEmpty()) {
+            return phone;
+        }
+
+        return QString(QLatin1String("user%1")).arg(peer.id);
+    }
+
+    // The snapshot exists in the network thread mode, so the dispatcher is in this thread here.
+    return m_dispatcher->peerToIdentifier(peer);
+}
+
+void CTelegramCore::whenMessageReceived(const TelegramNamespace::Peer &peer, quint32 fromUserId, const QString &message,
+                                        TelegramNamespace::MessageType type, quint32 messageId, quint32 flags, quint32 timestamp)
+{
+    if (peer.type == TelegramNamespace::Peer::Chat) {
+        if (receivers(SIGNAL(chatMessageReceived(quint32,QString,QString,TelegramNamespace::MessageType,quint32,quint32,quint32))) > 0) {
+            emit chatMessageReceived(peer.id, peerToIdentifier(TelegramNamespace::Peer(fromUserId)), message, type, messageId, flags, timestamp);
+        }
+    } else {
+        if (receivers(SIGNAL(messageReceived(QString,QString,TelegramNamespace::MessageType,quint32,quint32,quint32))) > 0) {
+            emit messageReceived(peerToIdentifier(peer), message, type, messageId, flags, timestamp);
+        }
+    }
+}
+
+void CTelegramCore::whenTypingStatusChanged(const TelegramNamespace::Peer &peer, quint32 userId, bool typingStatus)
+{
+    if (peer.type == TelegramNamespace::Peer::Chat) {
+        if (receivers(SIGNAL(contactChatTypingStatusChanged(quint32,QString,bool))) > 0) {
+            emit contactChatTypingStatusChanged(peer.id, peerToIdentifier(TelegramNamespace::Peer(userId)), typingStatus);
+        }
+    } else {
+        if (receivers(SIGNAL(contactTypingStatusChanged(QString,bool))) > 0) {
+            emit contactTypingStatusChanged(peerToIdentifier(peer), typingStatus);
+        }
+    }
+}
+
+void CTelegramCore::whenSentMessageStatusChanged(const TelegramNamespace::Peer &peer, quint64 messageId, TelegramNamespace::MessageDeliveryStatus status)
+{
+    if (receivers(SIGNAL(sentMessageStatusChanged(QString,quint64,TelegramNamespace::MessageDeliveryStatus))) > 0) {
+        emit sentMessageStatusChanged(peerToIdentifier(peer), messageId, status);
+    }
+}
+
 void CTelegramCore::setOnlineStatus(bool onlineStatus)
 {
+    if (m_networkThread) {
+        QMetaObject::invokeMethod(m_dispatcher, "setOnlineStatus", Qt::QueuedConnection, Q_ARG(bool, onlineStatus));
+        return;
+    }
+
     m_dispatcher->setOnlineStatus(onlineStatus);
 }
 
 void CTelegramCore::checkUserName(const QString &userName)
 {
+    if (m_networkThread) {
+        QMetaObject::invokeMethod(m_dispatcher, "checkUserName", Qt::QueuedConnection, Q_ARG(QString, userName));
+        return;
+    }
+
     m_dispatcher->checkUserName(userName);
 }
 
 void CTelegramCore::setUserName(const QString &newUserName)
 {
+    if (m_networkThread) {
+        QMetaObject::invokeMethod(m_dispatcher, "setUserName", Qt::QueuedConnection, Q_ARG(QString, newUserName));
+        return;
+    }
+
     m_dispatcher->setUserName(newUserName);
 }
 
 quint32 CTelegramCore::createChat(const QStringList &phones, const QString &title)
 {
-    return m_dispatcher->createChat(phones, title);
+    if (!m_networkThread) {
+        return m_dispatcher->createChat(phones, title);
+    }
+
+    quint32 result = 0;
+    QMetaObject::invokeMethod(m_dispatcher, "createChat", Qt::BlockingQueuedConnection, Q_RETURN_ARG(quint32, result), Q_ARG(QStringList, phones), Q_ARG(QString, title));
+    return result;
 }
 
 bool CTelegramCore::addChatUser(quint32 chatId, const QString &contact, quint32 forwardMessages)
 {
-    return m_dispatcher->addChatUser(chatId, contact, forwardMessages);
+    if (!m_networkThread) {
+        return m_dispatcher->addChatUser(chatId, contact, forwardMessages);
+    }
+
+    bool result = false;
+    QMetaObject::invokeMethod(m_dispatcher, "addChatUser", Qt::BlockingQueuedConnection, Q_RETURN_ARG(bool, result), Q_ARG(quint32, chatId), Q_ARG(QString, contact), Q_ARG(quint32, forwardMessages));
+    return result;
 }
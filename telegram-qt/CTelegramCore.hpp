@@ -21,8 +21,14 @@
 #include <QVector>
 #include <QStringList>
 
+QT_BEGIN_NAMESPACE
+class QIODevice;
+class QThread;
+QT_END_NAMESPACE
+
 class CAppInformation;
 class CTelegramDispatcher;
+class DispatcherSnapshot;
 
 class TELEGRAMQT_EXPORT CTelegramCore : public QObject
 {
@@ -34,7 +40,16 @@ public:
     inline const CAppInformation *appInfo() { return m_appInfo; }
     void setAppInformation(const CAppInformation *newAppInfo);
 
-    QByteArray connectionSecretInfo() const;
+    // Runs the network stack (connections, protocol processing and the updates handling) in an internal thread,
+    // so a busy owner thread does not delay pings and acknowledgments. Should be enabled before the connection init
+    // and can not be disabled then. Signals are queued to the owner thread. connectionState(), selfPhone(), contactList(),
+    // chatList(), contactStatus() and chatTitle() return a snapshot without waiting for the network thread; the other
+    // methods with a result wait for it. Output devices of the media requests are written in the network thread.
+    bool enableNetworkThread();
+    inline bool isNetworkThreadEnabled() const { return m_networkThread; }
+
+    QByteArray connectionSecretInfo() const; // Auth data of all signed in DCs. Secrets of the older versions are accepted by restoreConnection().
+    QByteArray sessionSnapshot() const; // Users, contacts and chats, to be passed to restoreSessionSnapshot()
 
     Q_INVOKABLE TelegramNamespace::ConnectionState connectionState() const;
     Q_INVOKABLE QString selfPhone() const;
@@ -55,6 +70,20 @@ public:
     bool getChatInfo(TelegramNamespace::GroupChat *chatInfo, quint32 chatId) const;
     bool getChatParticipants(QStringList *participants, quint32 chatId);
 
+    quint64 messageCacheMemoryUsage() const; // Approximate, in bytes
+    Q_INVOKABLE quint64 memoryUsage() const; // Approximate memory used by the account (including the message cache), in bytes
+
+    // Local history from the message store (see setMessageStoreDirectory()). No network requests are made.
+    // Messages with id less than beforeMessageId (or the latest ones for zero), from the newest to the oldest.
+    QList<TelegramNamespace::Message> storedMessages(const TelegramNamespace::Peer &peer, quint32 beforeMessageId = 0, int limit = 50);
+    // Messages from the time interval (bounds are included), from the oldest to the newest.
+    QList<TelegramNamespace::Message> storedMessagesByDate(const TelegramNamespace::Peer &peer, quint32 fromTimestamp, quint32 toTimestamp, int limit = 50);
+    bool getStoredMessage(TelegramNamespace::Message *message, quint32 messageId);
+
+    // Conversion between string identifiers and numeric peers. Resolve an identifier once and use the peer afterwards.
+    Q_INVOKABLE TelegramNamespace::Peer identifierToPeer(const QString &identifier) const;
+    Q_INVOKABLE QString peerToIdentifier(const TelegramNamespace::Peer &peer) const;
+
 public Q_SLOTS:
     void setMessageReceivingFilterFlags(quint32 flags); // TelegramNamespace::MessageFlags. Messages with at least one of the passed flags will be filtered out.
     void setAcceptableMessageTypes(quint32 types); // TelegramNamespace::MessageType
@@ -63,8 +92,52 @@ public Q_SLOTS:
     // By default, the app would ping server every 15 000 ms and instruct the server to close connection after 10 000 more ms. Use 0 to disable ping.
     void setPingInterval(quint32 ms);
 
+    // Files are downloaded by parts of 128 KB. This is the max number of parts requested at once per connection to a DC (4 by default).
+    void setFileRequestWindow(int partsPerConnection);
+
+    // Max number of file parts uploaded at once per connection (4 by default).
+    void setFileUploadWindow(int parts);
+
+    // Number of extra connections per DC for the file transfers (0 by default). They share the auth key of the main
+    // connection, have own sessions and take all the file parts requests and uploads, so the API traffic is not blocked by them.
+    void setMediaConnectionsPerDc(int connections);
+
+    // Connect and authorize in advance on the DCs of the known avatars and media (disabled by default),
+    // so the first file request from a DC does not wait for the connection and the authorization import.
+    void setConnectionPrewarmingEnabled(bool enabled);
+
+    // File parts requests and uploads and contacts imports are bulk requests. Their number in flight can be limited per connection
+    // (the file windows are the only limit by default, zero restores it, negative values are ignored). One is sent at once
+    // while a message, typing or read status request is in flight, so they do not delay the interactive ones.
+    void setBulkRequestsLimit(int requests);
+
+    // Downloaded avatars and media are cached in the directory (disabled by default) and requested again from there.
+    // Least recently used files are removed to keep the cache size under the limit (256 MB by default).
+    void setFileCacheDirectory(const QString &directory);
+    void setFileCacheMaxSize(quint64 bytes);
+
+    // Sent messages (for delivery status) and media messages (for media data requests) are remembered up to the capacity
+    // each (10 000 by default, 0 means no limit). Media messages beyond the capacity are moved to the file cache, if it is enabled.
+    void setMessageCacheCapacity(int messages);
+
+    // Received messages are appended to the message store in the directory (disabled by default).
+    // Use a separate directory for each account.
+    void setMessageStoreDirectory(const QString &directory);
+
+    // With batching enabled, received messages are reported by messagesReceived() instead of the per-message signals:
+    // messages from the updates difference (received after an offline period) once per applied chunk,
+    // messages from the live updates once per event loop iteration (which covers all packets decoded in it).
+    void setMessageBatchingEnabled(bool enabled);
+
+    // Max number of the difference messages applied per event loop iteration (1 000 by default).
+    void setDifferenceChunkSize(int messages);
+
+    // Max number of queueMessages() send requests in flight (10 by default).
+    void setSendWindow(int requests);
+
     bool initConnection(const QString &address, quint32 port);
     bool restoreConnection(const QByteArray &secret);
+    bool restoreSessionSnapshot(const QByteArray &snapshot); // Call it right after restoreConnection()
     void closeConnection();
     bool logOut();
 
@@ -82,11 +155,30 @@ public Q_SLOTS:
     void requestContactAvatar(const QString &contact);
     void requestMessageMediaData(quint32 messageId);
 
-    quint64 sendMessage(const QString &identifier, const QString &message); // Message id is random number
+    // Streaming variant: the data is not collected. It is written to outputDevice (if not null) and is emitted
+    // by messageMediaDataPartReceived() in order, as soon as it arrives. Then messageMediaDataReceived() is emitted with empty data.
+    void requestMessageMediaData(quint32 messageId, QIODevice *outputDevice);
+
+    // Message id is random number. In the network thread mode the message is sent asynchronously
+    // and a failure is reported by sentMessageStatusChanged().
+    quint64 sendMessage(const QString &identifier, const QString &message);
+
+    // The file is uploaded and then sent as a photo, audio, video or document (any other type). Message id is random number.
+    quint64 sendMedia(const QString &identifier, const QString &fileName, TelegramNamespace::MessageType type, const QString &mimeType = QString());
     /* Typing status is valid for 6 seconds. It is recommended to repeat typing status with localTypingRecommendedRepeatInterval() interval. */
     void setTyping(const QString &contact, bool typingStatus);
     void setMessageRead(const QString &contact, quint32 messageId);
 
+    // Peer variants of the methods above. The peer is not parsed or looked up by string.
+    quint64 sendMessage(const TelegramNamespace::Peer &peer, const QString &message); // Message id is random number
+
+    // Bulk send: the peer and text of each message are used. Returns random message ids (zero for the rejected messages),
+    // the outcomes are reported by sentMessageStatusChanged(). Messages with the same text to consecutive users are sent
+    // by a single broadcast request. Flood waits reported by the server are waited out and the messages are resent.
+    QList<quint64> queueMessages(const QList<TelegramNamespace::Message> &messages);
+    void setTyping(const TelegramNamespace::Peer &peer, bool typingStatus);
+    void setMessageRead(const TelegramNamespace::Peer &peer, quint32 messageId);
+
     // Set visible (not actual) online status.
     void setOnlineStatus(bool onlineStatus);
 
@@ -114,6 +206,8 @@ Q_SIGNALS:
 
     void avatarReceived(const QString &contact, const QByteArray &data, const QString &mimeType, const QString &avatarToken);
     void messageMediaDataReceived(const QString &contact, quint32 messageId, const QByteArray &data, const QString &mimeType, TelegramNamespace::MessageType type);
+    void messageMediaDataProgress(quint32 messageId, quint32 bytesReceived, quint32 bytesTotal); // Total is zero, if it is not known yet
+    void messageMediaDataPartReceived(quint32 messageId, quint32 offset, const QByteArray &data);
 
     void messageReceived(const QString &contact, const QString &message, TelegramNamespace::MessageType type, quint32 messageId, quint32 flags, quint32 timestamp);
     void chatMessageReceived(quint32 chatId, const QString &contact, const QString &message, TelegramNamespace::MessageType type, quint32 messageId, quint32 flags, quint32 timestamp);
@@ -124,6 +218,15 @@ Q_SIGNALS:
 
     void sentMessageStatusChanged(const QString &contact, quint64 messageId, TelegramNamespace::MessageDeliveryStatus status); // Message id is random number
 
+    // Peer variants of the signals above. The peer is the dialog: the other user or the chat.
+    // String signals are built only if they have receivers, so prefer these ones on the hot path.
+    void peerMessageReceived(const TelegramNamespace::Peer &peer, quint32 fromUserId, const QString &message, TelegramNamespace::MessageType type, quint32 messageId, quint32 flags, quint32 timestamp);
+    void messagesReceived(const QVector<TelegramNamespace::Message> &messages); // See setMessageBatchingEnabled()
+    void peerTypingStatusChanged(const TelegramNamespace::Peer &peer, quint32 userId, bool typingStatus);
+    void peerSentMessageStatusChanged(const TelegramNamespace::Peer &peer, quint64 messageId, TelegramNamespace::MessageDeliveryStatus status); // Message id is random number
+
+    void mediaUploadProgress(quint64 messageId, quint32 bytesUploaded, quint32 bytesTotal); // Message id is random number
+
     void chatAdded(quint32 publichChatId);
     void chatChanged(quint32 publichChatId);
 
@@ -131,11 +234,24 @@ Q_SIGNALS:
 
     void userNameStatusUpdated(const QString &userName, TelegramNamespace::AccountUserNameStatus status);
 
+private Q_SLOTS:
+    void whenMessageReceived(const TelegramNamespace::Peer &peer, quint32 fromUserId, const QString &message, TelegramNamespace::MessageType type, quint32 messageId, quint32 flags, quint32 timestamp);
+    void whenTypingStatusChanged(const TelegramNamespace::Peer &peer, quint32 userId, bool typingStatus);
+    void whenSentMessageStatusChanged(const TelegramNamespace::Peer &peer, quint64 messageId, TelegramNamespace::MessageDeliveryStatus status);
+
+protected:
+    bool event(QEvent *event);
+
 private:
+    friend class CTelegramSessionHost;
+
     CTelegramDispatcher *m_dispatcher;
 
     const CAppInformation *m_appInfo;
 
+    QThread *m_networkThread;
+    DispatcherSnapshot *m_snapshot; // Getters data in the network thread mode
+
 };
 
 inline void CTelegramCore::addContact(const QString &phoneNumber)
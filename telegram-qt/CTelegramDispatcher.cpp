@@ -14,10 +14,16 @@
 #include "CTelegramDispatcher.hpp"
 
 #include "TelegramNamespace.hpp"
+#include "CSessionSharedData.hpp"
+#include "CDcEndpointProber.hpp"
 #include "CTelegramConnection.hpp"
 #include "CTelegramStream.hpp"
 #include "Utils.hpp"
 
+#include <QCoreApplication>
+#include <QFile>
+#include <QFileInfo>
+#include <QSet>
 #include <QTimer>
 
 #include <QDebug>
@@ -75,14 +81,36 @@ static QStringList maskPhoneNumberList(const QStringList &list)
     return result;
 }
 
-const quint32 secretFormatVersion = 3;
+const quint32 secretFormatVersion = 4;
 const int s_userTypingActionPeriod = 6000; // 6 sec
 const int s_localTypingDuration = 5000; // 5 sec
 const int s_localTypingRecommendedRepeatInterval = 400; // (s_userTypingActionPeriod - s_localTypingDuration) / 2. Minus 100 ms for insurance.
 
-#if QT_VERSION < 0x050000
-const int s_timerMaxInterval = 500; // 0.5 sec. Needed to limit max possible typing time deviation in Qt4 by this value.
-#endif
+const quint32 s_fileRequestPartSize = 128 * 1024; // Divides 1 MB, as required by upload.getFile
+const int s_fileRequestDefaultWindow = 4;
+const int s_fileRequestMaxFailures = 3;
+
+const quint32 s_fileUploadPartSize = 128 * 1024; // Divides 512 KB, as required by upload.saveFilePart
+const quint32 s_fileUploadBigPartSize = 512 * 1024;
+const quint32 s_fileUploadBigFileSize = 10 * 1024 * 1024; // Bigger files are uploaded by upload.saveBigFilePart
+const quint32 s_fileUploadMaxParts = 3000;
+const int s_fileUploadDefaultWindow = 4;
+const int s_fileUploadMaxFailures = 3;
+
+const int s_messageCacheDefaultCapacity = 10000; // Sent and media messages
+const quint32 s_mediaMessageFormatVersion = 1;
+const quint32 s_sessionSnapshotFormatVersion = 1;
+const int s_differenceDefaultChunkSize = 1000; // Messages applied per event loop iteration
+const int s_updatesGapHoldTime = 500; // ms to wait for the missing updates before the difference request
+
+const int s_mediaConnectionRetryDelay = 5000; // ms before a lost media connection is opened again
+const int s_endpointProbeTimeout = 5000; // ms
+
+const int s_sendDefaultWindow = 10;
+const int s_sendMaxFloodWaits = 3; // A message is failed after so many flood waits
+const int s_broadcastMaxContacts = 50;
+const qreal s_sendRate = 5; // Requests per second per method, reduced on flood waits
+const int s_sendBurst = 10;
 
 enum TelegramMessageFlags {
     TelegramMessageFlagNone   = 0x0,
@@ -105,43 +133,118 @@ FileRequestDescriptor FileRequestDescriptor::avatarRequest(const TLUser *user)
     return result;
 }
 
-FileRequestDescriptor FileRequestDescriptor::messageMediaDataRequest(const TLMessage &message)
+MediaMessageDescriptor::MediaMessageDescriptor() :
+    m_messageId(0),
+    m_contactUserId(0),
+    m_type(TelegramNamespace::MessageTypeUnsupported),
+    m_dcId(0),
+    m_size(0)
 {
-    const TLMessageMedia &media = message.media;
+}
 
-    FileRequestDescriptor result;
-    result.m_type = MessageMediaData;
-    result.m_messageId = message.id;
+MediaMessageDescriptor::MediaMessageDescriptor(const TLMessage &message, quint32 contactUserId, TelegramNamespace::MessageType type) :
+    m_messageId(message.id),
+    m_contactUserId(contactUserId),
+    m_type(type),
+    m_dcId(0),
+    m_size(0)
+{
+    const TLMessageMedia &media = message.media;
 
     switch (media.tlType) {
     case TLValue::MessageMediaPhoto:
         if (media.photo.sizes.isEmpty()) {
-            return FileRequestDescriptor();
+            break;
         }
-        result.setupLocation(media.photo.sizes.last().location);
+        m_dcId = media.photo.sizes.last().location.dcId;
+        m_inputLocation.tlType = TLValue::InputFileLocation;
+        m_inputLocation.volumeId = media.photo.sizes.last().location.volumeId;
+        m_inputLocation.localId = media.photo.sizes.last().location.localId;
+        m_inputLocation.secret = media.photo.sizes.last().location.secret;
+        m_size = media.photo.sizes.last().size;
         break;
     case TLValue::MessageMediaAudio:
-        result.m_dcId = media.audio.dcId;
-        result.m_inputLocation.tlType = TLValue::InputAudioFileLocation;
-        result.m_inputLocation.id = media.audio.id;
-        result.m_inputLocation.accessHash = media.audio.accessHash;
+        m_dcId = media.audio.dcId;
+        m_inputLocation.tlType = TLValue::InputAudioFileLocation;
+        m_inputLocation.id = media.audio.id;
+        m_inputLocation.accessHash = media.audio.accessHash;
+        m_size = media.audio.size;
         break;
     case TLValue::MessageMediaVideo:
-        result.m_dcId = media.video.dcId;
-        result.m_inputLocation.tlType = TLValue::InputVideoFileLocation;
-        result.m_inputLocation.id = media.video.id;
-        result.m_inputLocation.accessHash = media.video.accessHash;
+        m_dcId = media.video.dcId;
+        m_inputLocation.tlType = TLValue::InputVideoFileLocation;
+        m_inputLocation.id = media.video.id;
+        m_inputLocation.accessHash = media.video.accessHash;
+        m_size = media.video.size;
         break;
     case TLValue::MessageMediaDocument:
-        result.m_dcId = media.document.dcId;
-        result.m_inputLocation.tlType = TLValue::InputDocumentFileLocation;
-        result.m_inputLocation.id = media.document.id;
-        result.m_inputLocation.accessHash = media.document.accessHash;
+        m_dcId = media.document.dcId;
+        m_inputLocation.tlType = TLValue::InputDocumentFileLocation;
+        m_inputLocation.id = media.document.id;
+        m_inputLocation.accessHash = media.document.accessHash;
+        m_size = media.document.size;
         break;
     default:
+        break;
+    }
+}
+
+QByteArray MediaMessageDescriptor::toByteArray() const
+{
+    QByteArray output;
+    CTelegramStream outputStream(&output, /* write */ true);
+
+    outputStream << s_mediaMessageFormatVersion;
+    outputStream << m_messageId;
+    outputStream << m_contactUserId;
+    outputStream << quint32(m_type);
+    outputStream << m_dcId;
+    outputStream << m_inputLocation;
+    outputStream << m_size;
+
+    return output;
+}
+
+MediaMessageDescriptor MediaMessageDescriptor::fromByteArray(const QByteArray &data)
+{
+    CTelegramStream inputStream(data);
+
+    quint32 format = 0;
+    inputStream >> format;
+
+    if (format != s_mediaMessageFormatVersion) {
+        return MediaMessageDescriptor();
+    }
+
+    MediaMessageDescriptor result;
+    quint32 type = 0;
+
+    inputStream >> result.m_messageId;
+    inputStream >> result.m_contactUserId;
+    inputStream >> type;
+    inputStream >> result.m_dcId;
+    inputStream >> result.m_inputLocation;
+    inputStream >> result.m_size;
+
+    result.m_type = static_cast<TelegramNamespace::MessageType>(type);
+
+    return result;
+}
+
+FileRequestDescriptor FileRequestDescriptor::messageMediaDataRequest(const MediaMessageDescriptor &media)
+{
+    if (!media.isValid()) {
         return FileRequestDescriptor();
     }
 
+    FileRequestDescriptor result;
+    result.m_type = MessageMediaData;
+    result.m_messageId = media.messageId();
+    result.m_dcId = media.dcId();
+    result.m_inputLocation = media.inputLocation();
+    result.m_size = media.size();
+    result.m_sizeKnown = media.size() != 0; // Zero is an unknown size here
+
     return result;
 }
 
@@ -156,15 +259,345 @@ void FileRequestDescriptor::setupLocation(const TLFileLocation &fileLocation)
 }
 
 FileRequestDescriptor::FileRequestDescriptor() :
-    m_type(Invalid)
+    m_type(Invalid),
+    m_userId(0),
+    m_messageId(0),
+    m_dcId(0),
+    m_size(0),
+    m_sizeKnown(false),
+    m_nextOffset(0),
+    m_receivedSize(0),
+    m_failuresCount(0),
+    m_streaming(false)
+{
+
+}
+
+void FileRequestDescriptor::setStreaming(QIODevice *outputDevice)
+{
+    m_streaming = true;
+    m_outputDevice = outputDevice;
+}
+
+QByteArray FileRequestDescriptor::takeData()
+{
+    const QByteArray data = m_data;
+    m_data.clear();
+    return data;
+}
+
+void FileRequestDescriptor::setCachedFile(TLValue fileType, quint32 size, const QByteArray &data)
+{
+    m_fileType = fileType;
+    m_size = size;
+    m_sizeKnown = true;
+    m_receivedSize = size;
+    m_data = data;
+}
+
+bool FileRequestDescriptor::isFinished() const
+{
+    return m_sizeKnown && (m_receivedSize >= m_size);
+}
+
+bool FileRequestDescriptor::takeNextPartOffset(quint32 *offset)
+{
+    quint32 nextOffset = m_nextOffset;
+
+    while (m_partsInFlight.contains(nextOffset) || m_pendingParts.contains(nextOffset)) {
+        nextOffset += s_fileRequestPartSize;
+    }
+
+    if (m_sizeKnown && (nextOffset >= m_size)) {
+        return false;
+    }
+
+    // If the size is not known, then request parts one by one until the server returns a short one,
+    // so no part is requested behind the end of file.
+    if (!m_sizeKnown && !m_partsInFlight.isEmpty()) {
+        return false;
+    }
+
+    m_nextOffset = nextOffset + s_fileRequestPartSize;
+    m_partsInFlight.append(nextOffset);
+    *offset = nextOffset;
+
+    return true;
+}
+
+// Returns true if the contiguous data grew.
+bool FileRequestDescriptor::setPartReceived(quint32 offset, const TLUploadFile &part)
+{
+    m_partsInFlight.removeOne(offset);
+
+    if ((offset < m_receivedSize) || m_pendingParts.contains(offset)) {
+        // The part was requested again after reconnection and the server answered both requests.
+        return false;
+    }
+
+    if (offset == 0) {
+        m_fileType = part.type.tlType;
+    }
+
+    if (quint32(part.bytes.size()) < s_fileRequestPartSize) {
+        // Parts behind the end of file are empty, so the least end is the real one.
+        const quint32 partEnd = offset + part.bytes.size();
+
+        if (!m_sizeKnown || (partEnd < m_size)) {
+            m_size = partEnd;
+            m_sizeKnown = true;
+        }
+    }
+
+    if (offset != m_receivedSize) {
+        if (!part.bytes.isEmpty()) {
+            m_pendingParts.insert(offset, part.bytes);
+        }
+        return false;
+    }
+
+    if (m_data.isEmpty()) {
+        m_data = part.bytes; // Shared, not copied
+
+        if (!m_streaming && m_size) {
+            m_data.reserve(m_size);
+        }
+    } else {
+        m_data.append(part.bytes);
+    }
+
+    m_receivedSize += part.bytes.size();
+
+    while (m_pendingParts.contains(m_receivedSize)) {
+        const QByteArray data = m_pendingParts.take(m_receivedSize);
+        m_data.append(data);
+        m_receivedSize += data.size();
+    }
+
+    return true;
+}
+
+void FileRequestDescriptor::setPartFailed(quint32 offset)
+{
+    m_partsInFlight.removeOne(offset);
+
+    if (m_sizeKnown && (offset >= m_size)) {
+        // The part is behind the end of file, found out by a short part.
+        return;
+    }
+
+    ++m_failuresCount;
+
+    if (offset < m_nextOffset) {
+        m_nextOffset = offset;
+    }
+}
+
+void FileRequestDescriptor::resetPart(quint32 offset)
+{
+    if (!m_partsInFlight.removeOne(offset)) {
+        return;
+    }
+
+    if (offset < m_nextOffset) {
+        m_nextOffset = offset;
+    }
+}
+
+void FileRequestDescriptor::resetPartsInFlight()
+{
+    m_partsInFlight.clear();
+    m_nextOffset = m_receivedSize;
+}
+
+FileUploadDescriptor::FileUploadDescriptor(const QString &fileName, const TLInputPeer &inputPeer, const TelegramNamespace::Peer &peer,
+                                           TelegramNamespace::MessageType type, const QString &mimeType) :
+    m_file(fileName),
+    m_mappedData(0),
+    m_fileId(0),
+    m_randomMessageId(0),
+    m_inputPeer(inputPeer),
+    m_peer(peer),
+    m_type(type),
+    m_mimeType(mimeType),
+    m_size(0),
+    m_partsCount(0),
+    m_nextPart(0),
+    m_uploadedParts(0),
+    m_uploadedSize(0),
+    m_failuresCount(0),
+    m_md5(QCryptographicHash::Md5)
+{
+    Utils::randomBytes(&m_fileId);
+    Utils::randomBytes(&m_randomMessageId);
+}
+
+FileUploadDescriptor::~FileUploadDescriptor()
+{
+    if (m_mappedData) {
+        m_file.unmap(m_mappedData);
+    }
+}
+
+bool FileUploadDescriptor::open()
+{
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    const qint64 size = m_file.size();
+
+    if ((size <= 0) || (size > qint64(s_fileUploadMaxParts) * s_fileUploadBigPartSize)) {
+        return false;
+    }
+
+    m_size = size;
+    m_partsCount = (m_size + partSize() - 1) / partSize();
+
+    // Files, which can not be mapped, are read part by part.
+    m_mappedData = m_file.map(0, m_size);
+
+    return true;
+}
+
+quint32 FileUploadDescriptor::partSize() const
+{
+    return isBig() ? s_fileUploadBigPartSize : s_fileUploadPartSize;
+}
+
+bool FileUploadDescriptor::isBig() const
+{
+    return m_size > s_fileUploadBigFileSize;
+}
+
+bool FileUploadDescriptor::isFinished() const
+{
+    return m_partsCount && (m_uploadedParts == m_partsCount);
+}
+
+bool FileUploadDescriptor::takeNextPart(quint32 *part)
+{
+    if (!m_partsToRetry.isEmpty()) {
+        *part = m_partsToRetry.takeFirst();
+    } else if (m_nextPart < m_partsCount) {
+        *part = m_nextPart++;
+
+        // MD5 is not used for big files.
+        if (!isBig()) {
+            m_md5.addData(partData(*part));
+        }
+    } else {
+        return false;
+    }
+
+    m_partsInFlight.append(*part);
+
+    return true;
+}
+
+QByteArray FileUploadDescriptor::partData(quint32 part)
+{
+    const quint32 offset = part * partSize();
+    const quint32 length = qMin(partSize(), m_size - offset);
+
+    if (m_mappedData) {
+        // The data is serialized into the package right away, so the mapping outlives it.
+        return QByteArray::fromRawData(reinterpret_cast<const char *>(m_mappedData) + offset, length);
+    }
+
+    m_file.seek(offset);
+    return m_file.read(length);
+}
+
+// Returns false for unexpected answers (e.g. for parts sent again after reconnection).
+bool FileUploadDescriptor::setPartUploaded(quint32 part)
 {
+    if (!m_partsInFlight.removeOne(part)) {
+        return false;
+    }
+
+    ++m_uploadedParts;
+    m_uploadedSize += qMin(partSize(), m_size - part * partSize());
+
+    return true;
+}
+
+void FileUploadDescriptor::setPartFailed(quint32 part)
+{
+    if (!m_partsInFlight.removeOne(part)) {
+        return;
+    }
+
+    ++m_failuresCount;
+    m_partsToRetry.append(part);
+}
+
+void FileUploadDescriptor::resetPart(quint32 part)
+{
+    if (!m_partsInFlight.removeOne(part)) {
+        return;
+    }
+
+    m_partsToRetry.prepend(part);
+}
+
+void FileUploadDescriptor::resetPartsInFlight()
+{
+    m_partsToRetry = m_partsInFlight + m_partsToRetry;
+    m_partsInFlight.clear();
+}
+
+TLInputMedia FileUploadDescriptor::inputMedia() const
+{
+    TLInputMedia media;
+
+    media.file.id = m_fileId;
+    media.file.parts = m_partsCount;
+    media.file.name = QFileInfo(m_file.fileName()).fileName();
+
+    if (isBig()) {
+        media.file.tlType = TLValue::InputFileBig;
+    } else {
+        media.file.tlType = TLValue::InputFile;
+        media.file.md5Checksum = QString::fromLatin1(m_md5.result().toHex());
+    }
+
+    media.mimeType = m_mimeType;
+
+    switch (m_type) {
+    case TelegramNamespace::MessageTypePhoto:
+        media.tlType = TLValue::InputMediaUploadedPhoto;
+        break;
+    case TelegramNamespace::MessageTypeAudio:
+        media.tlType = TLValue::InputMediaUploadedAudio;
+        break;
+    case TelegramNamespace::MessageTypeVideo:
+        media.tlType = TLValue::InputMediaUploadedVideo;
+        break;
+    default: {
+        media.tlType = TLValue::InputMediaUploadedDocument;
 
+        if (media.mimeType.isEmpty()) {
+            media.mimeType = QLatin1String("application/octet-stream");
+        }
+
+        TLDocumentAttribute fileNameAttribute;
+        fileNameAttribute.tlType = TLValue::DocumentAttributeFilename;
+        fileNameAttribute.fileName = media.file.name;
+        media.attributes.append(fileNameAttribute);
+        break;
+    }
+    }
+
+    return media;
 }
 
 CTelegramDispatcher::CTelegramDispatcher(QObject *parent) :
     QObject(parent),
     m_connectionState(TelegramNamespace::ConnectionStateDisconnected),
     m_appInformation(0),
+    m_sharedData(0),
+    m_snapshotReceiver(0),
     m_messageReceivingFilterFlags(TelegramNamespace::MessageFlagRead),
     m_acceptableMessageTypes(TelegramNamespace::MessageTypeText),
     m_autoReconnectionEnabled(false),
@@ -173,12 +606,37 @@ CTelegramDispatcher::CTelegramDispatcher(QObject *parent) :
     m_requestedSteps(0),
     m_activeDc(0),
     m_wantedActiveDc(0),
+    m_endpointProber(new CDcEndpointProber(this)),
+    m_connectionPrewarmingEnabled(false),
+    m_mediaConnectionsPerDc(0),
     m_updatesStateIsLocked(false),
+    m_messageBatchingEnabled(false),
+    m_differenceRequested(false),
+    m_differenceApplyScheduled(false),
+    m_differenceChunkSize(s_differenceDefaultChunkSize),
+    m_pendingDifferenceOffset(0),
+    m_updatesGapTimer(new QTimer(this)),
+    m_messagesMap(s_messageCacheDefaultCapacity),
+    m_knownMediaMessages(s_messageCacheDefaultCapacity),
     m_selfUserId(0),
+    m_fileRequestCounter(0),
+    m_fileRequestWindow(s_fileRequestDefaultWindow),
+    m_fileUploadWindow(s_fileUploadDefaultWindow),
+    m_bulkRequestsLimit(0),
+    m_sendWindow(s_sendDefaultWindow),
+    m_sendQueueTimer(new QTimer(this)),
     m_typingUpdateTimer(new QTimer(this))
 {
+    connect(m_endpointProber, SIGNAL(endpointProbed(TLDcOption,qint64)), SLOT(whenEndpointProbed(TLDcOption,qint64)));
+    m_sendQueueTimer->setSingleShot(true);
+    connect(m_sendQueueTimer, SIGNAL(timeout()), SLOT(sendQueuedMessages()));
+    m_sendClock.start();
     m_typingUpdateTimer->setSingleShot(true);
     connect(m_typingUpdateTimer, SIGNAL(timeout()), SLOT(whenUserTypingTimerTimeout()));
+    m_updatesGapTimer->setSingleShot(true);
+    m_updatesGapTimer->setInterval(s_updatesGapHoldTime);
+    connect(m_updatesGapTimer, SIGNAL(timeout()), SLOT(whenUpdatesGapTimeout()));
+    m_typingClock.start();
 }
 
 CTelegramDispatcher::~CTelegramDispatcher()
@@ -192,6 +650,63 @@ void CTelegramDispatcher::setAppInformation(const CAppInformation *newAppInfo)
     m_appInformation = newAppInfo;
 }
 
+QEvent::Type DispatcherSnapshotEvent::eventType()
+{
+    static const QEvent::Type type = QEvent::Type(QEvent::registerEventType());
+    return type;
+}
+
+void CTelegramDispatcher::setSnapshotReceiver(QObject *receiver)
+{
+    if (m_snapshotReceiver) {
+        disconnect(this, 0, this, SLOT(publishSnapshot()));
+    }
+
+    m_snapshotReceiver = receiver;
+
+    if (!m_snapshotReceiver) {
+        return;
+    }
+
+    // The snapshot is published right away, so the receiver gets it before the signal about the change.
+    connect(this, SIGNAL(connectionStateChanged(TelegramNamespace::ConnectionState)), SLOT(publishSnapshot()));
+    connect(this, SIGNAL(contactListChanged()), SLOT(publishSnapshot()));
+    connect(this, SIGNAL(contactProfileChanged(QString)), SLOT(publishSnapshot()));
+    connect(this, SIGNAL(contactStatusChanged(QString,TelegramNamespace::ContactStatus)), SLOT(publishSnapshot()));
+    connect(this, SIGNAL(chatAdded(quint32)), SLOT(publishSnapshot()));
+    connect(this, SIGNAL(chatChanged(quint32)), SLOT(publishSnapshot()));
+
+    publishSnapshot();
+}
+
+void CTelegramDispatcher::publishSnapshot()
+{
+    if (!m_snapshotReceiver) {
+        return;
+    }
+
+    DispatcherSnapshot snapshot;
+    snapshot.connectionState = m_connectionState;
+    snapshot.selfPhone = selfPhone();
+    snapshot.contactList = contactList();
+
+    foreach (const QString &contact, snapshot.contactList) {
+        snapshot.contactStatuses.insert(contact, contactStatus(contact));
+    }
+
+    snapshot.chatList = chatList();
+
+    foreach (quint32 publicChatId, snapshot.chatList) {
+        snapshot.chatTitles.insert(publicChatId, chatTitle(publicChatId));
+    }
+
+    for (QHash<QString, quint32>::const_iterator it = m_phoneToUserId.constBegin(); it != m_phoneToUserId.constEnd(); ++it) {
+        snapshot.userPhones.insert(it.value(), it.key());
+    }
+
+    QCoreApplication::postEvent(m_snapshotReceiver, new DispatcherSnapshotEvent(snapshot), Qt::HighEventPriority);
+}
+
 qint32 CTelegramDispatcher::localTypingRecommendedRepeatInterval()
 {
     return s_localTypingRecommendedRepeatInterval;
@@ -282,39 +797,313 @@ QByteArray CTelegramDispatcher::connectionSecretInfo() const
     outputStream << m_updatesState.date;
     outputStream << m_chatIds;
 
-    return output;
-}
+    // Auth keys of the other DCs, so they do not need the handshake and authorization import again.
+    QList<CTelegramConnection *> otherConnections;
 
-void CTelegramDispatcher::setMessageReceivingFilterFlags(quint32 flags)
-{
-    m_messageReceivingFilterFlags = flags;
-}
+    foreach (CTelegramConnection *connection, m_connections) {
+        if ((connection != activeConnection()) && (connection->authState() == CTelegramConnection::AuthStateSignedIn)) {
+            otherConnections.append(connection);
+        }
+    }
 
-void CTelegramDispatcher::setAcceptableMessageTypes(quint32 types)
-{
-    m_acceptableMessageTypes = types;
-}
+    outputStream << quint32(otherConnections.count());
 
-void CTelegramDispatcher::setAutoReconnection(bool enable)
-{
-    m_autoReconnectionEnabled = enable;
-}
+    foreach (CTelegramConnection *connection, otherConnections) {
+        outputStream << connection->deltaTime();
+        outputStream << connection->dcInfo();
+        outputStream << connection->authKey();
+        outputStream << connection->authId();
+        outputStream << connection->serverSalt();
+    }
 
-void CTelegramDispatcher::setPingInterval(quint32 ms)
-{
-    m_pingInterval = ms;
+    outputStream << quint32(m_exportedAuthentications.count());
+
+    QMap<quint32, QPair<quint32, QByteArray> >::const_iterator it;
+    for (it = m_exportedAuthentications.constBegin(); it != m_exportedAuthentications.constEnd(); ++it) {
+        outputStream << it.key();
+        outputStream << it.value().first;
+        outputStream << it.value().second;
+    }
+
+    return output;
 }
 
-void CTelegramDispatcher::initConnection(const QString &address, quint32 port)
+QByteArray CTelegramDispatcher::sessionSnapshot() const
 {
-    TLDcOption dcInfo;
-    dcInfo.ipAddress = address;
-    dcInfo.port = port;
+    if (!activeConnection() || !m_selfUserId) {
+        return QByteArray();
+    }
 
-    m_updatesState.pts = 1;
+    TLVector<TLUser> users;
+    users.reserve(m_users.count());
+
+    foreach (const TLUser *user, m_users) {
+        users.append(*user);
+    }
+
+    TLVector<quint32> contactList;
+    contactList.reserve(m_contactList.count());
+
+    foreach (quint32 userId, m_contactList) {
+        contactList.append(userId);
+    }
+
+    TLVector<TLChat> chats;
+    chats.reserve(m_chatInfo.count());
+
+    foreach (const TLChat &chat, m_chatInfo) {
+        chats.append(chat);
+    }
+
+    TLVector<TLChatFull> fullChats;
+    fullChats.reserve(m_chatFullInfo.count());
+
+    foreach (const TLChatFull &fullChat, m_chatFullInfo) {
+        fullChats.append(fullChat);
+    }
+
+    QByteArray output;
+    CTelegramStream outputStream(&output, /* write */ true);
+
+    outputStream << s_sessionSnapshotFormatVersion;
+    outputStream << activeConnection()->authId();
+    outputStream << m_selfUserId;
+    outputStream << users;
+    outputStream << contactList;
+    outputStream << chats;
+    outputStream << fullChats;
+
+    return output;
+}
+
+bool CTelegramDispatcher::restoreSessionSnapshot(const QByteArray &snapshot)
+{
+    if (!activeConnection()) {
+        return false;
+    }
+
+    CTelegramStream inputStream(snapshot);
+
+    quint32 format = 0;
+    quint64 authId = 0;
+
+    inputStream >> format;
+
+    if (format != s_sessionSnapshotFormatVersion) {
+        qDebug() << Q_FUNC_INFO << "Unknown format version";
+        return false;
+    }
+
+    inputStream >> authId;
+
+    if (authId != activeConnection()->authId()) {
+        qDebug() << Q_FUNC_INFO << "The snapshot belongs to another session.";
+        return false;
+    }
+
+    quint32 selfUserId;
+    TLVector<TLUser> users;
+    TLVector<quint32> contactList;
+    TLVector<TLChat> chats;
+    TLVector<TLChatFull> fullChats;
+
+    inputStream >> selfUserId;
+    inputStream >> users;
+    inputStream >> contactList;
+    inputStream >> chats;
+    inputStream >> fullChats;
+
+    // Users are not passed to whenUsersReceived(), because it would proceed the initialization before the connection is ready.
+    foreach (const TLUser &user, users) {
+        TLUser *existsUser = m_users.value(user.id);
+
+        if (existsUser) {
+            removeUserFromIndexes(existsUser);
+            *existsUser = user;
+        } else {
+            existsUser = new TLUser(user);
+            m_users.insert(user.id, existsUser);
+        }
+
+        insertUserToIndexes(existsUser);
+    }
+
+    m_selfUserId = selfUserId;
+
+    foreach (const TLChat &chat, chats) {
+        m_chatInfo.insert(chat.id, chat);
+    }
+
+    foreach (const TLChatFull &fullChat, fullChats) {
+        m_chatFullInfo.insert(fullChat.id, fullChat);
+    }
+
+    QList<quint32> newContactList = contactList.toList();
+    std::sort(newContactList.begin(), newContactList.end());
+
+    if (m_contactList != newContactList) {
+        m_contactList = newContactList;
+        emit contactListChanged();
+    }
+
+    qDebug() << Q_FUNC_INFO << "users:" << users.count() << "contacts:" << contactList.count() << "chats:" << chats.count();
+
+    return true;
+}
+
+void CTelegramDispatcher::setMessageReceivingFilterFlags(quint32 flags)
+{
+    m_messageReceivingFilterFlags = flags;
+}
+
+void CTelegramDispatcher::setAcceptableMessageTypes(quint32 types)
+{
+    m_acceptableMessageTypes = types;
+}
+
+void CTelegramDispatcher::setAutoReconnection(bool enable)
+{
+    m_autoReconnectionEnabled = enable;
+}
+
+void CTelegramDispatcher::setPingInterval(quint32 ms)
+{
+    m_pingInterval = ms;
+
+    foreach (const QList<CTelegramConnection *> &connections, m_mediaConnections) {
+        foreach (CTelegramConnection *connection, connections) {
+            connection->setKeepAliveInterval(m_pingInterval);
+        }
+    }
+}
+
+void CTelegramDispatcher::setFileRequestWindow(int partsPerConnection)
+{
+    m_fileRequestWindow = qMax(1, partsPerConnection);
+}
+
+void CTelegramDispatcher::setFileUploadWindow(int parts)
+{
+    m_fileUploadWindow = qMax(1, parts);
+}
+
+void CTelegramDispatcher::setBulkRequestsLimit(int requests)
+{
+    if (requests < 0) {
+        qDebug() << Q_FUNC_INFO << "Invalid limit" << requests << "is ignored.";
+        return;
+    }
+
+    m_bulkRequestsLimit = requests;
+
+    foreach (CTelegramConnection *connection, m_connections) {
+        connection->setBulkRequestsLimit(m_bulkRequestsLimit);
+    }
+
+    foreach (const QList<CTelegramConnection *> &connections, m_mediaConnections) {
+        foreach (CTelegramConnection *connection, connections) {
+            connection->setBulkRequestsLimit(m_bulkRequestsLimit);
+        }
+    }
+}
+
+void CTelegramDispatcher::setConnectionPrewarmingEnabled(bool enabled)
+{
+    m_connectionPrewarmingEnabled = enabled;
+}
+
+void CTelegramDispatcher::setMediaConnectionsPerDc(int connections)
+{
+    m_mediaConnectionsPerDc = qMax(0, connections);
+
+    foreach (quint32 dc, m_mediaConnections.keys()) {
+        removeMediaConnections(dc, m_mediaConnectionsPerDc);
+    }
+
+    restoreMediaConnections();
+}
+
+void CTelegramDispatcher::setFileCacheDirectory(const QString &directory)
+{
+    m_fileCache.setDirectory(directory);
+    updateMediaMessagesSpillFileName();
+}
+
+void CTelegramDispatcher::setFileCacheMaxSize(quint64 bytes)
+{
+    m_fileCache.setMaxSize(bytes);
+}
+
+void CTelegramDispatcher::setMessageCacheCapacity(int messages)
+{
+    QList<QPair<quint32, MediaMessageDescriptor> > evicted;
+
+    m_messagesMap.setCapacity(messages);
+    m_knownMediaMessages.setCapacity(messages, &evicted);
+
+    spillMediaMessages(evicted);
+}
+
+quint64 CTelegramDispatcher::messageCacheMemoryUsage() const
+{
+    return m_messagesMap.memoryUsage() + m_knownMediaMessages.memoryUsage();
+}
+
+quint64 CTelegramDispatcher::memoryUsage() const
+{
+    // Map node: three pointers and color. Hash node: next pointer and hash.
+    static const quint64 mapNodeSize = sizeof(void *) * 4;
+    static const quint64 hashNodeSize = sizeof(void *) * 2;
+
+    quint64 result = sizeof(CTelegramDispatcher) + messageCacheMemoryUsage();
+
+    result += m_connections.count() * (sizeof(CTelegramConnection) + mapNodeSize);
+    result += m_users.count() * (sizeof(TLUser) + mapNodeSize + sizeof(quint32) + sizeof(void *));
+    result += (m_phoneToUserId.count() + m_userNameToUserId.count()) * (hashNodeSize + sizeof(QString) + sizeof(quint32));
+    result += m_contactList.count() * sizeof(quint32);
+    result += m_chatIds.count() * sizeof(quint32) + m_chatIdToPublicId.count() * (hashNodeSize + sizeof(quint32) * 2);
+    result += m_chatInfo.count() * (sizeof(TLChat) + mapNodeSize + sizeof(quint32));
+    result += m_chatFullInfo.count() * (sizeof(TLChatFull) + mapNodeSize + sizeof(quint32));
+    result += m_dcConfiguration.count() * sizeof(TLDcOption);
+
+    foreach (const TLUpdatesDifference &difference, m_pendingDifferences) {
+        result += difference.newMessages.count() * sizeof(TLMessage);
+    }
+
+    return result;
+}
+
+void CTelegramDispatcher::setMessageStoreDirectory(const QString &directory)
+{
+    m_messageStore.setDirectory(directory);
+}
+
+void CTelegramDispatcher::setMessageBatchingEnabled(bool enabled)
+{
+    m_messageBatchingEnabled = enabled;
+}
+
+void CTelegramDispatcher::setDifferenceChunkSize(int messages)
+{
+    m_differenceChunkSize = qMax(1, messages);
+}
+
+void CTelegramDispatcher::setSendWindow(int requests)
+{
+    m_sendWindow = qMax(1, requests);
+    sendQueuedMessages();
+}
+
+void CTelegramDispatcher::initConnection(const QString &address, quint32 port)
+{
+    TLDcOption dcInfo;
+    dcInfo.ipAddress = address;
+    dcInfo.port = port;
+
+    m_updatesState.pts = 1;
     m_updatesState.qts = 1;
     m_updatesState.date = 1;
-    m_chatIds.clear();
+    setTelegramChatIds(TLVector<quint32>());
 
     CTelegramConnection *connection = createConnection(dcInfo);
 
@@ -364,12 +1153,14 @@ bool CTelegramDispatcher::restoreConnection(const QByteArray &secret)
         m_updatesState.date = 1;
     }
 
-    m_chatIds.clear();
+    TLVector<quint32> chatIds;
 
     if (format >= 2) {
-        inputStream >> m_chatIds;
+        inputStream >> chatIds;
     }
 
+    setTelegramChatIds(chatIds);
+
     CTelegramConnection *connection = createConnection(dcInfo);
 
     connection->setDeltaTime(deltaTime);
@@ -382,9 +1173,57 @@ bool CTelegramDispatcher::restoreConnection(const QByteArray &secret)
         return false;
     }
 
-    m_connections.insert(dcInfo.id, connection);
+    const quint32 activeDc = dcInfo.id;
+    m_connections.insert(activeDc, connection);
+
+    if (format >= 4) {
+        quint32 connectionsCount;
+        inputStream >> connectionsCount;
+
+        for (quint32 i = 0; i < connectionsCount; ++i) {
+            inputStream >> deltaTime;
+            inputStream >> dcInfo;
+            inputStream >> authKey;
+            inputStream >> authId;
+            inputStream >> serverSalt;
+
+            if (m_connections.contains(dcInfo.id)) {
+                continue;
+            }
+
+            // The connection is established on demand; it is signed in as soon as it is connected.
+            CTelegramConnection *otherConnection = createConnection(dcInfo);
+
+            otherConnection->setDeltaTime(deltaTime);
+            otherConnection->setAuthKey(authKey);
+            otherConnection->setServerSalt(serverSalt);
+
+            if (otherConnection->authId() != authId) {
+                qDebug() << Q_FUNC_INFO << "Invalid auth data for dc" << dcInfo.id;
+                delete otherConnection;
+                continue;
+            }
+
+            m_connections.insert(dcInfo.id, otherConnection);
+        }
+
+        quint32 exportedCount;
+        inputStream >> exportedCount;
+
+        for (quint32 i = 0; i < exportedCount; ++i) {
+            quint32 dc;
+            quint32 id;
+            QByteArray data;
+
+            inputStream >> dc;
+            inputStream >> id;
+            inputStream >> data;
 
-    initConnectionSharedFinal(dcInfo.id);
+            m_exportedAuthentications.insert(dc, QPair<quint32, QByteArray>(id, data));
+        }
+    }
+
+    initConnectionSharedFinal(activeDc);
 
     return true;
 }
@@ -393,9 +1232,17 @@ void CTelegramDispatcher::initConnectionSharedFinal(quint32 activeDc)
 {
     m_initializationState = StepFirst;
     m_requestedSteps = 0;
+    m_initializationTimings.clear();
+    m_initializationClock.start();
     setConnectionState(TelegramNamespace::ConnectionStateConnecting);
     setActiveDc(activeDc);
     m_updatesStateIsLocked = false;
+    m_differenceRequested = false;
+    m_pendingDifferences.clear();
+    m_pendingDifferenceOffset = 0;
+    m_updatesDuringDifference.clear();
+    m_pendingUpdates.clear();
+    m_updatesGapTimer->stop();
     m_selfUserId = 0;
 
     m_actualState = TLUpdatesState();
@@ -412,18 +1259,51 @@ void CTelegramDispatcher::closeConnection()
 
     m_connections.clear();
 
+    foreach (const QList<CTelegramConnection *> &connections, m_mediaConnections) {
+        foreach (CTelegramConnection *o, connections) {
+            o->disconnect(this);
+            o->deleteLater();
+        }
+    }
+
+    m_mediaConnections.clear();
+
     m_dcConfiguration.clear();
     m_delayedPackages.clear();
     qDeleteAll(m_users);
     m_users.clear();
+    m_phoneToUserId.clear();
+    m_userNameToUserId.clear();
     m_messagesMap.clear();
+    m_knownMediaMessages.clear();
     m_contactList.clear();
     m_requestedFileDescriptors.clear();
     m_fileRequestCounter = 0;
-    m_userTypingMap.clear();
-    m_userChatTypingMap.clear();
-    m_localTypingMap.clear();
-    m_chatIds.clear();
+    qDeleteAll(m_fileUploads);
+    m_fileUploads.clear();
+    m_mediaSendRequests.clear();
+
+    QList<QueuedMessage> unsentMessages;
+    foreach (const QList<QueuedMessage> &messages, m_sendRequests) {
+        unsentMessages.append(messages);
+    }
+    unsentMessages.append(m_sendQueue);
+    m_sendRequests.clear();
+    m_sendQueue.clear();
+    m_sendQueueTimer->stop();
+    failQueuedMessages(unsentMessages);
+
+    m_differenceRequested = false;
+    m_pendingDifferences.clear();
+    m_pendingDifferenceOffset = 0;
+    m_updatesDuringDifference.clear();
+    m_pendingUpdates.clear();
+    m_updatesGapTimer->stop();
+    m_receivedMessagesBatch.clear();
+    m_typingUpdateTimer->stop();
+    m_typingDeadlines.clear();
+    m_typingExpirations.clear();
+    setTelegramChatIds(TLVector<quint32>());
     m_temporaryChatIdMap.clear();
     m_chatInfo.clear();
     m_chatFullInfo.clear();
@@ -504,119 +1384,339 @@ void CTelegramDispatcher::requestContactAvatar(const QString &phoneNumber)
 
 bool CTelegramDispatcher::requestMessageMediaData(quint32 messageId)
 {
-    if (!m_knownMediaMessages.contains(messageId)) {
-        return false;
-    }
-
     // TODO: MessageMediaContact, MessageMediaGeo
 
-    return requestFile(FileRequestDescriptor::messageMediaDataRequest(m_knownMediaMessages.value(messageId)));
+    return requestFile(FileRequestDescriptor::messageMediaDataRequest(knownMediaMessage(messageId)));
 }
 
-quint64 CTelegramDispatcher::sendMessage(const QString &identifier, const QString &message)
+bool CTelegramDispatcher::requestMessageMediaDataStream(quint32 messageId, QIODevice *outputDevice)
 {
-    if (!activeConnection()) {
-        return 0;
-    }
-    const TLInputPeer peer = identifierToInputPeer(identifier);
+    FileRequestDescriptor descriptor = FileRequestDescriptor::messageMediaDataRequest(knownMediaMessage(messageId));
 
-    if (peer.tlType == TLValue::InputPeerEmpty) {
-        qDebug() << Q_FUNC_INFO << "Can not resolve contact" << maskPhoneNumber(identifier);
-        return 0;
+    if (!descriptor.isValid()) {
+        return false;
     }
 
-    if (m_localTypingMap.contains(identifier)) {
-        m_localTypingMap.remove(identifier);
-    }
+    descriptor.setStreaming(outputDevice);
+
+    return requestFile(descriptor);
+}
 
-    return sendMessages(peer, message);
+quint64 CTelegramDispatcher::sendMessage(const QString &identifier, const QString &message)
+{
+    return sendMessage(identifierToPeer(identifier), message);
 }
 
-quint64 CTelegramDispatcher::sendMessages(const TLInputPeer &peer, const QString &message)
+quint64 CTelegramDispatcher::sendMessage(const TelegramNamespace::Peer &peer, const QString &message)
 {
     quint64 randomMessageId;
     Utils::randomBytes(&randomMessageId);
 
-    // Probably we have to implement GZip packing to fix this bug.
-    if (message.length() > 400) {
-        qDebug() << Q_FUNC_INFO << "Can not send such long message due to a bug. Current maximum length is 400 characters.";
-        return 0;
-    }
-
-    if (message.length() > 4095) { // 4096 - 1
-        qDebug() << Q_FUNC_INFO << "Can not send such long message due to server limitation. Current maximum length is 4095 characters.";
+    if (!sendMessages(peer, message, randomMessageId)) {
         return 0;
     }
 
-    activeConnection()->messagesSendMessage(peer, message, randomMessageId);
-
     return randomMessageId;
 }
 
-bool CTelegramDispatcher::filterReceivedMessage(quint32 messageFlags) const
+void CTelegramDispatcher::sendMessage(const QString &identifier, const QString &message, quint64 randomMessageId)
 {
-    return m_messageReceivingFilterFlags & messageFlags;
+    sendMessage(identifierToPeer(identifier), message, randomMessageId);
 }
 
-quint32 CTelegramDispatcher::createChat(const QStringList &phones, const QString chatName)
+void CTelegramDispatcher::sendMessage(const TelegramNamespace::Peer &peer, const QString &message, quint64 randomMessageId)
+{
+    if (!sendMessages(peer, message, randomMessageId)) {
+        emit sentMessageStatusChanged(peer, randomMessageId, TelegramNamespace::MessageDeliveryStatusFailed);
+    }
+}
+
+quint64 CTelegramDispatcher::sendMedia(const QString &identifier, const QString &fileName, TelegramNamespace::MessageType type, const QString &mimeType)
 {
     if (!activeConnection()) {
         return 0;
     }
-    TLVector<TLInputUser> users;
 
-    foreach (const QString &phone, phones) {
-        const TLInputUser user = phoneNumberToInputUser(phone);
-        users.append(user);
+    const TelegramNamespace::Peer peer = identifierToPeer(identifier);
+    const TLInputPeer inputPeer = peerToInputPeer(peer);
+
+    if (inputPeer.tlType == TLValue::InputPeerEmpty) {
+        qDebug() << Q_FUNC_INFO << "Can not resolve contact" << maskPhoneNumber(identifier);
+        return 0;
     }
 
-    quint32 publicChatId = insertTelegramChatId(0); // Real telegram id is not known at this moment.
-    quint64 apiCallId = activeConnection()->messagesCreateChat(users, chatName);
+    FileUploadDescriptor *descriptor = new FileUploadDescriptor(fileName, inputPeer, peer, type, mimeType);
 
-    m_temporaryChatIdMap.insert(apiCallId, publicChatId);
+    if (!descriptor->open()) {
+        qDebug() << Q_FUNC_INFO << "Can not upload file" << fileName;
+        delete descriptor;
+        return 0;
+    }
 
-    return publicChatId;
+    m_fileUploads.insert(descriptor->fileId(), descriptor);
+    uploadFileParts();
+
+    return descriptor->randomMessageId();
 }
 
-bool CTelegramDispatcher::addChatUser(quint32 publicChatId, const QString &contact, quint32 forwardMessages)
+QList<quint64> CTelegramDispatcher::queueMessages(const QList<TelegramNamespace::Message> &messages)
+{
+    QList<quint64> result;
+
+    foreach (const TelegramNamespace::Message &message, messages) {
+        QueuedMessage queuedMessage;
+        queuedMessage.peer = message.peer;
+        queuedMessage.inputPeer = peerToInputPeer(message.peer);
+        queuedMessage.text = message.text;
+
+        if (queuedMessage.inputPeer.tlType == TLValue::InputPeerEmpty) {
+            qDebug() << Q_FUNC_INFO << "Can not resolve peer" << message.peer.type << message.peer.id;
+            result.append(0);
+            continue;
+        }
+
+        if (!isSendableText(message.text)) {
+            result.append(0);
+            continue;
+        }
+
+        Utils::randomBytes(&queuedMessage.randomId);
+        m_sendQueue.append(queuedMessage);
+        result.append(queuedMessage.randomId);
+    }
+
+    sendQueuedMessages();
+
+    return result;
+}
+
+bool CTelegramDispatcher::sendMessages(const TelegramNamespace::Peer &peer, const QString &message, quint64 randomMessageId)
 {
     if (!activeConnection()) {
         return false;
     }
 
-    quint32 chatId = publicChatIdToChatId(publicChatId);
+    const TLInputPeer inputPeer = peerToInputPeer(peer);
 
-    if (!chatId) {
+    if (inputPeer.tlType == TLValue::InputPeerEmpty) {
+        qDebug() << Q_FUNC_INFO << "Can not resolve peer" << peer.type << peer.id;
         return false;
     }
 
-    const TLInputUser inputUser = phoneNumberToInputUser(contact);
-
-    switch (inputUser.tlType) {
-    case TLValue::InputUserEmpty:
-    case TLValue::InputUserSelf:
+    if (!isSendableText(message)) {
         return false;
-    default:
-        break;
     }
 
-    activeConnection()->messagesAddChatUser(chatId, inputUser, forwardMessages);
+    removeTypingDeadline(TypingKey(peer, 0));
+
+    activeConnection()->messagesSendMessage(inputPeer, message, randomMessageId);
+
     return true;
 }
 
-void CTelegramDispatcher::setTyping(const QString &identifier, bool typingStatus)
+bool CTelegramDispatcher::isSendableText(const QString &message)
 {
-    if (!activeConnection()) {
-        return;
-    }
-    if (typingStatus == m_localTypingMap.contains(identifier)) {
+    // Probably we have to implement GZip packing to fix this bug.
+    if (message.length() > 400) {
+        qDebug() << Q_FUNC_INFO << "Can not send such long message due to a bug. Current maximum length is 400 characters.";
+        return false;
+    }
+
+    if (message.length() > 4095) { // 4096 - 1
+        qDebug() << Q_FUNC_INFO << "Can not send such long message due to server limitation. Current maximum length is 4095 characters.";
+        return false;
+    }
+
+    return true;
+}
+
+static TLInputUser inputPeerToInputUser(const TLInputPeer &peer)
+{
+    TLInputUser user;
+
+    switch (peer.tlType) {
+    case TLValue::InputPeerSelf:
+        user.tlType = TLValue::InputUserSelf;
+        break;
+    case TLValue::InputPeerContact:
+        user.tlType = TLValue::InputUserContact;
+        user.userId = peer.userId;
+        break;
+    case TLValue::InputPeerForeign:
+        user.tlType = TLValue::InputUserForeign;
+        user.userId = peer.userId;
+        user.accessHash = peer.accessHash;
+        break;
+    default:
+        break;
+    }
+
+    return user;
+}
+
+void CTelegramDispatcher::sendQueuedMessages()
+{
+    CTelegramConnection *connection = activeConnection();
+
+    if (!connection || (connection->authState() != CTelegramConnection::AuthStateSignedIn)) {
+        return;
+    }
+
+    while (!m_sendQueue.isEmpty() && (m_sendRequests.count() < m_sendWindow)) {
+        QList<QueuedMessage> messages;
+        messages.append(m_sendQueue.takeFirst());
+
+        // Consecutive messages with the same text to users are sent by a single broadcast request.
+        const QString text = messages.first().text;
+
+        if (inputPeerToInputUser(messages.first().inputPeer).tlType != TLValue::InputUserEmpty) {
+            while (!m_sendQueue.isEmpty() && (messages.count() < s_broadcastMaxContacts)
+                   && (m_sendQueue.first().text == text)
+                   && (inputPeerToInputUser(m_sendQueue.first().inputPeer).tlType != TLValue::InputUserEmpty)) {
+                messages.append(m_sendQueue.takeFirst());
+            }
+        }
+
+        const TLValue method = messages.count() > 1 ? TLValue::MessagesSendBroadcast : TLValue::MessagesSendMessage;
+        CTokenBucket *bucket = floodBucket(method);
+        const qint64 now = m_sendClock.elapsed();
+
+        if (!bucket->take(now)) {
+            for (int i = messages.count() - 1; i >= 0; --i) {
+                m_sendQueue.prepend(messages.at(i));
+            }
+
+            m_sendQueueTimer->start(bucket->delay(now));
+            return;
+        }
+
+        quint64 requestId;
+
+        if (messages.count() == 1) {
+            requestId = connection->messagesSendMessage(messages.first().inputPeer, text, messages.first().randomId);
+        } else {
+            TLVector<TLInputUser> contacts;
+
+            foreach (const QueuedMessage &message, messages) {
+                contacts.append(inputPeerToInputUser(message.inputPeer));
+            }
+
+            requestId = connection->messagesSendBroadcast(contacts, text, TLInputMedia());
+        }
+
+        m_sendRequests.insert(requestId, messages);
+    }
+}
+
+void CTelegramDispatcher::failQueuedMessages(const QList<QueuedMessage> &messages)
+{
+    foreach (const QueuedMessage &message, messages) {
+        emit sentMessageStatusChanged(message.peer, message.randomId, TelegramNamespace::MessageDeliveryStatusFailed);
+    }
+}
+
+// The answers for the requests in flight are lost with the connection (or its authorization), so the messages are
+// sent again. They keep the random ids, so the server does not deliver a message twice.
+// A broadcast has no random ids, so it is not sent again: it could be delivered already.
+void CTelegramDispatcher::requeueSendRequests()
+{
+    const QList<QList<QueuedMessage> > requests = m_sendRequests.values(); // In the send order
+    m_sendRequests.clear();
+
+    for (int i = requests.count() - 1; i >= 0; --i) {
+        const QList<QueuedMessage> &messages = requests.at(i);
+
+        if (messages.count() == 1) {
+            m_sendQueue.prepend(messages.first());
+            continue;
+        }
+
+        foreach (const QueuedMessage &message, messages) {
+            emit sentMessageStatusChanged(message.peer, message.randomId, TelegramNamespace::MessageDeliveryStatusUnknown);
+        }
+    }
+}
+
+CTokenBucket *CTelegramDispatcher::floodBucket(TLValue method)
+{
+    QMap<quint32, CTokenBucket>::iterator it = m_floodBuckets.find(method);
+
+    if (it == m_floodBuckets.end()) {
+        it = m_floodBuckets.insert(method, CTokenBucket(s_sendRate, s_sendBurst));
+    }
+
+    return &it.value();
+}
+
+bool CTelegramDispatcher::filterReceivedMessage(quint32 messageFlags) const
+{
+    return m_messageReceivingFilterFlags & messageFlags;
+}
+
+quint32 CTelegramDispatcher::createChat(const QStringList &phones, const QString chatName)
+{
+    if (!activeConnection()) {
+        return 0;
+    }
+    TLVector<TLInputUser> users;
+
+    foreach (const QString &phone, phones) {
+        const TLInputUser user = phoneNumberToInputUser(phone);
+        users.append(user);
+    }
+
+    quint32 publicChatId = insertTelegramChatId(0); // Real telegram id is not known at this moment.
+    quint64 apiCallId = activeConnection()->messagesCreateChat(users, chatName);
+
+    m_temporaryChatIdMap.insert(apiCallId, publicChatId);
+
+    return publicChatId;
+}
+
+bool CTelegramDispatcher::addChatUser(quint32 publicChatId, const QString &contact, quint32 forwardMessages)
+{
+    if (!activeConnection()) {
+        return false;
+    }
+
+    quint32 chatId = publicChatIdToChatId(publicChatId);
+
+    if (!chatId) {
+        return false;
+    }
+
+    const TLInputUser inputUser = phoneNumberToInputUser(contact);
+
+    switch (inputUser.tlType) {
+    case TLValue::InputUserEmpty:
+    case TLValue::InputUserSelf:
+        return false;
+    default:
+        break;
+    }
+
+    activeConnection()->messagesAddChatUser(chatId, inputUser, forwardMessages);
+    return true;
+}
+
+void CTelegramDispatcher::setTyping(const QString &identifier, bool typingStatus)
+{
+    setTyping(identifierToPeer(identifier), typingStatus);
+}
+
+void CTelegramDispatcher::setTyping(const TelegramNamespace::Peer &peer, bool typingStatus)
+{
+    if (!activeConnection()) {
+        return;
+    }
+    if (typingStatus == m_typingDeadlines.contains(TypingKey(peer, 0))) {
         return; // Avoid flood
     }
 
-    TLInputPeer peer = identifierToInputPeer(identifier);
+    const TLInputPeer inputPeer = peerToInputPeer(peer);
 
-    if (peer.tlType == TLValue::InputPeerEmpty) {
-        qDebug() << Q_FUNC_INFO << "Can not resolve contact" << maskPhoneNumber(identifier);
+    if (inputPeer.tlType == TLValue::InputPeerEmpty) {
+        qDebug() << Q_FUNC_INFO << "Can not resolve peer" << peer.type << peer.id;
         return;
     }
 
@@ -627,25 +1727,29 @@ void CTelegramDispatcher::setTyping(const QString &identifier, bool typingStatus
         action.tlType = TLValue::SendMessageCancelAction;
     }
 
-    activeConnection()->messagesSetTyping(peer, action);
+    activeConnection()->messagesSetTyping(inputPeer, action);
 
     if (typingStatus) {
-        m_localTypingMap.insert(identifier, s_localTypingDuration);
-        ensureTypingUpdateTimer(s_localTypingDuration);
+        setTypingDeadline(TypingKey(peer, 0), s_localTypingDuration);
     } else {
-        m_localTypingMap.remove(identifier);
+        removeTypingDeadline(TypingKey(peer, 0));
     }
 }
 
 void CTelegramDispatcher::setMessageRead(const QString &identifier, quint32 messageId)
+{
+    setMessageRead(identifierToPeer(identifier), messageId);
+}
+
+void CTelegramDispatcher::setMessageRead(const TelegramNamespace::Peer &peer, quint32 messageId)
 {
     if (!activeConnection()) {
         return;
     }
-    const TLInputPeer peer = identifierToInputPeer(identifier);
+    const TLInputPeer inputPeer = peerToInputPeer(peer);
 
-    if (peer.tlType != TLValue::InputPeerEmpty) {
-        activeConnection()->messagesReadHistory(peer, messageId, /* offset */ 0, /* readContents */ false);
+    if (inputPeer.tlType != TLValue::InputPeerEmpty) {
+        activeConnection()->messagesReadHistory(inputPeer, messageId, /* offset */ 0, /* readContents */ false);
     }
 }
 
@@ -826,16 +1930,61 @@ bool CTelegramDispatcher::getChatParticipants(QStringList *participants, quint32
     return true;
 }
 
+QList<TelegramNamespace::Message> CTelegramDispatcher::storedMessages(const TelegramNamespace::Peer &peer, quint32 beforeMessageId, int limit)
+{
+    QList<TelegramNamespace::Message> result = m_messageStore.history(peerToStorePeer(peer), beforeMessageId, limit);
+
+    for (int i = 0; i < result.count(); ++i) {
+        storePeerToPublic(&result[i].peer);
+    }
+
+    return result;
+}
+
+QList<TelegramNamespace::Message> CTelegramDispatcher::storedMessagesByDate(const TelegramNamespace::Peer &peer, quint32 fromTimestamp, quint32 toTimestamp, int limit)
+{
+    QList<TelegramNamespace::Message> result = m_messageStore.historyByDate(peerToStorePeer(peer), fromTimestamp, toTimestamp, limit);
+
+    for (int i = 0; i < result.count(); ++i) {
+        storePeerToPublic(&result[i].peer);
+    }
+
+    return result;
+}
+
+bool CTelegramDispatcher::getStoredMessage(TelegramNamespace::Message *message, quint32 messageId)
+{
+    if (!m_messageStore.message(messageId, message)) {
+        return false;
+    }
+
+    storePeerToPublic(&message->peer);
+
+    return true;
+}
+
 void CTelegramDispatcher::whenUsersReceived(const QVector<TLUser> &users)
 {
     qDebug() << Q_FUNC_INFO << users.count();
+    bool phonesChanged = false;
+
     foreach (const TLUser &user, users) {
         TLUser *existsUser = m_users.value(user.id);
 
         if (existsUser) {
+            phonesChanged = phonesChanged || (existsUser->phone != user.phone);
+            removeUserFromIndexes(existsUser);
             *existsUser = user;
         } else {
-            m_users.insert(user.id, new TLUser(user));
+            existsUser = new TLUser(user);
+            m_users.insert(user.id, existsUser);
+            phonesChanged = phonesChanged || !user.phone.isEmpty();
+        }
+
+        insertUserToIndexes(existsUser);
+
+        if (user.photo.photoSmall.tlType == TLValue::FileLocation) {
+            prewarmDc(user.photo.photoSmall.dcId);
         }
 
         if (user.tlType == TLValue::UserSelf) {
@@ -844,6 +1993,11 @@ void CTelegramDispatcher::whenUsersReceived(const QVector<TLUser> &users)
             continueInitialization(StepKnowSelf);
         }
     }
+
+    // The user identifiers are resolved from the snapshot by the messages and statuses receivers.
+    if (phonesChanged) {
+        publishSnapshot();
+    }
 }
 
 void CTelegramDispatcher::whenContactListReceived(const QList<quint32> &contactList)
@@ -861,6 +2015,13 @@ void CTelegramDispatcher::whenContactListReceived(const QList<quint32> &contactL
     continueInitialization(StepContactList);
 }
 
+void CTelegramDispatcher::whenContactListNotModified()
+{
+    qDebug() << Q_FUNC_INFO << m_contactList.count();
+
+    continueInitialization(StepContactList);
+}
+
 void CTelegramDispatcher::whenContactListChanged(const QList<quint32> &added, const QList<quint32> &removed)
 {
     qDebug() << Q_FUNC_INFO << added << removed;
@@ -889,58 +2050,21 @@ void CTelegramDispatcher::whenContactListChanged(const QList<quint32> &added, co
 
 void CTelegramDispatcher::whenUserTypingTimerTimeout()
 {
+    const qint64 now = m_typingClock.elapsed() + 5; // Let 5 ms be allowed correction
 
-#if QT_VERSION >= 0x050000
-    int minTime = s_userTypingActionPeriod;
-#else
-    int minTime = s_timerMaxInterval;
-#endif
+    // Only expired entries are touched. The map is checked again on each iteration, because a receiver can change it.
+    while (!m_typingExpirations.isEmpty() && (m_typingExpirations.begin().key() <= now)) {
+        const TypingKey key = m_typingExpirations.begin().value();
 
-    const QList<quint32> users = m_userTypingMap.keys();
-    foreach (quint32 userId, users) {
-        int timeRemains = m_userTypingMap.value(userId) - m_typingUpdateTimer->interval();
-        if (timeRemains < 5) { // Let 5 ms be allowed correction
-            m_userTypingMap.remove(userId);
-            emit contactTypingStatusChanged(userIdToIdentifier(userId), /* typingStatus */ false);
-        } else {
-            m_userTypingMap.insert(userId, timeRemains);
-            if (minTime > timeRemains) {
-                minTime = timeRemains;
-            }
-        }
-    }
+        m_typingExpirations.erase(m_typingExpirations.begin());
+        m_typingDeadlines.remove(key);
 
-    const QList<QPair<quint32, quint32> > usersInChat = m_userChatTypingMap.keys();
-    QPair<quint32, quint32> userInChat;
-    foreach (userInChat, usersInChat) {
-        int timeRemains = m_userChatTypingMap.value(userInChat) - m_typingUpdateTimer->interval();
-        if (timeRemains < 5) { // Let 5 ms be allowed correction
-            m_userChatTypingMap.remove(userInChat);
-            emit contactChatTypingStatusChanged(userInChat.first, userIdToIdentifier(userInChat.second), /* typingStatus */ false);
-        } else {
-            m_userChatTypingMap.insert(userInChat, timeRemains);
-            if (minTime > timeRemains) {
-                minTime = timeRemains;
-            }
+        if (key.second) {
+            emit typingStatusChanged(key.first, key.second, /* typingStatus */ false);
         }
     }
 
-    const QList<QString> identifiers = m_localTypingMap.keys();
-    foreach (const QString &identifier, identifiers) {
-        int timeRemains = m_localTypingMap.value(identifier) - m_typingUpdateTimer->interval();
-        if (timeRemains < 5) { // Let 5 ms be allowed correction
-            m_localTypingMap.remove(identifier);
-        } else {
-            m_localTypingMap.insert(identifier, timeRemains);
-            if (minTime > timeRemains) {
-                minTime = timeRemains;
-            }
-        }
-    }
-
-    if (!m_userTypingMap.isEmpty() || !m_userChatTypingMap.isEmpty() || !m_localTypingMap.isEmpty()) {
-        m_typingUpdateTimer->start(minTime);
-    }
+    startTypingUpdateTimer();
 }
 
 void CTelegramDispatcher::whenStatedMessageReceived(const TLMessagesStatedMessage &statedMessage, quint64 messageId)
@@ -951,6 +2075,15 @@ void CTelegramDispatcher::whenStatedMessageReceived(const TLMessagesStatedMessag
     qDebug() << Q_FUNC_INFO << m_temporaryChatIdMap;
 #endif
 
+    if (m_mediaSendRequests.contains(messageId)) {
+        const QPair<TelegramNamespace::Peer, quint64> peerAndId = m_mediaSendRequests.take(messageId);
+
+        if (statedMessage.tlType == TLValue::MessagesStatedMessage) {
+            m_messagesMap.insert(statedMessage.message.id, peerAndId);
+            emit sentMessageStatusChanged(peerAndId.first, peerAndId.second, TelegramNamespace::MessageDeliveryStatusSent);
+        }
+    }
+
     if (m_temporaryChatIdMap.contains(messageId)) {
         if (statedMessage.chats.isEmpty()) {
             qDebug() << "Stated message expected to have chat id, but it haven't";
@@ -961,7 +2094,7 @@ void CTelegramDispatcher::whenStatedMessageReceived(const TLMessagesStatedMessag
         if (!havePublicChatId(publicChatId)) {
             qDebug() << Q_FUNC_INFO << "Unexpected stated message public id " << publicChatId << " for chat " << statedMessage.chats.first().id;
         } else {
-            m_chatIds[publicChatId] = statedMessage.chats.first().id;
+            setTelegramChatId(publicChatId, statedMessage.chats.first().id);
             qDebug() << Q_FUNC_INFO << "public chat id " << publicChatId << " resolved to " << statedMessage.chats.first().id;
         }
     }
@@ -974,182 +2107,659 @@ void CTelegramDispatcher::whenStatedMessageReceived(const TLMessagesStatedMessag
         break;
     }
 
-    ensureUpdateState(statedMessage.pts, statedMessage.seq);
-}
+    ensureUpdateState(statedMessage.pts, statedMessage.seq);
+}
+
+void CTelegramDispatcher::whenMessageSentInfoReceived(const TLInputPeer &peer, quint64 randomId, quint32 messageId, quint32 pts, quint32 date, quint32 seq, quint64 requestId)
+{
+    const QPair<TelegramNamespace::Peer, quint64> peerAndId(inputPeerToPeer(peer), randomId);
+
+    m_messagesMap.insert(messageId, peerAndId);
+
+    emit sentMessageStatusChanged(peerAndId.first, peerAndId.second, TelegramNamespace::MessageDeliveryStatusSent);
+
+    ensureUpdateState(pts, seq, date);
+
+    if (m_sendRequests.remove(requestId)) {
+        sendQueuedMessages();
+    }
+}
+
+void CTelegramDispatcher::whenBroadcastSentInfoReceived(const TLMessagesStatedMessages &result, quint64 requestId)
+{
+    if (!m_sendRequests.contains(requestId)) {
+        return;
+    }
+
+    QList<QueuedMessage> messages = m_sendRequests.take(requestId);
+
+    foreach (const TLMessage &message, result.messages) {
+        for (int i = 0; i < messages.count(); ++i) {
+            const TLInputPeer &inputPeer = messages.at(i).inputPeer;
+            const quint32 userId = inputPeer.tlType == TLValue::InputPeerSelf ? m_selfUserId : inputPeer.userId;
+
+            if (userId == message.toId.userId) {
+                const QueuedMessage sentMessage = messages.takeAt(i);
+                const QPair<TelegramNamespace::Peer, quint64> peerAndId(sentMessage.peer, sentMessage.randomId);
+
+                m_messagesMap.insert(message.id, peerAndId);
+                emit sentMessageStatusChanged(peerAndId.first, peerAndId.second, TelegramNamespace::MessageDeliveryStatusSent);
+                break;
+            }
+        }
+    }
+
+    // Sent too, but the server messages for them are unknown.
+    foreach (const QueuedMessage &message, messages) {
+        emit sentMessageStatusChanged(message.peer, message.randomId, TelegramNamespace::MessageDeliveryStatusSent);
+    }
+
+    ensureUpdateState(result.pts, result.seq);
+
+    sendQueuedMessages();
+}
+
+void CTelegramDispatcher::whenRpcErrorReceived(quint64 requestId, TLValue request, quint32 errorCode, const QString &errorMessage)
+{
+    if (m_mediaSendRequests.contains(requestId)) {
+        const QPair<TelegramNamespace::Peer, quint64> peerAndId = m_mediaSendRequests.take(requestId);
+
+        if (errorCode == 303) {
+            // The request is redirected by the connection and the answer can not be matched anymore.
+            qDebug() << Q_FUNC_INFO << "Media message" << peerAndId.second << "is redirected, the delivery status is unknown";
+            return;
+        }
+
+        emit sentMessageStatusChanged(peerAndId.first, peerAndId.second, TelegramNamespace::MessageDeliveryStatusFailed);
+        return;
+    }
+
+    if (!m_sendRequests.contains(requestId)) {
+        return;
+    }
+
+    const QList<QueuedMessage> messages = m_sendRequests.take(requestId);
+
+    if (errorCode == 303) {
+        // SEE_OTHER requests are redirected by the connection, so the window slot is released.
+        // The sent messages are still reported by their random ids.
+        sendQueuedMessages();
+        return;
+    }
+
+    if ((errorCode == 420) && errorMessage.startsWith(QLatin1String("FLOOD_WAIT_"))) {
+        const int seconds = errorMessage.mid(11).toInt();
+        qDebug() << Q_FUNC_INFO << "Flood wait" << seconds << "seconds for" << request.toString();
+
+        floodBucket(request)->block(m_sendClock.elapsed(), seconds * 1000);
+
+        QList<QueuedMessage> failedMessages;
+
+        for (int i = messages.count() - 1; i >= 0; --i) {
+            QueuedMessage message = messages.at(i);
+            ++message.attempts;
+
+            if (message.attempts > s_sendMaxFloodWaits) {
+                failedMessages.prepend(message);
+            } else {
+                m_sendQueue.prepend(message);
+            }
+        }
+
+        failQueuedMessages(failedMessages);
+    } else {
+        failQueuedMessages(messages);
+    }
+
+    sendQueuedMessages();
+}
+
+void CTelegramDispatcher::whenRequestIdChanged(quint64 previousId, quint64 newId)
+{
+    if (m_sendRequests.contains(previousId)) {
+        m_sendRequests.insert(newId, m_sendRequests.take(previousId));
+    }
+
+    if (m_mediaSendRequests.contains(previousId)) {
+        m_mediaSendRequests.insert(newId, m_mediaSendRequests.take(previousId));
+    }
+}
+
+void CTelegramDispatcher::getDcConfiguration()
+{
+    if (m_sharedData) {
+        const QVector<TLDcOption> configuration = m_sharedData->dcConfiguration();
+
+        if (!configuration.isEmpty()) {
+            qDebug() << "Core: Got shared DC Configuration.";
+            m_dcConfiguration = configuration;
+            probeDcEndpoints();
+            continueInitialization(StepDcConfiguration);
+            return;
+        }
+    }
+
+    activeConnection()->getConfiguration();
+}
+
+void CTelegramDispatcher::getUser(quint32 id)
+{
+    TLInputUser user;
+    user.tlType = TLValue::InputUserContact;
+    user.userId = id;
+    activeConnection()->usersGetUsers(QVector<TLInputUser>() << user);
+}
+
+void CTelegramDispatcher::getInitialUsers()
+{
+    QVector<TLInputUser> users;
+
+    TLInputUser user;
+
+    user.tlType = TLValue::InputUserSelf;
+    users << user;
+
+    user.tlType = TLValue::InputUserContact;
+    user.userId = 777000;
+    users << user;
+
+    activeConnection()->usersGetUsers(users);
+}
+
+void CTelegramDispatcher::getContacts()
+{
+    activeConnection()->contactsGetContacts(contactListHash());
+}
+
+void CTelegramDispatcher::getChatsInfo()
+{
+    bool allChatsKnown = true;
+
+    foreach (quint32 chatId, m_chatIds) {
+        if (chatId && !m_chatInfo.contains(chatId)) {
+            allChatsKnown = false;
+            break;
+        }
+    }
+
+    // Chats from the session snapshot are kept up to date by the updates difference.
+    if (allChatsKnown) {
+        continueInitialization(StepChatInfo);
+    } else {
+        activeConnection()->messagesGetChats(m_chatIds);
+    }
+}
+
+void CTelegramDispatcher::getUpdatesState()
+{
+    m_updatesStateIsLocked = true;
+
+    // The buffered updates are drained as soon as the state is in sync.
+    m_updatesGapTimer->stop();
+
+    activeConnection()->updatesGetState();
+}
+
+void CTelegramDispatcher::whenUpdatesStateReceived(const TLUpdatesState &updatesState)
+{
+    m_actualState = updatesState;
+
+    if (m_requestedSteps & StepUpdates) {
+        checkStateAndCallGetDifference();
+    } else {
+        continueInitialization(StepUpdatesState); // The difference is requested as soon as the users are known
+    }
+}
+
+// Should be called via checkStateAndCallGetDifference()
+void CTelegramDispatcher::getDifference()
+{
+    m_differenceRequested = true;
+    activeConnection()->updatesGetDifference(m_updatesState.pts, m_updatesState.date, m_updatesState.qts);
+}
+
+void CTelegramDispatcher::whenUpdatesDifferenceReceived(const TLUpdatesDifference &updatesDifference)
+{
+    m_differenceRequested = false;
+
+    switch (updatesDifference.tlType) {
+    case TLValue::UpdatesDifference:
+    case TLValue::UpdatesDifferenceSlice:
+        qDebug() << Q_FUNC_INFO << "UpdatesDifference" << updatesDifference.newMessages.count();
+        foreach (const TLChat &chat, updatesDifference.chats) {
+            updateChat(chat);
+        }
+
+        if (updatesDifference.tlType == TLValue::UpdatesDifferenceSlice) {
+            // The next slice is requested right away, so it is on the way while this one is applied.
+            const TLUpdatesState &nextState = updatesDifference.intermediateState;
+            activeConnection()->updatesGetDifference(nextState.pts, nextState.date, nextState.qts);
+            m_differenceRequested = true;
+        }
+
+        m_pendingDifferences.append(updatesDifference);
+
+        if (!m_differenceApplyScheduled) {
+            applyPendingDifferences();
+        }
+        return;
+    case TLValue::UpdatesDifferenceEmpty:
+        qDebug() << Q_FUNC_INFO << "UpdatesDifferenceEmpty";
+
+        if (!m_pendingDifferences.isEmpty()) {
+            return; // The state is checked again when the pending differences are applied.
+        }
+
+        // Try to update actual and local state in this weird case.
+        QTimer::singleShot(10, this, SLOT(getUpdatesState()));
+        return;
+        break;
+    default:
+        qDebug() << Q_FUNC_INFO << "unknown diff type:" << updatesDifference.tlType.toString();
+        break;
+    }
+
+    checkStateAndCallGetDifference();
+}
+
+void CTelegramDispatcher::applyPendingDifferences()
+{
+    m_differenceApplyScheduled = false;
+
+    if (m_pendingDifferences.isEmpty()) {
+        return; // The connection is closed
+    }
+
+    QVector<TelegramNamespace::Message> batch;
+    int budget = m_differenceChunkSize;
+
+    while (!m_pendingDifferences.isEmpty() && (budget > 0)) {
+        // A copy (cheap, the data is shared): the list can be cleared by a receiver of the emitted signals.
+        const TLUpdatesDifference difference = m_pendingDifferences.first();
+        const int end = qMin(difference.newMessages.count(), m_pendingDifferenceOffset + budget);
+
+        budget -= end - m_pendingDifferenceOffset;
+
+        for (int i = m_pendingDifferenceOffset; i < end; ++i) {
+            const TLMessage &message = difference.newMessages.at(i);
+
+            if ((message.tlType != TLValue::MessageService) && (filterReceivedMessage(telegramMessageFlagsToPublicMessageFlags(message.flags)))) {
+                storeMessage(message); // Filtered out messages are still a part of the history
+                continue;
+            }
+
+            if (!m_messageBatchingEnabled) {
+                processMessageReceived(message);
+                continue;
+            }
+
+            TelegramNamespace::Message receivedMessage;
+
+            if (applyReceivedMessage(message, &receivedMessage)) {
+                batch.append(receivedMessage);
+            }
+        }
+
+        if (m_pendingDifferences.isEmpty()) {
+            // The connection is closed, but the applied messages are still reported.
+            if (!batch.isEmpty()) {
+                emit messagesReceived(batch);
+            }
+            return;
+        }
+
+        m_pendingDifferenceOffset = end;
+
+        if (end < difference.newMessages.count()) {
+            break;
+        }
+
+        if (difference.tlType == TLValue::UpdatesDifference) {
+            m_updatesState = difference.state;
+        } else { // UpdatesDifferenceSlice
+            m_updatesState = difference.intermediateState;
+        }
+
+        m_pendingDifferences.removeFirst();
+        m_pendingDifferenceOffset = 0;
+    }
+
+    if (!batch.isEmpty()) {
+        emit messagesReceived(batch);
+    }
+
+    if (!m_pendingDifferences.isEmpty()) {
+        m_differenceApplyScheduled = true;
+        QTimer::singleShot(0, this, SLOT(applyPendingDifferences()));
+        return;
+    }
+
+    // The live updates are newer than the difference, so they are applied after it.
+    const QList<TLUpdates> updatesDuringDifference = m_updatesDuringDifference;
+    m_updatesDuringDifference.clear();
+
+    foreach (const TLUpdates &updates, updatesDuringDifference) {
+        whenUpdatesReceived(updates);
+    }
+
+    if (!m_differenceRequested) {
+        checkStateAndCallGetDifference();
+    }
+}
+
+void CTelegramDispatcher::whenMessagesChatsReceived(const QVector<TLChat> &chats, const QVector<TLUser> &users)
+{
+    qDebug() << Q_FUNC_INFO << chats.count();
+
+    whenUsersReceived(users);
+
+    foreach (const TLChat &chat, chats) {
+        updateChat(chat);
+    }
+
+    continueInitialization(StepChatInfo);
+}
+
+void CTelegramDispatcher::whenMessagesFullChatReceived(const TLChatFull &chat, const QVector<TLChat> &chats, const QVector<TLUser> &users)
+{
+    Q_UNUSED(chats);
+
+    whenUsersReceived(users);
+    updateFullChat(chat);
+}
+
+void CTelegramDispatcher::setConnectionState(TelegramNamespace::ConnectionState state)
+{
+    qDebug() << Q_FUNC_INFO << state;
+
+    if (m_connectionState == state) {
+        return;
+    }
+
+    m_connectionState = state;
+    emit connectionStateChanged(state);
+}
+
+bool CTelegramDispatcher::requestFile(const FileRequestDescriptor &requestId)
+{
+    if (!requestId.isValid()) {
+        return false;
+    }
+
+    if (completeFileRequestFromCache(requestId)) {
+        return true;
+    }
+
+    m_requestedFileDescriptors.insert(++m_fileRequestCounter, requestId);
+
+    CTelegramConnection *connection = m_connections.value(requestId.dcId());
+
+    if (connection && (connection->authState() == CTelegramConnection::AuthStateSignedIn)) {
+        requestFileParts(requestId.dcId());
+    } else {
+        ensureSignedConnection(requestId.dcId());
+    }
+
+    return true;
+}
+
+bool CTelegramDispatcher::completeFileRequestFromCache(const FileRequestDescriptor &request)
+{
+    const QString key = CFileCache::key(request.dcId(), request.inputLocation());
+
+    quint32 size;
+    TLValue fileType;
+
+    if (!m_fileCache.lookup(key, &size, &fileType)) {
+        return false;
+    }
+
+    FileRequestDescriptor descriptor = request;
+
+    if (!descriptor.isStreaming()) {
+        const QByteArray data = m_fileCache.data(key);
+
+        if (data.isEmpty()) {
+            return false;
+        }
+
+        descriptor.setCachedFile(fileType, size, data);
+
+        if (descriptor.type() == FileRequestDescriptor::MessageMediaData) {
+            emit messageMediaDataProgress(descriptor.messageId(), size, size);
+        }
+
+        finishFileRequest(descriptor);
+        return true;
+    }
+
+    QFile file(m_fileCache.filePath(key));
+
+    if (!file.open(QIODevice::ReadOnly) || (file.size() != size)) {
+        m_fileCache.remove(key);
+        return false;
+    }
+
+    // Deliver the file by parts of the download size, so a cached file takes no more memory than a downloaded one.
+    const QPointer<QIODevice> outputDevice = descriptor.outputDevice();
+    quint32 offset = 0;
 
-void CTelegramDispatcher::whenMessageSentInfoReceived(const TLInputPeer &peer, quint64 randomId, quint32 messageId, quint32 pts, quint32 date, quint32 seq)
-{
-    const QString phone = userIdToIdentifier(peer.userId);
-    QPair<QString, quint64> phoneAndId(phone, randomId);
+    while (offset < size) {
+        const QByteArray data = file.read(s_fileRequestPartSize);
 
-    m_messagesMap.insert(messageId, phoneAndId);
+        if (data.isEmpty()) {
+            break;
+        }
 
-    emit sentMessageStatusChanged(phoneAndId.first, phoneAndId.second, TelegramNamespace::MessageDeliveryStatusSent);
+        if (outputDevice) {
+            outputDevice->write(data);
+        }
 
-    ensureUpdateState(pts, seq, date);
-}
+        emit messageMediaDataPartReceived(descriptor.messageId(), offset, data);
+        offset += data.size();
+        emit messageMediaDataProgress(descriptor.messageId(), offset, size);
+    }
 
-void CTelegramDispatcher::getDcConfiguration()
-{
-    activeConnection()->getConfiguration();
+    descriptor.setCachedFile(fileType, offset, QByteArray());
+    finishFileRequest(descriptor);
+
+    return true;
 }
 
-void CTelegramDispatcher::getUser(quint32 id)
+// Returns the index of the connection with the fewest parts in flight, or -1 if every connection is at the window.
+static int leastLoadedConnection(const QVector<int> &partsInFlight, int window)
 {
-    TLInputUser user;
-    user.tlType = TLValue::InputUserContact;
-    user.userId = id;
-    activeConnection()->usersGetUsers(QVector<TLInputUser>() << user);
+    int result = -1;
+
+    for (int i = 0; i < partsInFlight.count(); ++i) {
+        if ((partsInFlight.at(i) < window) && ((result < 0) || (partsInFlight.at(i) < partsInFlight.at(result)))) {
+            result = i;
+        }
+    }
+
+    return result;
 }
 
-void CTelegramDispatcher::getInitialUsers()
+void CTelegramDispatcher::requestFileParts(quint32 dc)
 {
-    QVector<TLInputUser> users;
+    const QList<CTelegramConnection *> connections = bulkConnections(dc);
 
-    TLInputUser user;
+    if (connections.isEmpty()) {
+        return;
+    }
 
-    user.tlType = TLValue::InputUserSelf;
-    users << user;
+    // The window is per connection, so the throughput grows with the number of media connections.
+    QVector<int> partsInFlight(connections.count());
 
-    user.tlType = TLValue::InputUserContact;
-    user.userId = 777000;
-    users << user;
+    for (int i = 0; i < connections.count(); ++i) {
+        partsInFlight[i] = connections.at(i)->fileRequestsInFlight().count();
+    }
 
-    activeConnection()->usersGetUsers(users);
-}
+    int index = leastLoadedConnection(partsInFlight, m_fileRequestWindow);
 
-void CTelegramDispatcher::getContacts()
-{
-    activeConnection()->contactsGetContacts(QString()); // Empty hash argument for now.
-}
+    // The earliest requested files are served first.
+    QMap<quint32, FileRequestDescriptor>::iterator it;
+    for (it = m_requestedFileDescriptors.begin(); (it != m_requestedFileDescriptors.end()) && (index >= 0); ++it) {
+        if (it.value().dcId() != dc) {
+            continue;
+        }
 
-void CTelegramDispatcher::getChatsInfo()
-{
-    if (m_chatIds.isEmpty()) {
-        continueInitialization(StepChatInfo);
-    } else {
-        activeConnection()->messagesGetChats(m_chatIds);
+        quint32 offset;
+        while ((index >= 0) && it.value().takeNextPartOffset(&offset)) {
+            connections.at(index)->getFilePart(it.value().inputLocation(), it.key(), offset, s_fileRequestPartSize);
+            ++partsInFlight[index];
+            index = leastLoadedConnection(partsInFlight, m_fileRequestWindow);
+        }
     }
 }
 
-void CTelegramDispatcher::getUpdatesState()
+void CTelegramDispatcher::resumeFileRequests(quint32 dc)
 {
-    m_updatesStateIsLocked = true;
-    activeConnection()->updatesGetState();
-}
+    // Requests, sent before reconnection, would not be answered. Continue from the last contiguous offset.
+    QMap<quint32, FileRequestDescriptor>::iterator it;
+    for (it = m_requestedFileDescriptors.begin(); it != m_requestedFileDescriptors.end(); ++it) {
+        if (it.value().dcId() == dc) {
+            it.value().resetPartsInFlight();
+        }
+    }
 
-void CTelegramDispatcher::whenUpdatesStateReceived(const TLUpdatesState &updatesState)
-{
-    m_actualState = updatesState;
-    checkStateAndCallGetDifference();
+    requestFileParts(dc);
 }
 
-// Should be called via checkStateAndCallGetDifference()
-void CTelegramDispatcher::getDifference()
+// Only the parts sent via the lost connection are sent again, the others are still answered by their connections.
+void CTelegramDispatcher::resumeLostFileParts(const CTelegramConnection *connection)
 {
-    activeConnection()->updatesGetDifference(m_updatesState.pts, m_updatesState.date, m_updatesState.qts);
-}
+    typedef QPair<quint32, quint32> FileRequestPart;
+    typedef QPair<quint64, quint32> FileUploadPart;
 
-void CTelegramDispatcher::whenUpdatesDifferenceReceived(const TLUpdatesDifference &updatesDifference)
-{
-    switch (updatesDifference.tlType) {
-    case TLValue::UpdatesDifference:
-    case TLValue::UpdatesDifferenceSlice:
-        qDebug() << Q_FUNC_INFO << "UpdatesDifference" << updatesDifference.newMessages.count();
-        foreach (const TLChat &chat, updatesDifference.chats) {
-            updateChat(chat);
+    foreach (const FileRequestPart &part, connection->fileRequestsInFlight()) {
+        QMap<quint32, FileRequestDescriptor>::iterator it = m_requestedFileDescriptors.find(part.first);
+
+        if (it != m_requestedFileDescriptors.end()) {
+            it.value().resetPart(part.second);
         }
+    }
 
-        foreach (const TLMessage &message, updatesDifference.newMessages) {
-            if ((message.tlType != TLValue::MessageService) && (filterReceivedMessage(telegramMessageFlagsToPublicMessageFlags(message.flags)))) {
-                continue;
-            }
+    foreach (const FileUploadPart &part, connection->fileUploadsInFlight()) {
+        FileUploadDescriptor *descriptor = m_fileUploads.value(part.first);
 
-            processMessageReceived(message);
-        }
-        if (updatesDifference.tlType == TLValue::UpdatesDifference) {
-            m_updatesState = updatesDifference.state;
-        } else { // UpdatesDifferenceSlice
-            m_updatesState = updatesDifference.intermediateState;
+        if (descriptor) {
+            descriptor->resetPart(part.second);
         }
-        break;
-    case TLValue::UpdatesDifferenceEmpty:
-        qDebug() << Q_FUNC_INFO << "UpdatesDifferenceEmpty";
-
-        // Try to update actual and local state in this weird case.
-        QTimer::singleShot(10, this, SLOT(getUpdatesState()));
-        return;
-        break;
-    default:
-        qDebug() << Q_FUNC_INFO << "unknown diff type:" << updatesDifference.tlType.toString();
-        break;
     }
 
-    checkStateAndCallGetDifference();
+    const quint32 dc = connection->dcInfo().id;
+
+    requestFileParts(dc);
+
+    if (dc == m_activeDc) {
+        uploadFileParts();
+    }
 }
 
-void CTelegramDispatcher::whenMessagesChatsReceived(const QVector<TLChat> &chats, const QVector<TLUser> &users)
+void CTelegramDispatcher::uploadFileParts()
 {
-    qDebug() << Q_FUNC_INFO << chats.count();
+    const QList<CTelegramConnection *> connections = bulkConnections(m_activeDc);
 
-    whenUsersReceived(users);
+    if (connections.isEmpty()) {
+        return;
+    }
 
-    foreach (const TLChat &chat, chats) {
-        updateChat(chat);
+    QVector<int> partsInFlight(connections.count());
+
+    for (int i = 0; i < connections.count(); ++i) {
+        partsInFlight[i] = connections.at(i)->fileUploadsInFlight().count();
     }
 
-    continueInitialization(StepChatInfo);
+    int index = leastLoadedConnection(partsInFlight, m_fileUploadWindow);
+
+    QMap<quint64, FileUploadDescriptor *>::const_iterator it;
+    for (it = m_fileUploads.constBegin(); (it != m_fileUploads.constEnd()) && (index >= 0); ++it) {
+        FileUploadDescriptor *descriptor = it.value();
+
+        quint32 part;
+        while ((index >= 0) && descriptor->takeNextPart(&part)) {
+            CTelegramConnection *connection = connections.at(index);
+
+            if (descriptor->isBig()) {
+                connection->uploadSaveBigFilePart(descriptor->fileId(), part, descriptor->partsCount(), descriptor->partData(part));
+            } else {
+                connection->uploadSaveFilePart(descriptor->fileId(), part, descriptor->partData(part));
+            }
+
+            ++partsInFlight[index];
+            index = leastLoadedConnection(partsInFlight, m_fileUploadWindow);
+        }
+    }
 }
 
-void CTelegramDispatcher::whenMessagesFullChatReceived(const TLChatFull &chat, const QVector<TLChat> &chats, const QVector<TLUser> &users)
+void CTelegramDispatcher::resumeFileUploads()
 {
-    Q_UNUSED(chats);
+    // Parts, sent before reconnection, would not be answered. Send them again.
+    foreach (FileUploadDescriptor *descriptor, m_fileUploads) {
+        descriptor->resetPartsInFlight();
+    }
 
-    whenUsersReceived(users);
-    updateFullChat(chat);
+    uploadFileParts();
 }
 
-void CTelegramDispatcher::setConnectionState(TelegramNamespace::ConnectionState state)
+void CTelegramDispatcher::finishFileUpload(FileUploadDescriptor *descriptor)
 {
-    qDebug() << Q_FUNC_INFO << state;
+    const QPair<TelegramNamespace::Peer, quint64> peerAndId(descriptor->peer(), descriptor->randomMessageId());
+    CTelegramConnection *connection = activeConnection();
 
-    if (m_connectionState == state) {
-        return;
+    if (connection) {
+        const quint64 requestId = connection->messagesSendMedia(descriptor->inputPeer(), descriptor->inputMedia(), descriptor->randomMessageId());
+        m_mediaSendRequests.insert(requestId, peerAndId);
     }
 
-    m_connectionState = state;
-    emit connectionStateChanged(state);
+    delete descriptor;
+
+    if (!connection) {
+        emit sentMessageStatusChanged(peerAndId.first, peerAndId.second, TelegramNamespace::MessageDeliveryStatusFailed);
+    }
 }
 
-bool CTelegramDispatcher::requestFile(const FileRequestDescriptor &requestId)
+// The options of a DC in the update supersede all of the known options (the alternative endpoints come together).
+// The options of the updated DC take the place of the first superseded one. Returns the number of updated known DCs.
+static int updateDcOptions(QVector<TLDcOption> *configuration, const QVector<TLDcOption> &options)
 {
-    if (!requestId.isValid()) {
-        return false;
+    QSet<quint32> updatedDcs;
+    foreach (const TLDcOption &option, options) {
+        updatedDcs.insert(option.id);
     }
 
-    m_requestedFileDescriptors.insert(++m_fileRequestCounter, requestId);
+    QVector<TLDcOption> result;
+    QSet<quint32> replacedDcs;
 
-    CTelegramConnection *connection = m_connections.value(requestId.dcId());
+    foreach (const TLDcOption &knownOption, *configuration) {
+        if (!updatedDcs.contains(knownOption.id)) {
+            result.append(knownOption);
+            continue;
+        }
 
-    if (connection && (connection->authState() == CTelegramConnection::AuthStateSignedIn)) {
-        connection->getFile(requestId.inputLocation(), m_fileRequestCounter);
-    } else {
-        ensureSignedConnection(requestId.dcId());
-    }
+        if (replacedDcs.contains(knownOption.id)) {
+            continue; // Superseded
+        }
 
-    return true;
-}
+        replacedDcs.insert(knownOption.id);
 
-inline bool ensureDcOption(QVector<TLDcOption> *vector, const TLDcOption &option)
-{
-    for (int i = 0; i < vector->count(); ++i) {
-        if (vector->at(i).id == option.id) {
-            vector->replace(i, option);
-            return true;
+        foreach (const TLDcOption &option, options) {
+            if (option.id == knownOption.id) {
+                result.append(option);
+            }
+        }
+    }
+
+    foreach (const TLDcOption &option, options) {
+        if (!replacedDcs.contains(option.id)) {
+            result.append(option);
         }
     }
 
-    return false;
+    *configuration = result;
+
+    return replacedDcs.count();
 }
 
 void CTelegramDispatcher::processUpdate(const TLUpdate &update)
@@ -1170,8 +2780,11 @@ void CTelegramDispatcher::processUpdate(const TLUpdate &update)
 //        break;
     case TLValue::UpdateReadMessages:
         foreach (quint32 messageId, update.messages) {
-            const QPair<QString, quint64> phoneAndId = m_messagesMap.value(messageId);
-            emit sentMessageStatusChanged(phoneAndId.first, phoneAndId.second, TelegramNamespace::MessageDeliveryStatusRead);
+            if (!m_messagesMap.contains(messageId)) {
+                continue;
+            }
+            const QPair<TelegramNamespace::Peer, quint64> peerAndId = m_messagesMap.value(messageId);
+            emit sentMessageStatusChanged(peerAndId.first, peerAndId.second, TelegramNamespace::MessageDeliveryStatusRead);
         }
         ensureUpdateState(update.pts);
         break;
@@ -1184,27 +2797,24 @@ void CTelegramDispatcher::processUpdate(const TLUpdate &update)
 //        ensureUpdateState(update.pts);
 //        break;
     case TLValue::UpdateUserTyping:
-        if (m_users.contains(update.userId)) {
-            emit contactTypingStatusChanged(userIdToIdentifier(update.userId), update.action.tlType == TLValue::SendMessageTypingAction);
-#if QT_VERSION >= 0x050000
-            m_userTypingMap.insert(update.userId, m_typingUpdateTimer->remainingTime() + s_userTypingActionPeriod);
-#else
-            m_userTypingMap.insert(update.userId, s_userTypingActionPeriod); // Missed timer remaining time method can leads to typing time period deviation.
-#endif
-            ensureTypingUpdateTimer(s_userTypingActionPeriod);
-        }
-        break;
     case TLValue::UpdateChatUserTyping:
         if (m_users.contains(update.userId)) {
-            emit contactChatTypingStatusChanged(telegramChatIdToPublicId(update.chatId), userIdToIdentifier(update.userId),
-                                                update.action.tlType == TLValue::SendMessageTypingAction);
-            const QPair<quint32,quint32> key(telegramChatIdToPublicId(update.chatId), update.userId);
-#if QT_VERSION >= 0x050000
-            m_userChatTypingMap.insert(key, m_typingUpdateTimer->remainingTime() + s_userTypingActionPeriod);
-#else
-            m_userChatTypingMap.insert(key, s_userTypingActionPeriod); // Missed timer remaining time method can leads to typing time period deviation.
-#endif
-            ensureTypingUpdateTimer(s_userTypingActionPeriod);
+            TelegramNamespace::Peer peer(update.userId);
+
+            if (update.tlType == TLValue::UpdateChatUserTyping) {
+                peer = TelegramNamespace::Peer(telegramChatIdToPublicId(update.chatId), TelegramNamespace::Peer::Chat);
+            }
+
+            const TypingKey key(peer, update.userId);
+            const bool typingStatus = update.action.tlType == TLValue::SendMessageTypingAction;
+
+            if (typingStatus) {
+                setTypingDeadline(key, s_userTypingActionPeriod);
+            } else {
+                removeTypingDeadline(key);
+            }
+
+            emit typingStatusChanged(peer, update.userId, typingStatus);
         }
         break;
     case TLValue::UpdateChatParticipants: {
@@ -1231,7 +2841,13 @@ void CTelegramDispatcher::processUpdate(const TLUpdate &update)
     case TLValue::UpdateUserName: {
         TLUser *user = m_users.value(update.userId);
         if (user) {
-            bool changed = (user->firstName == update.firstName) && (user->lastName == update.lastName);
+            if (user->username != update.username) {
+                removeUserFromIndexes(user);
+                user->username = update.username;
+                insertUserToIndexes(user);
+            }
+
+            bool changed = (user->firstName != update.firstName) || (user->lastName != update.lastName);
             if (changed) {
                 user->firstName = update.firstName;
                 user->lastName = update.lastName;
@@ -1240,6 +2856,15 @@ void CTelegramDispatcher::processUpdate(const TLUpdate &update)
         }
         break;
     }
+    case TLValue::UpdateUserPhone: {
+        TLUser *user = m_users.value(update.userId);
+        if (user && (user->phone != update.phone)) {
+            removeUserFromIndexes(user);
+            user->phone = update.phone;
+            insertUserToIndexes(user);
+        }
+        break;
+    }
 //    case TLValue::UpdateUserPhoto:
 //        update.userId;
 //        update.date;
@@ -1295,17 +2920,15 @@ void CTelegramDispatcher::processUpdate(const TLUpdate &update)
 //        update.version;
 //        break;
     case TLValue::UpdateDcOptions: {
-        int dcUpdatesReplaced = 0;
-        int dcUpdatesInserted = 0;
-        foreach (const TLDcOption &option, update.dcOptions) {
-            if (ensureDcOption(&m_dcConfiguration, option)) {
-                ++dcUpdatesReplaced;
-            } else {
-                ++dcUpdatesInserted;
-            }
+        const int dcUpdatesReplaced = updateDcOptions(&m_dcConfiguration, update.dcOptions);
+
+        qDebug() << Q_FUNC_INFO << "Dc configuration update replaces options of" << dcUpdatesReplaced << "DCs (" << update.dcOptions.count() << "options received).";
+
+        if (m_sharedData) {
+            m_sharedData->setDcConfiguration(m_dcConfiguration);
         }
 
-        qDebug() << Q_FUNC_INFO << "Dc configuration update replaces" << dcUpdatesReplaced << "options (" << dcUpdatesInserted << "options inserted).";
+        probeDcEndpoints();
         break;
     }
 //    case TLValue::UpdateUserBlocked:
@@ -1323,12 +2946,48 @@ void CTelegramDispatcher::processUpdate(const TLUpdate &update)
 }
 
 void CTelegramDispatcher::processMessageReceived(const TLMessage &message)
+{
+    TelegramNamespace::Message receivedMessage;
+
+    if (!applyReceivedMessage(message, &receivedMessage)) {
+        return;
+    }
+
+    if (m_messageBatchingEnabled) {
+        m_receivedMessagesBatch.append(receivedMessage);
+
+        // All messages of the decoded packets are reported at once, on the next event loop iteration.
+        if (m_receivedMessagesBatch.count() == 1) {
+            QTimer::singleShot(0, this, SLOT(flushReceivedMessages()));
+        }
+        return;
+    }
+
+    emit messageReceived(receivedMessage.peer, receivedMessage.fromId, receivedMessage.text, receivedMessage.type,
+                         receivedMessage.id, receivedMessage.flags, receivedMessage.timestamp);
+}
+
+void CTelegramDispatcher::flushReceivedMessages()
+{
+    if (m_receivedMessagesBatch.isEmpty()) {
+        return; // The connection is closed
+    }
+
+    const QVector<TelegramNamespace::Message> batch = m_receivedMessagesBatch;
+    m_receivedMessagesBatch.clear();
+
+    emit messagesReceived(batch);
+}
+
+// Updates the local state (chats, media, the message store) and fills the output with the message to report.
+// Returns false if the message should not be reported.
+bool CTelegramDispatcher::applyReceivedMessage(const TLMessage &message, TelegramNamespace::Message *output)
 {
 #ifdef DEVELOPER_BUILD
     qDebug() << Q_FUNC_INFO << message;
 #endif
     if (message.tlType == TLValue::MessageEmpty) {
-        return;
+        return false;
     }
 
     if (message.tlType == TLValue::MessageService) {
@@ -1351,7 +3010,7 @@ void CTelegramDispatcher::processMessageReceived(const TLMessage &message)
             TLVector<TLChatParticipant> participants = fullChat.participants.participants;
             for (int i = 0; i < participants.count(); ++i) {
                 if (participants.at(i).userId == action.userId) {
-                    return;
+                    return false;
                 }
             }
 
@@ -1374,46 +3033,168 @@ void CTelegramDispatcher::processMessageReceived(const TLMessage &message)
                 }
             }
 
-            fullChat.participants.participants = participants;
-            chat.participantsCount = participants.count();
-            updateChat(chat);
-            updateFullChat(fullChat);
-            }
-            break;
-        case TLValue::MessageActionChatEditTitle:
-            chat.title = action.title;
-            updateChat(chat);
-            break;
-        case TLValue::MessageActionChatEditPhoto:
-        case TLValue::MessageActionChatDeletePhoto:
-            fullChat.chatPhoto = action.photo;
-            updateFullChat(fullChat);
-            break;
-        default:
-            break;
-        }
+            fullChat.participants.participants = participants;
+            chat.participantsCount = participants.count();
+            updateChat(chat);
+            updateFullChat(fullChat);
+            }
+            break;
+        case TLValue::MessageActionChatEditTitle:
+            chat.title = action.title;
+            updateChat(chat);
+            break;
+        case TLValue::MessageActionChatEditPhoto:
+        case TLValue::MessageActionChatDeletePhoto:
+            fullChat.chatPhoto = action.photo;
+            updateFullChat(fullChat);
+            break;
+        default:
+            break;
+        }
+        return false;
+    }
+
+    const quint32 messageFlags = telegramMessageFlagsToPublicMessageFlags(message.flags);
+    const TelegramNamespace::MessageType messageType = telegramMessageTypeToPublicMessageType(message.media.tlType);
+
+    storeMessage(message);
+
+    if (!(messageType & m_acceptableMessageTypes)) {
+        return false;
+    }
+
+    if (message.media.tlType != TLValue::MessageMediaEmpty) {
+        const quint32 contactUserId = messageFlags & TelegramNamespace::MessageFlagOut ? message.toId.userId : message.fromId;
+        insertKnownMediaMessage(MediaMessageDescriptor(message, contactUserId, messageType));
+    }
+
+    if (message.toId.tlType == TLValue::PeerUser) {
+        output->peer = TelegramNamespace::Peer(messageFlags & TelegramNamespace::MessageFlagOut ? message.toId.userId : message.fromId);
+    } else {
+        output->peer = TelegramNamespace::Peer(telegramChatIdToPublicId(message.toId.chatId), TelegramNamespace::Peer::Chat);
+    }
+
+    output->fromId = message.fromId;
+    output->id = message.id;
+    output->timestamp = message.date;
+    output->flags = messageFlags;
+    output->type = messageType;
+    output->text = message.message;
+
+    return true;
+}
+
+void CTelegramDispatcher::storeMessage(const TLMessage &message)
+{
+    if (!m_messageStore.isEnabled() || (message.tlType != TLValue::Message)) {
+        return;
+    }
+
+    TelegramNamespace::Message storedMessage;
+    storedMessage.fromId = message.fromId;
+    storedMessage.id = message.id;
+    storedMessage.timestamp = message.date;
+    storedMessage.flags = telegramMessageFlagsToPublicMessageFlags(message.flags);
+    storedMessage.type = telegramMessageTypeToPublicMessageType(message.media.tlType);
+    storedMessage.text = message.message;
+
+    // Public chat ids are valid only within the session, so the store uses Telegram chat ids.
+    if (message.toId.tlType == TLValue::PeerUser) {
+        storedMessage.peer.id = storedMessage.flags & TelegramNamespace::MessageFlagOut ? message.toId.userId : message.fromId;
+    } else {
+        storedMessage.peer = TelegramNamespace::Peer(message.toId.chatId, TelegramNamespace::Peer::Chat);
+    }
+
+    m_messageStore.insert(storedMessage);
+}
+
+TelegramNamespace::Peer CTelegramDispatcher::peerToStorePeer(const TelegramNamespace::Peer &peer) const
+{
+    if (peer.type == TelegramNamespace::Peer::Chat) {
+        return TelegramNamespace::Peer(publicChatIdToChatId(peer.id), TelegramNamespace::Peer::Chat);
+    }
+
+    return peer;
+}
+
+void CTelegramDispatcher::storePeerToPublic(TelegramNamespace::Peer *peer)
+{
+    if (peer->type != TelegramNamespace::Peer::Chat) {
+        return;
+    }
+
+    // A chat from the history can be unknown in this session. It gets a new public id then.
+    const qint32 publicChatId = telegramChatIdToPublicId(peer->id);
+    peer->id = publicChatId < 0 ? insertTelegramChatId(peer->id) : publicChatId;
+}
+
+void CTelegramDispatcher::insertKnownMediaMessage(const MediaMessageDescriptor &media)
+{
+    if (!media.isValid()) {
+        return;
+    }
+
+    QList<QPair<quint32, MediaMessageDescriptor> > evicted;
+    m_knownMediaMessages.insert(media.messageId(), media, &evicted);
+
+    spillMediaMessages(evicted);
+    prewarmDc(media.dcId());
+}
+
+MediaMessageDescriptor CTelegramDispatcher::knownMediaMessage(quint32 messageId)
+{
+    if (m_knownMediaMessages.contains(messageId)) {
+        return m_knownMediaMessages.value(messageId);
+    }
+
+    updateMediaMessagesSpillFileName();
+
+    if (!m_mediaMessagesSpill.isEnabled()) {
+        return MediaMessageDescriptor();
+    }
+
+    const MediaMessageDescriptor media = MediaMessageDescriptor::fromByteArray(m_mediaMessagesSpill.take(messageId));
+
+    if (media.isValid() && (media.messageId() == messageId)) {
+        insertKnownMediaMessage(media);
+        return media;
+    }
+
+    return MediaMessageDescriptor();
+}
+
+void CTelegramDispatcher::spillMediaMessages(const QList<QPair<quint32, MediaMessageDescriptor> > &evicted)
+{
+    // Evicted messages are appended to the spill log, if the file cache is enabled. Otherwise they are dropped.
+    if (evicted.isEmpty()) {
         return;
     }
 
-    const quint32 messageFlags = telegramMessageFlagsToPublicMessageFlags(message.flags);
-    const TelegramNamespace::MessageType messageType = telegramMessageTypeToPublicMessageType(message.media.tlType);
+    updateMediaMessagesSpillFileName();
 
-    if (!(messageType & m_acceptableMessageTypes)) {
+    if (!m_mediaMessagesSpill.isEnabled()) {
         return;
     }
 
-    if (message.media.tlType != TLValue::MessageMediaEmpty) {
-        m_knownMediaMessages.insert(message.id, message);
+    QList<QPair<quint32, QByteArray> > records;
+    records.reserve(evicted.count());
+
+    for (int i = 0; i < evicted.count(); ++i) {
+        records.append(QPair<quint32, QByteArray>(evicted.at(i).first, evicted.at(i).second.toByteArray()));
     }
 
-    if (message.toId.tlType == TLValue::PeerUser) {
-        quint32 contactUserId = messageFlags & TelegramNamespace::MessageFlagOut ? message.toId.userId : message.fromId;
-        emit messageReceived(userIdToIdentifier(contactUserId),
-                             message.message, messageType, message.id, messageFlags, message.date);
-    } else {
-        emit chatMessageReceived(telegramChatIdToPublicId(message.toId.chatId), userIdToIdentifier(message.fromId),
-                                 message.message, messageType, message.id, messageFlags, message.date);
+    m_mediaMessagesSpill.insert(records);
+}
+
+void CTelegramDispatcher::updateMediaMessagesSpillFileName()
+{
+    // Message ids are per account, so each account has its own log.
+    if (!m_fileCache.isEnabled() || !m_selfUserId) {
+        m_mediaMessagesSpill.setFileName(QString());
+        return;
     }
+
+    m_mediaMessagesSpill.setFileName(m_fileCache.directory() + QString(QLatin1String("/media-messages-%1.log")).arg(m_selfUserId));
 }
 
 void CTelegramDispatcher::updateChat(const TLChat &newChat)
@@ -1479,14 +3260,18 @@ TLInputPeer CTelegramDispatcher::publicChatIdToInputPeer(quint32 publicChatId) c
 }
 
 TLInputPeer CTelegramDispatcher::identifierToInputPeer(const QString &identifier) const
+{
+    return peerToInputPeer(identifierToPeer(identifier));
+}
+
+TLInputPeer CTelegramDispatcher::peerToInputPeer(const TelegramNamespace::Peer &peer) const
 {
     TLInputPeer inputPeer;
 
-    if (identifier.startsWith(QLatin1String("chat"))) {
-        quint32 publicChatId = identifier.section(QLatin1String("chat"), 1).toUInt();
-        return publicChatIdToInputPeer(publicChatId);
+    if (peer.type == TelegramNamespace::Peer::Chat) {
+        return publicChatIdToInputPeer(peer.id);
     }
-    quint32 userId = identifierToUserId(identifier);
+    const quint32 userId = peer.id;
 
     if (userId == m_selfUserId) {
         inputPeer.tlType = TLValue::InputPeerSelf;
@@ -1516,13 +3301,43 @@ TLInputPeer CTelegramDispatcher::identifierToInputPeer(const QString &identifier
             inputPeer.tlType = TLValue::InputPeerContact;
             inputPeer.userId = userId;
         } else {
-            qDebug() << Q_FUNC_INFO << "Unknown user: " << maskPhoneNumber(identifier);
+            qDebug() << Q_FUNC_INFO << "Unknown user";
         }
     }
 
     return inputPeer;
 }
 
+TelegramNamespace::Peer CTelegramDispatcher::inputPeerToPeer(const TLInputPeer &inputPeer) const
+{
+    switch (inputPeer.tlType) {
+    case TLValue::InputPeerChat:
+        return TelegramNamespace::Peer(telegramChatIdToPublicId(inputPeer.chatId), TelegramNamespace::Peer::Chat);
+    case TLValue::InputPeerSelf:
+        return TelegramNamespace::Peer(m_selfUserId);
+    default:
+        return TelegramNamespace::Peer(inputPeer.userId);
+    }
+}
+
+TelegramNamespace::Peer CTelegramDispatcher::identifierToPeer(const QString &identifier) const
+{
+    if (identifier.startsWith(QLatin1String("chat"))) {
+        return TelegramNamespace::Peer(identifier.section(QLatin1String("chat"), 1).toUInt(), TelegramNamespace::Peer::Chat);
+    }
+
+    return TelegramNamespace::Peer(identifierToUserId(identifier));
+}
+
+QString CTelegramDispatcher::peerToIdentifier(const TelegramNamespace::Peer &peer) const
+{
+    if (peer.type == TelegramNamespace::Peer::Chat) {
+        return chatIdToIdentifier(peer.id);
+    }
+
+    return userIdToIdentifier(peer.id);
+}
+
 TLInputUser CTelegramDispatcher::phoneNumberToInputUser(const QString &phoneNumber) const
 {
     TLInputUser inputUser;
@@ -1580,13 +3395,13 @@ quint32 CTelegramDispatcher::identifierToUserId(const QString &identifier) const
         return identifier.section(QLatin1String("user"), 1).toUInt();
     }
 
-    foreach (const TLUser *user, m_users) {
-        if (user->phone == identifier) {
-            return user->id;
-        }
+    const quint32 id = m_phoneToUserId.value(identifier);
+
+    if (id) {
+        return id;
     }
 
-    return 0;
+    return m_userNameToUserId.value(identifier.toLower());
 }
 
 TLUser *CTelegramDispatcher::identifierToUser(const QString &identifier) const
@@ -1594,6 +3409,51 @@ TLUser *CTelegramDispatcher::identifierToUser(const QString &identifier) const
     return m_users.value(identifierToUserId(identifier));
 }
 
+// contacts.getContacts hash: md5 of the sorted contact ids, separated by commas. The server answers contactsNotModified if it matches.
+QString CTelegramDispatcher::contactListHash() const
+{
+    if (m_contactList.isEmpty()) {
+        return QString();
+    }
+
+    QByteArray idList;
+
+    foreach (quint32 userId, m_contactList) {
+        if (!idList.isEmpty()) {
+            idList.append(',');
+        }
+
+        idList.append(QByteArray::number(userId));
+    }
+
+    return QString::fromLatin1(QCryptographicHash::hash(idList, QCryptographicHash::Md5).toHex());
+}
+
+void CTelegramDispatcher::insertUserToIndexes(const TLUser *user)
+{
+    if (!user->phone.isEmpty()) {
+        m_phoneToUserId.insert(user->phone, user->id);
+    }
+
+    if (!user->username.isEmpty()) {
+        m_userNameToUserId.insert(user->username.toLower(), user->id);
+    }
+}
+
+void CTelegramDispatcher::removeUserFromIndexes(const TLUser *user)
+{
+    // The phone or user name can be already taken by another user.
+    if (m_phoneToUserId.value(user->phone) == user->id) {
+        m_phoneToUserId.remove(user->phone);
+    }
+
+    const QString userName = user->username.toLower();
+
+    if (m_userNameToUserId.value(userName) == user->id) {
+        m_userNameToUserId.remove(userName);
+    }
+}
+
 QString CTelegramDispatcher::userAvatarToken(const TLUser *user) const
 {
     const TLFileLocation &avatar = user->photo.photoSmall;
@@ -1630,20 +3490,32 @@ void CTelegramDispatcher::whenConnectionAuthChanged(int newState, quint32 dc)
         return;
     }
 
+    if (newState == CTelegramConnection::AuthStateSignedIn) {
+        ensureMediaConnections(dc);
+    }
+
     if (connection == activeConnection()) {
         if (newState == CTelegramConnection::AuthStateSignedIn) {
             connect(connection, SIGNAL(usersReceived(QVector<TLUser>)),
                     SLOT(whenUsersReceived(QVector<TLUser>)));
             connect(connection, SIGNAL(contactListReceived(QList<quint32>)),
                     SLOT(whenContactListReceived(QList<quint32>)));
+            connect(connection, SIGNAL(contactListNotModified()),
+                    SLOT(whenContactListNotModified()));
             connect(connection, SIGNAL(contactListChanged(QList<quint32>,QList<quint32>)),
                     SLOT(whenContactListChanged(QList<quint32>,QList<quint32>)));
             connect(connection, SIGNAL(updatesReceived(TLUpdates)),
                     SLOT(whenUpdatesReceived(TLUpdates)));
-            connect(connection, SIGNAL(messageSentInfoReceived(TLInputPeer,quint64,quint32,quint32,quint32,quint32)),
-                    SLOT(whenMessageSentInfoReceived(TLInputPeer,quint64,quint32,quint32,quint32,quint32)));
+            connect(connection, SIGNAL(messageSentInfoReceived(TLInputPeer,quint64,quint32,quint32,quint32,quint32,quint64)),
+                    SLOT(whenMessageSentInfoReceived(TLInputPeer,quint64,quint32,quint32,quint32,quint32,quint64)));
             connect(connection, SIGNAL(statedMessageReceived(TLMessagesStatedMessage,quint64)),
                     SLOT(whenStatedMessageReceived(TLMessagesStatedMessage,quint64)));
+            connect(connection, SIGNAL(broadcastSentInfoReceived(TLMessagesStatedMessages,quint64)),
+                    SLOT(whenBroadcastSentInfoReceived(TLMessagesStatedMessages,quint64)));
+            connect(connection, SIGNAL(rpcErrorReceived(quint64,TLValue,quint32,QString)),
+                    SLOT(whenRpcErrorReceived(quint64,TLValue,quint32,QString)));
+            connect(connection, SIGNAL(requestIdChanged(quint64,quint64)),
+                    SLOT(whenRequestIdChanged(quint64,quint64)));
             connect(connection, SIGNAL(updatesStateReceived(TLUpdatesState)),
                     SLOT(whenUpdatesStateReceived(TLUpdatesState)));
             connect(connection, SIGNAL(updatesDifferenceReceived(TLUpdatesDifference)),
@@ -1659,19 +3531,17 @@ void CTelegramDispatcher::whenConnectionAuthChanged(int newState, quint32 dc)
             connect(connection, SIGNAL(loggedOut(bool)),
                     SIGNAL(loggedOut(bool)));
 
+            resumeFileRequests(dc);
+            resumeFileUploads();
+            requeueSendRequests();
+            sendQueuedMessages();
             continueInitialization(StepSignIn);
         } else if (newState == CTelegramConnection::AuthStateSuccess) {
             continueInitialization(StepFirst); // Start initialization, if it is not started yet.
         }
     } else {
         if (newState == CTelegramConnection::AuthStateSignedIn) {
-            foreach (quint32 fileId, m_requestedFileDescriptors.keys()) {
-                if (m_requestedFileDescriptors.value(fileId).dcId() != dc) {
-                    continue;
-                }
-
-                connection->getFile(m_requestedFileDescriptors.value(fileId).inputLocation(), fileId);
-            }
+            resumeFileRequests(dc);
         } else if (newState == CTelegramConnection::AuthStateSuccess) {
             ensureSignedConnection(dc);
         }
@@ -1703,9 +3573,19 @@ void CTelegramDispatcher::whenConnectionStatusChanged(int newStatus, quint32 dc)
 
     if (connection == activeConnection()) {
         if (newStatus == CTelegramConnection::ConnectionStatusDisconnected) {
+            requeueSendRequests();
+
             if (connectionState() == TelegramNamespace::ConnectionStateConnecting) {
                 // We are connecting and there is Connecting->Disconnected changes in CTelegramConnection.
-                // Consider it as network error; try to reconnect after a second.
+                // Consider it as network error; try to reconnect (to the fastest endpoint of the DC) after a second.
+                m_endpointLatency.addFailure(connection->dcInfo());
+
+                const TLDcOption endpoint = dcInfoById(dc);
+
+                if (!endpoint.ipAddress.isEmpty()) {
+                    connection->setDcInfo(endpoint);
+                }
+
                 QTimer::singleShot(1000, connection, SLOT(connectToDc()));
             } else {
                 setConnectionState(TelegramNamespace::ConnectionStateDisconnected);
@@ -1718,106 +3598,324 @@ void CTelegramDispatcher::whenConnectionStatusChanged(int newStatus, quint32 dc)
     }
 }
 
-void CTelegramDispatcher::whenDcConfigurationUpdated(quint32 dc)
+void CTelegramDispatcher::whenDcConfigurationUpdated(quint32 dc)
+{
+    CTelegramConnection *connection = m_connections.value(dc);
+
+    if (!connection) {
+        return;
+    }
+
+    m_dcConfiguration = connection->dcConfiguration();
+
+    if (m_sharedData) {
+        m_sharedData->setDcConfiguration(m_dcConfiguration);
+    }
+
+    qDebug() << "Core: Got DC Configuration.";
+
+    probeDcEndpoints();
+    continueInitialization(StepDcConfiguration);
+}
+
+void CTelegramDispatcher::whenConnectionDcIdUpdated(quint32 connectionId, quint32 newDcId)
+{
+    CTelegramConnection *connection = m_connections.value(connectionId);
+
+    if (!connection) {
+        return;
+    }
+
+    if (m_connections.value(newDcId)) {
+        qDebug() << "Connection with wanted id already exists";
+    } else {
+        m_connections.remove(connectionId);
+        m_connections.insert(newDcId, connection);
+
+        TLDcOption info = connection->dcInfo();
+        info.id = newDcId;
+        connection->setDcInfo(info);
+
+        if (m_activeDc == connectionId) {
+
+            if (m_wantedActiveDc == m_activeDc) {
+                m_wantedActiveDc = newDcId;
+            }
+
+            setActiveDc(newDcId);
+        }
+
+        qDebug() << "Connection DC Id changed from" << connectionId << "to" << newDcId;
+    }
+}
+
+void CTelegramDispatcher::whenPackageRedirected(const QByteArray &data, quint32 dc)
+{
+    CTelegramConnection *connection = m_connections.value(dc);
+
+    if (connection && connection->authState() >= CTelegramConnection::AuthStateSuccess) {
+        connection->processRedirectedPackage(data);
+    } else {
+        m_delayedPackages.insertMulti(dc, data);
+        establishConnectionToDc(dc);
+    }
+}
+
+void CTelegramDispatcher::whenConnectionAuthorizationError()
+{
+    CTelegramConnection *connection = qobject_cast<CTelegramConnection *>(sender());
+
+    if (!connection) {
+        return;
+    }
+
+    if (m_mediaConnections.value(connection->dcInfo().id).contains(connection)) {
+        // The media connections use the auth key of the main connection of the DC.
+        connection = m_connections.value(connection->dcInfo().id);
+
+        if (!connection) {
+            return;
+        }
+    }
+
+    if (connection == activeConnection()) {
+        emit authorizationErrorReceived();
+        return;
+    }
+
+    // The (restored) auth key of the other DC is not valid anymore. Authorize on the DC again from scratch.
+    const TLDcOption dcInfo = connection->dcInfo();
+    qDebug() << Q_FUNC_INFO << "Drop the auth key of dc" << dcInfo.id;
+
+    m_connections.remove(m_connections.key(connection));
+    connection->disconnect(this);
+    connection->deleteLater();
+
+    m_exportedAuthentications.remove(dcInfo.id);
+    removeMediaConnections(dcInfo.id, 0);
+
+    // The answers of the dropped connection are not processed anymore.
+    resumeLostFileParts(connection);
+
+    CTelegramConnection *newConnection = createConnection(dcInfo);
+    m_connections.insert(dcInfo.id, newConnection);
+    newConnection->connectToDc();
+}
+
+void CTelegramDispatcher::whenEndpointProbed(const TLDcOption &endpoint, qint64 connectTime)
+{
+    if (connectTime < 0) {
+        m_endpointLatency.addFailure(endpoint);
+    } else {
+        m_endpointLatency.addSample(endpoint, connectTime);
+    }
+}
+
+void CTelegramDispatcher::whenMediaConnectionAuthChanged(int newState, quint32 dc)
+{
+    if (newState != CTelegramConnection::AuthStateSignedIn) {
+        return;
+    }
+
+    requestFileParts(dc);
+
+    if (dc == m_activeDc) {
+        uploadFileParts();
+    }
+}
+
+void CTelegramDispatcher::whenMediaConnectionStatusChanged(int newStatus, quint32 dc)
+{
+    if (newStatus != CTelegramConnection::ConnectionStatusDisconnected) {
+        return;
+    }
+
+    CTelegramConnection *connection = qobject_cast<CTelegramConnection *>(sender());
+
+    if (!connection || !m_mediaConnections[dc].removeOne(connection)) {
+        return;
+    }
+
+    qDebug() << Q_FUNC_INFO << "Media connection to dc" << dc << "is lost";
+
+    connection->disconnect(this);
+    connection->deleteLater();
+
+    // Parts requested via the lost connection would not be answered.
+    resumeLostFileParts(connection);
+
+    QTimer::singleShot(s_mediaConnectionRetryDelay, this, SLOT(restoreMediaConnections()));
+}
+
+void CTelegramDispatcher::restoreMediaConnections()
+{
+    foreach (CTelegramConnection *connection, m_connections) {
+        if (connection->authState() == CTelegramConnection::AuthStateSignedIn) {
+            ensureMediaConnections(connection->dcInfo().id);
+        }
+    }
+}
+
+void CTelegramDispatcher::whenWantedActiveDcChanged(quint32 dc)
+{
+    qDebug() << Q_FUNC_INFO << dc;
+    CTelegramConnection *connection = m_connections.value(dc);
+
+    if (connection && connection->authState() >= CTelegramConnection::AuthStateSuccess) {
+        setActiveDc(dc);
+    } else {
+        m_wantedActiveDc = dc;
+        establishConnectionToDc(dc);
+    }
+}
+
+void CTelegramDispatcher::whenFilePartReceived(const TLUploadFile &file, quint32 fileId, quint32 offset)
+{
+    if (!m_requestedFileDescriptors.contains(fileId)) {
+        qDebug() << Q_FUNC_INFO << "Unexpected fileId" << fileId;
+        return;
+    }
+
+    FileRequestDescriptor &descriptor = m_requestedFileDescriptors[fileId];
+    const quint32 dc = descriptor.dcId();
+
+    if (!descriptor.setPartReceived(offset, file)) {
+        requestFileParts(dc);
+        return;
+    }
+
+    // Signal receivers are free to make new requests, so the descriptor reference is not used after emission.
+    const FileRequestDescriptor::Type type = descriptor.type();
+    const quint32 messageId = descriptor.messageId();
+    const quint32 receivedSize = descriptor.receivedSize();
+    const quint32 size = descriptor.size();
+    const bool finished = descriptor.isFinished();
+
+    QByteArray streamData;
+    QPointer<QIODevice> outputDevice;
+
+    if (descriptor.isStreaming()) {
+        streamData = descriptor.takeData();
+        outputDevice = descriptor.outputDevice();
+    }
+
+    FileRequestDescriptor finishedDescriptor;
+
+    if (finished) {
+        finishedDescriptor = m_requestedFileDescriptors.take(fileId);
+
+        // Streamed data is not kept, so only whole files get into the cache.
+        if (!finishedDescriptor.isStreaming()) {
+            m_fileCache.insert(CFileCache::key(finishedDescriptor.dcId(), finishedDescriptor.inputLocation()),
+                               finishedDescriptor.data(), finishedDescriptor.fileType());
+        }
+    }
+
+    requestFileParts(dc);
+
+    if (!streamData.isEmpty()) {
+        if (outputDevice) {
+            outputDevice->write(streamData);
+        }
+
+        emit messageMediaDataPartReceived(messageId, receivedSize - streamData.size(), streamData);
+    }
+
+    if (type == FileRequestDescriptor::MessageMediaData) {
+        emit messageMediaDataProgress(messageId, receivedSize, size);
+    }
+
+    if (finished) {
+        finishFileRequest(finishedDescriptor);
+    }
+}
+
+void CTelegramDispatcher::whenFilePartRequestFailed(quint32 fileId, quint32 offset)
 {
-    CTelegramConnection *connection = m_connections.value(dc);
-
-    if (!connection) {
+    if (!m_requestedFileDescriptors.contains(fileId)) {
         return;
     }
 
-    m_dcConfiguration = connection->dcConfiguration();
+    FileRequestDescriptor &descriptor = m_requestedFileDescriptors[fileId];
+    const quint32 dc = descriptor.dcId();
 
-    qDebug() << "Core: Got DC Configuration.";
+    descriptor.setPartFailed(offset);
 
-    continueInitialization(StepDcConfiguration);
+    if (descriptor.failuresCount() > s_fileRequestMaxFailures) {
+        qDebug() << Q_FUNC_INFO << "File request" << fileId << "is dropped after" << descriptor.failuresCount() << "failures";
+        m_requestedFileDescriptors.remove(fileId);
+    }
+
+    requestFileParts(dc);
 }
 
-void CTelegramDispatcher::whenConnectionDcIdUpdated(quint32 connectionId, quint32 newDcId)
+void CTelegramDispatcher::whenFilePartSaved(quint64 fileId, quint32 filePart, bool result)
 {
-    CTelegramConnection *connection = m_connections.value(connectionId);
+    FileUploadDescriptor *descriptor = m_fileUploads.value(fileId);
 
-    if (!connection) {
+    if (!descriptor) {
         return;
     }
 
-    if (m_connections.value(newDcId)) {
-        qDebug() << "Connection with wanted id already exists";
-    } else {
-        m_connections.remove(connectionId);
-        m_connections.insert(newDcId, connection);
-
-        TLDcOption info = connection->dcInfo();
-        info.id = newDcId;
-        connection->setDcInfo(info);
+    if (!result) {
+        descriptor->setPartFailed(filePart);
 
-        if (m_activeDc == connectionId) {
+        if (descriptor->failuresCount() > s_fileUploadMaxFailures) {
+            qDebug() << Q_FUNC_INFO << "File upload" << fileId << "is dropped after" << descriptor->failuresCount() << "failures";
+            const QPair<TelegramNamespace::Peer, quint64> peerAndId(descriptor->peer(), descriptor->randomMessageId());
 
-            if (m_wantedActiveDc == m_activeDc) {
-                m_wantedActiveDc = newDcId;
-            }
+            m_fileUploads.remove(fileId);
+            delete descriptor;
 
-            setActiveDc(newDcId);
+            uploadFileParts();
+            emit sentMessageStatusChanged(peerAndId.first, peerAndId.second, TelegramNamespace::MessageDeliveryStatusFailed);
+        } else {
+            uploadFileParts();
         }
 
-        qDebug() << "Connection DC Id changed from" << connectionId << "to" << newDcId;
+        return;
     }
-}
 
-void CTelegramDispatcher::whenPackageRedirected(const QByteArray &data, quint32 dc)
-{
-    CTelegramConnection *connection = m_connections.value(dc);
-
-    if (connection && connection->authState() >= CTelegramConnection::AuthStateSuccess) {
-        connection->processRedirectedPackage(data);
-    } else {
-        m_delayedPackages.insertMulti(dc, data);
-        establishConnectionToDc(dc);
+    if (!descriptor->setPartUploaded(filePart)) {
+        return;
     }
-}
 
-void CTelegramDispatcher::whenWantedActiveDcChanged(quint32 dc)
-{
-    qDebug() << Q_FUNC_INFO << dc;
-    CTelegramConnection *connection = m_connections.value(dc);
+    const quint64 randomMessageId = descriptor->randomMessageId();
+    const quint32 uploadedSize = descriptor->uploadedSize();
+    const quint32 size = descriptor->size();
 
-    if (connection && connection->authState() >= CTelegramConnection::AuthStateSuccess) {
-        setActiveDc(dc);
-    } else {
-        m_wantedActiveDc = dc;
-        establishConnectionToDc(dc);
+    if (descriptor->isFinished()) {
+        m_fileUploads.remove(fileId);
+        finishFileUpload(descriptor);
     }
+
+    uploadFileParts();
+
+    emit mediaUploadProgress(randomMessageId, uploadedSize, size);
 }
 
-void CTelegramDispatcher::whenFileReceived(const TLUploadFile &file, quint32 fileId)
+void CTelegramDispatcher::finishFileRequest(const FileRequestDescriptor &descriptor)
 {
-    if (!m_requestedFileDescriptors.contains(fileId)) {
-        qDebug() << Q_FUNC_INFO << "Unexpected fileId" << fileId;
-        return;
-    }
-
-    const QString mimeType = mimeTypeByStorageFileType(file.type.tlType);
-    const FileRequestDescriptor descriptor = m_requestedFileDescriptors.take(fileId);
+    const QString mimeType = mimeTypeByStorageFileType(descriptor.fileType());
 
     switch (descriptor.type()) {
     case FileRequestDescriptor::Avatar:
         if (m_users.contains(descriptor.userId())) {
-            emit avatarReceived(userIdToIdentifier(descriptor.userId()), file.bytes, mimeType, userAvatarToken(m_users.value(descriptor.userId())));
+            emit avatarReceived(userIdToIdentifier(descriptor.userId()), descriptor.data(), mimeType, userAvatarToken(m_users.value(descriptor.userId())));
         } else {
             qDebug() << Q_FUNC_INFO << "Unknown userId" << descriptor.userId();
         }
         break;
-    case FileRequestDescriptor::MessageMediaData:
-        if (m_knownMediaMessages.contains(descriptor.messageId())) {
-            const TLMessage message = m_knownMediaMessages.value(descriptor.messageId());
-            const quint32 messageFlags = telegramMessageFlagsToPublicMessageFlags(message.flags);
-            const TelegramNamespace::MessageType messageType = telegramMessageTypeToPublicMessageType(message.media.tlType);
-
-            quint32 contactUserId = messageFlags & TelegramNamespace::MessageFlagOut ? message.toId.userId : message.fromId;
-            emit messageMediaDataReceived(userIdToIdentifier(contactUserId), message.id, file.bytes, mimeType, messageType);
+    case FileRequestDescriptor::MessageMediaData: {
+        const MediaMessageDescriptor media = knownMediaMessage(descriptor.messageId());
+
+        if (media.isValid()) {
+            emit messageMediaDataReceived(userIdToIdentifier(media.contactUserId()), media.messageId(), descriptor.data(), mimeType, media.type());
         } else {
             qDebug() << Q_FUNC_INFO << "Unknown media message data received" << descriptor.messageId();
         }
+    }
+        break;
     default:
         break;
     }
@@ -1830,6 +3928,76 @@ void CTelegramDispatcher::whenUpdatesReceived(const TLUpdates &updates)
 #else
     qDebug() << Q_FUNC_INFO;
 #endif
+    if (!m_pendingDifferences.isEmpty()) {
+        m_updatesDuringDifference.append(updates);
+        return;
+    }
+
+    switch (updates.tlType) {
+    case TLValue::UpdateShortMessage:
+    case TLValue::UpdateShortChatMessage:
+    case TLValue::UpdatesCombined:
+    case TLValue::Updates:
+        break;
+    default:
+        applyUpdates(updates);
+        return;
+    }
+
+    // Seq-ordered updates. Zero seq means that the updates are not a part of the sequence.
+    const quint32 seqStart = (updates.tlType == TLValue::UpdatesCombined) ? updates.seqStart : updates.seq;
+
+    if (!updates.seq || m_updatesStateIsLocked || !m_updatesState.seq) {
+        // The order is not known (yet) or the state is going to be synced with the difference.
+        applyUpdates(updates);
+        return;
+    }
+
+    if (updates.seq <= m_updatesState.seq) {
+        qDebug() << Q_FUNC_INFO << "Skip already applied updates" << seqStart << updates.seq;
+        return;
+    }
+
+    if (seqStart > m_updatesState.seq + 1) {
+        qDebug() << Q_FUNC_INFO << "Updates gap:" << m_updatesState.seq << "->" << seqStart;
+        m_pendingUpdates.insert(seqStart, updates);
+
+        if (!m_updatesGapTimer->isActive()) {
+            m_updatesGapTimer->start();
+        }
+        return;
+    }
+
+    applyUpdates(updates);
+
+    // Apply the buffered updates which are contiguous now.
+    while (!m_pendingUpdates.isEmpty() && (m_pendingUpdates.begin().key() <= m_updatesState.seq + 1)) {
+        const TLUpdates pendingUpdates = m_pendingUpdates.begin().value();
+        m_pendingUpdates.erase(m_pendingUpdates.begin());
+
+        if (pendingUpdates.seq > m_updatesState.seq) {
+            applyUpdates(pendingUpdates);
+        }
+    }
+
+    if (m_pendingUpdates.isEmpty()) {
+        m_updatesGapTimer->stop();
+    }
+}
+
+void CTelegramDispatcher::whenUpdatesGapTimeout()
+{
+    if (m_pendingUpdates.isEmpty()) {
+        return;
+    }
+
+    qDebug() << Q_FUNC_INFO << "The gap is not filled:" << m_updatesState.seq << "->" << m_pendingUpdates.begin().key();
+
+    getUpdatesState();
+}
+
+void CTelegramDispatcher::applyUpdates(const TLUpdates &updates)
+{
     switch (updates.tlType) {
     case TLValue::UpdatesTooLong:
         getUpdatesState();
@@ -1850,41 +4018,41 @@ void CTelegramDispatcher::whenUpdatesReceived(const TLUpdates &updates)
             shortMessage.toId.tlType = TLValue::PeerUser;
             processMessageReceived(shortMessage);
 
-            const QString phone = userIdToIdentifier(updates.fromId);
-            if (!phone.isEmpty()) {
-                if (m_userTypingMap.value(updates.fromId, 0) > 0) {
-                    m_userTypingMap.remove(updates.fromId);
-                    emit contactTypingStatusChanged(phone, /* typingStatus */ false);
-                }
+            const TypingKey key(TelegramNamespace::Peer(updates.fromId), updates.fromId);
+
+            if (removeTypingDeadline(key)) {
+                emit typingStatusChanged(key.first, key.second, /* typingStatus */ false);
             }
         } else {
             shortMessage.toId.tlType = TLValue::PeerChat;
             shortMessage.toId.chatId = updates.chatId;
             processMessageReceived(shortMessage);
 
-            const QString phone = userIdToIdentifier(updates.fromId);
-            const quint32 publicChatId = telegramChatIdToPublicId(updates.chatId);
-            const QPair<quint32,quint32> key(publicChatId, updates.fromId);
+            const TypingKey key(TelegramNamespace::Peer(telegramChatIdToPublicId(updates.chatId), TelegramNamespace::Peer::Chat), updates.fromId);
 
-            if (m_userChatTypingMap.contains(key)) {
-                m_userChatTypingMap.remove(key);
-                emit contactChatTypingStatusChanged(publicChatId, phone, /* typingStatus */ false);
+            if (removeTypingDeadline(key)) {
+                emit typingStatusChanged(key.first, key.second, /* typingStatus */ false);
             }
         }
     }
-        ensureUpdateState(updates.pts);
+        ensureUpdateState(updates.pts, updates.seq, updates.date);
         break;
     case TLValue::UpdateShort:
         processUpdate(updates.update);
         break;
-    case TLValue::UpdatesCombined:
-        qDebug() << Q_FUNC_INFO << "UpdatesCombined processing is not implemented yet.";
-        break;
+    case TLValue::UpdatesCombined: // The seqStart..seq range, applied as a whole
     case TLValue::Updates:
-        // Initial implementation
         for (int i = 0; i < updates.updates.count(); ++i) {
-            processUpdate(updates.updates.at(i));
+            const TLUpdate &update = updates.updates.at(i);
+
+            // The range can overlap the already applied updates (e.g. a combined range after a gap is filled).
+            if (update.pts && (update.pts <= m_updatesState.pts)) {
+                continue;
+            }
+
+            processUpdate(update);
         }
+        ensureUpdateState(0, updates.seq, updates.date);
         break;
     default:
         break;
@@ -1920,16 +4088,44 @@ void CTelegramDispatcher::setActiveDc(quint32 dc, bool syncWantedDc)
     qDebug() << Q_FUNC_INFO << dc;
 }
 
-void CTelegramDispatcher::ensureTypingUpdateTimer(int interval)
+void CTelegramDispatcher::setTypingDeadline(const TypingKey &key, int timeout)
 {
-    if (!m_typingUpdateTimer->isActive()) {
-#if QT_VERSION >= 0x050000
-        m_typingUpdateTimer->start(interval);
-#else
-        Q_UNUSED(interval);
-        m_typingUpdateTimer->start(s_timerMaxInterval);
-#endif
+    removeTypingDeadline(key);
+
+    const qint64 deadline = m_typingClock.elapsed() + timeout;
+
+    m_typingDeadlines.insert(key, deadline);
+    m_typingExpirations.insert(deadline, key);
+
+    if (m_typingExpirations.begin().key() == deadline) {
+        startTypingUpdateTimer(); // The new deadline is the nearest one.
+    }
+}
+
+bool CTelegramDispatcher::removeTypingDeadline(const TypingKey &key)
+{
+    QMap<TypingKey, qint64>::iterator it = m_typingDeadlines.find(key);
+
+    if (it == m_typingDeadlines.end()) {
+        return false;
+    }
+
+    m_typingExpirations.remove(it.value(), key);
+    m_typingDeadlines.erase(it);
+
+    // The timer is not rearmed here: a timeout without expired entries just arms it for the next deadline.
+    return true;
+}
+
+void CTelegramDispatcher::startTypingUpdateTimer()
+{
+    if (m_typingExpirations.isEmpty()) {
+        m_typingUpdateTimer->stop();
+        return;
     }
+
+    const qint64 interval = m_typingExpirations.begin().key() - m_typingClock.elapsed();
+    m_typingUpdateTimer->start(int(qMax<qint64>(interval, 0)));
 }
 
 void CTelegramDispatcher::continueInitialization(CTelegramDispatcher::InitializationStep justDone)
@@ -1942,13 +4138,8 @@ void CTelegramDispatcher::continueInitialization(CTelegramDispatcher::Initializa
 
     m_initializationState = InitializationStep(m_initializationState|justDone);
 
-    if (!(m_requestedSteps & StepDcConfiguration)) { // DC configuration is not requested yet
-        getDcConfiguration();
-        m_requestedSteps |= StepDcConfiguration;
-    }
-
-    if (!(m_initializationState & StepDcConfiguration)) { // DC configuration is unknown yet
-        return;
+    if (justDone) {
+        m_initializationTimings.insert(justDone, m_initializationClock.elapsed());
     }
 
     if (justDone == StepDcConfiguration) {
@@ -1961,53 +4152,121 @@ void CTelegramDispatcher::continueInitialization(CTelegramDispatcher::Initializa
 
     if ((m_initializationState & StepDcConfiguration) && (m_initializationState & StepSignIn)) {
         setConnectionState(TelegramNamespace::ConnectionStateAuthenticated);
+    }
 
-        if (!(m_requestedSteps & StepKnowSelf)) {
-            getInitialUsers();
-            m_requestedSteps |= StepKnowSelf;
-        }
+    struct StepRequest {
+        InitializationStep step;
+        quint32 prerequisites; // InitializationStep flags
+        void (CTelegramDispatcher::*request)();
+    };
 
-        if (!(m_requestedSteps & StepContactList)) {
-            getContacts();
-            m_requestedSteps |= StepContactList;
-        }
+    // Each step is requested as soon as its prerequisites are done.
+    static const StepRequest stepRequests[] = {
+        { StepDcConfiguration, StepFirst, &CTelegramDispatcher::getDcConfiguration },
+        { StepKnowSelf, StepSignIn, &CTelegramDispatcher::getInitialUsers },
+        { StepContactList, StepSignIn, &CTelegramDispatcher::getContacts },
+        { StepChatInfo, StepSignIn, &CTelegramDispatcher::getChatsInfo },
+        { StepUpdatesState, StepSignIn, &CTelegramDispatcher::getUpdatesState },
+        // We need to know users (contact list and self) info to properly process the updates difference.
+        { StepUpdates, StepKnowSelf|StepContactList|StepUpdatesState, &CTelegramDispatcher::checkStateAndCallGetDifference },
+    };
+
+    CTelegramConnection *connection = activeConnection();
+
+    // Requests made in one pass do not depend on each other, so they are sent in one container.
+    connection->beginRequestsBatch();
+
+    for (size_t i = 0; i < sizeof(stepRequests) / sizeof(stepRequests[0]); ++i) {
+        const StepRequest &stepRequest = stepRequests[i];
 
-        if (!(m_requestedSteps & StepChatInfo)) {
-            getChatsInfo();
-            m_requestedSteps |= StepChatInfo;
+        if ((m_requestedSteps & stepRequest.step) || ((m_initializationState & stepRequest.prerequisites) != stepRequest.prerequisites)) {
+            continue;
         }
-    }
 
-    if (m_initializationState == StepDone) {
-        setConnectionState(TelegramNamespace::ConnectionStateReady);
-        return;
+        qDebug() << Q_FUNC_INFO << "request step" << stepRequest.step << "at" << m_initializationClock.elapsed() << "ms";
+
+        m_requestedSteps |= stepRequest.step;
+        (this->*stepRequest.request)();
     }
 
-    if ((m_initializationState & StepContactList) && (m_initializationState & StepKnowSelf)) {
-        // We need to know users (contact list and self) info to properly process updates.
-        if (!(m_requestedSteps & StepUpdates)) {
-            getUpdatesState();
-            m_requestedSteps |= StepUpdates;
+    connection->endRequestsBatch();
+
+    if (m_initializationState == StepDone) {
+        if (connectionState() != TelegramNamespace::ConnectionStateReady) {
+            qDebug() << Q_FUNC_INFO << "ready in" << m_initializationClock.elapsed() << "ms, steps done at" << m_initializationTimings;
         }
+
+        setConnectionState(TelegramNamespace::ConnectionStateReady);
     }
 }
 
 qint32 CTelegramDispatcher::telegramChatIdToPublicId(quint32 telegramChatId) const
 {
-    for (int i = 0; i < m_chatIds.count(); ++i) {
-        if (m_chatIds.at(i) == telegramChatId) {
-            return i;
-        }
+    QHash<quint32, quint32>::const_iterator it = m_chatIdToPublicId.constFind(telegramChatId);
+
+    if (it == m_chatIdToPublicId.constEnd()) {
+        return -1;
     }
 
-    return -1;
+    return it.value();
 }
 
 /* Return public chat id */
 quint32 CTelegramDispatcher::insertTelegramChatId(quint32 telegramChatId)
 {
     m_chatIds.append(telegramChatId);
-    return m_chatIds.count() - 1;
+
+    const quint32 publicChatId = m_chatIds.count() - 1;
+
+    if (telegramChatId && !m_chatIdToPublicId.contains(telegramChatId)) { // Zero is a placeholder for a chat, which is not created yet
+        m_chatIdToPublicId.insert(telegramChatId, publicChatId);
+    }
+
+    return publicChatId;
+}
+
+void CTelegramDispatcher::setTelegramChatId(quint32 publicChatId, quint32 telegramChatId)
+{
+    // The first (least) public id wins for a duplicated chat id, as in insertTelegramChatId() and setTelegramChatIds().
+    const quint32 previousChatId = m_chatIds.at(publicChatId);
+
+    m_chatIds[publicChatId] = telegramChatId;
+
+    if (previousChatId && (m_chatIdToPublicId.value(previousChatId) == publicChatId)) {
+        const int anotherPublicId = m_chatIds.indexOf(previousChatId);
+
+        if (anotherPublicId < 0) {
+            m_chatIdToPublicId.remove(previousChatId);
+        } else {
+            m_chatIdToPublicId.insert(previousChatId, anotherPublicId);
+        }
+    }
+
+    if (!telegramChatId) {
+        return;
+    }
+
+    QHash<quint32, quint32>::iterator it = m_chatIdToPublicId.find(telegramChatId);
+
+    if (it == m_chatIdToPublicId.end()) {
+        m_chatIdToPublicId.insert(telegramChatId, publicChatId);
+    } else if (it.value() > publicChatId) {
+        it.value() = publicChatId;
+    }
+}
+
+void CTelegramDispatcher::setTelegramChatIds(const TLVector<quint32> &telegramChatIds)
+{
+    m_chatIds = telegramChatIds;
+    m_chatIdToPublicId.clear();
+    m_chatIdToPublicId.reserve(m_chatIds.count());
+
+    // Walk backward, so the first public id wins for a duplicated chat id, as the linear search did.
+    for (int i = m_chatIds.count() - 1; i >= 0; --i) {
+        if (m_chatIds.at(i)) {
+            m_chatIdToPublicId.insert(m_chatIds.at(i), i);
+        }
+    }
 }
 
 bool CTelegramDispatcher::havePublicChatId(quint32 publicChatId) const
@@ -2059,10 +4318,53 @@ void CTelegramDispatcher::checkStateAndCallGetDifference()
     if (m_updatesStateIsLocked) {
         QTimer::singleShot(10, this, SLOT(getDifference()));
     } else {
+        // The message box is in sync, so the actual seq is the next base for the updates ordering.
+        ensureUpdateState(0, m_actualState.seq, m_actualState.date);
+        drainPendingUpdates();
         continueInitialization(StepUpdates);
     }
 }
 
+void CTelegramDispatcher::drainPendingUpdates()
+{
+    // The gap is resolved by the state (and the difference), so the buffered updates are not waited for anymore.
+    // The ones with a new pts are applied in order, the rest are covered by the state and dropped.
+    const QMap<quint32, TLUpdates> pendingUpdates = m_pendingUpdates;
+    m_pendingUpdates.clear();
+    m_updatesGapTimer->stop();
+
+    foreach (TLUpdates updates, pendingUpdates) {
+        if (updates.seq > m_updatesState.seq) {
+            applyUpdates(updates); // The already applied part is skipped by pts
+            continue;
+        }
+
+        switch (updates.tlType) {
+        case TLValue::UpdateShortMessage:
+        case TLValue::UpdateShortChatMessage:
+            if (updates.pts > m_updatesState.pts) {
+                applyUpdates(updates);
+            }
+            break;
+        default: {
+            TLVector<TLUpdate> newUpdates;
+
+            foreach (const TLUpdate &update, updates.updates) {
+                if (update.pts > m_updatesState.pts) {
+                    newUpdates.append(update);
+                }
+            }
+
+            if (!newUpdates.isEmpty()) {
+                updates.updates = newUpdates;
+                applyUpdates(updates);
+            }
+            break;
+        }
+        }
+    }
+}
+
 CTelegramConnection *CTelegramDispatcher::createConnection(const TLDcOption &dc)
 {
     CTelegramConnection *connection = new CTelegramConnection(m_appInformation, this);
@@ -2079,15 +4381,134 @@ CTelegramConnection *CTelegramDispatcher::createConnection(const TLDcOption &dc)
     connect(connection,
             SIGNAL(authSignErrorReceived(TelegramNamespace::AuthSignError,QString)),
             SIGNAL(authSignErrorReceived(TelegramNamespace::AuthSignError,QString)));
-    connect(connection, SIGNAL(authorizationErrorReceived()), SIGNAL(authorizationErrorReceived()));
+    connect(connection, SIGNAL(authorizationErrorReceived()), SLOT(whenConnectionAuthorizationError()));
 
-    connect(connection, SIGNAL(fileReceived(TLUploadFile,quint32)), SLOT(whenFileReceived(TLUploadFile,quint32)));
+    connect(connection, SIGNAL(filePartReceived(TLUploadFile,quint32,quint32)), SLOT(whenFilePartReceived(TLUploadFile,quint32,quint32)));
+    connect(connection, SIGNAL(filePartRequestFailed(quint32,quint32)), SLOT(whenFilePartRequestFailed(quint32,quint32)));
+    connect(connection, SIGNAL(filePartSaved(quint64,quint32,bool)), SLOT(whenFilePartSaved(quint64,quint32,bool)));
 
     connection->setDcInfo(dc);
+    connection->setBulkRequestsLimit(m_bulkRequestsLimit);
 
     return connection;
 }
 
+void CTelegramDispatcher::ensureMediaConnections(quint32 dc)
+{
+    CTelegramConnection *mainConnection = m_connections.value(dc);
+
+    if (!mainConnection || (mainConnection->authState() != CTelegramConnection::AuthStateSignedIn)) {
+        return;
+    }
+
+    QList<CTelegramConnection *> &connections = m_mediaConnections[dc];
+
+    while (connections.count() < m_mediaConnectionsPerDc) {
+        // Media connections share the auth key of the main one, each of them has its own session.
+        CTelegramConnection *connection = new CTelegramConnection(m_appInformation, this);
+
+        connect(connection, SIGNAL(authStateChanged(int,quint32)), SLOT(whenMediaConnectionAuthChanged(int,quint32)));
+        connect(connection, SIGNAL(statusChanged(int,quint32)), SLOT(whenMediaConnectionStatusChanged(int,quint32)));
+        connect(connection, SIGNAL(newRedirectedPackage(QByteArray,quint32)), SLOT(whenPackageRedirected(QByteArray,quint32)));
+        connect(connection, SIGNAL(filePartReceived(TLUploadFile,quint32,quint32)), SLOT(whenFilePartReceived(TLUploadFile,quint32,quint32)));
+        connect(connection, SIGNAL(filePartRequestFailed(quint32,quint32)), SLOT(whenFilePartRequestFailed(quint32,quint32)));
+        connect(connection, SIGNAL(filePartSaved(quint64,quint32,bool)), SLOT(whenFilePartSaved(quint64,quint32,bool)));
+        connect(connection, SIGNAL(authorizationErrorReceived()), SLOT(whenConnectionAuthorizationError()));
+
+        connection->setDcInfo(mainConnection->dcInfo());
+        connection->setKeepAliveInterval(m_pingInterval); // A dead media connection is found out by the ping timeout
+        connection->setDeltaTime(mainConnection->deltaTime());
+        connection->setAuthKey(mainConnection->authKey());
+        connection->setServerSalt(mainConnection->serverSalt());
+        connection->setBulkRequestsLimit(m_bulkRequestsLimit);
+
+        connections.append(connection);
+        connection->connectToDc();
+    }
+}
+
+void CTelegramDispatcher::prewarmDc(quint32 dc)
+{
+    if (!m_connectionPrewarmingEnabled || !dc || (dc == m_activeDc)) {
+        return;
+    }
+
+    if (!activeConnection() || (activeConnection()->authState() != CTelegramConnection::AuthStateSignedIn)) {
+        return;
+    }
+
+    const CTelegramConnection *connection = m_connections.value(dc);
+
+    if (connection && (connection->status() != CTelegramConnection::ConnectionStatusDisconnected)) {
+        return;
+    }
+
+    qDebug() << Q_FUNC_INFO << dc;
+    ensureSignedConnection(dc);
+}
+
+void CTelegramDispatcher::probeDcEndpoints()
+{
+    // Only the DCs with alternative endpoints have something to choose from.
+    QMap<quint32, int> endpointsCount;
+
+    foreach (const TLDcOption &option, m_dcConfiguration) {
+        ++endpointsCount[option.id];
+    }
+
+    QVector<TLDcOption> endpoints;
+
+    foreach (const TLDcOption &option, m_dcConfiguration) {
+        if (endpointsCount.value(option.id) > 1) {
+            endpoints.append(option);
+        }
+    }
+
+    if (!endpoints.isEmpty()) {
+        m_endpointProber->probe(endpoints, s_endpointProbeTimeout);
+    }
+}
+
+void CTelegramDispatcher::removeMediaConnections(quint32 dc, int keepCount)
+{
+    QList<CTelegramConnection *> &connections = m_mediaConnections[dc];
+
+    if (connections.count() <= keepCount) {
+        return;
+    }
+
+    while (connections.count() > keepCount) {
+        CTelegramConnection *connection = connections.takeLast();
+        connection->disconnect(this);
+        connection->deleteLater();
+
+        // The answers of the removed connection are not processed anymore.
+        resumeLostFileParts(connection);
+    }
+}
+
+QList<CTelegramConnection *> CTelegramDispatcher::bulkConnections(quint32 dc) const
+{
+    QList<CTelegramConnection *> result;
+
+    // Bulk requests are routed to the media connections, if there are any ready. The main connection is used otherwise.
+    foreach (CTelegramConnection *connection, m_mediaConnections.value(dc)) {
+        if (connection->authState() == CTelegramConnection::AuthStateSignedIn) {
+            result.append(connection);
+        }
+    }
+
+    if (result.isEmpty()) {
+        CTelegramConnection *connection = m_connections.value(dc);
+
+        if (connection && (connection->authState() == CTelegramConnection::AuthStateSignedIn)) {
+            result.append(connection);
+        }
+    }
+
+    return result;
+}
+
 CTelegramConnection *CTelegramDispatcher::establishConnectionToDc(quint32 dc)
 {
     CTelegramConnection *connection = m_connections.value(dc);
@@ -2136,13 +4557,7 @@ void CTelegramDispatcher::ensureSignedConnection(quint32 dc)
 
 TLDcOption CTelegramDispatcher::dcInfoById(quint32 dc) const
 {
-    foreach (const TLDcOption option, m_dcConfiguration) {
-        if (option.id == dc) {
-            return option;
-        }
-    }
-
-    return TLDcOption();
+    return m_endpointLatency.fastest(m_dcConfiguration, dc);
 }
 
 QString CTelegramDispatcher::mimeTypeByStorageFileType(TLValue type)
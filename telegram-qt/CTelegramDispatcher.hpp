@@ -16,20 +16,66 @@
 
 #include <QObject>
 
+#include <QHash>
 #include <QMap>
 #include <QMultiMap>
+#include <QCryptographicHash>
+#include <QElapsedTimer>
+#include <QEvent>
+#include <QFile>
+#include <QIODevice>
 #include <QPair>
+#include <QPointer>
 #include <QStringList>
 #include <QVector>
 
 #include "TLTypes.hpp"
 #include "TelegramNamespace.hpp"
+#include "CFileCache.hpp"
+#include "CLruMap.hpp"
+#include "CMessageStore.hpp"
+#include "CSpillStore.hpp"
+#include "CTokenBucket.hpp"
+#include "CEndpointLatency.hpp"
 
 class QTimer;
 
 class CAppInformation;
+class CDcEndpointProber;
+class CSessionSharedData;
 class CTelegramConnection;
 
+// Part of a media message, which is enough to request and to report the media data.
+class MediaMessageDescriptor
+{
+public:
+    MediaMessageDescriptor();
+    MediaMessageDescriptor(const TLMessage &message, quint32 contactUserId, TelegramNamespace::MessageType type);
+
+    inline bool isValid() const { return m_dcId; }
+
+    inline quint32 messageId() const { return m_messageId; }
+    inline quint32 contactUserId() const { return m_contactUserId; }
+    inline TelegramNamespace::MessageType type() const { return m_type; }
+
+    inline quint32 dcId() const { return m_dcId; }
+    inline TLInputFileLocation inputLocation() const { return m_inputLocation; }
+    inline quint32 size() const { return m_size; }
+
+    QByteArray toByteArray() const;
+    static MediaMessageDescriptor fromByteArray(const QByteArray &data);
+
+protected:
+    quint32 m_messageId;
+    quint32 m_contactUserId;
+    TelegramNamespace::MessageType m_type;
+
+    quint32 m_dcId;
+    TLInputFileLocation m_inputLocation;
+    quint32 m_size;
+
+};
+
 class FileRequestDescriptor
 {
 public:
@@ -42,7 +88,7 @@ public:
     FileRequestDescriptor();
 
     static FileRequestDescriptor avatarRequest(const TLUser *user);
-    static FileRequestDescriptor messageMediaDataRequest(const TLMessage &message);
+    static FileRequestDescriptor messageMediaDataRequest(const MediaMessageDescriptor &media);
 
     inline Type type() const { return m_type; }
 
@@ -54,6 +100,32 @@ public:
     inline quint32 userId() const { return m_userId; }
     inline quint32 messageId() const { return m_messageId; }
 
+    inline quint32 size() const { return m_size; } // Zero if the size is not known (yet)
+    inline bool isSizeKnown() const { return m_sizeKnown; } // The size of an empty file is known too
+
+    // Download state
+    inline quint32 receivedSize() const { return m_receivedSize; }
+    inline int partsInFlight() const { return m_partsInFlight.count(); }
+    inline int failuresCount() const { return m_failuresCount; }
+    inline TLValue fileType() const { return m_fileType; }
+    inline QByteArray data() const { return m_data; }
+
+    // In streaming mode the contiguous data is taken out as soon as it is received.
+    inline bool isStreaming() const { return m_streaming; }
+    inline QIODevice *outputDevice() const { return m_outputDevice; }
+    void setStreaming(QIODevice *outputDevice);
+    QByteArray takeData();
+
+    void setCachedFile(TLValue fileType, quint32 size, const QByteArray &data);
+
+    bool isFinished() const;
+
+    bool takeNextPartOffset(quint32 *offset);
+    bool setPartReceived(quint32 offset, const TLUploadFile &part);
+    void setPartFailed(quint32 offset);
+    void resetPart(quint32 offset); // The request is lost, the part is requested again (not a failure)
+    void resetPartsInFlight();
+
 protected:
     void setupLocation(const TLFileLocation &fileLocation);
     Type m_type;
@@ -62,7 +134,112 @@ protected:
 
     TLInputFileLocation m_inputLocation;
     quint32 m_dcId;
+    quint32 m_size;
+    bool m_sizeKnown;
+
+    quint32 m_nextOffset;
+    quint32 m_receivedSize; // Size of the contiguous data, received from the file begin.
+    QList<quint32> m_partsInFlight; // Offsets of requested parts
+    QMap<quint32, QByteArray> m_pendingParts; // Offset, data. Parts, received out of order.
+    QByteArray m_data;
+    TLValue m_fileType;
+    int m_failuresCount;
+    bool m_streaming;
+    QPointer<QIODevice> m_outputDevice;
+
+};
+
+class FileUploadDescriptor
+{
+public:
+    FileUploadDescriptor(const QString &fileName, const TLInputPeer &inputPeer, const TelegramNamespace::Peer &peer,
+                         TelegramNamespace::MessageType type, const QString &mimeType);
+    ~FileUploadDescriptor();
+
+    bool open();
+
+    inline quint64 fileId() const { return m_fileId; }
+    inline quint64 randomMessageId() const { return m_randomMessageId; }
+    inline TLInputPeer inputPeer() const { return m_inputPeer; }
+    inline TelegramNamespace::Peer peer() const { return m_peer; }
+
+    inline quint32 size() const { return m_size; }
+    inline quint32 partsCount() const { return m_partsCount; }
+    quint32 partSize() const;
+    bool isBig() const;
+
+    // Upload state
+    inline quint32 uploadedSize() const { return m_uploadedSize; }
+    inline int partsInFlight() const { return m_partsInFlight.count(); }
+    inline int failuresCount() const { return m_failuresCount; }
+
+    bool isFinished() const;
+
+    bool takeNextPart(quint32 *part);
+    QByteArray partData(quint32 part);
+    bool setPartUploaded(quint32 part);
+    void setPartFailed(quint32 part);
+    void resetPart(quint32 part); // The upload is lost, the part is sent again (not a failure)
+    void resetPartsInFlight();
+
+    TLInputMedia inputMedia() const;
+
+protected:
+    QFile m_file;
+    uchar *m_mappedData;
+
+    quint64 m_fileId;
+    quint64 m_randomMessageId;
+    TLInputPeer m_inputPeer;
+    TelegramNamespace::Peer m_peer;
+    TelegramNamespace::MessageType m_type;
+    QString m_mimeType;
+
+    quint32 m_size;
+    quint32 m_partsCount;
+
+    quint32 m_nextPart;
+    quint32 m_uploadedParts;
+    quint32 m_uploadedSize;
+    QList<quint32> m_partsInFlight;
+    QList<quint32> m_partsToRetry;
+    int m_failuresCount;
+
+    QCryptographicHash m_md5; // Fed by parts in order, as they are read for the first time
 
+private:
+    Q_DISABLE_COPY(FileUploadDescriptor)
+
+};
+
+// Data for the getters of a core, which runs the dispatcher in the network thread.
+class DispatcherSnapshot
+{
+public:
+    DispatcherSnapshot() :
+        connectionState(TelegramNamespace::ConnectionStateDisconnected) { }
+
+    TelegramNamespace::ConnectionState connectionState;
+    QString selfPhone;
+    QStringList contactList;
+    QHash<QString, TelegramNamespace::ContactStatus> contactStatuses; // Contact list identifier, status
+    QList<quint32> chatList;
+    QHash<quint32, QString> chatTitles; // Public chat id, title
+    QHash<quint32, QString> userPhones; // User id, phone (used as the user identifier)
+};
+
+// Posted to the snapshot receiver, so the snapshot is handed over to its thread without locking.
+// The event has a high priority, so it is delivered ahead of the queued signals about the change.
+class DispatcherSnapshotEvent : public QEvent
+{
+public:
+    explicit DispatcherSnapshotEvent(const DispatcherSnapshot &snapshot) :
+        QEvent(eventType()),
+        snapshot(snapshot) { }
+
+    static QEvent::Type eventType();
+
+    DispatcherSnapshot snapshot;
 };
 
 class CTelegramDispatcher : public QObject
@@ -76,71 +253,118 @@ public:
         StepKnowSelf        = 1 << 2,
         StepContactList     = 1 << 3,
         StepChatInfo        = 1 << 4,
-        StepUpdates         = 1 << 5,
+        StepUpdatesState    = 1 << 5,
+        StepUpdates         = 1 << 6,
         StepDone            = StepUpdates | (StepUpdates - 1)
     };
 
     explicit CTelegramDispatcher(QObject *parent = 0);
     ~CTelegramDispatcher();
 
-    void setAppInformation(const CAppInformation *newAppInfo);
+    Q_INVOKABLE void setAppInformation(const CAppInformation *newAppInfo);
+
+    // The DC configuration is taken from (and reported to) the shared data, if it is set.
+    inline void setSharedData(CSessionSharedData *data) { m_sharedData = data; }
+
+    // The receiver gets a DispatcherSnapshotEvent on each change of the snapshot data.
+    void setSnapshotReceiver(QObject *receiver);
 
     static qint32 localTypingRecommendedRepeatInterval();
 
     inline TelegramNamespace::ConnectionState connectionState() const { return m_connectionState; }
 
+    // Time in ms from the connection start to the step completion, or -1 if the step is not done yet.
+    qint64 initializationStepTime(InitializationStep step) const { return m_initializationTimings.value(step, -1); }
+
     QString selfPhone() const;
 
     QStringList contactList() const;
     QList<quint32> chatList() const;
 
-    void addContacts(const QStringList &phoneNumbers, bool replace = false);
-    void deleteContacts(const QStringList &phoneNumbers);
+    Q_INVOKABLE void addContacts(const QStringList &phoneNumbers, bool replace = false);
+    Q_INVOKABLE void deleteContacts(const QStringList &phoneNumbers);
 
-    QByteArray connectionSecretInfo() const;
+    Q_INVOKABLE QByteArray connectionSecretInfo() const;
 
-    inline quint32 messageReceivingFilterFlags() const { return m_messageReceivingFilterFlags; }
-    void setMessageReceivingFilterFlags(quint32 flags);
-    void setAcceptableMessageTypes(quint32 types);
-    void setAutoReconnection(bool enable);
-    void setPingInterval(quint32 ms);
-
-    void initConnection(const QString &address, quint32 port);
-    bool restoreConnection(const QByteArray &secret);
-    void closeConnection();
-    bool logOut();
-
-    void requestPhoneStatus(const QString &phoneNumber);
-    void signIn(const QString &phoneNumber, const QString &authCode);
-    void signUp(const QString &phoneNumber, const QString &authCode, const QString &firstName, const QString &lastName);
-
-    void requestPhoneCode(const QString &phoneNumber);
-    void requestContactAvatar(const QString &contact);
-    bool requestMessageMediaData(quint32 messageId);
-
-    quint64 sendMessage(const QString &identifier, const QString &message);
-    void setTyping(const QString &identifier, bool typingStatus);
-    void setMessageRead(const QString &identifier, quint32 messageId);
+    // Known users, contacts and chats. Restore it right after restoreConnection() to be ready without refetching them.
+    Q_INVOKABLE QByteArray sessionSnapshot() const;
+    Q_INVOKABLE bool restoreSessionSnapshot(const QByteArray &snapshot);
 
-    quint32 createChat(const QStringList &phones, const QString chatName);
-    bool addChatUser(quint32 publicChatId, const QString &contact, quint32 forwardMessages);
-
-    void setOnlineStatus(bool onlineStatus);
-    void checkUserName(const QString &userName);
-    void setUserName(const QString &newUserName);
+    inline quint32 messageReceivingFilterFlags() const { return m_messageReceivingFilterFlags; }
+    Q_INVOKABLE void setMessageReceivingFilterFlags(quint32 flags);
+    Q_INVOKABLE void setAcceptableMessageTypes(quint32 types);
+    Q_INVOKABLE void setAutoReconnection(bool enable);
+    Q_INVOKABLE void setPingInterval(quint32 ms);
+    Q_INVOKABLE void setFileRequestWindow(int partsPerConnection);
+    Q_INVOKABLE void setFileUploadWindow(int parts);
+    Q_INVOKABLE void setBulkRequestsLimit(int requests);
+    Q_INVOKABLE void setMediaConnectionsPerDc(int connections);
+    Q_INVOKABLE void setConnectionPrewarmingEnabled(bool enabled);
+    Q_INVOKABLE void setFileCacheDirectory(const QString &directory);
+    Q_INVOKABLE void setFileCacheMaxSize(quint64 bytes);
+    Q_INVOKABLE void setMessageCacheCapacity(int messages);
+    Q_INVOKABLE quint64 messageCacheMemoryUsage() const;
+    Q_INVOKABLE quint64 memoryUsage() const; // Approximate, in bytes. The strings data is not counted.
+    Q_INVOKABLE void setMessageStoreDirectory(const QString &directory);
+    Q_INVOKABLE void setMessageBatchingEnabled(bool enabled);
+    Q_INVOKABLE void setDifferenceChunkSize(int messages);
+    Q_INVOKABLE void setSendWindow(int requests);
+
+    Q_INVOKABLE void initConnection(const QString &address, quint32 port);
+    Q_INVOKABLE bool restoreConnection(const QByteArray &secret);
+    Q_INVOKABLE void closeConnection();
+    Q_INVOKABLE bool logOut();
+
+    Q_INVOKABLE void requestPhoneStatus(const QString &phoneNumber);
+    Q_INVOKABLE void signIn(const QString &phoneNumber, const QString &authCode);
+    Q_INVOKABLE void signUp(const QString &phoneNumber, const QString &authCode, const QString &firstName, const QString &lastName);
+
+    Q_INVOKABLE void requestPhoneCode(const QString &phoneNumber);
+    Q_INVOKABLE void requestContactAvatar(const QString &contact);
+    Q_INVOKABLE bool requestMessageMediaData(quint32 messageId);
+    Q_INVOKABLE bool requestMessageMediaDataStream(quint32 messageId, QIODevice *outputDevice);
+
+    Q_INVOKABLE quint64 sendMessage(const QString &identifier, const QString &message);
+    Q_INVOKABLE quint64 sendMessage(const TelegramNamespace::Peer &peer, const QString &message);
+    // The variants with the random id given by the caller. A failure is reported by sentMessageStatusChanged().
+    Q_INVOKABLE void sendMessage(const QString &identifier, const QString &message, quint64 randomMessageId);
+    Q_INVOKABLE void sendMessage(const TelegramNamespace::Peer &peer, const QString &message, quint64 randomMessageId);
+    Q_INVOKABLE quint64 sendMedia(const QString &identifier, const QString &fileName, TelegramNamespace::MessageType type, const QString &mimeType);
+
+    // Queues text messages (peer and text of each one are used) and returns their random ids (zero for the rejected ones).
+    // Outcomes are reported by sentMessageStatusChanged(). Flood waits are waited out and the messages are resent.
+    Q_INVOKABLE QList<quint64> queueMessages(const QList<TelegramNamespace::Message> &messages);
+    Q_INVOKABLE void setTyping(const QString &identifier, bool typingStatus);
+    Q_INVOKABLE void setTyping(const TelegramNamespace::Peer &peer, bool typingStatus);
+    Q_INVOKABLE void setMessageRead(const QString &identifier, quint32 messageId);
+    Q_INVOKABLE void setMessageRead(const TelegramNamespace::Peer &peer, quint32 messageId);
+
+    Q_INVOKABLE TelegramNamespace::Peer identifierToPeer(const QString &identifier) const;
+    Q_INVOKABLE QString peerToIdentifier(const TelegramNamespace::Peer &peer) const;
+
+    Q_INVOKABLE quint32 createChat(const QStringList &phones, const QString chatName);
+    Q_INVOKABLE bool addChatUser(quint32 publicChatId, const QString &contact, quint32 forwardMessages);
+
+    Q_INVOKABLE void setOnlineStatus(bool onlineStatus);
+    Q_INVOKABLE void checkUserName(const QString &userName);
+    Q_INVOKABLE void setUserName(const QString &newUserName);
 
     TelegramNamespace::ContactStatus contactStatus(const QString &phone) const;
-    quint32 contactLastOnline(const QString &contact) const;
+    Q_INVOKABLE quint32 contactLastOnline(const QString &contact) const;
 
-    QString contactFirstName(const QString &contact) const;
-    QString contactLastName(const QString &contact) const;
-    QString contactUserName(const QString &contact) const;
-    QString contactAvatarToken(const QString &contact) const;
+    Q_INVOKABLE QString contactFirstName(const QString &contact) const;
+    Q_INVOKABLE QString contactLastName(const QString &contact) const;
+    Q_INVOKABLE QString contactUserName(const QString &contact) const;
+    Q_INVOKABLE QString contactAvatarToken(const QString &contact) const;
 
     QString chatTitle(quint32 publicChatId) const;
 
-    bool getChatInfo(TelegramNamespace::GroupChat *outputChat, quint32 publicChatId) const;
-    bool getChatParticipants(QStringList *participants, quint32 publicChatId);
+    Q_INVOKABLE bool getChatInfo(TelegramNamespace::GroupChat *outputChat, quint32 publicChatId) const;
+    Q_INVOKABLE bool getChatParticipants(QStringList *participants, quint32 publicChatId);
+
+    Q_INVOKABLE QList<TelegramNamespace::Message> storedMessages(const TelegramNamespace::Peer &peer, quint32 beforeMessageId, int limit);
+    Q_INVOKABLE QList<TelegramNamespace::Message> storedMessagesByDate(const TelegramNamespace::Peer &peer, quint32 fromTimestamp, quint32 toTimestamp, int limit);
+    Q_INVOKABLE bool getStoredMessage(TelegramNamespace::Message *message, quint32 messageId);
 
 signals:
     void connectionStateChanged(TelegramNamespace::ConnectionState status);
@@ -156,15 +380,17 @@ signals:
 
     void avatarReceived(const QString &contact, const QByteArray &data, const QString &mimeType, const QString &avatarToken);
     void messageMediaDataReceived(const QString &contact, quint32 messageId, const QByteArray &data, const QString &mimeType, TelegramNamespace::MessageType type);
+    void messageMediaDataProgress(quint32 messageId, quint32 bytesReceived, quint32 bytesTotal);
+    void messageMediaDataPartReceived(quint32 messageId, quint32 offset, const QByteArray &data);
 
-    void messageReceived(const QString &contact, const QString &message, TelegramNamespace::MessageType type, quint32 messageId, quint32 flags, quint32 timestamp);
-    void chatMessageReceived(quint32 chatId, const QString &contact, const QString &message, TelegramNamespace::MessageType type, quint32 messageId, quint32 flags, quint32 timestamp);
+    void messageReceived(const TelegramNamespace::Peer &peer, quint32 fromId, const QString &message, TelegramNamespace::MessageType type, quint32 messageId, quint32 flags, quint32 timestamp);
+    void messagesReceived(const QVector<TelegramNamespace::Message> &messages);
 
     void contactStatusChanged(const QString &phone, TelegramNamespace::ContactStatus status);
-    void contactTypingStatusChanged(const QString &phone, bool typingStatus);
-    void contactChatTypingStatusChanged(quint32 publicChatId, const QString &phone, bool typingStatus);
+    void typingStatusChanged(const TelegramNamespace::Peer &peer, quint32 userId, bool typingStatus);
 
-    void sentMessageStatusChanged(const QString &phone, quint64 randomMessageId, TelegramNamespace::MessageDeliveryStatus status);
+    void sentMessageStatusChanged(const TelegramNamespace::Peer &peer, quint64 randomMessageId, TelegramNamespace::MessageDeliveryStatus status);
+    void mediaUploadProgress(quint64 randomMessageId, quint32 bytesUploaded, quint32 bytesTotal);
 
     void chatAdded(quint32 publichChatId);
     void chatChanged(quint32 publichChatId);
@@ -176,19 +402,32 @@ protected slots:
     void whenConnectionDcIdUpdated(quint32 connectionId, quint32 newDcId);
     void whenPackageRedirected(const QByteArray &data, quint32 dc);
     void whenWantedActiveDcChanged(quint32 dc);
-
-    void whenFileReceived(const TLUploadFile &file, quint32 fileId);
+    void whenConnectionAuthorizationError();
+    void whenEndpointProbed(const TLDcOption &endpoint, qint64 connectTime);
+    void whenMediaConnectionAuthChanged(int newState, quint32 dc);
+    void whenMediaConnectionStatusChanged(int newStatus, quint32 dc);
+    void restoreMediaConnections();
+
+    void whenFilePartReceived(const TLUploadFile &file, quint32 fileId, quint32 offset);
+    void whenFilePartRequestFailed(quint32 fileId, quint32 offset);
+    void whenFilePartSaved(quint64 fileId, quint32 filePart, bool result);
     void whenUpdatesReceived(const TLUpdates &updates);
+    void whenUpdatesGapTimeout();
     void whenAuthExportedAuthorizationReceived(quint32 dc, quint32 id, const QByteArray &data);
 
     void whenUsersReceived(const QVector<TLUser> &users);
 
     void whenContactListReceived(const QList<quint32> &contactList);
+    void whenContactListNotModified();
     void whenContactListChanged(const QList<quint32> &added, const QList<quint32> &removed);
     void whenUserTypingTimerTimeout();
 
     void whenStatedMessageReceived(const TLMessagesStatedMessage &statedMessage, quint64 messageId);
-    void whenMessageSentInfoReceived(const TLInputPeer &peer, quint64 randomId, quint32 messageId, quint32 pts, quint32 date, quint32 seq);
+    void whenMessageSentInfoReceived(const TLInputPeer &peer, quint64 randomId, quint32 messageId, quint32 pts, quint32 date, quint32 seq, quint64 requestId);
+    void whenBroadcastSentInfoReceived(const TLMessagesStatedMessages &result, quint64 requestId);
+    void whenRpcErrorReceived(quint64 requestId, TLValue request, quint32 errorCode, const QString &errorMessage);
+    void whenRequestIdChanged(quint64 previousId, quint64 newId);
+    void sendQueuedMessages();
 
     void getDcConfiguration();
     void getContacts();
@@ -198,6 +437,10 @@ protected slots:
 
     void getDifference();
     void whenUpdatesDifferenceReceived(const TLUpdatesDifference &updatesDifference);
+    void applyPendingDifferences();
+    void flushReceivedMessages();
+
+    void publishSnapshot();
 
     void whenMessagesChatsReceived(const QVector<TLChat> &chats, const QVector<TLUser> &users);
     void whenMessagesFullChatReceived(const TLChatFull &chat, const QVector<TLChat> &chats, const QVector<TLUser> &users);
@@ -206,9 +449,26 @@ protected:
     void setConnectionState(TelegramNamespace::ConnectionState state);
 
     bool requestFile(const FileRequestDescriptor &requestId);
+    bool completeFileRequestFromCache(const FileRequestDescriptor &request);
+    void requestFileParts(quint32 dc);
+    void resumeFileRequests(quint32 dc);
+    void resumeLostFileParts(const CTelegramConnection *connection);
+    void finishFileRequest(const FileRequestDescriptor &descriptor);
+    void uploadFileParts();
+    void resumeFileUploads();
+    void finishFileUpload(FileUploadDescriptor *descriptor);
+    void applyUpdates(const TLUpdates &updates);
     void processUpdate(const TLUpdate &update);
 
     void processMessageReceived(const TLMessage &message);
+    bool applyReceivedMessage(const TLMessage &message, TelegramNamespace::Message *output);
+    void storeMessage(const TLMessage &message);
+    TelegramNamespace::Peer peerToStorePeer(const TelegramNamespace::Peer &peer) const;
+    void storePeerToPublic(TelegramNamespace::Peer *peer);
+    void insertKnownMediaMessage(const MediaMessageDescriptor &media);
+    MediaMessageDescriptor knownMediaMessage(quint32 messageId);
+    void spillMediaMessages(const QList<QPair<quint32, MediaMessageDescriptor> > &evicted);
+    void updateMediaMessagesSpillFileName();
 
     void updateChat(const TLChat &newChat);
     void updateFullChat(const TLChatFull &newChat);
@@ -218,19 +478,43 @@ protected:
     void getUser(quint32 id);
     void getInitialUsers();
 
-    quint64 sendMessages(const TLInputPeer &peer, const QString &message);
+    bool sendMessages(const TelegramNamespace::Peer &peer, const QString &message, quint64 randomMessageId);
+    static bool isSendableText(const QString &message);
+
+    struct QueuedMessage {
+        QueuedMessage() :
+            randomId(0),
+            attempts(0) { }
+
+        TelegramNamespace::Peer peer;
+        TLInputPeer inputPeer;
+        QString text;
+        quint64 randomId;
+        int attempts;
+    };
+
+    void failQueuedMessages(const QList<QueuedMessage> &messages);
+    void requeueSendRequests();
+    CTokenBucket *floodBucket(TLValue method);
 
     bool filterReceivedMessage(quint32 messageFlags) const;
 
     quint32 publicChatIdToChatId(quint32 publicChatId) const;
     TLInputPeer publicChatIdToInputPeer(quint32 publicChatId) const;
     TLInputPeer identifierToInputPeer(const QString &identifier) const;
+    TLInputPeer peerToInputPeer(const TelegramNamespace::Peer &peer) const;
+    TelegramNamespace::Peer inputPeerToPeer(const TLInputPeer &inputPeer) const;
     TLInputUser phoneNumberToInputUser(const QString &phoneNumber) const;
     QString userIdToIdentifier(const quint32 id) const;
     QString chatIdToIdentifier(const quint32 id) const;
     quint32 identifierToUserId(const QString &identifier) const;
     TLUser *identifierToUser(const QString &identifier) const;
 
+    QString contactListHash() const;
+
+    void insertUserToIndexes(const TLUser *user);
+    void removeUserFromIndexes(const TLUser *user);
+
     QString userAvatarToken(const TLUser *user) const;
 
     TelegramNamespace::ContactStatus decodeContactStatus(TLValue status) const;
@@ -240,6 +524,11 @@ protected:
     CTelegramConnection *createConnection(const TLDcOption &dc);
     CTelegramConnection *establishConnectionToDc(quint32 dc);
     void ensureSignedConnection(quint32 dc);
+    void ensureMediaConnections(quint32 dc);
+    void prewarmDc(quint32 dc);
+    void probeDcEndpoints();
+    void removeMediaConnections(quint32 dc, int keepCount);
+    QList<CTelegramConnection *> bulkConnections(quint32 dc) const;
 
     TLDcOption dcInfoById(quint32 dc) const;
 
@@ -248,15 +537,22 @@ protected:
 
     void setActiveDc(quint32 dc, bool syncWantedDc = true);
 
-    void ensureTypingUpdateTimer(int interval);
+    typedef QPair<TelegramNamespace::Peer, quint32> TypingKey; // Dialog peer, typing user id (zero for the local typing)
+
+    void setTypingDeadline(const TypingKey &key, int timeout);
+    bool removeTypingDeadline(const TypingKey &key);
+    void startTypingUpdateTimer();
     void ensureUpdateState(quint32 pts = 0, quint32 seq = 0, quint32 date = 0);
 
     void checkStateAndCallGetDifference();
+    void drainPendingUpdates();
 
     void continueInitialization(InitializationStep justDone);
 
     qint32 telegramChatIdToPublicId(quint32 telegramChatId) const;
     quint32 insertTelegramChatId(quint32 telegramChatId);
+    void setTelegramChatId(quint32 publicChatId, quint32 telegramChatId);
+    void setTelegramChatIds(const TLVector<quint32> &telegramChatIds);
     bool havePublicChatId(quint32 publicChatId) const;
 
     quint32 telegramMessageFlagsToPublicMessageFlags(quint32 tgFlags);
@@ -264,6 +560,8 @@ protected:
     TelegramNamespace::ConnectionState m_connectionState;
 
     const CAppInformation *m_appInformation;
+    CSessionSharedData *m_sharedData;
+    QObject *m_snapshotReceiver;
 
     quint32 m_messageReceivingFilterFlags;
     quint32 m_acceptableMessageTypes;
@@ -272,25 +570,45 @@ protected:
 
     quint32 m_initializationState; // InitializationStep flags
     quint32 m_requestedSteps; // InitializationStep flags
+    QElapsedTimer m_initializationClock;
+    QMap<quint32, qint64> m_initializationTimings; // InitializationStep, time of the step completion (m_initializationClock ms)
 
     quint32 m_activeDc;
     quint32 m_wantedActiveDc;
 
-    QVector<TLDcOption> m_dcConfiguration;
+    QVector<TLDcOption> m_dcConfiguration; // May have a few endpoints per DC
+    CEndpointLatency m_endpointLatency;
+    CDcEndpointProber *m_endpointProber;
+    bool m_connectionPrewarmingEnabled; // Connect and authorize in advance on the DCs of the known avatars and media
     QMap<int, CTelegramConnection *> m_connections;
+    QMap<quint32, QList<CTelegramConnection *> > m_mediaConnections; // dc, extra connections for the file transfers
+    int m_mediaConnectionsPerDc;
 
     TLUpdatesState m_updatesState; // Current application update state (may be older than actual server-side message box state)
     TLUpdatesState m_actualState; // State reported by server as actual
     bool m_updatesStateIsLocked; // True if we are (going to) getting updatesDifference.
+    bool m_messageBatchingEnabled;
+    QVector<TelegramNamespace::Message> m_receivedMessagesBatch; // Live updates messages to be reported by messagesReceived()
+
+    bool m_differenceRequested;
+    bool m_differenceApplyScheduled;
+    int m_differenceChunkSize; // Max number of difference messages applied per event loop iteration
+    QList<TLUpdatesDifference> m_pendingDifferences; // Received, but not (completely) applied yet
+    int m_pendingDifferenceOffset; // Number of applied messages of the first pending difference
+    QList<TLUpdates> m_updatesDuringDifference; // Live updates received while the difference is applied
+    QMap<quint32, TLUpdates> m_pendingUpdates; // Seq start, updates received ahead of a gap
+    QTimer *m_updatesGapTimer; // Hold window for the gap to be filled
     bool m_emitOnlyIncomingUnreadMessages;
 
     QMap<quint32, QPair<quint32,QByteArray> > m_exportedAuthentications; // dc, <id, auth data>
     QMap<quint32, QByteArray> m_delayedPackages; // dc, package data
     QMap<quint32, TLUser*> m_users;
+    QHash<QString, quint32> m_phoneToUserId; // Phone, user id
+    QHash<QString, quint32> m_userNameToUserId; // Lower case user name, user id
 
-    QMap<quint32, QPair<QString, quint64> >m_messagesMap; // message id to phone and big_random message id
+    CLruMap<quint32, QPair<TelegramNamespace::Peer, quint64> > m_messagesMap; // message id to peer and big_random message id
 
-    QMap<quint32, TLMessage> m_knownMediaMessages; // message id, message
+    CLruMap<quint32, MediaMessageDescriptor> m_knownMediaMessages; // message id, media. Evicted ones are moved to m_mediaMessagesSpill.
 
     quint32 m_selfUserId;
 
@@ -299,13 +617,30 @@ protected:
     // fileId is program-specific handler, not related to Telegram.
     QMap<quint32, FileRequestDescriptor> m_requestedFileDescriptors; // fileId, file request descriptor
     quint32 m_fileRequestCounter;
-
-    QTimer *m_typingUpdateTimer;
-    QMap<quint32, int> m_userTypingMap; // user id, typing time (ms)
-    QMap<QPair<quint32, quint32>, int> m_userChatTypingMap; // <public chat id, user id>, typing time (ms)
-    QMap<QString, int> m_localTypingMap; // phone, typing time (ms)
+    int m_fileRequestWindow; // Max number of file parts requested at once per connection
+    CFileCache m_fileCache;
+    CMessageStore m_messageStore;
+    CSpillStore m_mediaMessagesSpill; // Enabled together with the file cache
+
+    QMap<quint64, FileUploadDescriptor *> m_fileUploads; // Telegram file id, upload descriptor
+    int m_fileUploadWindow; // Max number of file parts uploaded at once per connection
+    int m_bulkRequestsLimit; // Max number of bulk requests in flight per connection (zero for no limit)
+    QMap<quint64, QPair<TelegramNamespace::Peer, quint64> > m_mediaSendRequests; // RPC message (request) id to peer and random message id
+
+    QList<QueuedMessage> m_sendQueue; // Queued, but not sent yet
+    QMap<quint64, QList<QueuedMessage> > m_sendRequests; // RPC message (request) id (follows the resends) to sent messages (more than one for a broadcast)
+    int m_sendWindow; // Max number of send requests in flight
+    QMap<quint32, CTokenBucket> m_floodBuckets; // Method (TLValue), rate limiter
+    QTimer *m_sendQueueTimer; // Armed for the flood wait end
+    QElapsedTimer m_sendClock;
+
+    QTimer *m_typingUpdateTimer; // Armed for the nearest typing deadline
+    QElapsedTimer m_typingClock;
+    QMap<TypingKey, qint64> m_typingDeadlines; // Typing key, deadline (m_typingClock ms)
+    QMultiMap<qint64, TypingKey> m_typingExpirations; // Deadline, typing key. The first one expires first.
 
     TLVector<quint32> m_chatIds; // Telegram chat ids vector. Index is "public chat id".
+    QHash<quint32, quint32> m_chatIdToPublicId; // Telegram chat id, public chat id. Reverse index of m_chatIds.
     QMap<quint64, quint32> m_temporaryChatIdMap; // RPC message (request) id to public chat id map
 
     QMap<quint32, TLChat> m_chatInfo; // Telegram chat id to Chat map
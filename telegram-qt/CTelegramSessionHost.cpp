@@ -0,0 +1,130 @@
+/*
+    Copyright (C) 2015 Alexandr Akulich <akulichalexander@gmail.com>
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+    LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+    OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+    WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "CTelegramSessionHost.hpp"
+
+#include "CSessionSharedData.hpp"
+#include "CTelegramCore.hpp"
+#include "CTelegramDispatcher.hpp"
+
+#include <QThread>
+#include <QVector>
+
+#include <QDebug>
+
+CTelegramSessionHost::CTelegramSessionHost(int threadCount, QObject *parent) :
+    QObject(parent),
+    m_sharedData(new CSessionSharedData())
+{
+    for (int i = 0; i < threadCount; ++i) {
+        QThread *thread = new QThread(this);
+        thread->start();
+        m_threads.append(thread);
+    }
+}
+
+CTelegramSessionHost::~CTelegramSessionHost()
+{
+    // Accounts of the host threads are deleted on the thread finish.
+    foreach (QThread *thread, m_threads) {
+        thread->quit();
+    }
+
+    foreach (QThread *thread, m_threads) {
+        thread->wait();
+    }
+
+    // Accounts of the host thread are deleted before the shared data.
+    foreach (CTelegramCore *account, m_accountThreads.keys()) {
+        if (m_accountThreads.value(account) < 0) {
+            delete account;
+        }
+    }
+
+    delete m_sharedData;
+}
+
+CTelegramCore *CTelegramSessionHost::addAccount(const CAppInformation *appInfo)
+{
+    CTelegramCore *account = new CTelegramCore();
+    account->setAppInformation(appInfo);
+    account->m_dispatcher->setSharedData(m_sharedData);
+
+    int threadIndex = -1;
+
+    if (!m_threads.isEmpty()) {
+        QVector<int> threadLoad(m_threads.count(), 0);
+
+        foreach (int index, m_accountThreads) {
+            ++threadLoad[index];
+        }
+
+        threadIndex = 0;
+
+        for (int i = 1; i < threadLoad.count(); ++i) {
+            if (threadLoad.at(i) < threadLoad.at(threadIndex)) {
+                threadIndex = i;
+            }
+        }
+
+        QThread *thread = m_threads.at(threadIndex);
+        account->moveToThread(thread);
+        connect(thread, SIGNAL(finished()), account, SLOT(deleteLater()));
+    }
+
+    m_accountThreads.insert(account, threadIndex);
+
+    qDebug() << Q_FUNC_INFO << "account" << m_accountThreads.count() << "thread" << threadIndex;
+
+    return account;
+}
+
+void CTelegramSessionHost::removeAccount(CTelegramCore *account)
+{
+    if (!m_accountThreads.contains(account)) {
+        return;
+    }
+
+    m_accountThreads.remove(account);
+    account->deleteLater();
+}
+
+quint64 CTelegramSessionHost::accountMemoryUsage(CTelegramCore *account) const
+{
+    const int threadIndex = m_accountThreads.value(account, -2);
+
+    if (threadIndex < -1) {
+        return 0;
+    }
+
+    if (threadIndex < 0) {
+        return account->memoryUsage();
+    }
+
+    // The account data is read in its own thread.
+    quint64 result = 0;
+    QMetaObject::invokeMethod(account, "memoryUsage", Qt::BlockingQueuedConnection, Q_RETURN_ARG(quint64, result));
+
+    return result;
+}
+
+quint64 CTelegramSessionHost::memoryUsage() const
+{
+    quint64 result = sizeof(CTelegramSessionHost) + sizeof(CSessionSharedData);
+
+    foreach (CTelegramCore *account, m_accountThreads.keys()) {
+        result += accountMemoryUsage(account);
+    }
+
+    return result;
+}
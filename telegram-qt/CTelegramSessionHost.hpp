@@ -0,0 +1,60 @@
+/*
+    Copyright (C) 2015 Alexandr Akulich <akulichalexander@gmail.com>
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+    LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+    OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+    WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef CTELEGRAMSESSIONHOST_HPP
+#define CTELEGRAMSESSIONHOST_HPP
+
+#include "telegramqt_export.h"
+
+#include <QObject>
+#include <QList>
+#include <QMap>
+
+QT_BEGIN_NAMESPACE
+class QThread;
+QT_END_NAMESPACE
+
+class CAppInformation;
+class CSessionSharedData;
+class CTelegramCore;
+
+// Host of many accounts. The accounts share the DC configuration and live in a fixed set of threads.
+// Ping and acknowledgment timeouts of all connections of a thread are multiplexed through one timer.
+// Accounts, which live in the host threads, should be used via queued calls (signals or QMetaObject::invokeMethod()).
+class TELEGRAMQT_EXPORT CTelegramSessionHost : public QObject
+{
+    Q_OBJECT
+public:
+    // Zero thread count means that the accounts live in the host thread.
+    explicit CTelegramSessionHost(int threadCount = 0, QObject *parent = 0);
+    ~CTelegramSessionHost();
+
+    inline int threadCount() const { return m_threads.count(); }
+    inline int accountCount() const { return m_accountThreads.count(); }
+    inline QList<CTelegramCore *> accounts() const { return m_accountThreads.keys(); }
+
+    // The account is created in the least loaded thread. The app information should outlive the account.
+    CTelegramCore *addAccount(const CAppInformation *appInfo);
+    void removeAccount(CTelegramCore *account);
+
+    quint64 accountMemoryUsage(CTelegramCore *account) const; // Approximate, in bytes
+    quint64 memoryUsage() const; // All accounts
+
+protected:
+    CSessionSharedData *m_sharedData;
+    QList<QThread *> m_threads;
+    QMap<CTelegramCore *, int> m_accountThreads; // Account, thread index (-1 for the host thread)
+
+};
+
+#endif // CTELEGRAMSESSIONHOST_HPP
@@ -68,6 +68,12 @@ template CTelegramStream &CTelegramStream::operator<<(const TLVector<TLInputPhot
 template CTelegramStream &CTelegramStream::operator<<(const TLVector<TLDocumentAttribute> &v);
 // End of generated vector write templates instancing
 template CTelegramStream &CTelegramStream::operator<<(const TLVector<TLDcOption> &v);
+template CTelegramStream &CTelegramStream::operator<<(const TLVector<TLPhotoSize> &v);
+template CTelegramStream &CTelegramStream::operator<<(const TLVector<TLUser> &v);
+template CTelegramStream &CTelegramStream::operator<<(const TLVector<TLChat> &v);
+template CTelegramStream &CTelegramStream::operator<<(const TLVector<TLChatParticipant> &v);
+template CTelegramStream &CTelegramStream::operator<<(const TLVector<TLChatFull> &v);
+template CTelegramStream &CTelegramStream::operator>>(TLVector<TLChatFull> &v);
 
 CTelegramStream::CTelegramStream(QByteArray *data, bool write) :
     CRawStream(data, write)
@@ -3179,6 +3185,316 @@ CTelegramStream &CTelegramStream::operator<<(const TLDcOption &dcOption)
     return *this;
 }
 
+CTelegramStream &CTelegramStream::operator<<(const TLFileLocation &fileLocation)
+{
+    *this << fileLocation.tlType;
+
+    switch (fileLocation.tlType) {
+    case TLValue::FileLocationUnavailable:
+        *this << fileLocation.volumeId;
+        *this << fileLocation.localId;
+        *this << fileLocation.secret;
+        break;
+    case TLValue::FileLocation:
+        *this << fileLocation.dcId;
+        *this << fileLocation.volumeId;
+        *this << fileLocation.localId;
+        *this << fileLocation.secret;
+        break;
+    default:
+        break;
+    }
+
+    return *this;
+}
+
+CTelegramStream &CTelegramStream::operator<<(const TLGeoPoint &geoPoint)
+{
+    *this << geoPoint.tlType;
+
+    switch (geoPoint.tlType) {
+    case TLValue::GeoPoint:
+        *this << geoPoint.longitude;
+        *this << geoPoint.latitude;
+        break;
+    default:
+        break;
+    }
+
+    return *this;
+}
+
+CTelegramStream &CTelegramStream::operator<<(const TLPeerNotifySettings &peerNotifySettings)
+{
+    *this << peerNotifySettings.tlType;
+
+    switch (peerNotifySettings.tlType) {
+    case TLValue::PeerNotifySettings:
+        *this << peerNotifySettings.muteUntil;
+        *this << peerNotifySettings.sound;
+        *this << peerNotifySettings.showPreviews;
+        *this << peerNotifySettings.eventsMask;
+        break;
+    default:
+        break;
+    }
+
+    return *this;
+}
+
+CTelegramStream &CTelegramStream::operator<<(const TLPhotoSize &photoSize)
+{
+    *this << photoSize.tlType;
+
+    switch (photoSize.tlType) {
+    case TLValue::PhotoSizeEmpty:
+        *this << photoSize.type;
+        break;
+    case TLValue::PhotoSize:
+        *this << photoSize.type;
+        *this << photoSize.location;
+        *this << photoSize.w;
+        *this << photoSize.h;
+        *this << photoSize.size;
+        break;
+    case TLValue::PhotoCachedSize:
+        *this << photoSize.type;
+        *this << photoSize.location;
+        *this << photoSize.w;
+        *this << photoSize.h;
+        *this << photoSize.bytes;
+        break;
+    default:
+        break;
+    }
+
+    return *this;
+}
+
+CTelegramStream &CTelegramStream::operator<<(const TLPhoto &photo)
+{
+    *this << photo.tlType;
+
+    switch (photo.tlType) {
+    case TLValue::PhotoEmpty:
+        *this << photo.id;
+        break;
+    case TLValue::Photo:
+        *this << photo.id;
+        *this << photo.accessHash;
+        *this << photo.userId;
+        *this << photo.date;
+        *this << photo.caption;
+        *this << photo.geo;
+        *this << photo.sizes;
+        break;
+    default:
+        break;
+    }
+
+    return *this;
+}
+
+CTelegramStream &CTelegramStream::operator<<(const TLUserProfilePhoto &userProfilePhoto)
+{
+    *this << userProfilePhoto.tlType;
+
+    switch (userProfilePhoto.tlType) {
+    case TLValue::UserProfilePhoto:
+        *this << userProfilePhoto.photoId;
+        *this << userProfilePhoto.photoSmall;
+        *this << userProfilePhoto.photoBig;
+        break;
+    default:
+        break;
+    }
+
+    return *this;
+}
+
+CTelegramStream &CTelegramStream::operator<<(const TLUserStatus &userStatus)
+{
+    *this << userStatus.tlType;
+
+    switch (userStatus.tlType) {
+    case TLValue::UserStatusOnline:
+        *this << userStatus.expires;
+        break;
+    case TLValue::UserStatusOffline:
+        *this << userStatus.wasOnline;
+        break;
+    default:
+        break;
+    }
+
+    return *this;
+}
+
+CTelegramStream &CTelegramStream::operator<<(const TLUser &user)
+{
+    *this << user.tlType;
+
+    switch (user.tlType) {
+    case TLValue::UserEmpty:
+        *this << user.id;
+        break;
+    case TLValue::UserSelf:
+        *this << user.id;
+        *this << user.firstName;
+        *this << user.lastName;
+        *this << user.username;
+        *this << user.phone;
+        *this << user.photo;
+        *this << user.status;
+        *this << user.inactive;
+        break;
+    case TLValue::UserContact:
+    case TLValue::UserRequest:
+        *this << user.id;
+        *this << user.firstName;
+        *this << user.lastName;
+        *this << user.username;
+        *this << user.accessHash;
+        *this << user.phone;
+        *this << user.photo;
+        *this << user.status;
+        break;
+    case TLValue::UserForeign:
+        *this << user.id;
+        *this << user.firstName;
+        *this << user.lastName;
+        *this << user.username;
+        *this << user.accessHash;
+        *this << user.photo;
+        *this << user.status;
+        break;
+    case TLValue::UserDeleted:
+        *this << user.id;
+        *this << user.firstName;
+        *this << user.lastName;
+        *this << user.username;
+        break;
+    default:
+        break;
+    }
+
+    return *this;
+}
+
+CTelegramStream &CTelegramStream::operator<<(const TLChatPhoto &chatPhoto)
+{
+    *this << chatPhoto.tlType;
+
+    switch (chatPhoto.tlType) {
+    case TLValue::ChatPhoto:
+        *this << chatPhoto.photoSmall;
+        *this << chatPhoto.photoBig;
+        break;
+    default:
+        break;
+    }
+
+    return *this;
+}
+
+CTelegramStream &CTelegramStream::operator<<(const TLChat &chat)
+{
+    *this << chat.tlType;
+
+    switch (chat.tlType) {
+    case TLValue::ChatEmpty:
+        *this << chat.id;
+        break;
+    case TLValue::Chat:
+        *this << chat.id;
+        *this << chat.title;
+        *this << chat.photo;
+        *this << chat.participantsCount;
+        *this << chat.date;
+        *this << chat.left;
+        *this << chat.version;
+        break;
+    case TLValue::ChatForbidden:
+        *this << chat.id;
+        *this << chat.title;
+        *this << chat.date;
+        break;
+    case TLValue::GeoChat:
+        *this << chat.id;
+        *this << chat.accessHash;
+        *this << chat.title;
+        *this << chat.address;
+        *this << chat.venue;
+        *this << chat.geo;
+        *this << chat.photo;
+        *this << chat.participantsCount;
+        *this << chat.date;
+        *this << chat.checkedIn;
+        *this << chat.version;
+        break;
+    default:
+        break;
+    }
+
+    return *this;
+}
+
+CTelegramStream &CTelegramStream::operator<<(const TLChatParticipant &chatParticipant)
+{
+    *this << chatParticipant.tlType;
+
+    switch (chatParticipant.tlType) {
+    case TLValue::ChatParticipant:
+        *this << chatParticipant.userId;
+        *this << chatParticipant.inviterId;
+        *this << chatParticipant.date;
+        break;
+    default:
+        break;
+    }
+
+    return *this;
+}
+
+CTelegramStream &CTelegramStream::operator<<(const TLChatParticipants &chatParticipants)
+{
+    *this << chatParticipants.tlType;
+
+    switch (chatParticipants.tlType) {
+    case TLValue::ChatParticipantsForbidden:
+        *this << chatParticipants.chatId;
+        break;
+    case TLValue::ChatParticipants:
+        *this << chatParticipants.chatId;
+        *this << chatParticipants.adminId;
+        *this << chatParticipants.participants;
+        *this << chatParticipants.version;
+        break;
+    default:
+        break;
+    }
+
+    return *this;
+}
+
+CTelegramStream &CTelegramStream::operator<<(const TLChatFull &chatFull)
+{
+    *this << chatFull.tlType;
+
+    switch (chatFull.tlType) {
+    case TLValue::ChatFull:
+        *this << chatFull.id;
+        *this << chatFull.participants;
+        *this << chatFull.chatPhoto;
+        *this << chatFull.notifySettings;
+        break;
+    default:
+        break;
+    }
+
+    return *this;
+}
+
 // Generated write operators implementation
 CTelegramStream &CTelegramStream::operator<<(const TLAccountDaysTTL &accountDaysTTL)
 {
@@ -159,6 +159,21 @@ public:
 
     CTelegramStream &operator<<(const TLDcOption &dcOption);
 
+    // Write operators for received types, used to save a local state snapshot
+    CTelegramStream &operator<<(const TLFileLocation &fileLocation);
+    CTelegramStream &operator<<(const TLGeoPoint &geoPoint);
+    CTelegramStream &operator<<(const TLPeerNotifySettings &peerNotifySettings);
+    CTelegramStream &operator<<(const TLPhotoSize &photoSize);
+    CTelegramStream &operator<<(const TLPhoto &photo);
+    CTelegramStream &operator<<(const TLUserProfilePhoto &userProfilePhoto);
+    CTelegramStream &operator<<(const TLUserStatus &userStatus);
+    CTelegramStream &operator<<(const TLUser &user);
+    CTelegramStream &operator<<(const TLChatPhoto &chatPhoto);
+    CTelegramStream &operator<<(const TLChat &chat);
+    CTelegramStream &operator<<(const TLChatParticipant &chatParticipant);
+    CTelegramStream &operator<<(const TLChatParticipants &chatParticipants);
+    CTelegramStream &operator<<(const TLChatFull &chatFull);
+
     // Generated write operators
     CTelegramStream &operator<<(const TLAccountDaysTTL &accountDaysTTL);
     CTelegramStream &operator<<(const TLDocumentAttribute &documentAttribute);
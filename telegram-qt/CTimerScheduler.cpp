@@ -0,0 +1,124 @@
+/*
+    Copyright (C) 2015 Alexandr Akulich <akulichalexander@gmail.com>
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+    LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+    OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+    WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "CTimerScheduler.hpp"
+
+#include <QThreadStorage>
+#include <QTimer>
+
+#include <QDebug>
+
+static QThreadStorage<CTimerScheduler *> s_threadSchedulers;
+
+CTimerScheduler *CTimerScheduler::threadInstance()
+{
+    if (!s_threadSchedulers.hasLocalData()) {
+        s_threadSchedulers.setLocalData(new CTimerScheduler());
+    }
+
+    return s_threadSchedulers.localData();
+}
+
+CTimerScheduler::CTimerScheduler(QObject *parent) :
+    QObject(parent),
+    m_timer(new QTimer(this))
+{
+    m_timer->setSingleShot(true);
+    connect(m_timer, SIGNAL(timeout()), SLOT(whenTimerTimeout()));
+    m_clock.start();
+}
+
+void CTimerScheduler::schedule(QObject *receiver, const char *member, int msec)
+{
+    const Entry entry(receiver, QByteArray(member));
+    removeEntry(entry);
+
+    const qint64 deadline = m_clock.elapsed() + qMax(0, msec);
+
+    m_deadlines.insert(entry, deadline);
+    m_expirations.insert(deadline, entry);
+
+    connect(receiver, SIGNAL(destroyed(QObject*)), SLOT(whenReceiverDestroyed(QObject*)), Qt::UniqueConnection);
+
+    armTimer();
+}
+
+void CTimerScheduler::cancel(QObject *receiver, const char *member)
+{
+    removeEntry(Entry(receiver, QByteArray(member)));
+    armTimer();
+}
+
+bool CTimerScheduler::isScheduled(QObject *receiver, const char *member) const
+{
+    return m_deadlines.contains(Entry(receiver, QByteArray(member)));
+}
+
+void CTimerScheduler::whenTimerTimeout()
+{
+    const qint64 now = m_clock.elapsed();
+
+    // The invoked members can schedule and cancel entries, so the first entry is taken on each iteration.
+    while (!m_expirations.isEmpty() && (m_expirations.begin().key() <= now)) {
+        const Entry entry = m_expirations.begin().value();
+
+        m_expirations.erase(m_expirations.begin());
+        m_deadlines.remove(entry);
+
+        if (!QMetaObject::invokeMethod(entry.first, entry.second.constData())) {
+            qDebug() << Q_FUNC_INFO << "Unable to invoke" << entry.second;
+        }
+    }
+
+    armTimer();
+}
+
+void CTimerScheduler::whenReceiverDestroyed(QObject *receiver)
+{
+    QList<Entry> receiverEntries;
+
+    foreach (const Entry &entry, m_deadlines.keys()) {
+        if (entry.first == receiver) {
+            receiverEntries.append(entry);
+        }
+    }
+
+    foreach (const Entry &entry, receiverEntries) {
+        removeEntry(entry);
+    }
+
+    armTimer();
+}
+
+void CTimerScheduler::removeEntry(const Entry &entry)
+{
+    QMap<Entry, qint64>::iterator it = m_deadlines.find(entry);
+
+    if (it == m_deadlines.end()) {
+        return;
+    }
+
+    m_expirations.remove(it.value(), entry);
+    m_deadlines.erase(it);
+}
+
+void CTimerScheduler::armTimer()
+{
+    if (m_expirations.isEmpty()) {
+        m_timer->stop();
+        return;
+    }
+
+    const qint64 timeout = m_expirations.begin().key() - m_clock.elapsed();
+    m_timer->start(int(qMax(timeout, qint64(0))));
+}
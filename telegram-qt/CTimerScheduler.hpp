@@ -0,0 +1,58 @@
+/*
+    Copyright (C) 2015 Alexandr Akulich <akulichalexander@gmail.com>
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+    LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+    OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+    WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef CTIMERSCHEDULER_HPP
+#define CTIMERSCHEDULER_HPP
+
+#include <QObject>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QMap>
+#include <QPair>
+
+class QTimer;
+
+// Single-shot timeouts of many objects of one thread, multiplexed through one QTimer.
+// The receiver member (a slot or an invokable method name without the signature) is invoked on timeout.
+class CTimerScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    static CTimerScheduler *threadInstance(); // The scheduler of the current thread
+
+    void schedule(QObject *receiver, const char *member, int msec); // Replaces the previous schedule of the member
+    void cancel(QObject *receiver, const char *member);
+    bool isScheduled(QObject *receiver, const char *member) const;
+
+    inline int count() const { return m_deadlines.count(); }
+
+protected slots:
+    void whenTimerTimeout();
+    void whenReceiverDestroyed(QObject *receiver);
+
+protected:
+    explicit CTimerScheduler(QObject *parent = 0);
+
+    typedef QPair<QObject *, QByteArray> Entry; // Receiver, member name
+
+    void removeEntry(const Entry &entry);
+    void armTimer();
+
+    QTimer *m_timer; // Armed for the nearest deadline
+    QElapsedTimer m_clock;
+    QMap<Entry, qint64> m_deadlines; // Entry, deadline (m_clock ms)
+    QMultiMap<qint64, Entry> m_expirations; // Deadline, entry. The first one expires first.
+
+};
+
+#endif // CTIMERSCHEDULER_HPP
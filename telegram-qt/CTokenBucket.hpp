@@ -0,0 +1,108 @@
+/*
+    Copyright (C) 2015 Alexandr Akulich <akulichalexander@gmail.com>
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+    LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+    OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+    WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef CTOKENBUCKET_HPP
+#define CTOKENBUCKET_HPP
+
+#include <QtGlobal>
+
+// Rate limiter. A token is taken per request; tokens are refilled with the rate up to the burst size.
+// A block (a flood wait reported by the server) empties the bucket until its end and halves the rate,
+// which then recovers by a small step per taken token. Time is passed by the caller (in ms of any monotonic clock).
+class CTokenBucket
+{
+public:
+    explicit CTokenBucket(qreal rate = 1, int burst = 1) :
+        m_nominalRate(rate),
+        m_rate(rate),
+        m_burst(burst),
+        m_tokens(burst),
+        m_updated(0),
+        m_blockedUntil(0)
+    {
+    }
+
+    inline qreal rate() const { return m_rate; } // Tokens per second
+
+    inline void setRate(qreal rate, int burst)
+    {
+        m_nominalRate = rate;
+        m_rate = rate;
+        m_burst = burst;
+        m_tokens = qMin(m_tokens, qreal(burst));
+    }
+
+    bool take(qint64 now)
+    {
+        refill(now);
+
+        if ((now < m_blockedUntil) || (m_tokens < 1)) {
+            return false;
+        }
+
+        m_tokens -= 1;
+        m_rate = qMin(m_nominalRate, m_rate + m_nominalRate / 20);
+
+        return true;
+    }
+
+    // Time to wait for the next token (zero if a token is available).
+    qint64 delay(qint64 now)
+    {
+        refill(now);
+
+        if (now < m_blockedUntil) {
+            return m_blockedUntil - now + delayForTokens(1);
+        }
+
+        if (m_tokens >= 1) {
+            return 0;
+        }
+
+        return delayForTokens(1 - m_tokens);
+    }
+
+    void block(qint64 now, qint64 duration)
+    {
+        m_blockedUntil = qMax(m_blockedUntil, now + duration);
+        m_updated = m_blockedUntil;
+        m_tokens = 0;
+        m_rate = m_rate / 2;
+    }
+
+protected:
+    void refill(qint64 now)
+    {
+        if (now <= m_updated) {
+            return;
+        }
+
+        m_tokens = qMin(qreal(m_burst), m_tokens + (now - m_updated) * m_rate / 1000);
+        m_updated = now;
+    }
+
+    inline qint64 delayForTokens(qreal tokens) const
+    {
+        return qint64(tokens * 1000 / m_rate) + 1;
+    }
+
+    qreal m_nominalRate;
+    qreal m_rate;
+    int m_burst;
+    qreal m_tokens;
+    qint64 m_updated;
+    qint64 m_blockedUntil;
+
+};
+
+#endif // CTOKENBUCKET_HPP
@@ -14,6 +14,7 @@
 #include "TelegramNamespace.hpp"
 
 #include <QMetaType>
+#include <QVector>
 #include <QDebug>
 
 void TelegramNamespace::registerTypes()
@@ -26,11 +27,17 @@ void TelegramNamespace::registerTypes()
 #endif
 
         qRegisterMetaType<TelegramNamespace::ConnectionState>("TelegramNamespace::ConnectionStatus");
+        qRegisterMetaType<TelegramNamespace::ConnectionState>("TelegramNamespace::ConnectionState");
         qRegisterMetaType<TelegramNamespace::ContactStatus>("TelegramNamespace::ContactStatus");
         qRegisterMetaType<TelegramNamespace::MessageDeliveryStatus>("TelegramNamespace::MessageDeliveryStatus");
         qRegisterMetaType<TelegramNamespace::MessageFlags>("TelegramNamespace::MessageFlags");
         qRegisterMetaType<TelegramNamespace::MessageType>("TelegramNamespace::MessageType");
         qRegisterMetaType<TelegramNamespace::AuthSignError>("TelegramNamespace::AuthSignError");
+        qRegisterMetaType<TelegramNamespace::AccountUserNameStatus>("TelegramNamespace::AccountUserNameStatus");
+        qRegisterMetaType<TelegramNamespace::Peer>("TelegramNamespace::Peer");
+        qRegisterMetaType<QVector<TelegramNamespace::Message> >("QVector<TelegramNamespace::Message>");
+        qRegisterMetaType<QList<TelegramNamespace::Message> >("QList<TelegramNamespace::Message>");
+        qRegisterMetaType<QList<quint64> >("QList<quint64>");
         registered = true;
     }
 }
@@ -33,7 +33,8 @@ public:
         MessageDeliveryStatusUnknown,
         MessageDeliveryStatusSent,
         MessageDeliveryStatusRead,
-        MessageDeliveryStatusDeleted
+        MessageDeliveryStatusDeleted,
+        MessageDeliveryStatusFailed
     };
 
     enum MessageFlags {
@@ -112,8 +113,58 @@ public:
         quint32 participantsCount;
     };
 
+    // Numeric alternative to string identifiers ("+phone", "user123", "chat5"), which needs no formatting or parsing.
+    struct Peer
+    {
+        enum Type {
+            User,
+            Chat
+        };
+
+        explicit Peer(quint32 id = 0, Type type = User) :
+            type(type),
+            id(id) {
+        }
+
+        bool operator ==(const Peer &anotherPeer) const {
+            return (type == anotherPeer.type) && (id == anotherPeer.id);
+        }
+
+        bool operator !=(const Peer &anotherPeer) const {
+            return !(*this == anotherPeer);
+        }
+
+        bool operator <(const Peer &anotherPeer) const {
+            return (type < anotherPeer.type) || ((type == anotherPeer.type) && (id < anotherPeer.id));
+        }
+
+        Type type;
+        quint32 id; // User id or public chat id
+    };
+
+    struct Message
+    {
+        Message() :
+            fromId(0),
+            id(0),
+            timestamp(0),
+            flags(MessageFlagNone),
+            type(MessageTypeUnsupported) {
+        }
+
+        Peer peer; // Dialog: the other user or the chat
+        quint32 fromId; // Author user id
+        quint32 id;
+        quint32 timestamp;
+        quint32 flags; // MessageFlags
+        MessageType type;
+        QString text;
+    };
+
 };
 
 Q_DECLARE_TYPEINFO(TelegramNamespace::GroupChat, Q_MOVABLE_TYPE);
+Q_DECLARE_TYPEINFO(TelegramNamespace::Peer, Q_PRIMITIVE_TYPE);
+Q_DECLARE_TYPEINFO(TelegramNamespace::Message, Q_MOVABLE_TYPE);
 
 #endif // TELEGRAMNAMESPACE_HPP
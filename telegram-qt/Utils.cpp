@@ -178,7 +178,9 @@ SRsaKey Utils::loadHardcodedKey()
 
 SRsaKey Utils::loadRsaKey()
 {
-    return loadHardcodedKey();
+    // Parsed once and shared by all connections.
+    static const SRsaKey key = loadHardcodedKey();
+    return key;
 //    return loadRsaKeyFromFile("telegram_server_key.pub");
 }
 
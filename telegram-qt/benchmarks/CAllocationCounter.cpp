@@ -0,0 +1,103 @@
+/*
+    Copyright (C) 2015 Alexandr Akulich <akulichalexander@gmail.com>
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+    LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+    OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+    WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "CAllocationCounter.hpp"
+
+#include <QDebug>
+
+#include <stdlib.h>
+
+// Benchmarks are single-threaded, so plain counters are good enough.
+static quint64 s_allocations = 0;
+static quint64 s_allocatedBytes = 0;
+
+#if defined(__GLIBC__)
+extern "C" {
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+
+void *malloc(size_t size)
+{
+    ++s_allocations;
+    s_allocatedBytes += size;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    ++s_allocations;
+    s_allocatedBytes += count * size;
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size)
+{
+    ++s_allocations;
+    s_allocatedBytes += size;
+    return __libc_realloc(pointer, size);
+}
+
+}
+#endif
+
+CAllocationCounter::CAllocationCounter()
+{
+    restart();
+}
+
+bool CAllocationCounter::isSupported()
+{
+#if defined(__GLIBC__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+void CAllocationCounter::restart()
+{
+    m_startAllocations = s_allocations;
+    m_startBytes = s_allocatedBytes;
+}
+
+quint64 CAllocationCounter::allocations() const
+{
+    return s_allocations - m_startAllocations;
+}
+
+quint64 CAllocationCounter::allocatedBytes() const
+{
+    return s_allocatedBytes - m_startBytes;
+}
+
+void reportPerObject(const char *name, qint64 nsecsElapsed, const CAllocationCounter &counter, quint64 objectsCount)
+{
+    if (!objectsCount) {
+        return;
+    }
+
+    const quint64 allocations = counter.allocations();
+    const quint64 bytes = counter.allocatedBytes();
+
+    if (CAllocationCounter::isSupported()) {
+        qDebug() << name << ":"
+                 << double(nsecsElapsed) / objectsCount << "ns/object,"
+                 << double(allocations) / objectsCount << "allocations/object,"
+                 << double(bytes) / objectsCount << "bytes/object";
+    } else {
+        qDebug() << name << ":"
+                 << double(nsecsElapsed) / objectsCount << "ns/object (allocations are not counted on this platform)";
+    }
+}
@@ -0,0 +1,43 @@
+/*
+    Copyright (C) 2015 Alexandr Akulich <akulichalexander@gmail.com>
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+    LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+    OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+    WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef CALLOCATIONCOUNTER_HPP
+#define CALLOCATIONCOUNTER_HPP
+
+#include <qglobal.h>
+
+// Counts heap allocations (malloc, calloc, realloc and everything built on top of them)
+// made by the whole process since the counter construction or the last restart().
+// Counting is available only on glibc, where the allocator can be interposed.
+class CAllocationCounter
+{
+public:
+    CAllocationCounter();
+
+    static bool isSupported();
+
+    void restart();
+
+    quint64 allocations() const;
+    quint64 allocatedBytes() const;
+
+private:
+    quint64 m_startAllocations;
+    quint64 m_startBytes;
+
+};
+
+// Prints "<name>: X ns/object, Y allocations/object" for a measured loop.
+void reportPerObject(const char *name, qint64 nsecsElapsed, const CAllocationCounter &counter, quint64 objectsCount);
+
+#endif // CALLOCATIONCOUNTER_HPP
@@ -0,0 +1,236 @@
+/*
+    Copyright (C) 2015 Alexandr Akulich <akulichalexander@gmail.com>
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+    LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+    OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+    WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include <QObject>
+
+#include "CTelegramDispatcher.hpp"
+#include "CAllocationCounter.hpp"
+
+#include <QElapsedTimer>
+#include <QTest>
+#include <QDebug>
+
+static const int usersCount = 100000;
+static const int chatsCount = 5000;
+
+class CBenchDispatcher : public CTelegramDispatcher
+{
+public:
+    using CTelegramDispatcher::whenUsersReceived;
+    using CTelegramDispatcher::identifierToUserId;
+    using CTelegramDispatcher::insertTelegramChatId;
+    using CTelegramDispatcher::telegramChatIdToPublicId;
+
+};
+
+static QVector<TLUser> makeUsers()
+{
+    QVector<TLUser> users;
+    users.reserve(usersCount);
+
+    for (int i = 0; i < usersCount; ++i) {
+        TLUser user;
+        user.tlType = TLValue::UserContact;
+        user.id = 1000 + i;
+        user.firstName = QString(QLatin1String("First%1")).arg(i);
+        user.lastName = QString(QLatin1String("Last%1")).arg(i);
+        user.username = QString(QLatin1String("UserName%1")).arg(i);
+        user.phone = QString(QLatin1String("7900%1")).arg(i, 7, 10, QLatin1Char('0'));
+        user.accessHash = 0x1234567890abcdefULL + i;
+        users.append(user);
+    }
+
+    return users;
+}
+
+class bench_CTelegramDispatcher : public QObject
+{
+    Q_OBJECT
+public:
+    explicit bench_CTelegramDispatcher(QObject *parent = 0);
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void receiveUsers();
+    void receiveKnownUsers();
+    void lookupByPhone();
+    void lookupByUserName();
+    void contactFirstName();
+    void chatIdToPublicId();
+
+private:
+    QVector<TLUser> m_users;
+    QStringList m_phones;
+    QStringList m_userNames;
+    CBenchDispatcher *m_dispatcher;
+
+};
+
+bench_CTelegramDispatcher::bench_CTelegramDispatcher(QObject *parent) :
+    QObject(parent),
+    m_dispatcher(0)
+{
+}
+
+void bench_CTelegramDispatcher::initTestCase()
+{
+    m_users = makeUsers();
+
+    foreach (const TLUser &user, m_users) {
+        m_phones.append(user.phone);
+        m_userNames.append(user.username);
+    }
+
+    m_dispatcher = new CBenchDispatcher();
+    m_dispatcher->whenUsersReceived(m_users);
+}
+
+void bench_CTelegramDispatcher::cleanupTestCase()
+{
+    delete m_dispatcher;
+    m_dispatcher = 0;
+}
+
+void bench_CTelegramDispatcher::receiveUsers()
+{
+    quint64 rounds = 0;
+
+    CAllocationCounter counter;
+    QElapsedTimer timer;
+    timer.start();
+
+    QBENCHMARK {
+        CBenchDispatcher dispatcher;
+        dispatcher.whenUsersReceived(m_users);
+        ++rounds;
+    }
+
+    reportPerObject("Users receiving, new users (per user)", timer.nsecsElapsed(), counter, rounds * usersCount);
+}
+
+void bench_CTelegramDispatcher::receiveKnownUsers()
+{
+    quint64 rounds = 0;
+
+    CAllocationCounter counter;
+    QElapsedTimer timer;
+    timer.start();
+
+    QBENCHMARK {
+        m_dispatcher->whenUsersReceived(m_users);
+        ++rounds;
+    }
+
+    reportPerObject("Users receiving, known users (per user)", timer.nsecsElapsed(), counter, rounds * usersCount);
+}
+
+void bench_CTelegramDispatcher::lookupByPhone()
+{
+    quint64 rounds = 0;
+    quint64 idsSum = 0;
+
+    CAllocationCounter counter;
+    QElapsedTimer timer;
+    timer.start();
+
+    QBENCHMARK {
+        foreach (const QString &phone, m_phones) {
+            idsSum += m_dispatcher->identifierToUserId(phone);
+        }
+        ++rounds;
+    }
+
+    reportPerObject("User id by phone (per lookup)", timer.nsecsElapsed(), counter, rounds * usersCount);
+
+    QVERIFY(idsSum);
+    QCOMPARE(m_dispatcher->identifierToUserId(m_phones.last()), m_users.last().id);
+}
+
+void bench_CTelegramDispatcher::lookupByUserName()
+{
+    quint64 rounds = 0;
+    quint64 idsSum = 0;
+
+    CAllocationCounter counter;
+    QElapsedTimer timer;
+    timer.start();
+
+    QBENCHMARK {
+        foreach (const QString &userName, m_userNames) {
+            idsSum += m_dispatcher->identifierToUserId(userName);
+        }
+        ++rounds;
+    }
+
+    reportPerObject("User id by user name (per lookup)", timer.nsecsElapsed(), counter, rounds * usersCount);
+
+    QVERIFY(idsSum);
+    QCOMPARE(m_dispatcher->identifierToUserId(m_userNames.last()), m_users.last().id);
+}
+
+void bench_CTelegramDispatcher::contactFirstName()
+{
+    quint64 rounds = 0;
+    int namesLength = 0;
+
+    CAllocationCounter counter;
+    QElapsedTimer timer;
+    timer.start();
+
+    QBENCHMARK {
+        foreach (const QString &phone, m_phones) {
+            namesLength += m_dispatcher->contactFirstName(phone).length();
+        }
+        ++rounds;
+    }
+
+    reportPerObject("Contact first name by phone (per call)", timer.nsecsElapsed(), counter, rounds * usersCount);
+
+    QVERIFY(namesLength);
+    QCOMPARE(m_dispatcher->contactFirstName(m_phones.first()), m_users.first().firstName);
+}
+
+void bench_CTelegramDispatcher::chatIdToPublicId()
+{
+    CBenchDispatcher dispatcher;
+
+    for (int i = 0; i < chatsCount; ++i) {
+        dispatcher.insertTelegramChatId(2000000 + i * 7);
+    }
+
+    quint64 rounds = 0;
+    qint64 idsSum = 0;
+
+    CAllocationCounter counter;
+    QElapsedTimer timer;
+    timer.start();
+
+    QBENCHMARK {
+        for (int i = 0; i < chatsCount; ++i) {
+            idsSum += dispatcher.telegramChatIdToPublicId(2000000 + i * 7);
+        }
+        ++rounds;
+    }
+
+    reportPerObject("Public chat id by telegram chat id (per lookup)", timer.nsecsElapsed(), counter, rounds * chatsCount);
+
+    QVERIFY(idsSum);
+    QCOMPARE(dispatcher.telegramChatIdToPublicId(2000000 + (chatsCount - 1) * 7), chatsCount - 1);
+    QCOMPARE(dispatcher.telegramChatIdToPublicId(1), -1);
+}
+
+QTEST_MAIN(bench_CTelegramDispatcher)
+
+#include "bench_CTelegramDispatcher.moc"
@@ -0,0 +1,36 @@
+include(../benchmarks.pri)
+
+TARGET = bench_telegramdispatcher
+SOURCES += bench_CTelegramDispatcher.cpp \
+    ../../Utils.cpp \
+    ../../CTcpTransport.cpp \
+    ../../CTelegramConnection.cpp \
+    ../../CTimerScheduler.cpp \
+    ../../CDcEndpointProber.cpp \
+    ../../CTelegramStream.cpp \
+    ../../CTelegramDispatcher.cpp \
+    ../../CFileCache.cpp \
+    ../../CMessageStore.cpp \
+    ../../CSpillStore.cpp \
+    ../../CRawStream.cpp \
+    ../../TLValues.cpp
+
+HEADERS += \
+    ../../Utils.hpp \
+    ../../CTelegramConnection.hpp \
+    ../../CTimerScheduler.hpp \
+    ../../CDcEndpointProber.hpp \
+    ../../CTelegramTransport.hpp \
+    ../../CTcpTransport.hpp \
+    ../../CTelegramStream.hpp \
+    ../../CTelegramDispatcher.hpp \
+    ../../CFileCache.hpp \
+    ../../CLruMap.hpp \
+    ../../CTokenBucket.hpp \
+    ../../CEndpointLatency.hpp \
+    ../../CMessageStore.hpp \
+    ../../CSpillStore.hpp \
+    ../../CRawStream.hpp \
+    ../../TLValues.hpp
+
+LIBS += -lz
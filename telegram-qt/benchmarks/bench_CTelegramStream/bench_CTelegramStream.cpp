@@ -0,0 +1,660 @@
+/*
+    Copyright (C) 2015 Alexandr Akulich <akulichalexander@gmail.com>
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+    LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+    OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+    WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include <QObject>
+
+#include "CTelegramStream.hpp"
+#include "CAllocationCounter.hpp"
+
+#include <QElapsedTimer>
+#include <QTest>
+#include <QDebug>
+
+static const int updatesCount = 1000;
+static const int updatesUsersCount = 100;
+static const int updatesChatsCount = 10;
+
+static const int dialogsCount = 500;
+static const int dialogsChatsCount = 50;
+
+static const int contactsCount = 5000;
+
+static const int uploadFilePartSize = 512 * 1024;
+
+static const int inputContactsCount = 5000;
+
+// Output types have no generated write operators, so the corpus is written by the helpers below,
+// field by field, exactly as the server lays it out. The same helpers are used to measure encoding.
+
+static void writeFileLocation(CTelegramStream &stream, const TLFileLocation &location)
+{
+    stream << location.tlType;
+    stream << location.dcId;
+    stream << location.volumeId;
+    stream << location.localId;
+    stream << location.secret;
+}
+
+static void writeUser(CTelegramStream &stream, const TLUser &user)
+{
+    stream << user.tlType;
+    stream << user.id;
+    stream << user.firstName;
+    stream << user.lastName;
+    stream << user.username;
+    stream << user.accessHash;
+    stream << user.phone;
+
+    stream << user.photo.tlType;
+    if (user.photo.tlType == TLValue::UserProfilePhoto) {
+        stream << user.photo.photoId;
+        writeFileLocation(stream, user.photo.photoSmall);
+        writeFileLocation(stream, user.photo.photoBig);
+    }
+
+    stream << user.status.tlType;
+    if (user.status.tlType == TLValue::UserStatusOnline) {
+        stream << user.status.expires;
+    } else if (user.status.tlType == TLValue::UserStatusOffline) {
+        stream << user.status.wasOnline;
+    }
+}
+
+static void writeChat(CTelegramStream &stream, const TLChat &chat)
+{
+    stream << chat.tlType;
+    stream << chat.id;
+    stream << chat.title;
+    stream << chat.photo.tlType; // Corpus chats have no photo
+    stream << chat.participantsCount;
+    stream << chat.date;
+    stream << chat.left;
+    stream << chat.version;
+}
+
+static void writeMessage(CTelegramStream &stream, const TLMessage &message)
+{
+    stream << message.tlType;
+    stream << message.flags;
+    stream << message.id;
+    stream << message.fromId;
+    stream << message.toId.tlType;
+    stream << message.toId.userId; // Corpus messages are addressed to users
+    stream << message.date;
+    stream << message.message;
+    stream << message.media.tlType; // Corpus messages have no media
+}
+
+static void writeDialog(CTelegramStream &stream, const TLDialog &dialog)
+{
+    stream << dialog.tlType;
+    stream << dialog.peer.tlType;
+    stream << dialog.peer.userId;
+    stream << dialog.topMessage;
+    stream << dialog.unreadCount;
+    stream << dialog.notifySettings.tlType;
+    stream << dialog.notifySettings.muteUntil;
+    stream << dialog.notifySettings.sound;
+    stream << dialog.notifySettings.showPreviews;
+    stream << dialog.notifySettings.eventsMask;
+}
+
+static void writeContact(CTelegramStream &stream, const TLContact &contact)
+{
+    stream << contact.tlType;
+    stream << contact.userId;
+    stream << contact.mutual;
+}
+
+static void writeUpdate(CTelegramStream &stream, const TLUpdate &update)
+{
+    stream << update.tlType;
+
+    switch (update.tlType) {
+    case TLValue::UpdateNewMessage:
+        writeMessage(stream, update.message);
+        stream << update.pts;
+        break;
+    case TLValue::UpdateUserTyping:
+        stream << update.userId;
+        stream << update.action.tlType;
+        break;
+    case TLValue::UpdateUserStatus:
+        stream << update.userId;
+        stream << update.status.tlType;
+        stream << update.status.expires;
+        break;
+    case TLValue::UpdateReadMessages:
+        stream << update.messages;
+        stream << update.pts;
+        break;
+    default:
+        break;
+    }
+}
+
+template <typename T>
+static void writeVector(CTelegramStream &stream, const TLVector<T> &vector, void (*writeItem)(CTelegramStream &, const T &))
+{
+    stream << TLValue::Vector;
+    stream << quint32(vector.count());
+
+    for (int i = 0; i < vector.count(); ++i) {
+        writeItem(stream, vector.at(i));
+    }
+}
+
+static QByteArray encodeUpdates(const TLUpdates &updates)
+{
+    QByteArray data;
+    CTelegramStream stream(&data, /* write */ true);
+
+    stream << updates.tlType;
+    writeVector(stream, updates.updates, writeUpdate);
+    writeVector(stream, updates.users, writeUser);
+    writeVector(stream, updates.chats, writeChat);
+    stream << updates.date;
+    stream << updates.seq;
+
+    return data;
+}
+
+static QByteArray encodeDialogs(const TLMessagesDialogs &dialogs)
+{
+    QByteArray data;
+    CTelegramStream stream(&data, /* write */ true);
+
+    stream << dialogs.tlType;
+    writeVector(stream, dialogs.dialogs, writeDialog);
+    writeVector(stream, dialogs.messages, writeMessage);
+    writeVector(stream, dialogs.chats, writeChat);
+    writeVector(stream, dialogs.users, writeUser);
+
+    return data;
+}
+
+static QByteArray encodeContacts(const TLContactsContacts &contacts)
+{
+    QByteArray data;
+    CTelegramStream stream(&data, /* write */ true);
+
+    stream << contacts.tlType;
+    writeVector(stream, contacts.contacts, writeContact);
+    writeVector(stream, contacts.users, writeUser);
+
+    return data;
+}
+
+static QByteArray encodeUploadFile(const TLUploadFile &file)
+{
+    QByteArray data;
+    CTelegramStream stream(&data, /* write */ true);
+
+    stream << file.tlType;
+    stream << file.type.tlType;
+    stream << file.mtime;
+    stream << file.bytes;
+
+    return data;
+}
+
+static TLFileLocation makeFileLocation(quint32 seed)
+{
+    TLFileLocation location;
+    location.tlType = TLValue::FileLocation;
+    location.dcId = 2;
+    location.volumeId = 0x10000000ull + seed;
+    location.localId = seed;
+    location.secret = 0xabcdef0000ull + seed;
+    return location;
+}
+
+static TLUser makeUser(quint32 userId)
+{
+    TLUser user;
+    user.tlType = TLValue::UserContact;
+    user.id = userId;
+    user.firstName = QString(QLatin1String("First name %1")).arg(userId);
+    user.lastName = QString(QLatin1String("Last name %1")).arg(userId);
+    user.username = QString(QLatin1String("username%1")).arg(userId);
+    user.accessHash = 0x1234567800000000ull + userId;
+    user.phone = QString(QLatin1String("7911%1")).arg(userId, 7, 10, QLatin1Char('0'));
+
+    if (userId % 2) {
+        user.photo.tlType = TLValue::UserProfilePhoto;
+        user.photo.photoId = 0x5000000000ull + userId;
+        user.photo.photoSmall = makeFileLocation(userId * 2);
+        user.photo.photoBig = makeFileLocation(userId * 2 + 1);
+    } else {
+        user.photo.tlType = TLValue::UserProfilePhotoEmpty;
+    }
+
+    if (userId % 3) {
+        user.status.tlType = TLValue::UserStatusOffline;
+        user.status.wasOnline = 1420000000 + userId;
+    } else {
+        user.status.tlType = TLValue::UserStatusOnline;
+        user.status.expires = 1430000000 + userId;
+    }
+
+    return user;
+}
+
+static TLChat makeChat(quint32 chatId)
+{
+    TLChat chat;
+    chat.tlType = TLValue::Chat;
+    chat.id = chatId;
+    chat.title = QString(QLatin1String("Group chat %1")).arg(chatId);
+    chat.photo.tlType = TLValue::ChatPhotoEmpty;
+    chat.participantsCount = 5 + chatId % 20;
+    chat.date = 1410000000 + chatId;
+    chat.left = false;
+    chat.version = 1;
+    return chat;
+}
+
+static TLMessage makeMessage(quint32 messageId, quint32 fromId)
+{
+    TLMessage message;
+    message.tlType = TLValue::Message;
+    message.flags = 1;
+    message.id = messageId;
+    message.fromId = fromId;
+    message.toId.tlType = TLValue::PeerUser;
+    message.toId.userId = 1;
+    message.date = 1420000000 + messageId;
+    message.message = QString(QLatin1String("Message text number %1, long enough to look like a real one.")).arg(messageId);
+    message.media.tlType = TLValue::MessageMediaEmpty;
+    return message;
+}
+
+static TLUpdates makeUpdates()
+{
+    TLUpdates updates;
+    updates.tlType = TLValue::Updates;
+
+    for (int i = 0; i < updatesCount; ++i) {
+        TLUpdate update;
+        update.userId = 1000 + i % updatesUsersCount;
+
+        switch (i % 4) {
+        case 0:
+            update.tlType = TLValue::UpdateNewMessage;
+            update.message = makeMessage(10000 + i, update.userId);
+            update.pts = 500 + i;
+            break;
+        case 1:
+            update.tlType = TLValue::UpdateUserTyping;
+            update.action.tlType = TLValue::SendMessageTypingAction;
+            break;
+        case 2:
+            update.tlType = TLValue::UpdateUserStatus;
+            update.status.tlType = TLValue::UserStatusOnline;
+            update.status.expires = 1430000000 + i;
+            break;
+        default:
+            update.tlType = TLValue::UpdateReadMessages;
+            update.messages.append(10000 + i - 3);
+            update.messages.append(10000 + i - 2);
+            update.messages.append(10000 + i - 1);
+            update.pts = 500 + i;
+            break;
+        }
+
+        updates.updates.append(update);
+    }
+
+    for (int i = 0; i < updatesUsersCount; ++i) {
+        updates.users.append(makeUser(1000 + i));
+    }
+
+    for (int i = 0; i < updatesChatsCount; ++i) {
+        updates.chats.append(makeChat(200 + i));
+    }
+
+    updates.date = 1430000000;
+    updates.seq = 77;
+
+    return updates;
+}
+
+static TLMessagesDialogs makeDialogs()
+{
+    TLMessagesDialogs dialogs;
+    dialogs.tlType = TLValue::MessagesDialogs;
+
+    for (int i = 0; i < dialogsCount; ++i) {
+        TLDialog dialog;
+        dialog.tlType = TLValue::Dialog;
+        dialog.peer.tlType = TLValue::PeerUser;
+        dialog.peer.userId = 1000 + i;
+        dialog.topMessage = 20000 + i;
+        dialog.unreadCount = i % 7;
+        dialog.notifySettings.tlType = TLValue::PeerNotifySettings;
+        dialog.notifySettings.muteUntil = 0;
+        dialog.notifySettings.sound = QLatin1String("default");
+        dialog.notifySettings.showPreviews = true;
+        dialog.notifySettings.eventsMask = 0;
+        dialogs.dialogs.append(dialog);
+
+        dialogs.messages.append(makeMessage(20000 + i, 1000 + i));
+        dialogs.users.append(makeUser(1000 + i));
+    }
+
+    for (int i = 0; i < dialogsChatsCount; ++i) {
+        dialogs.chats.append(makeChat(200 + i));
+    }
+
+    return dialogs;
+}
+
+static TLContactsContacts makeContacts()
+{
+    TLContactsContacts contacts;
+    contacts.tlType = TLValue::ContactsContacts;
+
+    for (int i = 0; i < contactsCount; ++i) {
+        TLContact contact;
+        contact.tlType = TLValue::Contact;
+        contact.userId = 1000 + i;
+        contact.mutual = i % 2;
+        contacts.contacts.append(contact);
+
+        contacts.users.append(makeUser(1000 + i));
+    }
+
+    return contacts;
+}
+
+static TLUploadFile makeUploadFile()
+{
+    TLUploadFile file;
+    file.tlType = TLValue::UploadFile;
+    file.type.tlType = TLValue::StorageFileJpeg;
+    file.mtime = 1430000000;
+    file.bytes.resize(uploadFilePartSize);
+
+    for (int i = 0; i < file.bytes.size(); ++i) {
+        file.bytes[i] = char(i * 7 + 3);
+    }
+
+    return file;
+}
+
+static TLVector<TLInputContact> makeInputContacts()
+{
+    TLVector<TLInputContact> contacts;
+
+    for (int i = 0; i < inputContactsCount; ++i) {
+        TLInputContact contact;
+        contact.clientId = i;
+        contact.phone = QString(QLatin1String("7911%1")).arg(i, 7, 10, QLatin1Char('0'));
+        contact.firstName = QString(QLatin1String("First name %1")).arg(i);
+        contact.lastName = QString(QLatin1String("Last name %1")).arg(i);
+        contacts.append(contact);
+    }
+
+    return contacts;
+}
+
+class bench_CTelegramStream : public QObject
+{
+    Q_OBJECT
+public:
+    explicit bench_CTelegramStream(QObject *parent = 0);
+
+private slots:
+    void initTestCase();
+
+    void decodeUpdates();
+    void decodeMessagesDialogs();
+    void decodeContactsContacts();
+    void decodeUploadFile();
+
+    void encodeUpdates();
+    void encodeMessagesDialogs();
+    void encodeContactsContacts();
+    void encodeUploadFile();
+    void encodeInputContacts();
+
+private:
+    TLUpdates m_updates;
+    TLMessagesDialogs m_dialogs;
+    TLContactsContacts m_contacts;
+    TLUploadFile m_uploadFile;
+
+    QByteArray m_updatesData;
+    QByteArray m_dialogsData;
+    QByteArray m_contactsData;
+    QByteArray m_uploadFileData;
+
+};
+
+bench_CTelegramStream::bench_CTelegramStream(QObject *parent) :
+    QObject(parent)
+{
+}
+
+void bench_CTelegramStream::initTestCase()
+{
+    m_updates = makeUpdates();
+    m_dialogs = makeDialogs();
+    m_contacts = makeContacts();
+    m_uploadFile = makeUploadFile();
+
+    m_updatesData = encodeUpdates(m_updates);
+    m_dialogsData = encodeDialogs(m_dialogs);
+    m_contactsData = encodeContacts(m_contacts);
+    m_uploadFileData = encodeUploadFile(m_uploadFile);
+
+    qDebug() << "Payload sizes (bytes): updates" << m_updatesData.size()
+             << "dialogs" << m_dialogsData.size()
+             << "contacts" << m_contactsData.size()
+             << "upload.file" << m_uploadFileData.size();
+}
+
+void bench_CTelegramStream::decodeUpdates()
+{
+    TLUpdates updates;
+    quint64 rounds = 0;
+
+    CAllocationCounter counter;
+    QElapsedTimer timer;
+    timer.start();
+
+    QBENCHMARK {
+        CTelegramStream stream(m_updatesData);
+        stream >> updates;
+        ++rounds;
+    }
+
+    reportPerObject("Updates decode (per update)", timer.nsecsElapsed(), counter, rounds * updatesCount);
+
+    QCOMPARE(quint32(updates.tlType), quint32(TLValue::Updates));
+    QCOMPARE(updates.updates.count(), updatesCount);
+    QCOMPARE(updates.users.count(), updatesUsersCount);
+    QCOMPARE(updates.chats.count(), updatesChatsCount);
+    QCOMPARE(updates.seq, m_updates.seq);
+}
+
+void bench_CTelegramStream::decodeMessagesDialogs()
+{
+    TLMessagesDialogs dialogs;
+    quint64 rounds = 0;
+
+    CAllocationCounter counter;
+    QElapsedTimer timer;
+    timer.start();
+
+    QBENCHMARK {
+        CTelegramStream stream(m_dialogsData);
+        stream >> dialogs;
+        ++rounds;
+    }
+
+    reportPerObject("MessagesDialogs decode (per dialog)", timer.nsecsElapsed(), counter, rounds * dialogsCount);
+
+    QCOMPARE(quint32(dialogs.tlType), quint32(TLValue::MessagesDialogs));
+    QCOMPARE(dialogs.dialogs.count(), dialogsCount);
+    QCOMPARE(dialogs.messages.count(), dialogsCount);
+    QCOMPARE(dialogs.chats.count(), dialogsChatsCount);
+    QCOMPARE(dialogs.users.count(), dialogsCount);
+}
+
+void bench_CTelegramStream::decodeContactsContacts()
+{
+    TLContactsContacts contacts;
+    quint64 rounds = 0;
+
+    CAllocationCounter counter;
+    QElapsedTimer timer;
+    timer.start();
+
+    QBENCHMARK {
+        CTelegramStream stream(m_contactsData);
+        stream >> contacts;
+        ++rounds;
+    }
+
+    reportPerObject("ContactsContacts decode (per user)", timer.nsecsElapsed(), counter, rounds * contactsCount);
+
+    QCOMPARE(quint32(contacts.tlType), quint32(TLValue::ContactsContacts));
+    QCOMPARE(contacts.contacts.count(), contactsCount);
+    QCOMPARE(contacts.users.count(), contactsCount);
+    QCOMPARE(contacts.users.last().phone, m_contacts.users.last().phone);
+}
+
+void bench_CTelegramStream::decodeUploadFile()
+{
+    TLUploadFile file;
+    quint64 rounds = 0;
+
+    CAllocationCounter counter;
+    QElapsedTimer timer;
+    timer.start();
+
+    QBENCHMARK {
+        CTelegramStream stream(m_uploadFileData);
+        stream >> file;
+        ++rounds;
+    }
+
+    reportPerObject("UploadFile decode (per 512 KB part)", timer.nsecsElapsed(), counter, rounds);
+
+    QCOMPARE(quint32(file.tlType), quint32(TLValue::UploadFile));
+    QCOMPARE(file.bytes, m_uploadFile.bytes);
+}
+
+void bench_CTelegramStream::encodeUpdates()
+{
+    QByteArray data;
+    quint64 rounds = 0;
+
+    CAllocationCounter counter;
+    QElapsedTimer timer;
+    timer.start();
+
+    QBENCHMARK {
+        data = encodeUpdates(m_updates);
+        ++rounds;
+    }
+
+    reportPerObject("Updates encode (per update)", timer.nsecsElapsed(), counter, rounds * updatesCount);
+
+    QCOMPARE(data, m_updatesData);
+}
+
+void bench_CTelegramStream::encodeMessagesDialogs()
+{
+    QByteArray data;
+    quint64 rounds = 0;
+
+    CAllocationCounter counter;
+    QElapsedTimer timer;
+    timer.start();
+
+    QBENCHMARK {
+        data = encodeDialogs(m_dialogs);
+        ++rounds;
+    }
+
+    reportPerObject("MessagesDialogs encode (per dialog)", timer.nsecsElapsed(), counter, rounds * dialogsCount);
+
+    QCOMPARE(data, m_dialogsData);
+}
+
+void bench_CTelegramStream::encodeContactsContacts()
+{
+    QByteArray data;
+    quint64 rounds = 0;
+
+    CAllocationCounter counter;
+    QElapsedTimer timer;
+    timer.start();
+
+    QBENCHMARK {
+        data = encodeContacts(m_contacts);
+        ++rounds;
+    }
+
+    reportPerObject("ContactsContacts encode (per user)", timer.nsecsElapsed(), counter, rounds * contactsCount);
+
+    QCOMPARE(data, m_contactsData);
+}
+
+void bench_CTelegramStream::encodeUploadFile()
+{
+    QByteArray data;
+    quint64 rounds = 0;
+
+    CAllocationCounter counter;
+    QElapsedTimer timer;
+    timer.start();
+
+    QBENCHMARK {
+        data = encodeUploadFile(m_uploadFile);
+        ++rounds;
+    }
+
+    reportPerObject("UploadFile encode (per 512 KB part)", timer.nsecsElapsed(), counter, rounds);
+
+    QCOMPARE(data, m_uploadFileData);
+}
+
+void bench_CTelegramStream::encodeInputContacts()
+{
+    const TLVector<TLInputContact> contacts = makeInputContacts();
+    QByteArray data;
+    quint64 rounds = 0;
+
+    CAllocationCounter counter;
+    QElapsedTimer timer;
+    timer.start();
+
+    // Generated write operators, as used by contacts.importContacts
+    QBENCHMARK {
+        data.clear();
+        CTelegramStream stream(&data, /* write */ true);
+        stream << contacts;
+        ++rounds;
+    }
+
+    reportPerObject("InputContact vector encode (per contact)", timer.nsecsElapsed(), counter, rounds * inputContactsCount);
+
+    QVERIFY(!data.isEmpty());
+}
+
+QTEST_MAIN(bench_CTelegramStream)
+
+#include "bench_CTelegramStream.moc"
@@ -0,0 +1,10 @@
+include(../benchmarks.pri)
+
+TARGET = bench_telegramstream
+SOURCES += bench_CTelegramStream.cpp \
+    ../../CTelegramStream.cpp \
+    ../../CRawStream.cpp
+
+HEADERS += \
+    ../../CTelegramStream.hpp \
+    ../../CRawStream.hpp
@@ -0,0 +1,23 @@
+include(../benchmarks.pri)
+
+TARGET = bench_crypto
+SOURCES += bench_Crypto.cpp \
+    ../../Utils.cpp \
+    ../../CTcpTransport.cpp \
+    ../../CTelegramConnection.cpp \
+    ../../CTimerScheduler.cpp \
+    ../../CTelegramStream.cpp \
+    ../../CRawStream.cpp \
+    ../../TLValues.cpp
+
+HEADERS += \
+    ../../Utils.hpp \
+    ../../CTelegramConnection.hpp \
+    ../../CTimerScheduler.hpp \
+    ../../CTelegramTransport.hpp \
+    ../../CTcpTransport.hpp \
+    ../../CTelegramStream.hpp \
+    ../../CRawStream.hpp \
+    ../../TLValues.hpp
+
+LIBS += -lz
@@ -0,0 +1,10 @@
+QT += core network testlib
+TEMPLATE = app
+
+INCLUDEPATH += $$PWD/..
+INCLUDEPATH += $$PWD
+
+LIBS += -lssl -lcrypto
+
+SOURCES += $$PWD/CAllocationCounter.cpp
+HEADERS += $$PWD/CAllocationCounter.hpp
@@ -0,0 +1,4 @@
+TEMPLATE = subdirs
+SUBDIRS += bench_CTelegramStream
+SUBDIRS += bench_Crypto
+SUBDIRS += bench_CTelegramDispatcher
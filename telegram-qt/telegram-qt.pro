@@ -10,6 +10,7 @@ include(../options.pri)
 DEFINES += TELEGRAMQT_LIBRARY
 
 SOURCES = CTelegramCore.cpp \
+    CTelegramSessionHost.cpp \
     CAppInformation.cpp \
     CTelegramDispatcher.cpp \
     CRawStream.cpp \
@@ -18,9 +19,15 @@ SOURCES = CTelegramCore.cpp \
     CTcpTransport.cpp \
     TelegramNamespace.cpp \
     CTelegramConnection.cpp \
+    CTimerScheduler.cpp \
+    CDcEndpointProber.cpp \
+    CFileCache.cpp \
+    CMessageStore.cpp \
+    CSpillStore.cpp \
     TLValues.cpp \
 
 HEADERS = CTelegramCore.hpp \
+    CTelegramSessionHost.hpp \
     CAppInformation.hpp \
     CTelegramDispatcher.hpp \
     CTelegramStream.hpp \
@@ -33,6 +40,15 @@ HEADERS = CTelegramCore.hpp \
     crypto-aes.hpp \
     crypto-rsa.hpp \
     CTelegramConnection.hpp \
+    CTimerScheduler.hpp \
+    CDcEndpointProber.hpp \
+    CSessionSharedData.hpp \
+    CFileCache.hpp \
+    CLruMap.hpp \
+    CTokenBucket.hpp \
+    CEndpointLatency.hpp \
+    CMessageStore.hpp \
+    CSpillStore.hpp \
     TelegramNamespace.hpp \
     telegramqt_export.h \
     TLValues.hpp
@@ -2,3 +2,10 @@ TEMPLATE = subdirs
 SUBDIRS += tst_CTelegramConnection
 SUBDIRS += tst_CTelegramStream
 SUBDIRS += tst_CTelegramDispatcher
+SUBDIRS += tst_CFileCache
+SUBDIRS += tst_CLruMap
+SUBDIRS += tst_CMessageStore
+SUBDIRS += tst_CSpillStore
+SUBDIRS += tst_CTimerScheduler
+SUBDIRS += tst_CTokenBucket
+SUBDIRS += tst_CEndpointLatency
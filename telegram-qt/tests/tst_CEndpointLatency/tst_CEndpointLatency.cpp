@@ -0,0 +1,106 @@
+/*
+    Copyright (C) 2015 Alexandr Akulich <akulichalexander@gmail.com>
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+    LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+    OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+    WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+#include <QObject>
+
+#include "CEndpointLatency.hpp"
+
+#include <QTest>
+#include <QDebug>
+
+class tst_CEndpointLatency : public QObject
+{
+    Q_OBJECT
+public:
+    explicit tst_CEndpointLatency(QObject *parent = 0);
+
+private slots:
+    void average();
+    void fastest();
+    void failures();
+
+};
+
+static TLDcOption endpoint(quint32 dc, const char *address, quint32 port = 443)
+{
+    TLDcOption option;
+    option.id = dc;
+    option.ipAddress = QLatin1String(address);
+    option.port = port;
+
+    return option;
+}
+
+tst_CEndpointLatency::tst_CEndpointLatency(QObject *parent) :
+    QObject(parent)
+{
+}
+
+void tst_CEndpointLatency::average()
+{
+    CEndpointLatency latency;
+    const TLDcOption option = endpoint(1, "10.0.0.1");
+
+    QCOMPARE(latency.rtt(option), qint64(-1));
+
+    latency.addSample(option, 100);
+    QCOMPARE(latency.rtt(option), qint64(100));
+
+    latency.addSample(option, 200);
+    QCOMPARE(latency.rtt(option), qint64(125));
+
+    // Port is a part of the endpoint.
+    QCOMPARE(latency.rtt(endpoint(1, "10.0.0.1", 80)), qint64(-1));
+}
+
+void tst_CEndpointLatency::fastest()
+{
+    CEndpointLatency latency;
+
+    QVector<TLDcOption> options;
+    options << endpoint(1, "10.0.0.1") << endpoint(2, "10.0.0.2") << endpoint(2, "10.0.0.3") << endpoint(2, "::3");
+
+    // Without samples the first endpoint of the DC is taken.
+    QCOMPARE(latency.fastest(options, 2).ipAddress, QString(QLatin1String("10.0.0.2")));
+
+    latency.addSample(options.at(1), 300);
+    latency.addSample(options.at(2), 50);
+    latency.addSample(options.at(3), 80);
+
+    QCOMPARE(latency.fastest(options, 2).ipAddress, QString(QLatin1String("10.0.0.3")));
+    QCOMPARE(latency.fastest(options, 1).ipAddress, QString(QLatin1String("10.0.0.1")));
+    QVERIFY(latency.fastest(options, 3).ipAddress.isEmpty());
+}
+
+void tst_CEndpointLatency::failures()
+{
+    CEndpointLatency latency;
+
+    QVector<TLDcOption> options;
+    options << endpoint(2, "10.0.0.2") << endpoint(2, "10.0.0.3");
+
+    latency.addFailure(options.at(0));
+
+    // An unknown endpoint is better than a failing one.
+    QCOMPARE(latency.fastest(options, 2).ipAddress, QString(QLatin1String("10.0.0.3")));
+
+    latency.addFailure(options.at(1));
+    latency.addSample(options.at(0), 100);
+
+    QCOMPARE(latency.fastest(options, 2).ipAddress, QString(QLatin1String("10.0.0.2")));
+}
+
+QTEST_MAIN(tst_CEndpointLatency)
+
+#include "tst_CEndpointLatency.moc"
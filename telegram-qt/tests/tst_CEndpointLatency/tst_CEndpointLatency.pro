@@ -0,0 +1,9 @@
+include(../tests.pri)
+
+TARGET = tst_endpointlatency
+SOURCES = tst_CEndpointLatency.cpp \
+    ../../TLValues.cpp
+
+HEADERS = \
+    ../../CEndpointLatency.hpp \
+    ../../TLValues.hpp
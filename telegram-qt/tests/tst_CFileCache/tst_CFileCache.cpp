@@ -0,0 +1,370 @@
+/*
+    Copyright (C) 2015 Alexandr Akulich <akulichalexander@gmail.com>
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+    LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+    OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+    WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include <QObject>
+
+#include "CFileCache.hpp"
+
+#include <QDir>
+#include <QFile>
+#include <QTest>
+#include <QDebug>
+
+class tst_CFileCache : public QObject
+{
+    Q_OBJECT
+public:
+    explicit tst_CFileCache(QObject *parent = 0);
+
+private slots:
+    void init();
+    void cleanup();
+
+    void keyDependsOnLocation();
+    void keyDependsOnDocument();
+    void insertAndLookup();
+    void disabledCache();
+    void leastRecentlyUsedEviction();
+    void maxSizeReduction();
+    void indexPersistence();
+    void journalPersistence();
+    void removedFile();
+    void readsKeepIndex();
+    void unknownIndexFormat();
+
+protected:
+    QString m_directory;
+
+};
+
+static TLInputFileLocation testLocation(quint64 volumeId, quint32 localId, quint64 secret)
+{
+    TLInputFileLocation location;
+    location.volumeId = volumeId;
+    location.localId = localId;
+    location.secret = secret;
+
+    return location;
+}
+
+tst_CFileCache::tst_CFileCache(QObject *parent) :
+    QObject(parent)
+{
+}
+
+void tst_CFileCache::init()
+{
+    m_directory = QDir::tempPath() + QLatin1String("/tst_CFileCache");
+    QDir().mkpath(m_directory);
+}
+
+void tst_CFileCache::cleanup()
+{
+    QDir directory(m_directory);
+
+    foreach (const QString &fileName, directory.entryList(QDir::Files)) {
+        directory.remove(fileName);
+    }
+
+    QDir().rmdir(m_directory);
+}
+
+void tst_CFileCache::keyDependsOnLocation()
+{
+    const TLInputFileLocation location = testLocation(0x1234, 5, 0xabcdef);
+
+    QCOMPARE(CFileCache::key(2, location), CFileCache::key(2, location));
+    QVERIFY(CFileCache::key(2, location) != CFileCache::key(4, location));
+    QVERIFY(CFileCache::key(2, location) != CFileCache::key(2, testLocation(0x1234, 6, 0xabcdef)));
+    QVERIFY(CFileCache::key(2, location) != CFileCache::key(2, testLocation(0x1234, 5, 0xabcdee)));
+}
+
+static TLInputFileLocation testDocumentLocation(quint64 id, quint64 accessHash)
+{
+    TLInputFileLocation location;
+    location.tlType = TLValue::InputDocumentFileLocation;
+    location.id = id;
+    location.accessHash = accessHash;
+
+    return location;
+}
+
+void tst_CFileCache::keyDependsOnDocument()
+{
+    const TLInputFileLocation document1 = testDocumentLocation(100, 0x1111);
+    const TLInputFileLocation document2 = testDocumentLocation(101, 0x2222);
+
+    QVERIFY(CFileCache::key(2, document1) != CFileCache::key(2, document2));
+    QVERIFY(CFileCache::key(2, document1) != CFileCache::key(2, testDocumentLocation(100, 0x1112)));
+
+    TLInputFileLocation video = document1;
+    video.tlType = TLValue::InputVideoFileLocation;
+    QVERIFY(CFileCache::key(2, document1) != CFileCache::key(2, video));
+
+    // Two documents on the same DC are cached separately.
+    CFileCache cache;
+    cache.setDirectory(m_directory);
+
+    QVERIFY(cache.insert(CFileCache::key(2, document1), QByteArray(100, '1'), TLValue::StorageFilePartial));
+    QVERIFY(cache.insert(CFileCache::key(2, document2), QByteArray(200, '2'), TLValue::StorageFilePartial));
+
+    QCOMPARE(cache.data(CFileCache::key(2, document1)), QByteArray(100, '1'));
+    QCOMPARE(cache.data(CFileCache::key(2, document2)), QByteArray(200, '2'));
+}
+
+void tst_CFileCache::insertAndLookup()
+{
+    CFileCache cache;
+    cache.setDirectory(m_directory);
+
+    const QString key = CFileCache::key(2, testLocation(1, 2, 3));
+    const QByteArray data(1000, 'a');
+
+    quint32 size;
+    TLValue fileType;
+
+    QVERIFY(!cache.lookup(key, &size, &fileType));
+    QVERIFY(cache.insert(key, data, TLValue::StorageFileJpeg));
+    QVERIFY(cache.lookup(key, &size, &fileType));
+
+    QCOMPARE(size, quint32(data.size()));
+    QCOMPARE(quint32(fileType), quint32(TLValue::StorageFileJpeg));
+    QCOMPARE(cache.data(key), data);
+    QCOMPARE(cache.size(), quint64(data.size()));
+}
+
+void tst_CFileCache::disabledCache()
+{
+    CFileCache cache;
+
+    const QString key = CFileCache::key(2, testLocation(1, 2, 3));
+
+    quint32 size;
+    TLValue fileType;
+
+    QVERIFY(!cache.isEnabled());
+    QVERIFY(!cache.insert(key, QByteArray(10, 'a'), TLValue::StorageFileJpeg));
+    QVERIFY(!cache.lookup(key, &size, &fileType));
+}
+
+void tst_CFileCache::leastRecentlyUsedEviction()
+{
+    CFileCache cache;
+    cache.setDirectory(m_directory);
+    cache.setMaxSize(3000);
+
+    const QString key1 = CFileCache::key(2, testLocation(1, 1, 1));
+    const QString key2 = CFileCache::key(2, testLocation(1, 2, 1));
+    const QString key3 = CFileCache::key(2, testLocation(1, 3, 1));
+    const QString key4 = CFileCache::key(2, testLocation(1, 4, 1));
+
+    QVERIFY(cache.insert(key1, QByteArray(1000, '1'), TLValue::StorageFileJpeg));
+    QVERIFY(cache.insert(key2, QByteArray(1000, '2'), TLValue::StorageFileJpeg));
+    QVERIFY(cache.insert(key3, QByteArray(1000, '3'), TLValue::StorageFileJpeg));
+
+    quint32 size;
+    TLValue fileType;
+
+    // Use the first file, so the second one becomes the least recently used.
+    QVERIFY(cache.lookup(key1, &size, &fileType));
+
+    QVERIFY(cache.insert(key4, QByteArray(1000, '4'), TLValue::StorageFileJpeg));
+
+    QVERIFY(cache.lookup(key1, &size, &fileType));
+    QVERIFY(!cache.lookup(key2, &size, &fileType));
+    QVERIFY(cache.lookup(key3, &size, &fileType));
+    QVERIFY(cache.lookup(key4, &size, &fileType));
+    QVERIFY(!QFile::exists(cache.filePath(key2)));
+    QCOMPARE(cache.size(), quint64(3000));
+
+    // Files bigger than the cache are not stored.
+    QVERIFY(!cache.insert(key2, QByteArray(3001, '2'), TLValue::StorageFileJpeg));
+    QCOMPARE(cache.size(), quint64(3000));
+}
+
+void tst_CFileCache::maxSizeReduction()
+{
+    CFileCache cache;
+    cache.setDirectory(m_directory);
+
+    const QString key1 = CFileCache::key(2, testLocation(1, 1, 1));
+    const QString key2 = CFileCache::key(2, testLocation(1, 2, 1));
+
+    QVERIFY(cache.insert(key1, QByteArray(1000, '1'), TLValue::StorageFileJpeg));
+    QVERIFY(cache.insert(key2, QByteArray(1000, '2'), TLValue::StorageFileJpeg));
+
+    cache.setMaxSize(1500);
+
+    quint32 size;
+    TLValue fileType;
+
+    QVERIFY(!cache.lookup(key1, &size, &fileType));
+    QVERIFY(cache.lookup(key2, &size, &fileType));
+    QCOMPARE(cache.size(), quint64(1000));
+}
+
+void tst_CFileCache::indexPersistence()
+{
+    const QString key1 = CFileCache::key(2, testLocation(1, 1, 1));
+    const QString key2 = CFileCache::key(2, testLocation(1, 2, 1));
+    const QString key3 = CFileCache::key(2, testLocation(1, 3, 1));
+
+    quint32 size;
+    TLValue fileType;
+
+    {
+        CFileCache cache;
+        cache.setDirectory(m_directory);
+
+        QVERIFY(cache.insert(key1, QByteArray(1000, '1'), TLValue::StorageFileJpeg));
+        QVERIFY(cache.insert(key2, QByteArray(500, '2'), TLValue::StorageFilePng));
+        QVERIFY(cache.lookup(key1, &size, &fileType)); // The second file is the least recently used now
+    }
+
+    CFileCache cache;
+    cache.setDirectory(m_directory);
+    cache.setMaxSize(1500);
+
+    QCOMPARE(cache.size(), quint64(1500));
+    QVERIFY(cache.lookup(key2, &size, &fileType));
+    QCOMPARE(size, quint32(500));
+    QCOMPARE(quint32(fileType), quint32(TLValue::StorageFilePng));
+    QCOMPARE(cache.data(key2), QByteArray(500, '2'));
+
+    // The access order is restored, so the first file is evicted after the second file use.
+    QVERIFY(cache.insert(key3, QByteArray(100, '3'), TLValue::StorageFileJpeg));
+    QVERIFY(!cache.lookup(key1, &size, &fileType));
+    QVERIFY(cache.lookup(key2, &size, &fileType));
+}
+
+void tst_CFileCache::journalPersistence()
+{
+    const QString key1 = CFileCache::key(2, testLocation(1, 1, 1));
+    const QString key2 = CFileCache::key(2, testLocation(1, 2, 1));
+
+    quint32 size;
+    TLValue fileType;
+
+    CFileCache cache;
+    cache.setDirectory(m_directory);
+
+    QVERIFY(cache.insert(key1, QByteArray(1000, '1'), TLValue::StorageFileJpeg));
+    QVERIFY(cache.insert(key2, QByteArray(500, '2'), TLValue::StorageFilePng));
+    cache.remove(key1);
+
+    // The changes are in the journal, while the first cache is not destroyed yet.
+    QVERIFY(QFile::exists(m_directory + QLatin1String("/journal")));
+
+    CFileCache restoredCache;
+    restoredCache.setDirectory(m_directory);
+
+    QCOMPARE(restoredCache.size(), quint64(500));
+    QVERIFY(!restoredCache.lookup(key1, &size, &fileType));
+    QVERIFY(restoredCache.lookup(key2, &size, &fileType));
+    QCOMPARE(size, quint32(500));
+    QCOMPARE(quint32(fileType), quint32(TLValue::StorageFilePng));
+}
+
+void tst_CFileCache::removedFile()
+{
+    CFileCache cache;
+    cache.setDirectory(m_directory);
+
+    const QString key = CFileCache::key(2, testLocation(1, 2, 3));
+
+    QVERIFY(cache.insert(key, QByteArray(1000, 'a'), TLValue::StorageFileJpeg));
+    QVERIFY(QFile::remove(cache.filePath(key)));
+
+    quint32 size;
+    TLValue fileType;
+
+    QVERIFY(cache.data(key).isEmpty());
+    QVERIFY(!cache.lookup(key, &size, &fileType));
+    QCOMPARE(cache.size(), quint64(0));
+}
+
+static QByteArray readFile(const QString &fileName)
+{
+    QFile file(fileName);
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+
+    return file.readAll();
+}
+
+void tst_CFileCache::readsKeepIndex()
+{
+    const QString key1 = CFileCache::key(2, testLocation(1, 1, 1));
+    const QString key2 = CFileCache::key(2, testLocation(1, 2, 1));
+    const QString indexFileName = m_directory + QLatin1String("/index");
+
+    {
+        CFileCache cache;
+        cache.setDirectory(m_directory);
+
+        QVERIFY(cache.insert(key1, QByteArray(1000, '1'), TLValue::StorageFileJpeg));
+        QVERIFY(cache.insert(key2, QByteArray(500, '2'), TLValue::StorageFilePng));
+    }
+
+    const QByteArray index = readFile(indexFileName);
+    QVERIFY(!index.isEmpty());
+
+    quint32 size;
+    TLValue fileType;
+
+    {
+        CFileCache cache;
+        cache.setDirectory(m_directory);
+
+        QVERIFY(cache.lookup(key1, &size, &fileType));
+        QCOMPARE(cache.data(key1), QByteArray(1000, '1'));
+    }
+
+    QCOMPARE(readFile(indexFileName), index);
+}
+
+void tst_CFileCache::unknownIndexFormat()
+{
+    const QString key = CFileCache::key(2, testLocation(1, 2, 3));
+    const QString otherFileName = m_directory + QLatin1String("/media-messages-1.log");
+
+    {
+        CFileCache cache;
+        cache.setDirectory(m_directory);
+        QVERIFY(cache.insert(key, QByteArray(1000, 'a'), TLValue::StorageFileJpeg));
+    }
+
+    QFile index(m_directory + QLatin1String("/index"));
+    QVERIFY(index.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    index.write(QByteArray(4, char(0x7f)));
+    index.close();
+
+    QFile otherFile(otherFileName);
+    QVERIFY(otherFile.open(QIODevice::WriteOnly));
+    otherFile.write("other");
+    otherFile.close();
+
+    CFileCache cache;
+    cache.setDirectory(m_directory);
+
+    // The files of the unknown index are removed, the other files of the directory are kept.
+    QCOMPARE(cache.size(), quint64(0));
+    QVERIFY(!QFile::exists(cache.filePath(key)));
+    QVERIFY(QFile::exists(otherFileName));
+}
+
+QTEST_MAIN(tst_CFileCache)
+
+#include "tst_CFileCache.moc"
@@ -0,0 +1,14 @@
+include(../tests.pri)
+
+TARGET = tst_filecache
+SOURCES = tst_CFileCache.cpp \
+    ../../CFileCache.cpp \
+    ../../CTelegramStream.cpp \
+    ../../CRawStream.cpp \
+    ../../TLValues.cpp
+
+HEADERS = \
+    ../../CFileCache.hpp \
+    ../../CTelegramStream.hpp \
+    ../../CRawStream.hpp \
+    ../../TLValues.hpp
@@ -0,0 +1,154 @@
+/*
+    Copyright (C) 2015 Alexandr Akulich <akulichalexander@gmail.com>
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+    LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+    OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+    WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include <QObject>
+
+#include "CLruMap.hpp"
+
+#include <QString>
+#include <QTest>
+#include <QDebug>
+
+typedef CLruMap<quint32, QString> TestMap;
+typedef QList<QPair<quint32, QString> > EvictedList;
+
+class tst_CLruMap : public QObject
+{
+    Q_OBJECT
+public:
+    explicit tst_CLruMap(QObject *parent = 0);
+
+private slots:
+    void unlimited();
+    void leastRecentlyUsedEviction();
+    void peekDoesNotTouch();
+    void capacityReduction();
+    void removeAndReinsert();
+
+};
+
+tst_CLruMap::tst_CLruMap(QObject *parent) :
+    QObject(parent)
+{
+}
+
+void tst_CLruMap::unlimited()
+{
+    TestMap map;
+
+    for (quint32 i = 0; i < 1000; ++i) {
+        map.insert(i, QString::number(i));
+    }
+
+    QCOMPARE(map.count(), 1000);
+    QCOMPARE(map.value(0), QString(QLatin1String("0")));
+    QCOMPARE(map.value(1000, QLatin1String("none")), QString(QLatin1String("none")));
+    QVERIFY(map.memoryUsage() > 1000 * (sizeof(quint32) + sizeof(QString)));
+}
+
+void tst_CLruMap::leastRecentlyUsedEviction()
+{
+    TestMap map(3);
+    EvictedList evicted;
+
+    map.insert(1, QLatin1String("one"), &evicted);
+    map.insert(2, QLatin1String("two"), &evicted);
+    map.insert(3, QLatin1String("three"), &evicted);
+    QVERIFY(evicted.isEmpty());
+
+    // Use the first entry, so the second one becomes the least recently used.
+    QCOMPARE(map.value(1), QString(QLatin1String("one")));
+
+    map.insert(4, QLatin1String("four"), &evicted);
+
+    QCOMPARE(map.count(), 3);
+    QVERIFY(map.contains(1));
+    QVERIFY(!map.contains(2));
+    QVERIFY(map.contains(3));
+    QVERIFY(map.contains(4));
+
+    QCOMPARE(evicted.count(), 1);
+    QCOMPARE(evicted.first().first, quint32(2));
+    QCOMPARE(evicted.first().second, QString(QLatin1String("two")));
+
+    // Update of existing entry does not evict anything.
+    evicted.clear();
+    map.insert(3, QLatin1String("new three"), &evicted);
+    QVERIFY(evicted.isEmpty());
+    QCOMPARE(map.peek(3), QString(QLatin1String("new three")));
+}
+
+void tst_CLruMap::peekDoesNotTouch()
+{
+    TestMap map(2);
+
+    map.insert(1, QLatin1String("one"));
+    map.insert(2, QLatin1String("two"));
+
+    QCOMPARE(map.peek(1), QString(QLatin1String("one")));
+
+    map.insert(3, QLatin1String("three"));
+
+    QVERIFY(!map.contains(1));
+    QVERIFY(map.contains(2));
+    QVERIFY(map.contains(3));
+}
+
+void tst_CLruMap::capacityReduction()
+{
+    TestMap map;
+    EvictedList evicted;
+
+    for (quint32 i = 0; i < 10; ++i) {
+        map.insert(i, QString::number(i));
+    }
+
+    map.setCapacity(4, &evicted);
+
+    QCOMPARE(map.count(), 4);
+    QCOMPARE(evicted.count(), 6);
+
+    for (quint32 i = 0; i < 6; ++i) {
+        QCOMPARE(evicted.at(i).first, i);
+        QVERIFY(!map.contains(i));
+    }
+
+    for (quint32 i = 6; i < 10; ++i) {
+        QVERIFY(map.contains(i));
+    }
+}
+
+void tst_CLruMap::removeAndReinsert()
+{
+    TestMap map(2);
+
+    map.insert(1, QLatin1String("one"));
+    map.insert(2, QLatin1String("two"));
+    map.remove(1);
+
+    QCOMPARE(map.count(), 1);
+
+    map.insert(3, QLatin1String("three"));
+    QVERIFY(map.contains(2));
+    QVERIFY(map.contains(3));
+
+    map.clear();
+    QVERIFY(map.isEmpty());
+
+    map.insert(1, QLatin1String("one"));
+    QCOMPARE(map.value(1), QString(QLatin1String("one")));
+}
+
+QTEST_MAIN(tst_CLruMap)
+
+#include "tst_CLruMap.moc"
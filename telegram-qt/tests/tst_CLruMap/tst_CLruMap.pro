@@ -0,0 +1,7 @@
+include(../tests.pri)
+
+TARGET = tst_lrumap
+SOURCES = tst_CLruMap.cpp
+
+HEADERS = \
+    ../../CLruMap.hpp
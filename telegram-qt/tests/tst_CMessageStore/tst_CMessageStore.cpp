@@ -0,0 +1,277 @@
+/*
+    Copyright (C) 2015 Alexandr Akulich <akulichalexander@gmail.com>
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+    LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+    OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+    WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include <QObject>
+
+#include "CMessageStore.hpp"
+
+#include <QDir>
+#include <QFile>
+#include <QTest>
+#include <QDebug>
+
+class tst_CMessageStore : public QObject
+{
+    Q_OBJECT
+public:
+    explicit tst_CMessageStore(QObject *parent = 0);
+
+private slots:
+    void init();
+    void cleanup();
+
+    void disabledStore();
+    void insertAndRead();
+    void peerHistory();
+    void dateHistory();
+    void reopen();
+    void incompleteRecord();
+    void readsBetweenAppends();
+
+protected:
+    QString m_directory;
+
+};
+
+static TelegramNamespace::Message testMessage(quint32 id, const TelegramNamespace::Peer &peer, quint32 timestamp)
+{
+    TelegramNamespace::Message message;
+    message.peer = peer;
+    message.fromId = peer.type == TelegramNamespace::Peer::User ? peer.id : 100;
+    message.id = id;
+    message.timestamp = timestamp;
+    message.flags = TelegramNamespace::MessageFlagRead;
+    message.type = TelegramNamespace::MessageTypeText;
+    message.text = QString(QLatin1String("Message %1 ")).arg(id) + QString::fromUtf8("\xd1\x82\xd0\xb5\xd0\xba\xd1\x81\xd1\x82");
+
+    return message;
+}
+
+static bool messagesEqual(const TelegramNamespace::Message &message1, const TelegramNamespace::Message &message2)
+{
+    return (message1.peer == message2.peer)
+            && (message1.fromId == message2.fromId)
+            && (message1.id == message2.id)
+            && (message1.timestamp == message2.timestamp)
+            && (message1.flags == message2.flags)
+            && (message1.type == message2.type)
+            && (message1.text == message2.text);
+}
+
+tst_CMessageStore::tst_CMessageStore(QObject *parent) :
+    QObject(parent)
+{
+}
+
+void tst_CMessageStore::init()
+{
+    m_directory = QDir::tempPath() + QLatin1String("/tst_CMessageStore");
+    QDir().mkpath(m_directory);
+}
+
+void tst_CMessageStore::cleanup()
+{
+    QDir directory(m_directory);
+
+    foreach (const QString &fileName, directory.entryList(QDir::Files)) {
+        directory.remove(fileName);
+    }
+
+    QDir().rmdir(m_directory);
+}
+
+void tst_CMessageStore::disabledStore()
+{
+    CMessageStore store;
+
+    TelegramNamespace::Message message;
+
+    QVERIFY(!store.isEnabled());
+    QVERIFY(!store.insert(testMessage(1, TelegramNamespace::Peer(10), 1000)));
+    QVERIFY(!store.message(1, &message));
+    QCOMPARE(store.count(), 0);
+}
+
+void tst_CMessageStore::insertAndRead()
+{
+    CMessageStore store;
+    store.setDirectory(m_directory);
+
+    const TelegramNamespace::Message message = testMessage(5, TelegramNamespace::Peer(10), 1000);
+
+    QVERIFY(store.insert(message));
+    QVERIFY(!store.insert(message)); // Known message
+    QVERIFY(store.contains(5));
+    QCOMPARE(store.count(), 1);
+
+    TelegramNamespace::Message storedMessage;
+
+    QVERIFY(store.message(5, &storedMessage));
+    QVERIFY(messagesEqual(storedMessage, message));
+    QVERIFY(!store.message(6, &storedMessage));
+}
+
+void tst_CMessageStore::peerHistory()
+{
+    CMessageStore store;
+    store.setDirectory(m_directory);
+
+    const TelegramNamespace::Peer user(10);
+    const TelegramNamespace::Peer chat(10, TelegramNamespace::Peer::Chat);
+
+    for (quint32 i = 1; i <= 20; ++i) {
+        QVERIFY(store.insert(testMessage(i, (i % 2) ? user : chat, 1000 + i)));
+    }
+
+    QList<TelegramNamespace::Message> history = store.history(user, 0, 3);
+
+    QCOMPARE(history.count(), 3);
+    QCOMPARE(history.at(0).id, quint32(19));
+    QCOMPARE(history.at(1).id, quint32(17));
+    QCOMPARE(history.at(2).id, quint32(15));
+
+    history = store.history(user, 15, 100);
+
+    QCOMPARE(history.count(), 7);
+    QCOMPARE(history.first().id, quint32(13));
+    QCOMPARE(history.last().id, quint32(1));
+
+    history = store.history(chat, 0, 100);
+
+    QCOMPARE(history.count(), 10);
+    QVERIFY(history.first().peer == chat);
+
+    QVERIFY(store.history(TelegramNamespace::Peer(11), 0, 100).isEmpty());
+}
+
+void tst_CMessageStore::dateHistory()
+{
+    CMessageStore store;
+    store.setDirectory(m_directory);
+
+    const TelegramNamespace::Peer user(10);
+
+    QVERIFY(store.insert(testMessage(1, user, 1000)));
+    QVERIFY(store.insert(testMessage(2, user, 2000)));
+    QVERIFY(store.insert(testMessage(3, user, 2000)));
+    QVERIFY(store.insert(testMessage(4, user, 3000)));
+
+    QList<TelegramNamespace::Message> history = store.historyByDate(user, 1500, 3000, 100);
+
+    QCOMPARE(history.count(), 3);
+    QCOMPARE(history.at(0).timestamp, quint32(2000));
+    QCOMPARE(history.at(2).id, quint32(4));
+
+    history = store.historyByDate(user, 0, 2000, 2);
+
+    QCOMPARE(history.count(), 2);
+    QCOMPARE(history.at(0).id, quint32(1));
+}
+
+void tst_CMessageStore::reopen()
+{
+    const TelegramNamespace::Peer user(10);
+
+    {
+        CMessageStore store;
+        store.setDirectory(m_directory);
+
+        QVERIFY(store.insert(testMessage(1, user, 1000)));
+        QVERIFY(store.insert(testMessage(2, user, 2000)));
+    }
+
+    // The index is saved on close, so the log tail after it is scanned on the next open.
+    {
+        CMessageStore store;
+        store.setDirectory(m_directory);
+
+        QCOMPARE(store.count(), 2);
+        QVERIFY(store.insert(testMessage(3, user, 3000)));
+    }
+
+    QFile::remove(m_directory + QLatin1String("/messages.index"));
+
+    CMessageStore store;
+    store.setDirectory(m_directory);
+
+    QCOMPARE(store.count(), 3);
+
+    TelegramNamespace::Message message;
+    QVERIFY(store.message(3, &message));
+    QVERIFY(messagesEqual(message, testMessage(3, user, 3000)));
+    QCOMPARE(store.history(user, 0, 10).count(), 3);
+
+    store.clear();
+    QCOMPARE(store.count(), 0);
+    QVERIFY(!store.message(3, &message));
+}
+
+void tst_CMessageStore::incompleteRecord()
+{
+    const TelegramNamespace::Peer user(10);
+
+    {
+        CMessageStore store;
+        store.setDirectory(m_directory);
+
+        QVERIFY(store.insert(testMessage(1, user, 1000)));
+        QVERIFY(store.insert(testMessage(2, user, 2000)));
+    }
+
+    QFile::remove(m_directory + QLatin1String("/messages.index"));
+
+    // Cut the last record, as an interrupted write would do.
+    QFile log(m_directory + QLatin1String("/messages.log"));
+    QVERIFY(log.resize(log.size() - 3));
+
+    CMessageStore store;
+    store.setDirectory(m_directory);
+
+    QCOMPARE(store.count(), 1);
+    QVERIFY(store.contains(1));
+
+    // New records are appended after the last complete one.
+    QVERIFY(store.insert(testMessage(3, user, 3000)));
+
+    TelegramNamespace::Message message;
+    QVERIFY(store.message(3, &message));
+    QCOMPARE(message.timestamp, quint32(3000));
+}
+
+void tst_CMessageStore::readsBetweenAppends()
+{
+    CMessageStore store;
+    store.setDirectory(m_directory);
+
+    const TelegramNamespace::Peer user(10);
+    TelegramNamespace::Message storedMessage;
+
+    // Each read follows an append, so the records are read both from the mapped log and from its tail.
+    // The long texts make the log grow past the remapping step.
+    for (quint32 i = 1; i <= 300; ++i) {
+        TelegramNamespace::Message message = testMessage(i, user, 1000 + i);
+        message.text = QString(8 * 1024, QLatin1Char('a' + i % 26));
+
+        QVERIFY(store.insert(message));
+        QVERIFY(store.message(i, &storedMessage));
+        QVERIFY(messagesEqual(storedMessage, message));
+        QVERIFY(store.message((i + 1) / 2, &storedMessage));
+        QCOMPARE(storedMessage.id, (i + 1) / 2);
+    }
+
+    QCOMPARE(store.history(user, 0, 1000).count(), 300);
+}
+
+QTEST_MAIN(tst_CMessageStore)
+
+#include "tst_CMessageStore.moc"
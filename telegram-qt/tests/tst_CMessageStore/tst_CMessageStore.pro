@@ -0,0 +1,14 @@
+include(../tests.pri)
+
+TARGET = tst_messagestore
+SOURCES = tst_CMessageStore.cpp \
+    ../../CMessageStore.cpp \
+    ../../CTelegramStream.cpp \
+    ../../CRawStream.cpp \
+    ../../TLValues.cpp
+
+HEADERS = \
+    ../../CMessageStore.hpp \
+    ../../CTelegramStream.hpp \
+    ../../CRawStream.hpp \
+    ../../TLValues.hpp
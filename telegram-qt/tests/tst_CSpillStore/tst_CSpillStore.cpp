@@ -0,0 +1,201 @@
+/*
+    Copyright (C) 2015 Alexandr Akulich <akulichalexander@gmail.com>
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+    LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+    OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+    WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+#include <QObject>
+
+#include "CSpillStore.hpp"
+
+#include <QDir>
+#include <QFile>
+#include <QTest>
+#include <QDebug>
+
+class tst_CSpillStore : public QObject
+{
+    Q_OBJECT
+public:
+    explicit tst_CSpillStore(QObject *parent = 0);
+
+private slots:
+    void init();
+    void cleanup();
+
+    void insertAndTake();
+    void persistence();
+    void takenRecordPersistence();
+    void maxCount();
+    void compaction();
+    void incompleteRecord();
+
+protected:
+    typedef QPair<quint32, QByteArray> Record;
+
+    QString m_directory;
+    QString m_fileName;
+
+};
+
+tst_CSpillStore::tst_CSpillStore(QObject *parent) :
+    QObject(parent)
+{
+}
+
+void tst_CSpillStore::init()
+{
+    m_directory = QDir::tempPath() + QLatin1String("/tst_CSpillStore");
+    m_fileName = m_directory + QLatin1String("/spill.log");
+    QDir().mkpath(m_directory);
+}
+
+void tst_CSpillStore::cleanup()
+{
+    QDir directory(m_directory);
+
+    foreach (const QString &fileName, directory.entryList(QDir::Files)) {
+        directory.remove(fileName);
+    }
+
+    QDir().rmdir(m_directory);
+}
+
+void tst_CSpillStore::insertAndTake()
+{
+    CSpillStore store;
+
+    QVERIFY(!store.isEnabled());
+    QVERIFY(!store.insert(QList<Record>() << Record(1, "one")));
+
+    store.setFileName(m_fileName);
+
+    QVERIFY(store.insert(QList<Record>() << Record(1, "one") << Record(2, "two")));
+    QVERIFY(store.insert(QList<Record>() << Record(1, "first")));
+    QCOMPARE(store.count(), 2);
+
+    QCOMPARE(store.take(1), QByteArray("first"));
+    QCOMPARE(store.take(1), QByteArray());
+    QCOMPARE(store.take(2), QByteArray("two"));
+    QCOMPARE(store.count(), 0);
+}
+
+void tst_CSpillStore::persistence()
+{
+    {
+        CSpillStore store;
+        store.setFileName(m_fileName);
+
+        QVERIFY(store.insert(QList<Record>() << Record(1, "one") << Record(2, "two")));
+        QVERIFY(store.insert(QList<Record>() << Record(2, "second")));
+    }
+
+    CSpillStore store;
+    store.setFileName(m_fileName);
+
+    QCOMPARE(store.count(), 2);
+    QCOMPARE(store.take(2), QByteArray("second"));
+    QCOMPARE(store.take(1), QByteArray("one"));
+}
+
+void tst_CSpillStore::takenRecordPersistence()
+{
+    {
+        CSpillStore store;
+        store.setFileName(m_fileName);
+
+        QVERIFY(store.insert(QList<Record>() << Record(1, "one") << Record(2, "two")));
+        QCOMPARE(store.take(1), QByteArray("one"));
+    }
+
+    {
+        CSpillStore store;
+        store.setFileName(m_fileName);
+
+        // The taken record does not come back, but can be inserted again.
+        QCOMPARE(store.count(), 1);
+        QVERIFY(!store.contains(1));
+        QVERIFY(store.insert(QList<Record>() << Record(1, "first")));
+    }
+
+    CSpillStore store;
+    store.setFileName(m_fileName);
+
+    QCOMPARE(store.count(), 2);
+    QCOMPARE(store.take(1), QByteArray("first"));
+    QCOMPARE(store.take(2), QByteArray("two"));
+}
+
+void tst_CSpillStore::maxCount()
+{
+    CSpillStore store;
+    store.setFileName(m_fileName);
+    store.setMaxCount(2);
+
+    QVERIFY(store.insert(QList<Record>() << Record(1, "one") << Record(2, "two")));
+    QVERIFY(store.insert(QList<Record>() << Record(3, "three")));
+
+    // The oldest record is dropped.
+    QCOMPARE(store.count(), 2);
+    QVERIFY(!store.contains(1));
+    QVERIFY(store.contains(2));
+    QVERIFY(store.contains(3));
+}
+
+void tst_CSpillStore::compaction()
+{
+    CSpillStore store;
+    store.setFileName(m_fileName);
+
+    const QByteArray data(1024, 'a');
+
+    for (quint32 i = 0; i < 200; ++i) {
+        QVERIFY(store.insert(QList<Record>() << Record(i, data + QByteArray::number(i))));
+
+        if (i % 4) {
+            store.take(i);
+        }
+    }
+
+    // The most of the log is dead, so it is rewritten.
+    QCOMPARE(store.count(), 50);
+    QVERIFY(QFile(m_fileName).size() < 200 * 1024);
+
+    for (quint32 i = 0; i < 200; i += 4) {
+        QCOMPARE(store.take(i), data + QByteArray::number(i));
+    }
+}
+
+void tst_CSpillStore::incompleteRecord()
+{
+    {
+        CSpillStore store;
+        store.setFileName(m_fileName);
+        QVERIFY(store.insert(QList<Record>() << Record(1, "one") << Record(2, "two")));
+    }
+
+    const qint64 size = QFile(m_fileName).size();
+    QVERIFY(QFile::resize(m_fileName, size - 1));
+
+    CSpillStore store;
+    store.setFileName(m_fileName);
+
+    QCOMPARE(store.count(), 1);
+    QCOMPARE(store.take(1), QByteArray("one"));
+
+    // The next record is appended after the last complete one.
+    QVERIFY(store.insert(QList<Record>() << Record(3, "three")));
+    QCOMPARE(store.take(3), QByteArray("three"));
+}
+
+QTEST_MAIN(tst_CSpillStore)
+
+#include "tst_CSpillStore.moc"
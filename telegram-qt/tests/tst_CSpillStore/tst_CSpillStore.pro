@@ -0,0 +1,8 @@
+include(../tests.pri)
+
+TARGET = tst_spillstore
+SOURCES = tst_CSpillStore.cpp \
+    ../../CSpillStore.cpp
+
+HEADERS = \
+    ../../CSpillStore.hpp
@@ -18,6 +18,11 @@ CTestConnection::CTestConnection(QObject *parent) :
 {
 }
 
+void CTestConnection::setAppInfo(const CAppInformation *appInfo)
+{
+    m_appInfo = appInfo;
+}
+
 void CTestConnection::setClientNonce(TLNumber128 newClientNonce)
 {
     m_clientNonce = newClientNonce;
@@ -62,3 +67,19 @@ quint64 CTestConnection::testNewMessageId()
 {
     return newMessageId();
 }
+
+void CTestConnection::testReleaseRequest(quint64 id)
+{
+    releaseRequest(id);
+}
+
+void CTestConnection::testProcessServerMessage(quint64 messageId, const QByteArray &payload)
+{
+    m_receivedMessageId = messageId;
+    processRpcQuery(payload);
+}
+
+void CTestConnection::testUpdateDeltaTime(quint64 serverMessageId, qint64 localTimeInMs)
+{
+    updateDeltaTime(serverMessageId, localTimeInMs);
+}
@@ -24,6 +24,7 @@ public:
 
     inline CTelegramTransport *transport() const { return m_transport; }
 
+    void setAppInfo(const CAppInformation *appInfo);
     void setClientNonce(TLNumber128 newClientNonce);
     void setServerNonce(TLNumber128 newServerNonce);
     void setNewNonce(TLNumber256 newNewNonce);
@@ -34,6 +35,11 @@ public:
 
     SAesKey testGenerateClientToServerAesKey(const QByteArray &messageKey) const;
     quint64 testNewMessageId();
+    void testReleaseRequest(quint64 id);
+    void testProcessServerMessage(quint64 messageId, const QByteArray &payload);
+    void testUpdateDeltaTime(quint64 serverMessageId, qint64 localTimeInMs);
+    inline quint64 testLastMessageId() const { return m_lastMessageId; }
+    inline QList<quint64> testSubmittedMessageIds() const { return m_submittedPackages.keys(); }
 
 };
 
@@ -14,9 +14,12 @@
 #include <QObject>
 
 #include "CTestConnection.hpp"
+#include "CAppInformation.hpp"
+#include "CTelegramStream.hpp"
 #include "CTelegramTransport.hpp"
 
 #include <QTest>
+#include <QSignalSpy>
 #include <QDebug>
 
 #include <QDateTime>
@@ -35,6 +38,12 @@ private slots:
     void testPQAuthRequest();
     void testAuth();
     void testAesKeyGeneration();
+    void testBulkRequestsLimit();
+    void testDeltaTimeFromServerMessageId();
+    void testBadMessageTimeCorrection_data();
+    void testBadMessageTimeCorrection();
+    void testDeltaTimeDrift();
+    void testRejectedContainer();
 
 };
 
@@ -379,6 +388,219 @@ void tst_CTelegramConnection::testAesKeyGeneration()
     QCOMPARE(result.iv , aesIvArray);
 }
 
+void tst_CTelegramConnection::testBulkRequestsLimit()
+{
+    QCOMPARE(CTelegramConnection::requestPriority(TLValue::UploadGetFile), CTelegramConnection::RequestPriorityBulk);
+    QCOMPARE(CTelegramConnection::requestPriority(TLValue::MessagesSendMessage), CTelegramConnection::RequestPriorityInteractive);
+    QCOMPARE(CTelegramConnection::requestPriority(TLValue::UsersGetUsers), CTelegramConnection::RequestPriorityNormal);
+
+    CAppInformation appInfo;
+    appInfo.setAppId(1);
+    appInfo.setAppHash(QLatin1String("hash"));
+    appInfo.setAppVersion(QLatin1String("1.0"));
+    appInfo.setDeviceInfo(QLatin1String("test"));
+    appInfo.setOsInfo(QLatin1String("test"));
+    appInfo.setLanguageCode(QLatin1String("en"));
+
+    TLInputFileLocation location;
+    location.tlType = TLValue::InputFileLocation;
+
+    // Not limited by default
+    CTestConnection unlimitedConnection;
+    unlimitedConnection.setAppInfo(&appInfo);
+    unlimitedConnection.setAuthKey(QByteArray(256, char(0x11)));
+
+    for (int i = 0; i < 5; ++i) {
+        unlimitedConnection.getFilePart(location, 1, i * 1024, 1024);
+    }
+
+    QCOMPARE(unlimitedConnection.bulkRequestsInFlight(), 5);
+    QCOMPARE(unlimitedConnection.deferredRequestsCount(), 0);
+
+    CTestConnection connection;
+    connection.setAppInfo(&appInfo);
+    connection.setAuthKey(QByteArray(256, char(0x11)));
+    connection.setBulkRequestsLimit(2);
+
+    const quint64 part1 = connection.getFilePart(location, 1, 0, 1024);
+    connection.getFilePart(location, 1, 1024, 1024);
+    connection.getFilePart(location, 1, 2048, 1024);
+
+    QCOMPARE(connection.bulkRequestsInFlight(), 2);
+    QCOMPARE(connection.deferredRequestsCount(), 1);
+
+    // Not bulk requests are sent right away.
+    const quint64 usersRequest = connection.usersGetUsers(TLVector<TLInputUser>());
+    QCOMPARE(connection.deferredRequestsCount(), 1);
+
+    connection.testReleaseRequest(usersRequest);
+    QCOMPARE(connection.deferredRequestsCount(), 1);
+
+    TLInputPeer peer;
+    peer.tlType = TLValue::InputPeerSelf;
+    const quint64 messageRequest = connection.messagesSendMessage(peer, QLatin1String("Test"), 1);
+
+    // The deferred request waits for the message answer, as the limit is one while it is in flight.
+    connection.testReleaseRequest(part1);
+    QCOMPARE(connection.bulkRequestsInFlight(), 1);
+    QCOMPARE(connection.deferredRequestsCount(), 1);
+
+    connection.testReleaseRequest(messageRequest);
+    QCOMPARE(connection.bulkRequestsInFlight(), 2);
+    QCOMPARE(connection.deferredRequestsCount(), 0);
+
+    connection.setBulkRequestsLimit(3);
+    connection.getFilePart(location, 2, 0, 1024);
+    QCOMPARE(connection.bulkRequestsInFlight(), 3);
+
+    // A negative limit is ignored.
+    connection.setBulkRequestsLimit(-1);
+    connection.getFilePart(location, 2, 1024, 1024);
+    QCOMPARE(connection.bulkRequestsInFlight(), 3);
+    QCOMPARE(connection.deferredRequestsCount(), 1);
+
+    // Zero removes the limit, so the deferred request is sent.
+    connection.setBulkRequestsLimit(0);
+    QCOMPARE(connection.bulkRequestsInFlight(), 4);
+    QCOMPARE(connection.deferredRequestsCount(), 0);
+}
+
+void tst_CTelegramConnection::testDeltaTimeFromServerMessageId()
+{
+    const qint64 time = 1395335796550;
+
+    // Server message ids are odd.
+    QCOMPARE(CTelegramConnection::deltaTimeFromServerMessageId(CTelegramConnection::formatTimeStamp(time) | 1, time), 0);
+    QCOMPARE(CTelegramConnection::deltaTimeFromServerMessageId(CTelegramConnection::formatTimeStamp(time + 3600 * 1000 + 200) | 1, time), 3600);
+    QCOMPARE(CTelegramConnection::deltaTimeFromServerMessageId(CTelegramConnection::formatTimeStamp(time - 90 * 1000 - 700) | 1, time), -91);
+}
+
+void tst_CTelegramConnection::testBadMessageTimeCorrection_data()
+{
+    QTest::addColumn<quint32>("errorCode");
+    QTest::addColumn<qint64>("serverOffset");
+
+    QTest::newRow("Id too low") << quint32(16) << qint64(2 * 3600 * 1000);
+    QTest::newRow("Id too high") << quint32(17) << qint64(-15 * 60 * 1000);
+}
+
+void tst_CTelegramConnection::testBadMessageTimeCorrection()
+{
+    QFETCH(quint32, errorCode);
+    QFETCH(qint64, serverOffset);
+
+    CAppInformation appInfo;
+    appInfo.setAppId(1);
+    appInfo.setAppHash(QLatin1String("hash"));
+    appInfo.setAppVersion(QLatin1String("1.0"));
+    appInfo.setDeviceInfo(QLatin1String("test"));
+    appInfo.setOsInfo(QLatin1String("test"));
+    appInfo.setLanguageCode(QLatin1String("en"));
+
+    CTestConnection connection;
+    connection.setAppInfo(&appInfo);
+    connection.setAuthKey(QByteArray(256, char(0x11)));
+
+    const quint64 requestId = connection.usersGetUsers(TLVector<TLInputUser>());
+
+    QByteArray notification;
+    CTelegramStream stream(&notification, /* write */ true);
+    stream << TLValue::BadMsgNotification;
+    stream << requestId;
+    stream << quint32(1); // seqNo
+    stream << errorCode;
+
+    const quint64 serverMessageId = CTelegramConnection::formatTimeStamp(QDateTime::currentMSecsSinceEpoch() + serverOffset) | 1;
+    connection.testProcessServerMessage(serverMessageId, notification);
+
+    // The time is fixed at once, not in steps.
+    QCOMPARE(connection.deltaTime(), qint32(serverOffset / 1000));
+
+    const qint64 messageTime = CTelegramConnection::timeStampToMSecsSinceEpoch(connection.testNewMessageId());
+    QVERIFY(qAbs(messageTime - QDateTime::currentMSecsSinceEpoch() - serverOffset) < 1000);
+}
+
+void tst_CTelegramConnection::testDeltaTimeDrift()
+{
+    CTestConnection connection;
+    const qint64 time = 1395335796550;
+
+    // Network jitter does not change the time.
+    for (int i = 0; i < 20; ++i) {
+        const qint64 jitter = (i % 2) ? 300 : -300;
+        connection.testUpdateDeltaTime(CTelegramConnection::formatTimeStamp(time + jitter) | 1, time);
+    }
+    QCOMPARE(connection.deltaTime(), 0);
+
+    // The time follows the server clock.
+    for (int i = 0; i < 40; ++i) {
+        connection.testUpdateDeltaTime(CTelegramConnection::formatTimeStamp(time + 10 * 1000) | 1, time);
+    }
+    QVERIFY(qAbs(connection.deltaTime() - 10) <= 1);
+
+    // Message ids still grow after the time is moved back.
+    const quint64 lastMessageId = connection.testNewMessageId();
+    for (int i = 0; i < 40; ++i) {
+        connection.testUpdateDeltaTime(CTelegramConnection::formatTimeStamp(time) | 1, time);
+    }
+    QVERIFY(qAbs(connection.deltaTime()) <= 1);
+    QVERIFY(connection.testNewMessageId() > lastMessageId);
+}
+
+void tst_CTelegramConnection::testRejectedContainer()
+{
+    CAppInformation appInfo;
+    appInfo.setAppId(1);
+    appInfo.setAppHash(QLatin1String("hash"));
+    appInfo.setAppVersion(QLatin1String("1.0"));
+    appInfo.setDeviceInfo(QLatin1String("test"));
+    appInfo.setOsInfo(QLatin1String("test"));
+    appInfo.setLanguageCode(QLatin1String("en"));
+
+    CTestConnection connection;
+    connection.setAppInfo(&appInfo);
+    connection.setAuthKey(QByteArray(256, char(0x11)));
+
+    connection.beginRequestsBatch();
+    const quint64 statusRequest = connection.accountUpdateStatus(false);
+    const quint64 usersRequest = connection.usersGetUsers(TLVector<TLInputUser>());
+    connection.endRequestsBatch();
+
+    const quint64 containerId = connection.testLastMessageId();
+    QCOMPARE(connection.testSubmittedMessageIds().count(), 2);
+
+    QSignalSpy requestIdSpy(&connection, SIGNAL(requestIdChanged(quint64,quint64)));
+
+    // The server rejects the whole container because of the wrong salt.
+    QByteArray notification;
+    CTelegramStream stream(&notification, /* write */ true);
+    stream << TLValue::BadServerSalt;
+    stream << containerId;
+    stream << quint32(0); // seqNo
+    stream << quint32(48);
+    stream << quint64(0x1234); // New server salt
+
+    connection.testProcessServerMessage(CTelegramConnection::formatTimeStamp(QDateTime::currentMSecsSinceEpoch()) | 1, notification);
+
+    // Both requests are sent again with new ids.
+    const QList<quint64> ids = connection.testSubmittedMessageIds();
+    QCOMPARE(ids.count(), 2);
+    QVERIFY(!ids.contains(statusRequest));
+    QVERIFY(!ids.contains(usersRequest));
+    QVERIFY(!ids.contains(containerId));
+
+    // The new ids are reported, so the requests can be tracked by the callers.
+    QCOMPARE(requestIdSpy.count(), 2);
+    QCOMPARE(requestIdSpy.at(0).at(0).toULongLong(), statusRequest);
+    QCOMPARE(requestIdSpy.at(1).at(0).toULongLong(), usersRequest);
+    QVERIFY(ids.contains(requestIdSpy.at(0).at(1).toULongLong()));
+    QVERIFY(ids.contains(requestIdSpy.at(1).at(1).toULongLong()));
+
+    // The requests are sent in a new container.
+    QVERIFY(connection.testLastMessageId() > containerId);
+    QVERIFY(!ids.contains(connection.testLastMessageId()));
+}
+
 QTEST_MAIN(tst_CTelegramConnection)
 
 #include "tst_CTelegramConnection.moc"
@@ -2,17 +2,21 @@ include(../tests.pri)
 
 TARGET = tst_telegramconnection
 SOURCES = tst_CTelegramConnection.cpp \
+    ../../CAppInformation.cpp \
     ../../Utils.cpp \
     ../../CTcpTransport.cpp \
     ../../CTelegramConnection.cpp \
+    ../../CTimerScheduler.cpp \
     ../../CTelegramStream.cpp \
     ../../CRawStream.cpp \
     ../../TLValues.cpp \
     CTestConnection.cpp
 
 HEADERS += \
+    ../../CAppInformation.hpp \
     ../../Utils.hpp \
     ../../CTelegramConnection.hpp \
+    ../../CTimerScheduler.hpp \
     ../../CTelegramTransport.hpp \
     ../../CTcpTransport.hpp \
     ../../CTelegramStream.hpp \
@@ -27,3 +27,12 @@ void CTestDispatcher::testSetDcConfiguration(const QVector<TLDcOption> newDcConf
 {
     m_dcConfiguration = newDcConfiguration;
 }
+
+void CTestDispatcher::testUpdatesStateReceived(const TLUpdatesState &updatesState)
+{
+    // The initialization is done, so the state answer only syncs the updates (as after a gap timeout).
+    m_requestedSteps |= StepUpdates;
+    m_initializationState |= StepUpdates;
+
+    whenUpdatesStateReceived(updatesState);
+}
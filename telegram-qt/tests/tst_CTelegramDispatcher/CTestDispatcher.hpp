@@ -25,6 +25,38 @@ public:
     void testProcessUpdate(const TLUpdate &update);
     void testSetDcConfiguration(const QVector<TLDcOption> newDcConfiguration);
     QVector<TLDcOption> testGetDcConfiguration() const { return m_dcConfiguration; }
+    void testUsersReceived(const QVector<TLUser> &users) { whenUsersReceived(users); }
+    quint32 testIdentifierToUserId(const QString &identifier) const { return identifierToUserId(identifier); }
+    void testSetContactList(const QList<quint32> &contactList) { m_contactList = contactList; }
+    QString testContactListHash() const { return contactListHash(); }
+    void testUpdatesReceived(const TLUpdates &updates) { whenUpdatesReceived(updates); }
+    quint32 testUpdatesSeq() const { return m_updatesState.seq; }
+    int testPendingUpdatesCount() const { return m_pendingUpdates.count(); }
+    void testUpdatesStateReceived(const TLUpdatesState &updatesState);
+    int testReceivedMessagesBatchCount() const { return m_receivedMessagesBatch.count(); }
+    void testAppendPendingDifference(const TLUpdatesDifference &difference) { m_pendingDifferences.append(difference); }
+    int testUpdatesDuringDifferenceCount() const { return m_updatesDuringDifference.count(); }
+    void testSetTelegramChatIds(const TLVector<quint32> &chatIds) { setTelegramChatIds(chatIds); }
+    void testSetTelegramChatId(quint32 publicChatId, quint32 chatId) { setTelegramChatId(publicChatId, chatId); }
+    qint32 testTelegramChatIdToPublicId(quint32 chatId) const { return telegramChatIdToPublicId(chatId); }
+    void testAddFileUpload(FileUploadDescriptor *descriptor) { m_fileUploads.insert(descriptor->fileId(), descriptor); }
+    int testFileUploadsCount() const { return m_fileUploads.count(); }
+    void testFilePartSaved(quint64 fileId, quint32 filePart, bool result) { whenFilePartSaved(fileId, filePart, result); }
+    void testAddMediaSendRequest(quint64 requestId, const TelegramNamespace::Peer &peer, quint64 randomId)
+    {
+        m_mediaSendRequests.insert(requestId, QPair<TelegramNamespace::Peer, quint64>(peer, randomId));
+    }
+    void testRequestIdChanged(quint64 previousId, quint64 newId) { whenRequestIdChanged(previousId, newId); }
+    void testSetActiveDc(quint32 dc) { m_activeDc = dc; }
+    void testAddMediaConnection(quint32 dc, CTelegramConnection *connection) { m_mediaConnections[dc].append(connection); }
+    void testUploadFileParts() { uploadFileParts(); }
+    void testAddConnection(quint32 dc, CTelegramConnection *connection) { m_connections.insert(dc, connection); }
+    CTelegramConnection *testConnection(quint32 dc) const { return m_connections.value(dc); }
+    quint32 testUpdatesPts() const { return m_updatesState.pts; }
+    void testRpcErrorReceived(quint64 requestId, TLValue request, quint32 errorCode, const QString &errorMessage)
+    {
+        whenRpcErrorReceived(requestId, request, errorCode, errorMessage);
+    }
 
 };
 
@@ -14,8 +14,13 @@
 #include <QObject>
 
 #include "CTestDispatcher.hpp"
+#include "CAppInformation.hpp"
+#include "CTelegramConnection.hpp"
+#include "CTelegramStream.hpp"
 
 #include <QBuffer>
+#include <QSignalSpy>
+#include <QTemporaryFile>
 #include <QTest>
 #include <QDebug>
 
@@ -27,6 +32,16 @@ public:
 
 private slots:
     void testUpdateDcOptions();
+    void testUserIndexes();
+    void testPeerIdentifiers();
+    void testContactListHash();
+    void testUpdatesOrdering();
+    void testUpdatesGapTimeout();
+    void testFileRequestUnknownSize();
+    void testDuplicatedChatIds();
+    void testMediaSendFailures();
+    void testFilePartsSpread();
+    void testConnectionSecret();
 
 };
 
@@ -82,6 +97,490 @@ void tst_CTelegramDispatcher::testUpdateDcOptions()
         QCOMPARE(updated.ipAddress, correct.ipAddress);
         QCOMPARE(updated.port, correct.port);
     }
+
+    // Alternative endpoints of a DC come together and supersede the known ones.
+    dcUpdate.dcOptions = QVector<TLDcOption>()
+            << constructDcOption(2, QLatin1String(""), QLatin1String("149.154.167.52"), 443)
+            << constructDcOption(2, QLatin1String(""), QLatin1String("149.154.167.53"), 80);
+    dispatcher.testProcessUpdate(dcUpdate);
+
+    newOptions = dispatcher.testGetDcConfiguration();
+    QCOMPARE(newOptions.count(), options.count() + 1);
+    QCOMPARE(newOptions.at(0).ipAddress, newOption.ipAddress);
+    QCOMPARE(newOptions.at(1).ipAddress, QString(QLatin1String("149.154.167.52")));
+    QCOMPARE(newOptions.at(2).ipAddress, QString(QLatin1String("149.154.167.53")));
+    QCOMPARE(newOptions.at(3).id, quint32(3));
+}
+
+inline TLUser constructUser(quint32 id, QString phone, QString userName)
+{
+    TLUser result;
+    result.tlType = TLValue::UserContact;
+    result.id = id;
+    result.phone = phone;
+    result.username = userName;
+    return result;
+}
+
+void tst_CTelegramDispatcher::testUserIndexes()
+{
+    CTestDispatcher dispatcher;
+
+    QVector<TLUser> users;
+    users << constructUser(10, QLatin1String("79001110001"), QLatin1String("FirstUser"));
+    users << constructUser(11, QLatin1String("79001110002"), QString());
+
+    dispatcher.testUsersReceived(users);
+
+    QCOMPARE(dispatcher.testIdentifierToUserId(QLatin1String("79001110001")), quint32(10));
+    QCOMPARE(dispatcher.testIdentifierToUserId(QLatin1String("79001110002")), quint32(11));
+    QCOMPARE(dispatcher.testIdentifierToUserId(QLatin1String("firstuser")), quint32(10));
+    QCOMPARE(dispatcher.testIdentifierToUserId(QLatin1String("user11")), quint32(11));
+    QCOMPARE(dispatcher.testIdentifierToUserId(QLatin1String("79001110003")), quint32(0));
+
+    // The second user takes the phone of the first one.
+    users.clear();
+    users << constructUser(11, QLatin1String("79001110001"), QLatin1String("SecondUser"));
+    dispatcher.testUsersReceived(users);
+
+    QCOMPARE(dispatcher.testIdentifierToUserId(QLatin1String("79001110001")), quint32(11));
+    QCOMPARE(dispatcher.testIdentifierToUserId(QLatin1String("79001110002")), quint32(0));
+    QCOMPARE(dispatcher.testIdentifierToUserId(QLatin1String("SecondUser")), quint32(11));
+
+    TLUpdate phoneUpdate;
+    phoneUpdate.tlType = TLValue::UpdateUserPhone;
+    phoneUpdate.userId = 10;
+    phoneUpdate.phone = QLatin1String("79001110004");
+    dispatcher.testProcessUpdate(phoneUpdate);
+
+    QCOMPARE(dispatcher.testIdentifierToUserId(QLatin1String("79001110004")), quint32(10));
+    QCOMPARE(dispatcher.testIdentifierToUserId(QLatin1String("79001110001")), quint32(11));
+
+    TLUpdate nameUpdate;
+    nameUpdate.tlType = TLValue::UpdateUserName;
+    nameUpdate.userId = 10;
+    nameUpdate.username = QLatin1String("RenamedUser");
+    dispatcher.testProcessUpdate(nameUpdate);
+
+    QCOMPARE(dispatcher.testIdentifierToUserId(QLatin1String("RenamedUser")), quint32(10));
+    QCOMPARE(dispatcher.testIdentifierToUserId(QLatin1String("FirstUser")), quint32(0));
+}
+
+void tst_CTelegramDispatcher::testPeerIdentifiers()
+{
+    CTestDispatcher dispatcher;
+
+    QVector<TLUser> users;
+    users << constructUser(10, QLatin1String("79001110001"), QLatin1String("FirstUser"));
+    dispatcher.testUsersReceived(users);
+
+    QVERIFY(dispatcher.identifierToPeer(QLatin1String("79001110001")) == TelegramNamespace::Peer(10));
+    QVERIFY(dispatcher.identifierToPeer(QLatin1String("FirstUser")) == TelegramNamespace::Peer(10));
+    QVERIFY(dispatcher.identifierToPeer(QLatin1String("user12")) == TelegramNamespace::Peer(12));
+    QVERIFY(dispatcher.identifierToPeer(QLatin1String("chat3")) == TelegramNamespace::Peer(3, TelegramNamespace::Peer::Chat));
+    QVERIFY(dispatcher.identifierToPeer(QLatin1String("chat3")) != TelegramNamespace::Peer(3));
+
+    QCOMPARE(dispatcher.peerToIdentifier(TelegramNamespace::Peer(10)), QString(QLatin1String("79001110001")));
+    QCOMPARE(dispatcher.peerToIdentifier(TelegramNamespace::Peer(12)), QString(QLatin1String("user12")));
+    QCOMPARE(dispatcher.peerToIdentifier(TelegramNamespace::Peer(3, TelegramNamespace::Peer::Chat)), QString(QLatin1String("chat3")));
+}
+
+void tst_CTelegramDispatcher::testContactListHash()
+{
+    CTestDispatcher dispatcher;
+
+    QCOMPARE(dispatcher.testContactListHash(), QString());
+
+    dispatcher.testSetContactList(QList<quint32>() << 10 << 11 << 20);
+
+    QCOMPARE(dispatcher.testContactListHash(), QString(QLatin1String("4cc7c30ccdd7510197e8c7a33a5e1667")));
+}
+
+static TLUpdates constructUpdates(quint32 seqStart, quint32 seq, const QList<quint32> &messageIds = QList<quint32>())
+{
+    TLUpdates updates;
+    updates.tlType = (seqStart == seq) ? TLValue::Updates : TLValue::UpdatesCombined;
+    updates.seqStart = seqStart;
+    updates.seq = seq;
+    updates.date = 1000 + seq;
+
+    // One message per pts
+    foreach (quint32 messageId, messageIds) {
+        TLUpdate update;
+        update.tlType = TLValue::UpdateNewMessage;
+        update.pts = messageId;
+        update.message.tlType = TLValue::Message;
+        update.message.id = messageId;
+        update.message.fromId = 10;
+        update.message.toId.tlType = TLValue::PeerUser;
+        update.message.toId.userId = 20;
+        update.message.media.tlType = TLValue::MessageMediaEmpty;
+        update.message.message = QString::number(messageId);
+        updates.updates.append(update);
+    }
+
+    return updates;
+}
+
+void tst_CTelegramDispatcher::testUpdatesOrdering()
+{
+    CTestDispatcher dispatcher;
+
+    // The first updates set the base seq.
+    dispatcher.testUpdatesReceived(constructUpdates(5, 5));
+    QCOMPARE(dispatcher.testUpdatesSeq(), quint32(5));
+
+    dispatcher.testUpdatesReceived(constructUpdates(7, 7));
+    dispatcher.testUpdatesReceived(constructUpdates(9, 10));
+    QCOMPARE(dispatcher.testUpdatesSeq(), quint32(5));
+    QCOMPARE(dispatcher.testPendingUpdatesCount(), 2);
+
+    dispatcher.testUpdatesReceived(constructUpdates(6, 6));
+    QCOMPARE(dispatcher.testUpdatesSeq(), quint32(7));
+    QCOMPARE(dispatcher.testPendingUpdatesCount(), 1);
+
+    // Already applied
+    dispatcher.testUpdatesReceived(constructUpdates(7, 7));
+    QCOMPARE(dispatcher.testUpdatesSeq(), quint32(7));
+    QCOMPARE(dispatcher.testPendingUpdatesCount(), 1);
+
+    dispatcher.testUpdatesReceived(constructUpdates(8, 8));
+    QCOMPARE(dispatcher.testUpdatesSeq(), quint32(10));
+    QCOMPARE(dispatcher.testPendingUpdatesCount(), 0);
+
+    // A buffered range which overlaps the gap filler is applied without the overlapped part.
+    dispatcher.setMessageBatchingEnabled(true);
+    dispatcher.testUpdatesReceived(constructUpdates(11, 11, QList<quint32>() << 1));
+    QCOMPARE(dispatcher.testReceivedMessagesBatchCount(), 1);
+
+    dispatcher.testUpdatesReceived(constructUpdates(13, 14, QList<quint32>() << 3 << 4));
+    QCOMPARE(dispatcher.testPendingUpdatesCount(), 1);
+
+    dispatcher.testUpdatesReceived(constructUpdates(12, 13, QList<quint32>() << 2 << 3));
+    QCOMPARE(dispatcher.testUpdatesSeq(), quint32(14));
+    QCOMPARE(dispatcher.testPendingUpdatesCount(), 0);
+    QCOMPARE(dispatcher.testReceivedMessagesBatchCount(), 4);
+
+    // The live updates wait for the pending difference.
+    TLUpdatesDifference difference;
+    difference.tlType = TLValue::UpdatesDifference;
+    dispatcher.testAppendPendingDifference(difference);
+
+    dispatcher.testUpdatesReceived(constructUpdates(15, 15));
+    QCOMPARE(dispatcher.testUpdatesSeq(), quint32(14));
+    QCOMPARE(dispatcher.testUpdatesDuringDifferenceCount(), 1);
+}
+
+void tst_CTelegramDispatcher::testUpdatesGapTimeout()
+{
+    CTestDispatcher dispatcher;
+    dispatcher.setMessageBatchingEnabled(true);
+
+    dispatcher.testUpdatesReceived(constructUpdates(5, 5, QList<quint32>() << 1));
+    QCOMPARE(dispatcher.testReceivedMessagesBatchCount(), 1);
+
+    // The gap at 6 is never filled.
+    dispatcher.testUpdatesReceived(constructUpdates(7, 7, QList<quint32>() << 1));
+    dispatcher.testUpdatesReceived(constructUpdates(9, 10, QList<quint32>() << 2 << 3));
+    QCOMPARE(dispatcher.testPendingUpdatesCount(), 2);
+
+    // The state, got after the gap timeout, is in sync with the applied pts and covers seq 7 and 8.
+    TLUpdatesState state;
+    state.pts = 1;
+    state.seq = 8;
+    state.date = 1008;
+    dispatcher.testUpdatesStateReceived(state);
+
+    // The covered updates without new pts are dropped, the newer ones are applied.
+    QCOMPARE(dispatcher.testPendingUpdatesCount(), 0);
+    QCOMPARE(dispatcher.testUpdatesSeq(), quint32(10));
+    QCOMPARE(dispatcher.testReceivedMessagesBatchCount(), 3);
+}
+
+void tst_CTelegramDispatcher::testFileRequestUnknownSize()
+{
+    TLUser user = constructUser(10, QLatin1String("79001110001"), QString());
+    user.photo.tlType = TLValue::UserProfilePhoto;
+    user.photo.photoSmall.tlType = TLValue::FileLocation;
+    user.photo.photoSmall.dcId = 2;
+
+    FileRequestDescriptor request = FileRequestDescriptor::avatarRequest(&user);
+    QVERIFY(request.isValid());
+    QCOMPARE(request.size(), quint32(0));
+
+    // Parts of a file with unknown size are requested one by one.
+    quint32 offset = 1;
+    QVERIFY(request.takeNextPartOffset(&offset));
+    QCOMPARE(offset, quint32(0));
+    QVERIFY(!request.takeNextPartOffset(&offset));
+
+    TLUploadFile part;
+    part.tlType = TLValue::UploadFile;
+    part.bytes = QByteArray(128 * 1024, char(1));
+    QVERIFY(request.setPartReceived(0, part));
+    QVERIFY(!request.isFinished());
+
+    QVERIFY(request.takeNextPartOffset(&offset));
+    QCOMPARE(offset, quint32(128 * 1024));
+
+    // The first short part completes the file.
+    part.bytes = QByteArray(1000, char(2));
+    QVERIFY(request.setPartReceived(offset, part));
+    QVERIFY(request.isFinished());
+    QCOMPARE(request.size(), quint32(128 * 1024 + 1000));
+    QCOMPARE(request.data().size(), 128 * 1024 + 1000);
+    QVERIFY(!request.takeNextPartOffset(&offset));
+
+    // A failure behind the end of file is not counted.
+    request.setPartFailed(256 * 1024);
+    QCOMPARE(request.failuresCount(), 0);
+
+    // An empty file is finished by the first (empty) part.
+    FileRequestDescriptor emptyRequest = FileRequestDescriptor::avatarRequest(&user);
+    QVERIFY(!emptyRequest.isSizeKnown());
+    QVERIFY(emptyRequest.takeNextPartOffset(&offset));
+    QCOMPARE(offset, quint32(0));
+
+    part.bytes.clear();
+    QVERIFY(emptyRequest.setPartReceived(0, part));
+    QVERIFY(emptyRequest.isSizeKnown());
+    QCOMPARE(emptyRequest.size(), quint32(0));
+    QVERIFY(emptyRequest.isFinished());
+    QVERIFY(!emptyRequest.takeNextPartOffset(&offset));
+}
+
+void tst_CTelegramDispatcher::testDuplicatedChatIds()
+{
+    CTestDispatcher dispatcher;
+
+    // The first public id wins for a duplicated chat id.
+    dispatcher.testSetTelegramChatIds(TLVector<quint32>() << 100 << 200 << 100 << 0);
+    QCOMPARE(dispatcher.testTelegramChatIdToPublicId(100), qint32(0));
+    QCOMPARE(dispatcher.testTelegramChatIdToPublicId(200), qint32(1));
+
+    dispatcher.testSetTelegramChatId(3, 200);
+    QCOMPARE(dispatcher.testTelegramChatIdToPublicId(200), qint32(1));
+
+    // The next public id of the chat takes over.
+    dispatcher.testSetTelegramChatId(0, 300);
+    QCOMPARE(dispatcher.testTelegramChatIdToPublicId(100), qint32(2));
+    QCOMPARE(dispatcher.testTelegramChatIdToPublicId(300), qint32(0));
+
+    dispatcher.testSetTelegramChatId(2, 0);
+    QCOMPARE(dispatcher.testTelegramChatIdToPublicId(100), qint32(-1));
+}
+
+void tst_CTelegramDispatcher::testMediaSendFailures()
+{
+    TelegramNamespace::registerTypes();
+
+    CTestDispatcher dispatcher;
+    QSignalSpy statusSpy(&dispatcher, SIGNAL(sentMessageStatusChanged(TelegramNamespace::Peer,quint64,TelegramNamespace::MessageDeliveryStatus)));
+
+    const TelegramNamespace::Peer peer(20);
+    TLInputPeer inputPeer;
+    inputPeer.tlType = TLValue::InputPeerContact;
+    inputPeer.userId = 20;
+
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    file.write(QByteArray(1000, char(1)));
+    file.flush();
+
+    // The upload is dropped and reported after too many failures of its part.
+    FileUploadDescriptor *upload = new FileUploadDescriptor(file.fileName(), inputPeer, peer, TelegramNamespace::MessageTypePhoto, QLatin1String("image/jpeg"));
+    QVERIFY(upload->open());
+
+    const quint64 fileId = upload->fileId();
+    const quint64 uploadMessageId = upload->randomMessageId();
+    dispatcher.testAddFileUpload(upload);
+
+    for (int i = 0; statusSpy.isEmpty() && (i < 100); ++i) {
+        quint32 part;
+        QVERIFY(upload->takeNextPart(&part));
+        QCOMPARE(part, quint32(0));
+        dispatcher.testFilePartSaved(fileId, part, /* result */ false);
+    }
+
+    QCOMPARE(statusSpy.count(), 1);
+    QCOMPARE(statusSpy.at(0).at(1).toULongLong(), uploadMessageId);
+    QCOMPARE(dispatcher.testFileUploadsCount(), 0);
+
+    // An error on the media message is reported once, also after the request id is changed.
+    statusSpy.clear();
+    dispatcher.testAddMediaSendRequest(100, peer, 555);
+    dispatcher.testRequestIdChanged(100, 101);
+
+    dispatcher.testRpcErrorReceived(100, TLValue::MessagesSendMedia, 400, QLatin1String("MEDIA_INVALID"));
+    QVERIFY(statusSpy.isEmpty());
+
+    dispatcher.testRpcErrorReceived(101, TLValue::MessagesSendMedia, 400, QLatin1String("MEDIA_INVALID"));
+    QCOMPARE(statusSpy.count(), 1);
+    QCOMPARE(statusSpy.at(0).at(1).toULongLong(), quint64(555));
+
+    dispatcher.testRpcErrorReceived(101, TLValue::MessagesSendMedia, 400, QLatin1String("MEDIA_INVALID"));
+    QCOMPARE(statusSpy.count(), 1);
+}
+
+class CSignedInConnection : public CTelegramConnection
+{
+public:
+    explicit CSignedInConnection(const CAppInformation *appInfo) :
+        CTelegramConnection(appInfo)
+    {
+        setAuthKey(QByteArray(256, char(0x11)));
+        setAuthState(AuthStateSignedIn);
+    }
+};
+
+void tst_CTelegramDispatcher::testFilePartsSpread()
+{
+    CAppInformation appInfo;
+    appInfo.setAppId(1);
+    appInfo.setAppHash(QLatin1String("hash"));
+    appInfo.setAppVersion(QLatin1String("1.0"));
+    appInfo.setDeviceInfo(QLatin1String("test"));
+    appInfo.setOsInfo(QLatin1String("test"));
+    appInfo.setLanguageCode(QLatin1String("en"));
+
+    CSignedInConnection firstConnection(&appInfo);
+    CSignedInConnection secondConnection(&appInfo);
+    CSignedInConnection thirdConnection(&appInfo);
+
+    CTestDispatcher dispatcher;
+    dispatcher.setFileUploadWindow(2);
+    dispatcher.testSetActiveDc(2);
+    dispatcher.testAddMediaConnection(2, &firstConnection);
+    dispatcher.testAddMediaConnection(2, &secondConnection);
+
+    const TelegramNamespace::Peer peer(20);
+    TLInputPeer inputPeer;
+    inputPeer.tlType = TLValue::InputPeerContact;
+    inputPeer.userId = 20;
+
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    file.write(QByteArray(1024 * 1024, char(1)));
+    file.flush();
+
+    FileUploadDescriptor *upload = new FileUploadDescriptor(file.fileName(), inputPeer, peer, TelegramNamespace::MessageTypeDocument, QLatin1String("application/octet-stream"));
+    QVERIFY(upload->open());
+    QCOMPARE(upload->partsCount(), quint32(8));
+    dispatcher.testAddFileUpload(upload);
+
+    // The parts are spread over the connections, each one stops at the window.
+    dispatcher.testUploadFileParts();
+    QCOMPARE(firstConnection.fileUploadsInFlight().count(), 2);
+    QCOMPARE(secondConnection.fileUploadsInFlight().count(), 2);
+    QCOMPARE(upload->partsInFlight(), 4);
+
+    // The next parts go to the least loaded connection only.
+    dispatcher.testAddMediaConnection(2, &thirdConnection);
+    dispatcher.testUploadFileParts();
+    QCOMPARE(firstConnection.fileUploadsInFlight().count(), 2);
+    QCOMPARE(secondConnection.fileUploadsInFlight().count(), 2);
+    QCOMPARE(thirdConnection.fileUploadsInFlight().count(), 2);
+    QCOMPARE(upload->partsInFlight(), 6);
+}
+
+static QByteArray constructSecret(quint32 format, const TLDcOption &dcInfo, const QByteArray &authKey, quint64 authId,
+                                  const TLDcOption &otherDcInfo = TLDcOption(), const QByteArray &otherAuthKey = QByteArray(), quint64 otherAuthId = 0)
+{
+    QByteArray output;
+    CTelegramStream outputStream(&output, /* write */ true);
+
+    outputStream << format;
+    outputStream << qint32(10); // Delta time
+    outputStream << dcInfo;
+    outputStream << authKey;
+    outputStream << authId;
+    outputStream << quint64(0x1234); // Server salt
+    outputStream << quint32(100); // pts
+    outputStream << quint32(5); // qts
+    outputStream << quint32(1400000000); // date
+    outputStream << TLVector<quint32>();
+
+    if (format >= 4) {
+        if (otherAuthKey.isEmpty()) {
+            outputStream << quint32(0);
+        } else {
+            outputStream << quint32(1);
+            outputStream << qint32(20);
+            outputStream << otherDcInfo;
+            outputStream << otherAuthKey;
+            outputStream << otherAuthId;
+            outputStream << quint64(0x5678);
+        }
+
+        outputStream << quint32(0); // Exported authentications
+    }
+
+    return output;
+}
+
+void tst_CTelegramDispatcher::testConnectionSecret()
+{
+    CAppInformation appInfo;
+    appInfo.setAppId(1);
+    appInfo.setAppHash(QLatin1String("hash"));
+    appInfo.setAppVersion(QLatin1String("1.0"));
+    appInfo.setDeviceInfo(QLatin1String("test"));
+    appInfo.setOsInfo(QLatin1String("test"));
+    appInfo.setLanguageCode(QLatin1String("en"));
+
+    const TLDcOption dcInfo = constructDcOption(2, QString(), QLatin1String("127.0.0.1"), 443);
+    const TLDcOption otherDcInfo = constructDcOption(4, QString(), QLatin1String("127.0.0.2"), 443);
+    const QByteArray authKey(256, char(0x11));
+    const QByteArray otherAuthKey(256, char(0x22));
+
+    CTelegramConnection keyConnection(0);
+    keyConnection.setAuthKey(authKey);
+    const quint64 authId = keyConnection.authId();
+    keyConnection.setAuthKey(otherAuthKey);
+    const quint64 otherAuthId = keyConnection.authId();
+
+    // A secret of the previous format is still loaded.
+    CTestDispatcher dispatcher;
+    QVERIFY(dispatcher.restoreConnection(constructSecret(3, dcInfo, authKey, authId)));
+    QVERIFY(dispatcher.testConnection(2));
+    QCOMPARE(dispatcher.testConnection(2)->authKey(), authKey);
+    QCOMPARE(dispatcher.testConnection(2)->deltaTime(), qint32(10));
+    QCOMPARE(dispatcher.testConnection(2)->serverSalt(), quint64(0x1234));
+    QCOMPARE(dispatcher.testUpdatesPts(), quint32(100));
+
+    // The signed in connection to the other DC is saved along with the active one.
+    CSignedInConnection *otherConnection = new CSignedInConnection(&appInfo);
+    otherConnection->setDcInfo(otherDcInfo);
+    otherConnection->setAuthKey(otherAuthKey);
+    dispatcher.testAddConnection(4, otherConnection);
+
+    const QByteArray secret = dispatcher.connectionSecretInfo();
+    CTelegramStream inputStream(secret);
+    quint32 format = 0;
+    inputStream >> format;
+    QCOMPARE(format, quint32(4));
+
+    CTestDispatcher restoredDispatcher;
+    QVERIFY(restoredDispatcher.restoreConnection(secret));
+    QVERIFY(restoredDispatcher.testConnection(2));
+    QCOMPARE(restoredDispatcher.testConnection(2)->authKey(), authKey);
+    QCOMPARE(restoredDispatcher.testConnection(2)->deltaTime(), qint32(10));
+    QCOMPARE(restoredDispatcher.testConnection(2)->serverSalt(), quint64(0x1234));
+    QCOMPARE(restoredDispatcher.testUpdatesPts(), quint32(100));
+    QVERIFY(restoredDispatcher.testConnection(4));
+    QCOMPARE(restoredDispatcher.testConnection(4)->dcInfo().id, quint32(4));
+    QCOMPARE(restoredDispatcher.testConnection(4)->authKey(), otherAuthKey);
+
+    // A wrong auth id of the active DC fails the restoration.
+    CTestDispatcher invalidDispatcher;
+    QVERIFY(!invalidDispatcher.restoreConnection(constructSecret(4, dcInfo, authKey, authId + 1)));
+    QVERIFY(!invalidDispatcher.testConnection(2));
+
+    // A wrong auth id of the other DC drops only that connection.
+    CTestDispatcher partialDispatcher;
+    QVERIFY(partialDispatcher.restoreConnection(constructSecret(4, dcInfo, authKey, authId, otherDcInfo, otherAuthKey, otherAuthId + 1)));
+    QVERIFY(partialDispatcher.testConnection(2));
+    QVERIFY(!partialDispatcher.testConnection(4));
 }
 
 QTEST_MAIN(tst_CTelegramDispatcher)
@@ -3,22 +3,37 @@ include(../tests.pri)
 TARGET = tst_telegramdispatcher
 SOURCES = tst_CTelegramDispatcher.cpp \
     CTestDispatcher.cpp \
+    ../../CAppInformation.cpp \
     ../../Utils.cpp \
     ../../CTcpTransport.cpp \
     ../../CTelegramConnection.cpp \
+    ../../CTimerScheduler.cpp \
+    ../../CDcEndpointProber.cpp \
     ../../CTelegramStream.cpp \
     ../../CTelegramDispatcher.cpp \
+    ../../CFileCache.cpp \
+    ../../CMessageStore.cpp \
+    ../../CSpillStore.cpp \
     ../../CRawStream.cpp \
     ../../TLValues.cpp
 
 HEADERS += \
     CTestDispatcher.hpp \
+    ../../CAppInformation.hpp \
     ../../Utils.hpp \
     ../../CTelegramConnection.hpp \
+    ../../CTimerScheduler.hpp \
+    ../../CDcEndpointProber.hpp \
     ../../CTelegramTransport.hpp \
     ../../CTcpTransport.hpp \
     ../../CTelegramStream.hpp \
     ../../CTelegramDispatcher.hpp \
+    ../../CFileCache.hpp \
+    ../../CLruMap.hpp \
+    ../../CTokenBucket.hpp \
+    ../../CEndpointLatency.hpp \
+    ../../CMessageStore.hpp \
+    ../../CSpillStore.hpp \
     ../../CRawStream.hpp \
     ../../TLValues.hpp
 
@@ -40,6 +40,7 @@ private slots:
     void vectorDeserializationError();
     void tlNumbersSerialization();
     void tlDcOptionDeserialization();
+    void receivedTypesRoundTrip();
 
 };
 
@@ -415,6 +416,76 @@ void tst_CTelegramStream::tlDcOptionDeserialization()
     QCOMPARE(optionsVector.at(5).port     , quint32(80));
 }
 
+void tst_CTelegramStream::receivedTypesRoundTrip()
+{
+    TLUser user;
+    user.tlType = TLValue::UserContact;
+    user.id = 10;
+    user.firstName = QLatin1String("First");
+    user.lastName = QLatin1String("Last");
+    user.username = QLatin1String("user_name");
+    user.accessHash = 0x1122334455667788ull;
+    user.phone = QLatin1String("79001110001");
+    user.photo.tlType = TLValue::UserProfilePhoto;
+    user.photo.photoId = 77;
+    user.photo.photoSmall.tlType = TLValue::FileLocation;
+    user.photo.photoSmall.dcId = 2;
+    user.photo.photoSmall.volumeId = 123456;
+    user.photo.photoSmall.localId = 5;
+    user.photo.photoSmall.secret = 0xabcdef;
+    user.status.tlType = TLValue::UserStatusOffline;
+    user.status.wasOnline = 1420000000;
+
+    TLChatParticipant participant;
+    participant.userId = 10;
+    participant.inviterId = 11;
+    participant.date = 1420000001;
+
+    TLChatFull chatFull;
+    chatFull.id = 3;
+    chatFull.participants.tlType = TLValue::ChatParticipants;
+    chatFull.participants.chatId = 3;
+    chatFull.participants.adminId = 11;
+    chatFull.participants.participants.append(participant);
+    chatFull.participants.version = 4;
+    chatFull.notifySettings.tlType = TLValue::PeerNotifySettings;
+    chatFull.notifySettings.sound = QLatin1String("default");
+
+    QByteArray data;
+
+    {
+        CTelegramStream outputStream(&data, /* write */ true);
+        outputStream << user;
+        outputStream << chatFull;
+    }
+
+    CTelegramStream inputStream(data);
+
+    TLUser readUser;
+    TLChatFull readChatFull;
+
+    inputStream >> readUser;
+    inputStream >> readChatFull;
+
+    QVERIFY(inputStream.atEnd());
+
+    QCOMPARE(readUser.tlType, user.tlType);
+    QCOMPARE(readUser.id, user.id);
+    QCOMPARE(readUser.username, user.username);
+    QCOMPARE(readUser.accessHash, user.accessHash);
+    QCOMPARE(readUser.phone, user.phone);
+    QCOMPARE(readUser.photo.photoSmall.volumeId, user.photo.photoSmall.volumeId);
+    QCOMPARE(readUser.photo.photoSmall.secret, user.photo.photoSmall.secret);
+    QCOMPARE(readUser.status.wasOnline, user.status.wasOnline);
+
+    QCOMPARE(readChatFull.id, chatFull.id);
+    QCOMPARE(readChatFull.participants.adminId, chatFull.participants.adminId);
+    QCOMPARE(readChatFull.participants.participants.count(), 1);
+    QCOMPARE(readChatFull.participants.participants.at(0).inviterId, participant.inviterId);
+    QVERIFY(readChatFull.chatPhoto.tlType == TLValue::PhotoEmpty);
+    QCOMPARE(readChatFull.notifySettings.sound, chatFull.notifySettings.sound);
+}
+
 QTEST_MAIN(tst_CTelegramStream)
 
 #include "tst_CTelegramStream.moc"
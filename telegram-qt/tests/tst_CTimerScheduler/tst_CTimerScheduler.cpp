@@ -0,0 +1,140 @@
+/*
+    Copyright (C) 2015 Alexandr Akulich <akulichalexander@gmail.com>
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+    LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+    OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+    WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include <QObject>
+
+#include "CTimerScheduler.hpp"
+
+#include <QTest>
+#include <QDebug>
+
+class TimeoutReceiver : public QObject
+{
+    Q_OBJECT
+public:
+    explicit TimeoutReceiver(QObject *parent = 0) :
+        QObject(parent),
+        firstCount(0),
+        secondCount(0)
+    {
+    }
+
+    int firstCount;
+    int secondCount;
+
+public slots:
+    void first() { ++firstCount; }
+    void second() { ++secondCount; }
+
+};
+
+class tst_CTimerScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    explicit tst_CTimerScheduler(QObject *parent = 0);
+
+private slots:
+    void timeouts();
+    void reschedule();
+    void cancel();
+    void destroyedReceiver();
+
+};
+
+tst_CTimerScheduler::tst_CTimerScheduler(QObject *parent) :
+    QObject(parent)
+{
+}
+
+void tst_CTimerScheduler::timeouts()
+{
+    CTimerScheduler *scheduler = CTimerScheduler::threadInstance();
+    QCOMPARE(CTimerScheduler::threadInstance(), scheduler);
+
+    TimeoutReceiver receiver1;
+    TimeoutReceiver receiver2;
+
+    scheduler->schedule(&receiver1, "first", 10);
+    scheduler->schedule(&receiver1, "second", 200);
+    scheduler->schedule(&receiver2, "first", 10);
+
+    QCOMPARE(scheduler->count(), 3);
+    QVERIFY(scheduler->isScheduled(&receiver1, "second"));
+    QVERIFY(!scheduler->isScheduled(&receiver2, "second"));
+
+    QTest::qWait(100);
+
+    QCOMPARE(receiver1.firstCount, 1);
+    QCOMPARE(receiver1.secondCount, 0);
+    QCOMPARE(receiver2.firstCount, 1);
+    QCOMPARE(scheduler->count(), 1);
+
+    QTest::qWait(200);
+
+    QCOMPARE(receiver1.secondCount, 1);
+    QCOMPARE(scheduler->count(), 0);
+}
+
+void tst_CTimerScheduler::reschedule()
+{
+    CTimerScheduler *scheduler = CTimerScheduler::threadInstance();
+    TimeoutReceiver receiver;
+
+    scheduler->schedule(&receiver, "first", 10);
+    scheduler->schedule(&receiver, "first", 200); // Replaces the previous one
+
+    QCOMPARE(scheduler->count(), 1);
+
+    QTest::qWait(100);
+    QCOMPARE(receiver.firstCount, 0);
+
+    QTest::qWait(200);
+    QCOMPARE(receiver.firstCount, 1);
+}
+
+void tst_CTimerScheduler::cancel()
+{
+    CTimerScheduler *scheduler = CTimerScheduler::threadInstance();
+    TimeoutReceiver receiver;
+
+    scheduler->schedule(&receiver, "first", 10);
+    scheduler->schedule(&receiver, "second", 10);
+    scheduler->cancel(&receiver, "first");
+
+    QVERIFY(!scheduler->isScheduled(&receiver, "first"));
+
+    QTest::qWait(100);
+
+    QCOMPARE(receiver.firstCount, 0);
+    QCOMPARE(receiver.secondCount, 1);
+}
+
+void tst_CTimerScheduler::destroyedReceiver()
+{
+    CTimerScheduler *scheduler = CTimerScheduler::threadInstance();
+    TimeoutReceiver *receiver = new TimeoutReceiver();
+
+    scheduler->schedule(receiver, "first", 10);
+    scheduler->schedule(receiver, "second", 10);
+    QCOMPARE(scheduler->count(), 2);
+
+    delete receiver;
+    QCOMPARE(scheduler->count(), 0);
+
+    QTest::qWait(100); // Nothing is invoked
+}
+
+QTEST_MAIN(tst_CTimerScheduler)
+
+#include "tst_CTimerScheduler.moc"
@@ -0,0 +1,8 @@
+include(../tests.pri)
+
+TARGET = tst_timerscheduler
+SOURCES = tst_CTimerScheduler.cpp \
+    ../../CTimerScheduler.cpp
+
+HEADERS = \
+    ../../CTimerScheduler.hpp
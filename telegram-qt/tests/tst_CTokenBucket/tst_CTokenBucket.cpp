@@ -0,0 +1,104 @@
+/*
+    Copyright (C) 2015 Alexandr Akulich <akulichalexander@gmail.com>
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+    LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+    OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+    WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+#include <QObject>
+
+#include "CTokenBucket.hpp"
+
+#include <QTest>
+#include <QDebug>
+
+class tst_CTokenBucket : public QObject
+{
+    Q_OBJECT
+public:
+    explicit tst_CTokenBucket(QObject *parent = 0);
+
+private slots:
+    void burst();
+    void refill();
+    void block();
+    void rateRecovery();
+
+};
+
+tst_CTokenBucket::tst_CTokenBucket(QObject *parent) :
+    QObject(parent)
+{
+}
+
+void tst_CTokenBucket::burst()
+{
+    CTokenBucket bucket(2, 3);
+
+    QVERIFY(bucket.take(0));
+    QVERIFY(bucket.take(0));
+    QVERIFY(bucket.take(0));
+    QVERIFY(!bucket.take(0));
+    QCOMPARE(bucket.delay(0), qint64(501));
+}
+
+void tst_CTokenBucket::refill()
+{
+    CTokenBucket bucket(2, 2);
+
+    QVERIFY(bucket.take(0));
+    QVERIFY(bucket.take(0));
+    QVERIFY(!bucket.take(400));
+    QVERIFY(bucket.take(600));
+    QVERIFY(!bucket.take(600));
+
+    // Tokens are not accumulated beyond the burst size.
+    QCOMPARE(bucket.delay(10000), qint64(0));
+    QVERIFY(bucket.take(10000));
+    QVERIFY(bucket.take(10000));
+    QVERIFY(!bucket.take(10000));
+}
+
+void tst_CTokenBucket::block()
+{
+    CTokenBucket bucket(2, 2);
+
+    bucket.block(1000, 5000);
+
+    QCOMPARE(bucket.rate(), qreal(1));
+    QVERIFY(!bucket.take(3000));
+    QVERIFY(!bucket.take(6000));
+    QCOMPARE(bucket.delay(6000), qint64(1001));
+    QVERIFY(bucket.take(7000));
+    QVERIFY(!bucket.take(7000));
+}
+
+void tst_CTokenBucket::rateRecovery()
+{
+    CTokenBucket bucket(10, 100);
+
+    bucket.block(0, 0);
+    QCOMPARE(bucket.rate(), qreal(5));
+
+    qint64 now = 100000;
+
+    for (int i = 0; i < 10; ++i) {
+        QVERIFY(bucket.take(now));
+    }
+
+    QCOMPARE(bucket.rate(), qreal(10));
+
+    QVERIFY(bucket.take(now));
+    QCOMPARE(bucket.rate(), qreal(10)); // Never above the nominal rate
+}
+
+QTEST_MAIN(tst_CTokenBucket)
+
+#include "tst_CTokenBucket.moc"
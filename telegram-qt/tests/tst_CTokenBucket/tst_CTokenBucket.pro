@@ -0,0 +1,7 @@
+include(../tests.pri)
+
+TARGET = tst_tokenbucket
+SOURCES = tst_CTokenBucket.cpp
+
+HEADERS = \
+    ../../CTokenBucket.hpp